@@ -21,17 +21,29 @@
 
 @file ESP8266.h
 @author  jonls@kth.se
-@date 06-04-2021
-@version 1.0
+@author  agent@local
+@date 16-10-2026
+@version 2.0
 *******************************************************************************/
 
+#ifndef INC_ESP8266_H_
+#define INC_ESP8266_H_
+
 #include <usart.h>
+#include <esp8266_rx.h>
+#include <esp8266_tx.h>
+#include <esp8266_parser.h>
+#include <esp8266_format.h>
+#include <esp8266_trace.h>
+#include <esp8266_profile.h>
+#include <esp8266_log.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <login.h>
 
-#define RX_BUFFER_SIZE 			4096
+/* The state of one module, see MODULES below. Every function takes the module it works on */
+typedef struct esp8266 esp8266_t;
 
 /* ESP8266 response codes as strings.
    These are all the implemented statuses that can
@@ -49,6 +61,7 @@ static const char ESP8266_AT_WIFI_DISCONNECTED[] = "WIFI DISCONNECTED";
 static const char ESP8266_AT_CONNECT[] 		 	 = "CONNECT";
 static const char ESP8266_AT_CLOSED[] 			 = "CLOSED";
 static const char ESP8266_AT_SEND_OK[] 			 = "SEND OK";
+static const char ESP8266_AT_SEND_FAIL[] 		 = "SEND FAIL";
 static const char ESP8266_AT_NO_AP[] 			 = "No AP\r\n";
 static const char ESP8266_AT_UNKNOWN[]			 = "UNKNOWN";
 static const char ESP8266_AT_CWMODE_1[]			 = "CWMODE_CUR:1";
@@ -64,6 +77,8 @@ static const char ESP8266_AT_NO_TARGET[]	     = "cannot find AP";
 static const char ESP8266_AT_CONNECTION_FAIL[]	 = "connection failed";
 static const char ESP8266_AT_CIPMUX_0[]	 		 = "CIPMUX:0";
 static const char ESP8266_AT_CIPMUX_1[]	 		 = "CIPMUX:1";
+static const char ESP8266_TIMEOUT[]				 = "TIMEOUT"; // no answer from the ESP8266 in time
+static const char ESP8266_ABORTED[]				 = "ABORTED"; // a callback stopped the HTTP response
 
 /* HTTP request strings*/
 static const char HTTP_GET[]	 		 		 = "GET ";
@@ -71,25 +86,79 @@ static const char HTTP_POST[]	 		 		 = "POST ";
 static const char HTTP_VERSION[]	 		     = "HTTP/1.1";
 static const char HTTP_HOST[]	 		         = "Host: ";
 static const char HTTP_CONNECTION_CLOSE[]	     = "Connection: close";
+static const char HTTP_CONNECTION_KEEP_ALIVE[]	 = "Connection: keep-alive";
 static const char CRLF[] 						 = "\r\n";
 
-/* djb2 hash keys
- * Each key maps to corresponding AT command, see below for these
+/*============================================================================
+							COMMAND TABLE
+==============================================================================*/
+
+/* Every AT command the driver knows is defined once in this table, as
+ * X(id, command, timeout, expected, result)
+ *
+ * id			esp8266_command_id_t, sent along with the request so the response
+ * 				can be mapped without looking at the command string again
+ * command		the command, commands that take parameters end at '=' and the rest
+ * 				is added by the esp8266_get_*_command functions
+ * timeout		ms to wait for the answer, see ESP8266_TIMEOUT_* below
+ * expected		response string returned when the command succeeds
+ * result		how the response string is picked, see esp8266_result_t
+ *
+ * The command strings below (ESP8266_AT, ...) point into the table.
  */
+#define ESP8266_COMMANDS(X) \
+	X(ESP8266_CMD_AT,					"AT\r\n",				ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_RST,					"AT+RST\r\n",			ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_GMR,					"AT+GMR\r\n",			ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_CWMODE_TEST,			"AT+CWMODE_CUR?\r\n",	ESP8266_TIMEOUT_SHORT,		ESP8266_AT_CWMODE_1,		ESP8266_RESULT_CWMODE)		\
+	X(ESP8266_CMD_CWMODE_STATION_MODE,	"AT+CWMODE=1\r\n",		ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_CWJAP_TEST,			"AT+CWJAP?\r\n",		ESP8266_TIMEOUT_SHORT,		ESP8266_AT_WIFI_CONNECTED,	ESP8266_RESULT_CWJAP_TEST)	\
+	X(ESP8266_CMD_CWJAP_SET,			"AT+CWJAP=",			ESP8266_TIMEOUT_CWJAP,		ESP8266_AT_WIFI_CONNECTED,	ESP8266_RESULT_CWJAP_SET)	\
+	X(ESP8266_CMD_CWQAP,				"AT+CWQAP\r\n",			ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_CWAUTOCONN,			"AT+CWAUTOCONN=0\r\n",	ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_CIPMUX_SINGLE,		"AT+CIPMUX=0\r\n",		ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_CIPMUX_MULTIPLE,		"AT+CIPMUX=1\r\n",		ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_CIPMUX_TEST,			"AT+CIPMUX?\r\n",		ESP8266_TIMEOUT_SHORT,		ESP8266_AT_CIPMUX_0,		ESP8266_RESULT_CIPMUX)		\
+	X(ESP8266_CMD_START,				"AT+CIPSTART=",			ESP8266_TIMEOUT_CIPSTART,	ESP8266_AT_CONNECT,			ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_STOP,					"AT+CIPCLOSE\r\n",		ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_STOP_LINK,			"AT+CIPCLOSE=",			ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_SEND,					"AT+CIPSEND=",			ESP8266_TIMEOUT_SHORT,		ESP8266_AT_SEND_OK,			ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_SEND_PASSTHROUGH,		"AT+CIPSEND\r\n",		ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_CIPMODE_NORMAL,		"AT+CIPMODE=0\r\n",		ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_CIPMODE_PASSTHROUGH,	"AT+CIPMODE=1\r\n",		ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)		\
+	X(ESP8266_CMD_UART_CUR,				"AT+UART_CUR=",			ESP8266_TIMEOUT_SHORT,		ESP8266_AT_OK,				ESP8266_RESULT_BASIC)
+
+#define ESP8266_COMMAND_ID(id, command, timeout, expected, result)	id,
+
 typedef enum {
-	ESP8266_AT_KEY 						= 2088901425,
-	ESP8266_AT_RST_KEY	 				= 617536853,
-	ESP8266_AT_GMR_KEY	 				= 604273922,
-	ESP8266_AT_CWMODE_STATION_MODE_KEY 	= 608151977,
-	ESP8266_AT_CWMODE_TEST_KEY			= 4116713283,
-	ESP8266_AT_CWQAP_KEY				= 445513592,
-	ESP8266_AT_CWJAP_TEST_KEY			= 1543153456,
-	ESP8266_AT_CWJAP_SET_KEY 			= 2616259383,
-	ESP8266_AT_CIPMUX_KEY				= 423755967,
-	ESP8266_AT_CIPMUX_TEST_KEY			= 3657056785,
-	ESP8266_AT_START_KEY				= 3889879756,
-	ESP8266_AT_SEND_KEY					= 898252904
-} KEYS;
+	ESP8266_COMMANDS(ESP8266_COMMAND_ID)
+	ESP8266_CMD_COUNT,
+	ESP8266_CMD_OTHER = ESP8266_CMD_COUNT,	// command that is not in the table
+	ESP8266_CMD_DATA						// data sent after CIPSEND, not a command
+} esp8266_command_id_t;
+
+/* How the response string for a command is picked. All of them return ESP8266_AT_ERROR
+ * if the ESP8266 answered ERROR or FAIL. */
+typedef enum {
+	ESP8266_RESULT_BASIC,			// the expected string
+	ESP8266_RESULT_CWMODE,			// ESP8266_AT_CWMODE_<n> from +CWMODE_CUR:<n>
+	ESP8266_RESULT_CWJAP_TEST,		// connected, or disconnected if the answer was "No AP"
+	ESP8266_RESULT_CWJAP_SET,		// the expected string, or the reason from +CWJAP:<n> on failure
+	ESP8266_RESULT_CIPMUX			// ESP8266_AT_CIPMUX_<n> from +CIPMUX:<n>
+} esp8266_result_t;
+
+typedef struct {
+	const char* command;
+	uint8_t len;					// strlen(command)
+	uint32_t timeout;
+	const char* expected;
+	esp8266_result_t result;
+} esp8266_command_t;
+
+/* The command table, indexed by esp8266_command_id_t */
+extern const esp8266_command_t esp8266_commands[ESP8266_CMD_COUNT];
+
+#define ESP8266_COMMAND_STRING(id)	(esp8266_commands[id].command)
 
 /* AT Commands for the ESP8266, see
  * https://www.espressif.com/sites/default/files/documentation/4a-esp8266_at_instruction_set_en.pdf
@@ -110,17 +179,17 @@ typedef enum {
  *
  * Returns: OK
  */
-static const char ESP8266_AT[]						= "AT\r\n";
+#define ESP8266_AT						ESP8266_COMMAND_STRING(ESP8266_CMD_AT)
 
 
 /* Restarts the module.
  *
  * Returns: OK
  */
-static const char ESP8266_AT_RST[]					= "AT+RST\r\n";
+#define ESP8266_AT_RST					ESP8266_COMMAND_STRING(ESP8266_CMD_RST)
 
 /* Checks version information. */
-static const char ESP8266_AT_GMR[]					= "AT+GMR\r\n";
+#define ESP8266_AT_GMR					ESP8266_COMMAND_STRING(ESP8266_CMD_GMR)
 
 /*Checks current wifi-mode.
  *
@@ -129,17 +198,17 @@ static const char ESP8266_AT_GMR[]					= "AT+GMR\r\n";
  * 2: SoftAP Mode
  * 3: SoftAP+Station Mode
  */
-static const char ESP8266_AT_CWMODE_TEST[]			= "AT+CWMODE_CUR?\r\n";
+#define ESP8266_AT_CWMODE_TEST			ESP8266_COMMAND_STRING(ESP8266_CMD_CWMODE_TEST)
 
 /*Sets the wifi-mode to station.
  * The module will work as client.
  * Note: setting not saved in flash... so this should be configured 
  * after a restart
  */
-static const char ESP8266_AT_CWMODE_STATION_MODE[]	= "AT+CWMODE=1\r\n";
+#define ESP8266_AT_CWMODE_STATION_MODE	ESP8266_COMMAND_STRING(ESP8266_CMD_CWMODE_STATION_MODE)
 
 /*Query the AP for current connection */
-static const char ESP8266_AT_CWJAP_TEST[]			= "AT+CWJAP?\r\n";
+#define ESP8266_AT_CWJAP_TEST			ESP8266_COMMAND_STRING(ESP8266_CMD_CWJAP_TEST)
 
 /*Sets a connection to an Access point
  *
@@ -155,10 +224,10 @@ static const char ESP8266_AT_CWJAP_TEST[]			= "AT+CWJAP?\r\n";
  * connection failed
  *
  */
-static const char ESP8266_AT_CWJAP_SET[]			= "AT+CWJAP="; // add "ssid","pwd" + CRLF
+#define ESP8266_AT_CWJAP_SET			ESP8266_COMMAND_STRING(ESP8266_CMD_CWJAP_SET)
 
 /* Disconnect connected AP */
-static const char ESP8266_AT_CWQAP[]				= "AT+CWQAP\r\n";
+#define ESP8266_AT_CWQAP				ESP8266_COMMAND_STRING(ESP8266_CMD_CWQAP)
 
 /* Disable auto connect to AP
  * Writes to flash...
@@ -167,15 +236,20 @@ static const char ESP8266_AT_CWQAP[]				= "AT+CWQAP\r\n";
  * it can be used to prevent auto connections when 
  * initializing the module. 
  */
-static const char ESP8266_AT_CWAUTOCONN[]			= "AT+CWAUTOCONN=0";
+#define ESP8266_AT_CWAUTOCONN			ESP8266_COMMAND_STRING(ESP8266_CMD_CWAUTOCONN)
 
 /* Set single connection */
-static const char ESP8266_AT_CIPMUX_SINGLE[]		= "AT+CIPMUX=0\r\n";
+#define ESP8266_AT_CIPMUX_SINGLE		ESP8266_COMMAND_STRING(ESP8266_CMD_CIPMUX_SINGLE)
+
+/* Set multiple connections, see the connection pool below.
+ * Only works when there is no open connection.
+ */
+#define ESP8266_AT_CIPMUX_MULTIPLE		ESP8266_COMMAND_STRING(ESP8266_CMD_CIPMUX_MULTIPLE)
 
 /* Query CIPMUX setting 
  * Used to make sure we have the right setting...
  */
-static const char ESP8266_AT_CIPMUX_TEST[]			= "AT+CIPMUX?\r\n";
+#define ESP8266_AT_CIPMUX_TEST			ESP8266_COMMAND_STRING(ESP8266_CMD_CIPMUX_TEST)
 
 /* Establishes TCP connection
  *
@@ -187,10 +261,13 @@ static const char ESP8266_AT_CIPMUX_TEST[]			= "AT+CIPMUX?\r\n";
  * 
  * Note, the quotation marks are important...
  */
-static const char ESP8266_AT_START[]				= "AT+CIPSTART=";
+#define ESP8266_AT_START				ESP8266_COMMAND_STRING(ESP8266_CMD_START)
 
 /* Disconnect a connection */
-static const char ESP8266_AT_STOP[]					= "AT+CIPCLOSE=0";
+#define ESP8266_AT_STOP					ESP8266_COMMAND_STRING(ESP8266_CMD_STOP)
+
+/* Disconnect a link with multiple connections, AT+CIPCLOSE=<id> */
+#define ESP8266_AT_STOP_LINK			ESP8266_COMMAND_STRING(ESP8266_CMD_STOP_LINK)
 
 /* Send data of desired length,
  * this command should be followed by the request
@@ -202,114 +279,1085 @@ static const char ESP8266_AT_STOP[]					= "AT+CIPCLOSE=0";
  * 4. send data
  *
  */
-static const char ESP8266_AT_SEND[]					= "AT+CIPSEND=";
+#define ESP8266_AT_SEND					ESP8266_COMMAND_STRING(ESP8266_CMD_SEND)
+
+/* Start sending in passthrough mode, everything after the '>' prompt
+ * goes to the connection until "+++" is sent.
+ * Needs AT+CIPMODE=1 and a single connection.
+ */
+#define ESP8266_AT_SEND_PASSTHROUGH		ESP8266_COMMAND_STRING(ESP8266_CMD_SEND_PASSTHROUGH)
+
+/* Normal transmission mode, data is sent with AT+CIPSEND=<len> */
+#define ESP8266_AT_CIPMODE_NORMAL		ESP8266_COMMAND_STRING(ESP8266_CMD_CIPMODE_NORMAL)
+
+/* Passthrough (unvarnished) transmission mode, see ESP8266_AT_SEND_PASSTHROUGH.
+ * Only works with a single connection (AT+CIPMUX=0).
+ */
+#define ESP8266_AT_CIPMODE_PASSTHROUGH	ESP8266_COMMAND_STRING(ESP8266_CMD_CIPMODE_PASSTHROUGH)
+
+/* Set the uart of the ESP8266, not saved in flash, AT+RST goes back to the default
+ *
+ * Command format: AT+UART_CUR=<baudrate>,<databits>,<stopbits>,<parity>,<flow control>
+ * Example: AT+UART_CUR=921600,8,1,0,0
+ *
+ * The OK is sent at the old baud rate, the ESP8266 switches after it.
+ * See esp8266_set_baud.
+ */
+#define ESP8266_AT_UART_CUR				ESP8266_COMMAND_STRING(ESP8266_CMD_UART_CUR)
 
 
 
+/*============================================================================
+							ASYNCHRONOUS REQUESTS
+==============================================================================*/
+
+/* Requests are queued and worked on by esp8266_poll, which should be called
+ * from the main loop. The ESP8266 only handles one command at a time, so the
+ * requests are sent in order, each one when the previous one is done.
+ * When a request is done its callback is called with the same response string
+ * that the blocking function would have returned.
+ *
+ * Note: the command/data string is not copied, it has to stay valid until the
+ * callback is called. Do not call the blocking functions from a callback.
+ */
+
+/* Max number of requests waiting in the queue, enough for a send on every link */
+#define ESP8266_QUEUE_SIZE			10
+
+/* Timeout value for waiting forever */
+#define ESP8266_NO_TIMEOUT			0
+
+/* Timeout value for using the timeout for the type of request, see below */
+#define ESP8266_DEFAULT_TIMEOUT		UINT32_MAX
+
+/* Default timeouts in ms for each type of request. Most commands are answered right
+ * away, but connecting to an AP or a server can take several seconds. */
+#define ESP8266_TIMEOUT_SHORT		1000		// AT, AT+RST, mode settings and queries, CIPSEND
+#define ESP8266_TIMEOUT_CWJAP		20000		// AT+CWJAP=
+#define ESP8266_TIMEOUT_CIPSTART	10000		// AT+CIPSTART=
+#define ESP8266_TIMEOUT_DATA		10000		// data after CIPSEND, until CLOSED
+#define ESP8266_TIMEOUT_DEFAULT		5000		// commands that are not in the table
+#define ESP8266_TIMEOUT_BOOT		2000		// after AT+RST until "ready", and for the boot messages
+
+/**
+ * @brief completion callback for a request
+ * @param const char* result, ESP8266 response string, same as the blocking functions return,
+ * 		  or ESP8266_TIMEOUT if there was no answer in time
+ * @param void* context, the pointer that was passed with the request
+ */
+typedef void (*esp8266_callback_t)(const char* result, void* context);
+
+typedef enum {
+	ESP8266_REQUEST_COMMAND,		// AT command, done at OK, ERROR or FAIL
+	ESP8266_REQUEST_DATA,			// data after CIPSEND, done when the connection is CLOSED
+	ESP8266_REQUEST_SEND			// data after CIPSEND on a link, done at SEND OK or SEND FAIL
+} esp8266_request_type_t;
+
+/* Timing statistics for a type of request */
+typedef struct {
+	uint32_t count;					// completed requests, including timed out ones
+	uint32_t timeouts;				// requests that timed out
+	uint32_t min;					// ms
+	uint32_t max;					// ms
+	uint32_t total;					// ms, for the average
+} esp8266_timing_t;
+
+/* Latency profile of each command, and of the requests that are not in the table,
+ * see esp8266_set_profile. About 6 KB. */
+typedef struct {
+	esp8266_profile_t requests[ESP8266_CMD_DATA + 1];
+} esp8266_profile_table_t;
+
+/* Longest command or data of a request, it is sent as one DMA segment. Longer data is sent with
+ * esp8266_send, in segments of ESP8266_SEND_MAX. */
+#define ESP8266_REQUEST_MAX			UINT16_MAX
+
+typedef struct {
+	esp8266_request_type_t type;
+	esp8266_command_id_t id;		// table entry for the command, ESP8266_CMD_DATA for data
+	const char* data;
+	uint16_t len;					// length of data, it does not have to end with '\0', or the number of parts
+	const esp8266_tx_part_t* parts;	// sent instead of data if not NULL
+	uint32_t timeout;
+	esp8266_callback_t callback;
+	void* context;
+} esp8266_request_t;
+
+/**
+ * @brief find the table entry for a command. Commands with parameters are matched on the part
+ * 		  before the parameters. There is no need to call this for the strings in the table,
+ * 		  such as ESP8266_AT, or when sending with esp8266_send_command_id_async.
+ * @param const char* command, the command
+ * @return esp8266_command_id_t, the table entry, ESP8266_CMD_OTHER if the command is not in the table
+ */
+esp8266_command_id_t
+esp8266_command_id(const char* command);
+
+/**
+ * @brief queue an AT command from the command table, returns immediately
+ * @param esp8266_t* esp, the module
+ * @param esp8266_command_id_t id, the command
+ * @param const char* command, the command with its parameters for commands that take parameters,
+ * 		  NULL to send the command string from the table. Has to stay valid until the callback is called
+ * @param uint32_t timeout, ms to wait for the answer, ESP8266_NO_TIMEOUT to wait forever,
+ * 		  ESP8266_DEFAULT_TIMEOUT to use the timeout for the command
+ * @param esp8266_callback_t callback, called when done, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the queue is full
+ */
+bool
+esp8266_send_command_id_async(esp8266_t* esp, esp8266_command_id_t id, const char* command, uint32_t timeout,
+							  esp8266_callback_t callback, void* context);
+
+/**
+ * @brief queue an AT command that is sent in parts, returns immediately. The parts are sent one
+ * 		  after the other with DMA, so a command with parameters does not have to be put
+ * 		  together in a buffer first.
+ *
+ * 		  Usage:
+ * 		  esp8266_tx_part_t parts[] = {{ESP8266_AT_SEND, 11}, {length, strlen(length)}, {CRLF, 2}};
+ * 		  esp8266_send_parts_async(&esp, ESP8266_CMD_SEND, parts, 3, ESP8266_DEFAULT_TIMEOUT, done, NULL);
+ *
+ * @param esp8266_t* esp, the module
+ * @param esp8266_command_id_t id, the command, for the timeout and the result
+ * @param const esp8266_tx_part_t* parts, the parts of the command. The array and the data have
+ * 		  to stay valid until the callback is called
+ * @param uint8_t count, number of parts, at most ESP8266_TX_QUEUE_SIZE
+ * @param uint32_t timeout, ms to wait for the answer, ESP8266_NO_TIMEOUT to wait forever,
+ * 		  ESP8266_DEFAULT_TIMEOUT to use the timeout for the command
+ * @param esp8266_callback_t callback, called when done, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the queue is full
+ */
+bool
+esp8266_send_parts_async(esp8266_t* esp, esp8266_command_id_t id, const esp8266_tx_part_t* parts, uint8_t count,
+						 uint32_t timeout, esp8266_callback_t callback, void* context);
+
+/**
+ * @brief queue an AT command, returns immediately. The command is looked up in the command
+ * 		  table, see esp8266_command_id.
+ * @param esp8266_t* esp, the module
+ * @param const char* command, command to send, has to stay valid until the callback is called
+ * @param uint32_t timeout, ms to wait for the answer, ESP8266_NO_TIMEOUT to wait forever,
+ * 		  ESP8266_DEFAULT_TIMEOUT to use the timeout for the command
+ * @param esp8266_callback_t callback, called when done, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the queue is full or the command is longer than ESP8266_REQUEST_MAX
+ */
+bool
+esp8266_send_command_async(esp8266_t* esp, const char* command, uint32_t timeout,
+						   esp8266_callback_t callback, void* context);
+
+/**
+ * @brief queue data to send after CIPSEND, returns immediately. The callback is called
+ * 		  with ESP8266_AT_CLOSED when the connection is closed.
+ * @param esp8266_t* esp, the module
+ * @param const char* data, data to send, has to stay valid until the callback is called
+ * @param uint32_t timeout, ms to wait for the connection to close, ESP8266_NO_TIMEOUT to wait forever,
+ * 		  ESP8266_DEFAULT_TIMEOUT to use ESP8266_TIMEOUT_DATA
+ * @param esp8266_callback_t callback, called when done, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the queue is full or the data is longer than ESP8266_REQUEST_MAX
+ */
+bool
+esp8266_send_data_async(esp8266_t* esp, const char* data, uint32_t timeout, esp8266_callback_t callback, void* context);
+
+/**
+ * @brief work on the queued requests, call this from the main loop.
+ * 		  Sends the next request, handles received data and timeouts, and calls the callbacks.
+ * @param esp8266_t* esp, the module
+ * @return void
+ */
+void
+esp8266_poll(esp8266_t* esp);
+
+/**
+ * @brief check if there are requests that are not done
+ * @param esp8266_t* esp, the module
+ * @return bool, true if a request is queued or being worked on
+ */
+bool
+esp8266_busy(esp8266_t* esp);
+
+/**
+ * @brief get the default timeout for a request
+ * @param esp8266_command_id_t id, the command, ESP8266_CMD_OTHER or ESP8266_CMD_DATA
+ * @return uint32_t, timeout in ms
+ */
+uint32_t
+esp8266_get_timeout(esp8266_command_id_t id);
+
+/**
+ * @brief get the timing statistics for a type of request
+ * @param esp8266_t* esp, the module
+ * @param esp8266_command_id_t id, the command, ESP8266_CMD_OTHER or ESP8266_CMD_DATA
+ * @return const esp8266_timing_t*, statistics for all requests of the same type
+ */
+const esp8266_timing_t*
+esp8266_get_timing(esp8266_t* esp, esp8266_command_id_t id);
+
+/**
+ * @brief print the timing statistics for all types of requests that have been sent
+ * @param esp8266_t* esp, the module
+ * @return void
+ */
+void
+esp8266_print_timing(esp8266_t* esp);
+
+/**
+ * @brief get the latency profile for a type of request, see esp8266_set_profile
+ * @param esp8266_t* esp, the module
+ * @param esp8266_command_id_t id, the command, ESP8266_CMD_OTHER or ESP8266_CMD_DATA
+ * @return const esp8266_profile_t*, the profile, NULL if the module is not profiled
+ */
+const esp8266_profile_t*
+esp8266_get_profile(esp8266_t* esp, esp8266_command_id_t id);
+
+/**
+ * @brief print the latency profile for all types of requests that have been sent, in us
+ * @param esp8266_t* esp, the module
+ * @return void
+ */
+void
+esp8266_print_profile(esp8266_t* esp);
+
+/*============================================================================
+							SENDING DATA
+==============================================================================*/
+
+/* AT+CIPSEND takes at most ESP8266_SEND_MAX bytes, longer data is split into
+ * segments with an AT+CIPSEND each. The segments are pipelined, the next one
+ * is queued while the last one waits for SEND OK, so its AT+CIPSEND goes out
+ * right after the SEND OK instead of a poll later. If a segment fails the
+ * segments after it are taken out of the queue, so the other side never gets
+ * data with a hole in it.
+ *
+ * Usage:
+ * 		  esp8266_send_command(&esp, connection_command);
+ * 		  esp8266_send(&esp, (const uint8_t*) telemetry, telemetry_len);
+ *
+ * esp8266_sendv sends parts in front of the data, such as the lines of a HTTP
+ * request in front of its body. The parts go out with the first AT+CIPSEND,
+ * one after the other with DMA, so they are never put together in a buffer.
+ */
+
+/* Max data for one AT+CIPSEND */
+#define ESP8266_SEND_MAX			2048
+
+/* Max number of segments in the queue at once */
+#define ESP8266_SEND_WINDOW			2
+
+/* A send that can be longer than ESP8266_SEND_MAX */
+typedef struct {
+	esp8266_t* esp;								// module the send is on
+	const esp8266_tx_part_t* parts;				// sent as the first segment, NULL for none
+	uint8_t count;								// number of parts
+	uint16_t parts_len;							// bytes in the parts
+	const uint8_t* data;						// sent after the parts
+	uint32_t len;								// bytes to send, the parts and the data
+	int8_t link;								// link id, -1 for the single connection
+	bool busy;
+	uint32_t queued;							// bytes queued
+	uint32_t sent;								// bytes answered with SEND OK
+	uint8_t in_flight;							// segments queued and not answered yet
+	uint16_t segments;							// segments answered with SEND OK
+	char command[ESP8266_SEND_WINDOW][24];		// AT+CIPSEND for the segments in flight
+	esp8266_callback_t callback;
+	void* context;
+} esp8266_send_t;
+
+/**
+ * @brief send data on the single connection, returns immediately. The connection has to be
+ * 		  open, see esp8266_get_connection_command.
+ * @param esp8266_t* esp, the module
+ * @param const uint8_t* data, data to send, any length. Has to stay valid until the callback is called
+ * @param uint32_t len, number of bytes
+ * @param esp8266_callback_t callback, called with ESP8266_AT_SEND_OK when all segments are sent,
+ * 		  or with the result of the segment that failed, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if a send is going on, len is 0 or there is no queue space for a segment
+ */
+bool
+esp8266_send_async(esp8266_t* esp, const uint8_t* data, uint32_t len, esp8266_callback_t callback, void* context);
+
+/**
+ * @brief send data on the single connection and wait until all segments are sent
+ * @param esp8266_t* esp, the module
+ * @param const uint8_t* data, data to send, any length
+ * @param uint32_t len, number of bytes
+ * @return const char*, ESP8266 response string, "SEND OK" if everything was sent
+ */
+const char*
+esp8266_send(esp8266_t* esp, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief send parts followed by data on the single connection, returns immediately. The parts are
+ * 		  the first segment, the data is cut into segments after them.
+ * @param esp8266_t* esp, the module
+ * @param const esp8266_tx_part_t* parts, sent first. The array and the data have to stay valid
+ * 		  until the callback is called
+ * @param uint8_t count, number of parts, at most ESP8266_TX_QUEUE_SIZE
+ * @param const uint8_t* data, sent after the parts, any length. Has to stay valid until the callback is called
+ * @param uint32_t len, number of bytes in data, can be 0
+ * @param esp8266_callback_t callback, called with ESP8266_AT_SEND_OK when all segments are sent,
+ * 		  or with the result of the segment that failed, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if a send is going on, there is nothing to send, the parts are longer
+ * 		  than ESP8266_SEND_MAX or there is no queue space for a segment
+ */
+bool
+esp8266_sendv_async(esp8266_t* esp, const esp8266_tx_part_t* parts, uint8_t count, const uint8_t* data, uint32_t len,
+					esp8266_callback_t callback, void* context);
+
+/**
+ * @brief send parts followed by data on the single connection and wait until all segments are sent
+ * @param esp8266_t* esp, the module
+ * @param const esp8266_tx_part_t* parts, sent first
+ * @param uint8_t count, number of parts, at most ESP8266_TX_QUEUE_SIZE
+ * @param const uint8_t* data, sent after the parts, any length
+ * @param uint32_t len, number of bytes in data, can be 0
+ * @return const char*, ESP8266 response string, "SEND OK" if everything was sent
+ */
+const char*
+esp8266_sendv(esp8266_t* esp, const esp8266_tx_part_t* parts, uint8_t count, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief get the send on the single connection, to check how far it got
+ * @param esp8266_t* esp, the module
+ * @return const esp8266_send_t*, the send
+ */
+const esp8266_send_t*
+esp8266_get_send(esp8266_t* esp);
+
+/*============================================================================
+							CONNECTION POOL
+==============================================================================*/
+
+/* With multiple connections (AT+CIPMUX=1) the ESP8266 can have up to five
+ * connections open at once, called links 0 to 4. The commands are still sent
+ * one at a time through the request queue, but a link does not have to be
+ * closed before another one is used, so requests to different servers do not
+ * have to wait for each other.
+ *
+ * Each link has one operation (open, send or close) going at a time. Data that
+ * is received on a link is passed to the receive callback of the link as it
+ * comes in, and the callback is called with len 0 when the link is closed.
+ *
+ * Usage:
+ * 		  esp8266_pool_init(&esp);
+ * 		  int8_t link = esp8266_link_open_async(&esp, "TCP", "example.com", "80", receive, NULL, opened, NULL);
+ * 		  ... when opened is called with ESP8266_AT_CONNECT
+ * 		  esp8266_link_send_async(&esp, link, (const uint8_t*) request, strlen(request), sent, NULL);
+ */
+
+/* Max number of links */
+#define ESP8266_MAX_LINKS			5
+
+/* Size of the AT+CIPSTART command buffer of a link, limits the length of the host name */
+#define ESP8266_LINK_COMMAND_SIZE	128
+
+typedef enum {
+	ESP8266_LINK_FREE,				// not connected, can be opened
+	ESP8266_LINK_CONNECTING,		// AT+CIPSTART is queued or sent
+	ESP8266_LINK_CONNECTED,
+	ESP8266_LINK_CLOSING			// AT+CIPCLOSE is queued or sent
+} esp8266_link_state_t;
+
+/**
+ * @brief receive callback for a link, or the single connection, see RECEIVING DATA below
+ * @param uint8_t link, the link id, 0 for the single connection
+ * @param const uint8_t* data, received data, points into the receive buffer and is only valid during the call
+ * @param uint16_t len, number of bytes, 0 when the link has been closed
+ * @param void* context, the pointer that was passed when opening the link
+ */
+typedef void (*esp8266_receive_callback_t)(uint8_t link, const uint8_t* data, uint16_t len, void* context);
+
+typedef struct {
+	esp8266_link_state_t state;
+	bool pending;							// an open, send or close is queued
+	esp8266_receive_callback_t receive;
+	void* receive_context;
+	esp8266_callback_t callback;			// for the pending operation
+	void* context;
+	char command[ESP8266_LINK_COMMAND_SIZE];// AT+CIPSTART or AT+CIPCLOSE for the pending operation
+	esp8266_send_t send;					// the pending send
+	uint32_t sent;							// bytes sent while connected
+	uint32_t received;						// bytes received while connected
+} esp8266_link_t;
+
+/**
+ * @brief switch the ESP8266 to multiple connections and free all links. Needs esp8266_init
+ * 		  first, and no open connection. esp8266_init switches back to a single connection.
+ * @param esp8266_t* esp, the module
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR"
+ */
+const char*
+esp8266_pool_init(esp8266_t* esp);
+
+/**
+ * @brief open a connection on a free link, returns immediately
+ * @param esp8266_t* esp, the module
+ * @param const char* type, "TCP", "UDP" or "SSL"
+ * @param const char* remote_ip, the ip to connect to, can also be a url
+ * @param const char* remote_port, port to connect
+ * @param esp8266_receive_callback_t receive, called with the data received on the link, can be NULL
+ * @param void* receive_context, passed to the receive callback
+ * @param esp8266_callback_t callback, called with ESP8266_AT_CONNECT when connected, can be NULL
+ * @param void* context, passed to the callback
+ * @return int8_t, link id, -1 if there is no free link, the queue is full or the command is too long
+ */
+int8_t
+esp8266_link_open_async(esp8266_t* esp, const char* type, const char* remote_ip, const char* remote_port,
+						esp8266_receive_callback_t receive, void* receive_context,
+						esp8266_callback_t callback, void* context);
+
+/**
+ * @brief send data on a connected link, returns immediately
+ * @param esp8266_t* esp, the module
+ * @param uint8_t link, the link id
+ * @param const uint8_t* data, data to send, any length, longer data is sent in segments.
+ * 		  Has to stay valid until the callback is called
+ * @param uint32_t len, number of bytes
+ * @param esp8266_callback_t callback, called with ESP8266_AT_SEND_OK when sent, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the link is not connected or busy, len is 0 or the queue is full
+ */
+bool
+esp8266_link_send_async(esp8266_t* esp, uint8_t link, const uint8_t* data, uint32_t len,
+						esp8266_callback_t callback, void* context);
+
+/**
+ * @brief send parts followed by data on a connected link, returns immediately, see esp8266_sendv_async
+ * @param esp8266_t* esp, the module
+ * @param uint8_t link, the link id
+ * @param const esp8266_tx_part_t* parts, sent first as one segment, at most ESP8266_SEND_MAX bytes.
+ * 		  The array and the data have to stay valid until the callback is called
+ * @param uint8_t count, number of parts, at most ESP8266_TX_QUEUE_SIZE
+ * @param const uint8_t* data, sent after the parts, any length
+ * @param uint32_t len, number of bytes in data, can be 0
+ * @param esp8266_callback_t callback, called with ESP8266_AT_SEND_OK when sent, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the link is not connected or busy, there is nothing to send or the queue is full
+ */
+bool
+esp8266_link_sendv_async(esp8266_t* esp, uint8_t link, const esp8266_tx_part_t* parts, uint8_t count,
+						 const uint8_t* data, uint32_t len, esp8266_callback_t callback, void* context);
+
+/**
+ * @brief close a connected link, returns immediately. The receive callback of the link is called
+ * 		  with len 0 when it is closed.
+ * @param esp8266_t* esp, the module
+ * @param uint8_t link, the link id
+ * @param esp8266_callback_t callback, called with ESP8266_AT_OK when closed, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the link is not connected or busy, or the queue is full
+ */
+bool
+esp8266_link_close_async(esp8266_t* esp, uint8_t link, esp8266_callback_t callback, void* context);
+
+/**
+ * @brief get a link, to check its state and statistics
+ * @param esp8266_t* esp, the module
+ * @param uint8_t link, the link id
+ * @return const esp8266_link_t*, the link
+ */
+const esp8266_link_t*
+esp8266_get_link(esp8266_t* esp, uint8_t link);
+
+/*============================================================================
+							RECEIVING DATA
+==============================================================================*/
+
+/* Data from the server comes as "+IPD,<len>:" on the single connection, or as
+ * "+IPD,<id>,<len>:" on a link, followed by <len> bytes of data. The parser
+ * stops at the ':', and the driver passes the data to the receive callback of
+ * the connection right where the DMA put it in the receive buffer. The data is
+ * not copied, and not looked at for AT responses, which matters for binary data
+ * such as firmware.
+ *
+ * The callback gets the data in pieces, a piece ends where the received bytes
+ * end or at the end of the receive buffer. The DMA writes over the buffer again
+ * a lap later, so data that has to be kept, such as a config blob, is copied
+ * from the callback to where it belongs.
+ *
+ * Usage:
+ * 		  static void received(uint8_t link, const uint8_t* data, uint16_t len, void* context){
+ * 		  	  if(len > 0)
+ * 		  	  	  flash_write(data, len);
+ * 		  }
+ * 		  esp8266_set_receive(&esp, received, NULL);
+ */
+
+/**
+ * @brief set the receive callback for the single connection, links have their own, see
+ * 		  esp8266_link_open_async. Without one the data is thrown away.
+ * @param esp8266_t* esp, the module
+ * @param esp8266_receive_callback_t receive, called with the received data, NULL for none.
+ * 		  It is called with len 0 when the connection closes.
+ * @param void* context, passed to the callback
+ * @return void
+ */
+void
+esp8266_set_receive(esp8266_t* esp, esp8266_receive_callback_t receive, void* context);
+
+/*============================================================================
+							PASSTHROUGH STREAMING
+==============================================================================*/
+
+/* In passthrough mode (AT+CIPMODE=1) everything sent to the ESP8266 after
+ * AT+CIPSEND goes straight to the connection, without the AT+CIPSEND=<len>,
+ * prompt and SEND OK round trip for every piece of data. The data is sent with
+ * DMA, so the next buffer can be filled while the last one is sent and the
+ * UART never has to wait for the CPU.
+ *
+ * Passthrough needs a single connection (AT+CIPMUX=0) that has been opened with
+ * AT+CIPSTART. The request queue has to be empty, and it is not worked on while
+ * streaming. Data sent back by the server while streaming is thrown away.
+ *
+ * Usage:
+ * 		  esp8266_stream_start(&esp);
+ * 		  while(more data){
+ * 		  	  fill buffer[i]
+ * 		  	  while(esp8266_stream_busy(&esp));
+ * 		  	  esp8266_stream_write(&esp, buffer[i], len);
+ * 		  	  i = !i;
+ * 		  }
+ * 		  esp8266_stream_stop(&esp);
+ */
+
+/* The ESP8266 only takes "+++" as the end of passthrough mode if it is a packet of its own,
+ * so nothing can be sent for a while before it. It then needs a second before the next command. */
+#define ESP8266_STREAM_GUARD_TIME	20			// ms before "+++"
+#define ESP8266_STREAM_EXIT_TIME	1000		// ms after "+++"
+
+typedef struct {
+	uint32_t bytes;					// bytes sent
+	uint32_t ms;					// from esp8266_stream_start until the last byte was sent
+} esp8266_stream_stats_t;
+
+/**
+ * @brief switch to passthrough mode and start sending, waits for the prompt
+ * @param esp8266_t* esp, the module
+ * @return const char*, ESP8266 response string, "OK", "ERROR" or ESP8266_TIMEOUT if there was no prompt
+ */
+const char*
+esp8266_stream_start(esp8266_t* esp);
+
+/**
+ * @brief queue data to send with DMA, returns immediately. Up to ESP8266_TX_QUEUE_SIZE writes can
+ * 		  be queued, they are sent one after the other.
+ * @param esp8266_t* esp, the module
+ * @param const uint8_t* data, data to send, has to stay untouched until esp8266_stream_busy is false
+ * @param uint16_t len, number of bytes
+ * @return bool, false if not streaming or the transmit queue is full
+ */
+bool
+esp8266_stream_write(esp8266_t* esp, const uint8_t* data, uint16_t len);
+
+/**
+ * @brief check if queued data is still being sent
+ * @param esp8266_t* esp, the module
+ * @return bool, true if the DMA is busy
+ */
+bool
+esp8266_stream_busy(esp8266_t* esp);
+
+/**
+ * @brief wait for the last data to be sent, leave passthrough mode with "+++" and switch back to
+ * 		  normal transmission mode. Takes a little over ESP8266_STREAM_EXIT_TIME. The connection stays open.
+ * 		  The throughput is saved in the baud rate statistics, see esp8266_print_baud.
+ * @param esp8266_t* esp, the module
+ * @return const char*, ESP8266 response string, either "OK" or "ERROR"
+ */
+const char*
+esp8266_stream_stop(esp8266_t* esp);
+
+/**
+ * @brief get the statistics of the current or last stream
+ * @param esp8266_t* esp, the module
+ * @return const esp8266_stream_stats_t*, bytes and time
+ */
+const esp8266_stream_stats_t*
+esp8266_get_stream_stats(esp8266_t* esp);
+
+/**
+ * @brief get the throughput of the current or last stream
+ * @param esp8266_t* esp, the module
+ * @return uint32_t, bytes per second
+ */
+uint32_t
+esp8266_stream_rate(esp8266_t* esp);
+
+/*============================================================================
+							BAUD RATE AND FLOW CONTROL
+==============================================================================*/
+
+/* MX_UART4_Init starts the uart at 115200 baud, about 11 KB/s. esp8266_set_baud
+ * switches both sides to a higher rate with AT+UART_CUR. The ESP8266 answers OK
+ * at the old rate and then switches, so the uart is switched right after the OK,
+ * and the link is checked with AT at the new rate. If that does not get an
+ * answer, the ESP8266 is told to go back and the uart goes back to the last rate
+ * that worked.
+ *
+ * Every rate that is tried is kept with its result, and esp8266_stream_stop saves
+ * the throughput of the stream in the entry for the rate it ran at, so the rates
+ * can be compared with esp8266_print_baud.
+ *
+ * At high rates the ESP8266 can send faster than the main loop reads, and it
+ * drops what we send while it is busy with wifi. esp8266_set_flow_control turns
+ * on RTS/CTS on both sides. UART4 has no RTS/CTS of its own, so the driver does
+ * it with two GPIO pins, ESP_RTS and ESP_CTS on UART4, that are given to the module
+ * with esp8266_set_flow_pins, see esp8266_rx.h and esp8266_tx.h. The ESP8266 side
+ * needs its GPIO13 (CTS) and GPIO15 (RTS) wired to those pins, which an ESP-01
+ * does not have. esp8266_get_flow_stats tells if data was lost.
+ *
+ * Usage:
+ * 		  if(strcmp(esp8266_set_baud(&esp, 921600), ESP8266_AT_OK) != 0)
+ * 		  	{ still at the old rate, or no answer at all if ESP8266_TIMEOUT }
+ * 		  esp8266_set_flow_control(&esp, true);
+ */
+
+/* Rate of the ESP8266 after a reset */
+#define ESP8266_BAUD_DEFAULT		115200
+
+/* Number of AT sent at the new rate before giving up on it */
+#define ESP8266_BAUD_TRIES			3
+
+/* Max error in % between the asked for rate and the rate the uart can make */
+#define ESP8266_BAUD_TOLERANCE		2
+
+/* Max number of rates kept in the statistics */
+#define ESP8266_BAUD_MAX_RATES		8
+
+typedef struct {
+	uint32_t baud;
+	const char* result;				// result of the last esp8266_set_baud to this rate
+	uint32_t rate;					// bytes/s of the fastest stream at this rate, 0 if there was none
+} esp8266_baud_stats_t;
+
+/* Data lost on the uart, and how often flow control stepped in */
+typedef struct {
+	uint32_t overruns;				// received bytes overwritten before they were read
+	uint32_t errors;				// uart errors, such as an overrun of the uart itself
+	uint32_t throttles;				// times RTS told the ESP8266 to stop
+	uint32_t stalls;				// times CTS held back what we send
+} esp8266_flow_stats_t;
+
+/**
+ * @brief switch the ESP8266 and the uart to another baud rate, and check the link with AT.
+ * 		  Needs esp8266_init first and no requests going on. The rate lasts until AT+RST,
+ * 		  esp8266_init goes back to ESP8266_BAUD_DEFAULT.
+ * 		  Flow control stays as it is.
+ * @param esp8266_t* esp, the module
+ * @param uint32_t baud, the new baud rate, such as 921600
+ * @return const char*, ESP8266 response string:
+ * 		   "OK" 	if the link works at the new rate
+ * 		   "ERROR"	if the rate can not be made by the uart or the ESP8266 did not take it, nothing changed
+ * 		   "FAIL"	if there was no answer at the new rate, and the old rate works again
+ * 		   ESP8266_TIMEOUT if there is no answer at the old rate either
+ */
+const char*
+esp8266_set_baud(esp8266_t* esp, uint32_t baud);
+
+/**
+ * @brief get the baud rate the uart is running at
+ * @param esp8266_t* esp, the module
+ * @return uint32_t, baud rate
+ */
+uint32_t
+esp8266_get_baud(esp8266_t* esp);
+
+/**
+ * @brief get the statistics for a baud rate
+ * @param esp8266_t* esp, the module
+ * @param uint32_t baud, the baud rate
+ * @return const esp8266_baud_stats_t*, NULL if the rate has not been used
+ */
+const esp8266_baud_stats_t*
+esp8266_get_baud_stats(esp8266_t* esp, uint32_t baud);
+
+/**
+ * @brief turn RTS/CTS flow control on or off, on the ESP8266 with AT+UART_CUR and then on our
+ * 		  side, and check the link with AT. Needs esp8266_init first and no requests going on.
+ * 		  esp8266_init turns it off.
+ * @param esp8266_t* esp, the module
+ * @param bool enable, true to turn it on
+ * @return const char*, ESP8266 response string:
+ * 		   "OK" 	if the link works with the new setting
+ * 		   "ERROR"	if the ESP8266 did not take it or the module has no flow pins, nothing changed
+ * 		   "FAIL"	if there was no answer with flow control, such as when the pins are not wired,
+ * 		   			and it is off again on both sides
+ * 		   ESP8266_TIMEOUT if there is no answer with it off either
+ */
+const char*
+esp8266_set_flow_control(esp8266_t* esp, bool enable);
+
+/**
+ * @brief check if flow control is on
+ * @param esp8266_t* esp, the module
+ * @return bool, true if on
+ */
+bool
+esp8266_get_flow_control(esp8266_t* esp);
+
+/**
+ * @brief get the counters for lost data and flow control, they count from esp8266_init
+ * @param esp8266_t* esp, the module
+ * @param esp8266_flow_stats_t* stats, where the counters are stored
+ * @return void
+ */
+void
+esp8266_get_flow_stats(esp8266_t* esp, esp8266_flow_stats_t* stats);
+
+/**
+ * @brief print the result and the stream throughput of every rate that has been used
+ * @param esp8266_t* esp, the module
+ * @return void
+ */
+void
+esp8266_print_baud(esp8266_t* esp);
+
+/*============================================================================
+							MODULES
+==============================================================================*/
+
+/* All state of the driver is kept in an esp8266_t, so several modules can be
+ * used at once, each on its own uart. The application owns the esp8266_t and
+ * passes it to every function. esp8266_attach binds it to a uart, and the uart
+ * callbacks below find the module of the uart they are called for by its
+ * instance. A module only uses its own uart, buffers and request queue, so
+ * requests to different modules never wait for each other, and the callbacks
+ * of one module can be called while the other one is polled.
+ *
+ * The uart has to be set up with MX_*_Init first, with circular DMA for the
+ * reception, normal DMA for the transmission and its interrupt enabled. Its
+ * IRQ handler has to call esp8266_uart_irq, see UART4_IRQHandler and
+ * USART2_IRQHandler.
+ *
+ * Usage:
+ * 		  static esp8266_t wifi, wifi2;
+ * 		  esp8266_attach(&wifi, &huart4);
+ * 		  esp8266_set_flow_pins(&wifi, ESP_RTS_GPIO_Port, ESP_RTS_Pin, ESP_CTS_GPIO_Port, ESP_CTS_Pin);
+ * 		  esp8266_attach(&wifi2, &huart2);
+ * 		  esp8266_init(&wifi);
+ * 		  esp8266_init(&wifi2);
+ * 		  while(1){
+ * 		  	  esp8266_poll(&wifi);
+ * 		  	  esp8266_poll(&wifi2);
+ * 		  }
+ */
+
+/* Max number of modules attached at once */
+#define ESP8266_MAX_INSTANCES		2
+
+struct esp8266 {
+	UART_HandleTypeDef* huart;					// uart the module is connected to
+	esp8266_rx_t rx;
+	esp8266_tx_t tx;
+	esp8266_parser_t parser;
+	bool error_flag;
+	bool fail_flag;
+
+	/* Values reported by the ESP8266 in the response to the last command, -1 if not reported */
+	struct {
+		int32_t cwmode;
+		int32_t cipmux;
+		int32_t cwjap;
+		bool no_ap;
+	} response;
+
+	/* Queue of submitted requests, the first one is the one being worked on */
+	esp8266_request_t queue[ESP8266_QUEUE_SIZE];
+	uint8_t queue_first;
+	uint8_t queue_count;
+	bool active;								// the first request in the queue has been sent
+	uint32_t active_start;						// HAL_GetTick when it was sent
+
+	/* Timing statistics for each command, and for the requests that are not in the table */
+	esp8266_timing_t timing_table[ESP8266_CMD_DATA + 1];
+
+	/* Connection pool, see esp8266_pool_init */
+	esp8266_link_t links[ESP8266_MAX_LINKS];
+
+	/* +IPD data coming in, see esp8266_set_receive */
+	bool payload;
+	int8_t payload_link;						// link the data is for, no link for the single connection
+	esp8266_receive_callback_t single_receive;
+	void* single_receive_context;
+
+	/* Send on the single connection, see esp8266_send_async */
+	esp8266_send_t single_send;
+
+	/* Passthrough streaming, see esp8266_stream_start */
+	bool streaming;
+	uint32_t stream_start;
+	esp8266_stream_stats_t stream_stats;
+
+	/* Baud rates that have been used, see esp8266_set_baud */
+	esp8266_baud_stats_t baud_stats[ESP8266_BAUD_MAX_RATES];
+	uint8_t baud_count;
+	char baud_command[32];
+	bool flow_control;
+	GPIO_TypeDef* rts_port;						// flow control pins, NULL if the module has none
+	uint16_t rts_pin;
+	GPIO_TypeDef* cts_port;
+	uint16_t cts_pin;
+
+	/* What goes over the uart, NULL if it is not traced, see esp8266_set_trace */
+	esp8266_trace_t* trace;
+
+	/* Latencies in cycles, NULL if they are not profiled, see esp8266_set_profile */
+	esp8266_profile_table_t* profile;
+	uint32_t profile_start;						// clock when the active request was started
+	volatile uint32_t profile_sent;				// when the DMA had sent it, set from the interrupt
+	volatile uint32_t profile_received;			// when the last bytes for it were committed
+
+	/* Timeouts and uart errors, NULL if they are not logged, see esp8266_set_log */
+	esp8266_log_t* log;
+};
+
+/**
+ * @brief reset a module and bind it to a uart, so that the uart callbacks find it. A module
+ * 		  that was attached before, or another module on the same uart, is replaced.
+ * 		  Does not start the reception, see init_uart_interrupt and esp8266_init.
+ * @param esp8266_t* esp, the module
+ * @param UART_HandleTypeDef* huart, uart handle the ESP8266 is connected to, set up with DMA
+ * @return bool, false if ESP8266_MAX_INSTANCES modules are attached already
+ */
+bool
+esp8266_attach(esp8266_t* esp, UART_HandleTypeDef* huart);
+
+/**
+ * @brief unbind a module from its uart, the uart callbacks leave it alone after this.
+ * 		  Nothing is stopped on the uart.
+ * @param esp8266_t* esp, the module
+ * @return void
+ */
+void
+esp8266_detach(esp8266_t* esp);
+
+/**
+ * @brief set the pins for RTS/CTS flow control, see esp8266_set_flow_control. Without them
+ * 		  the module can not turn flow control on.
+ * @param esp8266_t* esp, the module
+ * @param GPIO_TypeDef* rts_port, port of the RTS pin, set up as output
+ * @param uint16_t rts_pin, the RTS pin, high tells the ESP8266 to stop sending
+ * @param GPIO_TypeDef* cts_port, port of the CTS pin, set up as input
+ * @param uint16_t cts_pin, the CTS pin, the ESP8266 raises it to hold us back
+ * @return void
+ */
+void
+esp8266_set_flow_pins(esp8266_t* esp, GPIO_TypeDef* rts_port, uint16_t rts_pin,
+					  GPIO_TypeDef* cts_port, uint16_t cts_pin);
+
+/**
+ * @brief put everything that goes over the uart of a module in a trace, with the time it went,
+ * 		  see esp8266_trace.h. The trace can be dumped with esp8266_trace_dump and played back
+ * 		  with esp8266_sim_replay. Has to be set after esp8266_attach, which turns it off.
+ * @param esp8266_t* esp, the module
+ * @param esp8266_trace_t* trace, set up with esp8266_trace_init, NULL to stop tracing
+ * @return void
+ */
+void
+esp8266_set_trace(esp8266_t* esp, esp8266_trace_t* trace);
+
+/**
+ * @brief measure the phases of every request of a module in a latency profile, see
+ * 		  esp8266_profile.h. Clears the profile and starts the cycle counter. Has to be
+ * 		  set after esp8266_attach, which turns it off.
+ *
+ * 		  static esp8266_profile_table_t profile;
+ *
+ * 		  esp8266_set_profile(&wifi, &profile);
+ * 		  ...
+ * 		  esp8266_print_profile(&wifi);
+ *
+ * @param esp8266_t* esp, the module
+ * @param esp8266_profile_table_t* profile, NULL to stop profiling
+ * @return void
+ */
+void
+esp8266_set_profile(esp8266_t* esp, esp8266_profile_table_t* profile);
+
+/**
+ * @brief log the requests of a module that time out and the errors of its uart, see
+ * 		  esp8266_log.h. Has to be set after esp8266_attach, which turns it off.
+ * @param esp8266_t* esp, the module
+ * @param esp8266_log_t* log, set up with esp8266_log_init, NULL to stop logging
+ * @return void
+ */
+void
+esp8266_set_log(esp8266_t* esp, esp8266_log_t* log);
+
 /*============================================================================
 							FUNCTIONS FOR ESP8266
 ==============================================================================*/
 
 
+/* Buffer for esp8266_get_wifi_command that fits the longest SSID (32) and password (64),
+ * even when every character has to be escaped */
+#define ESP8266_WIFI_COMMAND_SIZE	224
+
 /**
  * @brief assemble the command for connection to AP. Uses the SSID and PWD variables
- * 		  stored in the login.h header.
+ * 		  stored in the login.h header. '"', ',' and '\' in them are escaped.
  * @param char* buffer, where the command is stored into
- * @return void
+ * @param uint16_t size, size of the buffer, see ESP8266_WIFI_COMMAND_SIZE
+ * @return uint16_t, length of the command, 0 if it does not fit
  */
-void
-esp8266_get_wifi_command(char* buffer);
+uint16_t
+esp8266_get_wifi_command(char* buffer, uint16_t size);
 
 /**
  * @brief assemble the command for connection to a website
  * @param char* buffer, where the command is stored into
- * @param char* connection_type, type of connection "TCP", "UDP" or "SSL"
- * @param char* remote_ip, the ip to connect to, can also be a url
- * @param char* remote_port, port to connect
- * @return void
+ * @param uint16_t size, size of the buffer
+ * @param const char* connection_type, type of connection "TCP", "UDP" or "SSL"
+ * @param const char* remote_ip, the ip to connect to, can also be a url
+ * @param const char* remote_port, port to connect
+ * @return uint16_t, length of the command, 0 if it does not fit
  */
-void
-esp8266_get_connection_command(char* buffer, char* connection_type,
-							   char* remote_ip, char* remote_port);
+uint16_t
+esp8266_get_connection_command(char* buffer, uint16_t size, const char* connection_type,
+							   const char* remote_ip, const char* remote_port);
 
 /**
  * @brief assemble the CIPSEND command with length of request.
  * 		  The esp8266 should be connected to some website before using this.
  *
  * 		  Usage:
- *		  esp8266_get_at_send_command(a_buffer_for_the_command, length_of_your_http_request);
+ *		  esp8266_get_at_send_command(a_buffer_for_the_command, sizeof(a_buffer_for_the_command), length_of_your_http_request);
  * 		  esp8266_at_send(a_buffer_for_the_command);
- * 		  esp8266_send_data(buffer_with_http_request);
+ * 		  esp8266_send_data(&esp, buffer_with_http_request);
  *
  * @param char* buffer, where the command is stored
- * @param uint8_t len, length of the command
- * @return void
+ * @param uint16_t size, size of the buffer
+ * @param uint16_t len, length of the request, at most ESP8266_SEND_MAX. Use esp8266_send for longer data
+ * @return uint16_t, length of the command, 0 if it does not fit
  */
-void
-esp8266_get_at_send_command(char* buffer, uint8_t len);
+uint16_t
+esp8266_get_at_send_command(char* buffer, uint16_t size, uint16_t len);
 
 
 /**
  * @brief assemble the HTTP request to send
  * @param char* buffer, where the command is stored
+ * @param uint16_t size, size of the buffer
  * @param const char*, type of the HTTP request,   EXAMPLE: POST or GET
- * @param char* uri, URI for the request, 		   EXAMPLE: google.com/index
- * @param char* host, host adress for the request, EXAMPLE: google.com
- * @return uint8_t, length of the request
+ * @param const char* uri, URI for the request, 		   EXAMPLE: google.com/index
+ * @param const char* host, host adress for the request, EXAMPLE: google.com
+ * @return uint16_t, length of the request, 0 if it does not fit
+ */
+uint16_t
+esp8266_http_get_request(char* buffer, uint16_t size, const char* http_type, const char* uri, const char* host);
+
+/**
+ * @brief start circular DMA reception on the uart of the module, see esp8266_rx.h. Flow control
+ * 		  is turned off. Needs esp8266_attach first.
+ * @param esp8266_t* esp, the module
+ * @return void
+ */
+void
+init_uart_interrupt(esp8266_t* esp);
+
+/**
+ * @brief callback for the RX events of the attached modules: idle line, DMA half transfer and DMA transfer complete
+ * @param UART_HandleTypeDef* huart handle
+ * @param uint16_t Size, DMA write position in the receive buffer
+ * @return void
+ */
+void
+HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size);
+
+/**
+ * @brief uart interrupts that the HAL does not handle, the character match at the end of a line.
+ * 		  Call from the IRQ handler of every uart with a module, such as UART4_IRQHandler,
+ * 		  before HAL_UART_IRQHandler. Uarts without a module are left alone.
+ * @param UART_HandleTypeDef* huart handle
+ * @return void
  */
-uint8_t
-esp8266_http_get_request(char* buffer, const char* http_type, char* uri, char* host);
+void
+esp8266_uart_irq(UART_HandleTypeDef *huart);
 
 /**
- * @brief start RX interrupt for UART4
- * @param void
+ * @brief callback for the uart errors of the attached modules, the HAL stops the DMA reception on errors
+ * @param UART_HandleTypeDef* huart handle
  * @return void
  */
 void
-init_uart_interrupt(void);
+HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
 
 /**
- * @brief callback for UART4 RX interrupt
+ * @brief callback for the DMA transmission complete of the attached modules, starts the next segment,
+ * 		  see esp8266_tx.h
  * @param UART_HandleTypeDef* huart handle
  * @return void
  */
 void
-HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
 
 /**
- * @brief send command to ESP8266
+ * @brief send command to ESP8266 and wait for the answer, blocking version of esp8266_send_command_async.
+ * 		  Uses the default timeout for the command.
+ * @param esp8266_t* esp, the module
  * @param char* command to send
- * @return const char*, ESP8266 response string
+ * @return const char*, ESP8266 response string, ESP8266_TIMEOUT if there was no answer in time
  *
- * Usage: if(strcmp(esp8266_send_command(ESP8266_AT), ESP8266_AT) != 0))
+ * Usage: if(strcmp(esp8266_send_command(&esp, ESP8266_AT), ESP8266_AT) != 0))
  * 		  	{ error handling }
  */
 const char*
-esp8266_send_command(const char*);
+esp8266_send_command(esp8266_t* esp, const char*);
+
+/**
+ * @brief send a command from the command table and wait for the answer, blocking version
+ * 		  of esp8266_send_command_id_async. Uses the timeout for the command.
+ * @param esp8266_t* esp, the module
+ * @param esp8266_command_id_t id, the command
+ * @param const char* command, the command with its parameters, NULL to send the command from the table
+ * @return const char*, ESP8266 response string, ESP8266_TIMEOUT if there was no answer in time
+ */
+const char*
+esp8266_send_command_id(esp8266_t* esp, esp8266_command_id_t id, const char* command);
+
+/**
+ * @brief send a command in parts and wait for the answer, blocking version of esp8266_send_parts_async
+ * @param esp8266_t* esp, the module
+ * @param esp8266_command_id_t id, the command
+ * @param const esp8266_tx_part_t* parts, the parts of the command
+ * @param uint8_t count, number of parts
+ * @return const char*, ESP8266 response string, ESP8266_TIMEOUT if there was no answer in time
+ */
+const char*
+esp8266_send_parts(esp8266_t* esp, esp8266_command_id_t id, const esp8266_tx_part_t* parts, uint8_t count);
 
 /**
  * @brief send data to ESP8266, this is used after calling cipsend
  * where the length of the data that will be sent has been specified.
+ * Blocking version of esp8266_send_data_async, uses ESP8266_TIMEOUT_DATA.
+ * @param esp8266_t* esp, the module
  * @param char* data to send
- * @return const char*, ESP8266 response string
+ * @return const char*, ESP8266 response string, ESP8266_AT_ERROR if the data is longer than
+ * 		   ESP8266_REQUEST_MAX
  */
 const char*
-esp8266_send_data(const char*);
+esp8266_send_data(esp8266_t* esp, const char*);
 
 /**
  * @brief initiate the ESP8266, performs all necessary commands to start using the
  * 		  device. It also verifies that the settings were set.
- * 		  Settings are: station mode (cwmode=1), single connection mode (cipmux=0)
- * @param void
+ * 		  Settings are: station mode (cwmode=1), single connection mode (cipmux=0).
+ * 		  The reset puts the ESP8266 back at ESP8266_BAUD_DEFAULT without flow control, and the uart follows.
+ * @param esp8266_t* esp, the module
  * @return const char*, ESP8266 response string, either "OK" or "ERROR"
  */
 const char*
-esp8266_init(void);
+esp8266_init(esp8266_t* esp);
 
 /**
  * @brief initiate a wifi connection, uses the esp8266_get_wifi_command function, so make sure
  * 		  that SSID and PWD variables are present and correct.
- * @param void
+ * @param esp8266_t* esp, the module
  * @return const char*, ESP8266 response string.
  * Possible return strings:
  * 		 					"WIFI CONNECTED"
@@ -319,41 +1367,34 @@ esp8266_init(void);
  * 							"error"
  */
 const char*
-esp8266_wifi_init(void);
-
-/**
- * @brief get hash number for string. The hash number corresponds to a
- * 		  specific command. This is used to determine the possible return values for the command
- * 		  that was sent. There is generally no need for the user to call this function.
- * 		  The hash keys that are implemented can be found in the typedef enum initialized as KEYS.
- * @param const char* string to get hash number for
- * @return const unsigned long the hash number
- */
-const unsigned long
-hash(const char*);
+esp8266_wifi_init(esp8266_t* esp);
 
 /**
- * @brief Evaluate ESP8266 response, if any global flags were set return "ERROR" else "OK".
+ * @brief Evaluate ESP8266 response, if any flags of the module were set return "ERROR" else "OK".
  * Used for applicable AT commands that only need to return basic responses.
+ * @param esp8266_t* esp, the module
  * @return char* "OK" or "ERROR"
  */
 const char*
-evaluate(void);
+evaluate(esp8266_t* esp);
 
 /**
- * @brief matches command to ESP8266 return type. Looks up the hash of the command, and then looks for
- * the ESP8266 response which should be returned.
- * @param char* command to match to a return type. The command needs to be in the typedef enum (KEYS)
- * @return char* return ESP8266 response depending on command and its outcome
+ * @brief matches command to ESP8266 return type. Picks the ESP8266 response which should be
+ * returned from the result mapping in the command table and what the parser saw in the response.
+ * @param esp8266_t* esp, the module
+ * @param esp8266_command_id_t id, the command that was sent
+ * @return char* return ESP8266 response depending on command and its outcome,
+ * 		   ESP8266_NOT_IMPLEMENTED for commands that are not in the table
  */
 const char*
-get_return(const char*);
+get_return(esp8266_t* esp, esp8266_command_id_t id);
 
 /**
- * @brief clear all flags, and the rx buffer
- * @param void
+ * @brief clear all flags, throw away received bytes and reset the response parser
+ * @param esp8266_t* esp, the module
  * @return void
  */
 void
-esp8266_clear(void);
+esp8266_clear(esp8266_t* esp);
 
+#endif /* INC_ESP8266_H_ */
@@ -0,0 +1,93 @@
+/**
+******************************************************************************
+@brief header for the AT command formatter
+@details A small replacement for sprintf for putting AT commands together.
+		 It knows three things: strings as they are, quoted strings and
+		 unsigned decimals, which is all an AT command needs. Each piece is
+		 appended in a single pass over its bytes, without parsing a format
+		 string, and without the several KB of flash newlib's printf family
+		 brings along.
+
+		 Quoted strings are escaped the way the AT firmware wants it: '"',
+		 ',' and '\' get a '\' in front, so a SSID such as my"wifi,5 is sent
+		 as "my\"wifi\,5".
+
+		 The length of the buffer is checked for every byte. When a piece does
+		 not fit the output is cut where the buffer ends, and the formatter
+		 remembers it, so a command is only sent if all of it was written.
+		 The output always ends with '\0'.
+
+		 Usage:
+		 	 esp8266_format_t format;
+		 	 esp8266_format_init(&format, buffer, sizeof(buffer));
+		 	 esp8266_format_string(&format, ESP8266_AT_SEND);
+		 	 esp8266_format_uint(&format, len);
+		 	 esp8266_format_string(&format, "\r\n");
+		 	 if(esp8266_format_end(&format) == 0)
+		 	 	 ...the buffer was too small
+
+@file esp8266_format.h
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_ESP8266_FORMAT_H_
+#define INC_ESP8266_FORMAT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	char* buffer;
+	uint16_t size;					// size of the buffer, including the '\0'
+	uint16_t len;					// bytes written, without the '\0'
+	bool overflow;					// something did not fit
+} esp8266_format_t;
+
+/**
+ * @brief start formatting into a buffer
+ * @param esp8266_format_t* format
+ * @param char* buffer, where the output is stored
+ * @param uint16_t size, size of the buffer, at least 1 for the '\0'
+ * @return void
+ */
+void
+esp8266_format_init(esp8266_format_t* format, char* buffer, uint16_t size);
+
+/**
+ * @brief append a string as it is
+ * @param esp8266_format_t* format
+ * @param const char* string
+ * @return void
+ */
+void
+esp8266_format_string(esp8266_format_t* format, const char* string);
+
+/**
+ * @brief append a string in quotes, with '"', ',' and '\' escaped
+ * @param esp8266_format_t* format
+ * @param const char* string
+ * @return void
+ */
+void
+esp8266_format_quoted(esp8266_format_t* format, const char* string);
+
+/**
+ * @brief append an unsigned decimal
+ * @param esp8266_format_t* format
+ * @param uint32_t value
+ * @return void
+ */
+void
+esp8266_format_uint(esp8266_format_t* format, uint32_t value);
+
+/**
+ * @brief get the length of the output
+ * @param const esp8266_format_t* format
+ * @return uint16_t, number of bytes without the '\0', 0 if something did not fit
+ */
+uint16_t
+esp8266_format_end(const esp8266_format_t* format);
+
+#endif /* INC_ESP8266_FORMAT_H_ */
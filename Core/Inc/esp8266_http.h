@@ -0,0 +1,384 @@
+/**
+******************************************************************************
+@brief header for the ESP8266 HTTP client
+@details A HTTP/1.1 client that keeps its connection open between requests,
+		 instead of sending "Connection: close" and connecting again for every
+		 request. Connecting costs a DNS lookup, the TCP handshake and the
+		 AT+CIPSTART round trip, which is most of the time a request takes.
+
+		 The client sends on a link from the connection pool, see
+		 esp8266_pool_init, so the module has to be in multiple connection
+		 mode. The link is opened by the first request, and opened again only
+		 when the server has closed it or a request failed.
+
+		 Since the connection stays open, the end of a response has to be
+		 found from the response itself. esp8266_http_response_t does that
+		 from the headers, with Content-Length or chunked encoding, or when
+		 the server closes the connection if the response has neither. The
+		 response framing does not use the HAL, so it can be tested on its own.
+
+		 The response is parsed as it arrives, one +IPD piece at a time, and
+		 handed to esp8266_http_callbacks_t: the status code, each header as a
+		 name and a value, and the body in the pieces it was received in, with
+		 the chunk framing taken out. Only the current line is kept, so the RAM
+		 used is the same for a 100 byte and a 1 MB response. A callback that
+		 returns false stops the response, the rest of it is not looked at.
+
+		 Requests are put together from pieces with esp8266_http_request_t:
+		 the method, URI and host, a list of headers and a body. The pieces are
+		 not copied, they are sent one after the other by the DMA, and only the
+		 Content-Length is formatted. The length of the whole request is known
+		 before anything is sent, as AT+CIPSEND needs it.
+
+@file esp8266_http.h
+@author agent@local
+@date 16-10-2026
+@version 1.2
+*******************************************************************************/
+
+#ifndef INC_ESP8266_HTTP_H_
+#define INC_ESP8266_HTTP_H_
+
+#include <ESP8266.h>
+
+/* Header lines longer than this are cut, only the start of a header is looked at */
+#define ESP8266_HTTP_LINE_SIZE		64
+
+/* Length of a response that has no Content-Length */
+#define ESP8266_HTTP_NO_LENGTH		(-1)
+
+/* Where the response framing is, see esp8266_http.c */
+typedef enum {
+	ESP8266_HTTP_STATUS_LINE,
+	ESP8266_HTTP_HEADERS,
+	ESP8266_HTTP_BODY,				// Content-Length bytes, or until the connection is closed
+	ESP8266_HTTP_CHUNK_SIZE,
+	ESP8266_HTTP_CHUNK_DATA,
+	ESP8266_HTTP_CHUNK_END,			// CRLF after the chunk data
+	ESP8266_HTTP_TRAILER,			// headers after the last chunk
+	ESP8266_HTTP_DONE,
+	ESP8266_HTTP_ERROR,				// the response could not be read
+	ESP8266_HTTP_ABORTED			// a callback returned false
+} esp8266_http_state_t;
+
+/**
+ * @brief called with the status code of the response. Not called for 1xx responses such as 100 Continue.
+ * @param uint16_t status, status code, such as 200
+ * @param void* context, from esp8266_http_callbacks_t
+ * @return bool, false to stop the response
+ */
+typedef bool (*esp8266_http_status_callback_t)(uint16_t status, void* context);
+
+/**
+ * @brief called with each header of the response, and the trailer headers after the last chunk
+ * @param const char* name, header name as sent, such as "Content-Type"
+ * @param const char* value, header value without the leading whitespace. Both are cut at
+ * 		  ESP8266_HTTP_LINE_SIZE, and are only valid during the call
+ * @param void* context, from esp8266_http_callbacks_t
+ * @return bool, false to stop the response
+ */
+typedef bool (*esp8266_http_header_callback_t)(const char* name, const char* value, void* context);
+
+/**
+ * @brief called with a piece of the body, without the chunk framing
+ * @param const uint8_t* data, body bytes, only valid during the call
+ * @param uint32_t len, number of bytes, never 0
+ * @param void* context, from esp8266_http_callbacks_t
+ * @return bool, false to stop the response
+ */
+typedef bool (*esp8266_http_body_callback_t)(const uint8_t* data, uint32_t len, void* context);
+
+/* What to call while parsing a response, each callback can be NULL */
+typedef struct {
+	esp8266_http_status_callback_t status;
+	esp8266_http_header_callback_t header;
+	esp8266_http_body_callback_t body;
+	void* context;
+} esp8266_http_callbacks_t;
+
+typedef struct {
+	esp8266_http_state_t state;
+	const esp8266_http_callbacks_t* callbacks;	// NULL to only find the end of the response
+	uint16_t status;					// status code, such as 200
+	int32_t content_length;				// ESP8266_HTTP_NO_LENGTH if there was none
+	bool chunked;						// Transfer-Encoding: chunked
+	bool close;							// Connection: close, the server closes after the response
+	uint32_t remaining;					// body or chunk bytes left
+	uint32_t body;						// body bytes received, without the chunk framing
+	char line[ESP8266_HTTP_LINE_SIZE];	// current status/header/chunk size line
+	uint8_t line_len;
+} esp8266_http_response_t;
+
+/**
+ * @brief reset the response framing for a new response, without callbacks
+ * @param esp8266_http_response_t* response
+ * @return void
+ */
+void
+esp8266_http_response_init(esp8266_http_response_t* response);
+
+/**
+ * @brief set the callbacks for the response, after esp8266_http_response_init
+ * @param esp8266_http_response_t* response
+ * @param const esp8266_http_callbacks_t* callbacks, has to stay valid until the response is done, NULL for none
+ * @return void
+ */
+void
+esp8266_http_response_callbacks(esp8266_http_response_t* response, const esp8266_http_callbacks_t* callbacks);
+
+/**
+ * @brief feed received bytes to the response framing, and call the callbacks. Stops at the end
+ * 		  of the response, bytes after it belong to the next response. Stops as well when a
+ * 		  callback returns false, the state is ESP8266_HTTP_ABORTED then.
+ * @param esp8266_http_response_t* response
+ * @param const uint8_t* data, received bytes
+ * @param uint32_t len, number of bytes
+ * @return uint32_t, number of bytes that belong to this response
+ */
+uint32_t
+esp8266_http_response_feed(esp8266_http_response_t* response, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief tell the response framing that the connection was closed. This ends a response
+ * 		  that has no length, any other response is cut short and becomes an error.
+ * @param esp8266_http_response_t* response
+ * @return void
+ */
+void
+esp8266_http_response_closed(esp8266_http_response_t* response);
+
+/**
+ * @brief check if the whole response has been received
+ * @param const esp8266_http_response_t* response
+ * @return bool, true if done
+ */
+bool
+esp8266_http_response_done(const esp8266_http_response_t* response);
+
+/**
+ * @brief receive callback that feeds a response, for the single connection or a link that is not
+ * 		  used by a client. The CLOSED is passed on with esp8266_http_response_closed.
+ * 		  Usage:
+ * 		  	  esp8266_http_response_init(&response);
+ * 		  	  esp8266_http_response_callbacks(&response, &callbacks);
+ * 		  	  esp8266_set_receive(&esp, esp8266_http_receive, &response);
+ * @param uint8_t link, the link id, not used
+ * @param const uint8_t* data, received data
+ * @param uint16_t len, number of bytes, 0 when the connection has been closed
+ * @param void* context, the esp8266_http_response_t
+ * @return void
+ */
+void
+esp8266_http_receive(uint8_t link, const uint8_t* data, uint16_t len, void* context);
+
+/* Pieces of a request: the request line and the Host header take 4, each header 4, and the end
+ * of the headers and the start of the body 1 each */
+#define ESP8266_HTTP_REQUEST_LINE_PARTS	4
+#define ESP8266_HTTP_HEADER_PARTS		4
+#define ESP8266_HTTP_REQUEST_END_PARTS	2
+
+/* Max pieces of a request, and the headers that fit in what is left of them */
+#define ESP8266_HTTP_REQUEST_PARTS		24
+#define ESP8266_HTTP_REQUEST_HEADERS	((ESP8266_HTTP_REQUEST_PARTS - ESP8266_HTTP_REQUEST_LINE_PARTS \
+										  - ESP8266_HTTP_REQUEST_END_PARTS) / ESP8266_HTTP_HEADER_PARTS)
+
+_Static_assert(ESP8266_HTTP_REQUEST_PARTS <= ESP8266_TX_QUEUE_SIZE, "a request is sent with one esp8266_tx_writev");
+
+/* A header for esp8266_http_request_headers */
+typedef struct {
+	const char* name;
+	const char* value;
+} esp8266_http_header_t;
+
+/* A request put together from pieces. The pieces up to the first part of the body are sent with
+ * the first AT+CIPSEND, the rest of the body is cut into segments after them, see esp8266_sendv. */
+typedef struct {
+	esp8266_tx_part_t parts[ESP8266_HTTP_REQUEST_PARTS];
+	uint8_t count;
+	uint16_t len;						// bytes in the parts
+	const uint8_t* body;				// the rest of the body, after the part in parts
+	uint32_t body_len;
+	bool ended;							// esp8266_http_request_end was called
+	bool overflow;						// a piece did not fit, the request can not be sent
+	char content_length[32];			// "Content-Length: <len>\r\n\r\n"
+} esp8266_http_request_t;
+
+/**
+ * @brief start a request with the request line and the Host header. Nothing is copied, the strings
+ * 		  have to stay valid until the request has been sent.
+ *
+ * 		  Usage:
+ * 		  	  static const esp8266_http_header_t headers[] = {{"Content-Type", "application/json"}};
+ * 		  	  esp8266_http_request_init(&request, HTTP_POST, "/telemetry", "example.com");
+ * 		  	  esp8266_http_request_headers(&request, headers, 1);
+ * 		  	  esp8266_http_request_end(&request, (const uint8_t*) json, json_len);
+ * 		  	  esp8266_http_request_send_async(&esp, &request, sent, NULL);
+ *
+ * @param esp8266_http_request_t* request
+ * @param const char* method, HTTP_GET or HTTP_POST, or another method followed by a space
+ * @param const char* uri, URI for the request, EXAMPLE: /index.html
+ * @param const char* host, host for the Host header, EXAMPLE: google.com
+ * @return void
+ */
+void
+esp8266_http_request_init(esp8266_http_request_t* request, const char* method, const char* uri, const char* host);
+
+/**
+ * @brief add a header, before esp8266_http_request_end
+ * @param esp8266_http_request_t* request
+ * @param const char* name, EXAMPLE: Content-Type
+ * @param const char* value, EXAMPLE: application/json
+ * @return bool, false if there is no room for it, after ESP8266_HTTP_REQUEST_HEADERS headers. The
+ * 		   request can not be sent then.
+ */
+bool
+esp8266_http_request_header(esp8266_http_request_t* request, const char* name, const char* value);
+
+/**
+ * @brief add a list of headers, before esp8266_http_request_end
+ * @param esp8266_http_request_t* request
+ * @param const esp8266_http_header_t* headers, the array is not needed after the call, the strings are
+ * @param uint8_t count, number of headers
+ * @return bool, false if there is no room for all of them, the request can not be sent then
+ */
+bool
+esp8266_http_request_headers(esp8266_http_request_t* request, const esp8266_http_header_t* headers, uint8_t count);
+
+/**
+ * @brief end the headers and add the body. A body gets a Content-Length header.
+ * @param esp8266_http_request_t* request
+ * @param const uint8_t* body, any length, NULL for a request without a body
+ * @param uint32_t len, number of bytes in the body, 0 without a body
+ * @return bool, false if the request is too long for the first AT+CIPSEND, something did not fit, or
+ * 		   there is a len without a body
+ */
+bool
+esp8266_http_request_end(esp8266_http_request_t* request, const uint8_t* body, uint32_t len);
+
+/**
+ * @brief get the length of the whole request, the headers and the body
+ * @param const esp8266_http_request_t* request
+ * @return uint32_t, number of bytes, 0 if the request has not been ended or something did not fit
+ */
+uint32_t
+esp8266_http_request_length(const esp8266_http_request_t* request);
+
+/**
+ * @brief send a request on the single connection, returns immediately, see esp8266_sendv_async
+ * @param esp8266_t* esp, the module
+ * @param const esp8266_http_request_t* request, has to stay valid until the callback is called
+ * @param esp8266_callback_t callback, called with ESP8266_AT_SEND_OK when sent, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the request can not be sent, or a send is going on
+ */
+bool
+esp8266_http_request_send_async(esp8266_t* esp, const esp8266_http_request_t* request,
+								esp8266_callback_t callback, void* context);
+
+/**
+ * @brief send a request on a connected link, returns immediately, see esp8266_link_sendv_async
+ * @param esp8266_t* esp, the module
+ * @param uint8_t link, the link id
+ * @param const esp8266_http_request_t* request, has to stay valid until the callback is called
+ * @param esp8266_callback_t callback, called with ESP8266_AT_SEND_OK when sent, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the request can not be sent, or the link is not connected or busy
+ */
+bool
+esp8266_http_request_link_send_async(esp8266_t* esp, uint8_t link, const esp8266_http_request_t* request,
+									 esp8266_callback_t callback, void* context);
+
+typedef struct {
+	esp8266_t* esp;						// module the requests go through
+	const char* type;					// "TCP" or "SSL"
+	const char* remote_ip;
+	const char* remote_port;
+	int8_t link;						// link id, -1 when not connected
+	const char* request;				// request being worked on
+	const esp8266_http_request_t* built;	// sent instead of request if not NULL
+	bool sent;							// SEND OK for the request
+	bool busy;
+	uint32_t start;						// HAL_GetTick when the request was started
+	uint32_t timeout;					// ms to wait for the response
+	esp8266_callback_t callback;
+	void* context;
+	const esp8266_http_callbacks_t* callbacks;	// for the response of the request, NULL for none
+	esp8266_http_response_t response;
+	uint32_t requests;					// completed requests
+	uint32_t connects;					// number of times the link was opened
+} esp8266_http_client_t;
+
+/**
+ * @brief set up a client for a server. Does not connect, the first request does.
+ * @param esp8266_http_client_t* client
+ * @param esp8266_t* esp, the module, with its connection pool set up, see esp8266_pool_init
+ * @param const char* type, "TCP" or "SSL"
+ * @param const char* remote_ip, the ip to connect to, can also be a url
+ * @param const char* remote_port, port to connect
+ * @return void
+ */
+void
+esp8266_http_client_init(esp8266_http_client_t* client, esp8266_t* esp, const char* type,
+						 const char* remote_ip, const char* remote_port);
+
+/**
+ * @brief send a request and receive the response, returns immediately. Connects first if the
+ * 		  client has no open link. The callback is called with ESP8266_AT_OK when the whole
+ * 		  response has been received, the status code is in client->response.status.
+ * 		  The response is passed to client->callbacks while it is received. If one of them
+ * 		  stops it, the link is closed and the callback is called with ESP8266_ABORTED.
+ * @param esp8266_http_client_t* client
+ * @param const char* request, see esp8266_http_keep_alive_request, has to stay valid until
+ * 		  the callback is called
+ * @param esp8266_callback_t callback, called when done, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the client is busy, or there is no free link or queue space
+ */
+bool
+esp8266_http_client_request_async(esp8266_http_client_t* client, const char* request,
+								  esp8266_callback_t callback, void* context);
+
+/**
+ * @brief send a request put together with esp8266_http_request_init and receive the response,
+ * 		  returns immediately, see esp8266_http_client_request_async
+ * @param esp8266_http_client_t* client
+ * @param const esp8266_http_request_t* request, has to stay valid until the callback is called
+ * @param esp8266_callback_t callback, called when done, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the client is busy, the request can not be sent, or there is no free link or queue space
+ */
+bool
+esp8266_http_client_send_async(esp8266_http_client_t* client, const esp8266_http_request_t* request,
+							   esp8266_callback_t callback, void* context);
+
+/**
+ * @brief check if a request is being worked on, and time it out if the response takes longer than
+ * 		  ESP8266_TIMEOUT_DATA. A timed out request closes the link and calls the callback with
+ * 		  ESP8266_TIMEOUT. Call esp8266_poll while this is true.
+ * @param esp8266_http_client_t* client
+ * @return bool, true if busy
+ */
+bool
+esp8266_http_client_busy(esp8266_http_client_t* client);
+
+/**
+ * @brief close the link of the client, returns immediately
+ * @param esp8266_http_client_t* client
+ * @return void
+ */
+void
+esp8266_http_client_close(esp8266_http_client_t* client);
+
+/**
+ * @brief assemble a HTTP request that keeps the connection open
+ * @param char* buffer, where the request is stored
+ * @param uint16_t size, size of the buffer
+ * @param const char*, type of the HTTP request,   EXAMPLE: POST or GET
+ * @param const char* uri, URI for the request, 		   EXAMPLE: google.com/index
+ * @param const char* host, host adress for the request, EXAMPLE: google.com
+ * @return uint16_t, length of the request, 0 if it does not fit
+ */
+uint16_t
+esp8266_http_keep_alive_request(char* buffer, uint16_t size, const char* http_type, const char* uri, const char* host);
+
+#endif /* INC_ESP8266_HTTP_H_ */
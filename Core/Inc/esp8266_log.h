@@ -0,0 +1,175 @@
+/**
+******************************************************************************
+@brief header for the buffered binary log
+@details printf goes out through ITM_SendChar, which waits whenever the SWO
+		 FIFO is full, so a line of text can hold up the network code for
+		 as long as it takes to send. ESP8266_LOG does not format or send
+		 anything. It puts a record in a ring in RAM: the pointer to the
+		 format, the time and up to ESP8266_LOG_MAX_ARGS integer arguments.
+		 esp8266_log_drain sends the records from the main loop on ITM
+		 stimulus port ESP8266_LOG_ITM_PORT, as much as fits in the FIFO,
+		 without waiting. The text is put back together by a reader on the
+		 other end, see esp8266_log_reader.h.
+
+		 	 ESP8266_LOG(&wifi_log, "link %u got %lu bytes\n", link, len);
+
+		 The format has to be a string literal, or last as long as the log,
+		 only the pointer is kept. The arguments have to be integers of up to
+		 32 bits, they can be printed with the d, i, u, x, X, o and c
+		 conversions, with flags, width, precision and an l. Strings can not
+		 be logged, ESP8266_LOG does not compile with a pointer or a float
+		 argument. Another conversion, such as %s, reads back as "?" and
+		 takes its argument. Records can be written from the main loop and
+		 from interrupts.
+
+		 The stream starts with "E8LG" and 1 byte ESP8266_LOG_VERSION, after
+		 that each item starts with a tag byte:
+
+		 	 format		ESP8266_LOG_TAG_FORMAT, 1 byte id, 1 byte length,
+		 	 			the text. Sent before the first record that uses
+		 	 			it, ids are handed out in turn and used again after
+		 	 			ESP8266_LOG_FORMATS, the new text replaces the old
+		 	 record		ESP8266_LOG_TAG_RECORD | number of arguments,
+		 	 			1 byte id, ms since the record before, or since
+		 	 			the start for the first one, each argument
+		 	 dropped	ESP8266_LOG_TAG_DROPPED, records that did not fit in
+		 	 			the ring, before the next record that did
+
+		 Times and arguments take 7 bits per byte, lowest first, bit 7 set on
+		 every byte but the last. A record costs 3 to 4 bytes plus its
+		 arguments, usually less than the text.
+
+		 When no debugger has turned on the ITM port the drain throws the
+		 records away.
+
+@file esp8266_log.h
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_ESP8266_LOG_H_
+#define INC_ESP8266_LOG_H_
+
+#include <main.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ring_buffer.h>
+
+/* Max arguments of a record */
+#define ESP8266_LOG_MAX_ARGS		4
+
+/* Formats that have an id at the same time */
+#define ESP8266_LOG_FORMATS			32
+
+/* Longer formats are cut off */
+#define ESP8266_LOG_FORMAT_MAX		200
+
+/* Version of the stream, in the header */
+#define ESP8266_LOG_VERSION			1
+
+/* Start of the stream */
+#define ESP8266_LOG_HEADER			{ 'E', '8', 'L', 'G', ESP8266_LOG_VERSION }
+
+/* ITM stimulus port of esp8266_log_drain, printf uses port 0 and the uart trace port 1 */
+#define ESP8266_LOG_ITM_PORT		2
+
+/* Tags of the items in the stream */
+#define ESP8266_LOG_TAG_FORMAT		0xF0
+#define ESP8266_LOG_TAG_RECORD		0xA0
+#define ESP8266_LOG_TAG_DROPPED		0xD0
+
+/* Room for a drop, a format and a record */
+#define ESP8266_LOG_OUT_SIZE		(ESP8266_LOG_FORMAT_MAX + 40)
+
+/* Counts the arguments of ESP8266_LOG, up to ESP8266_LOG_MAX_ARGS, TOO_MANY for up to 8 */
+#define ESP8266_LOG_COUNT(...) \
+	ESP8266_LOG_COUNT_(0, ##__VA_ARGS__, TOO_MANY, TOO_MANY, TOO_MANY, TOO_MANY, 4, 3, 2, 1, 0)
+#define ESP8266_LOG_COUNT_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...)	n
+
+/* An argument as it is stored. An argument that is not an integer of up to 32 bits, such as
+ * a string, a pointer or a float, does not compile: | is only defined for integers, and the
+ * array size is negative for a wider one. Neither is evaluated at run time. */
+#define ESP8266_LOG_ARG(x) \
+	((uint32_t) (((x) | 0) + 0 * sizeof(char[sizeof(x) <= sizeof(uint32_t) ? 1 : -1])))
+
+/* Put a record in the log, log can be NULL to log nothing. More than ESP8266_LOG_MAX_ARGS
+ * arguments do not compile. */
+#define ESP8266_LOG(log, format, ...) \
+	ESP8266_LOG_WRITE(ESP8266_LOG_COUNT(__VA_ARGS__), (log), (format), ##__VA_ARGS__)
+#define ESP8266_LOG_WRITE(n, ...)		ESP8266_LOG_WRITE_(n, __VA_ARGS__)
+#define ESP8266_LOG_WRITE_(n, ...)		ESP8266_LOG_WRITE_##n(__VA_ARGS__)
+#define ESP8266_LOG_WRITE_0(log, format) \
+	esp8266_log_write(log, format, 0, NULL)
+#define ESP8266_LOG_WRITE_1(log, format, a) \
+	esp8266_log_write(log, format, 1, (const uint32_t[]) { ESP8266_LOG_ARG(a) })
+#define ESP8266_LOG_WRITE_2(log, format, a, b) \
+	esp8266_log_write(log, format, 2, (const uint32_t[]) { ESP8266_LOG_ARG(a), ESP8266_LOG_ARG(b) })
+#define ESP8266_LOG_WRITE_3(log, format, a, b, c) \
+	esp8266_log_write(log, format, 3, (const uint32_t[]) { ESP8266_LOG_ARG(a), ESP8266_LOG_ARG(b), \
+														   ESP8266_LOG_ARG(c) })
+#define ESP8266_LOG_WRITE_4(log, format, a, b, c, d) \
+	esp8266_log_write(log, format, 4, (const uint32_t[]) { ESP8266_LOG_ARG(a), ESP8266_LOG_ARG(b), \
+														   ESP8266_LOG_ARG(c), ESP8266_LOG_ARG(d) })
+#define ESP8266_LOG_WRITE_TOO_MANY(...) \
+	(sizeof(char[-1]) == 0)
+
+typedef struct {
+	/* Records that have not been sent, written with interrupts off so that there is one producer */
+	ring_buffer_t ring;
+	uint32_t records;						// records written
+	uint32_t dropped;						// records that did not fit
+
+	/* Sending side, only used from the main loop */
+	const char* formats[ESP8266_LOG_FORMATS];	// formats that have been sent, by id
+	uint8_t next_id;
+	bool started;							// the header has been sent
+	uint32_t reported;						// dropped records that have been sent
+	uint32_t last;							// time of the last record sent
+	uint8_t out[ESP8266_LOG_OUT_SIZE];		// bytes of the item that is being sent
+	uint16_t out_len;
+	uint16_t out_pos;
+} esp8266_log_t;
+
+/**
+ * @brief set up an empty log
+ * @param esp8266_log_t* log
+ * @param uint8_t* buffer, where the records are kept until they are sent
+ * @param uint32_t size, size of the buffer, has to be a power of two
+ * @return bool, false if the size is not a power of two
+ */
+bool
+esp8266_log_init(esp8266_log_t* log, uint8_t* buffer, uint32_t size);
+
+/**
+ * @brief put a record in the log, use ESP8266_LOG instead, it counts the arguments.
+ * 		  Can be called from interrupts.
+ * @param esp8266_log_t* log, NULL to log nothing
+ * @param const char* format, kept as a pointer
+ * @param uint8_t count, number of arguments, up to ESP8266_LOG_MAX_ARGS
+ * @param const uint32_t* args, the arguments, see ESP8266_LOG_ARG, NULL without arguments
+ * @return bool, false if the record did not fit
+ */
+bool
+esp8266_log_write(esp8266_log_t* log, const char* format, uint8_t count, const uint32_t* args);
+
+/**
+ * @brief take the next bytes of the stream, for sending it some other way than ITM
+ * @param esp8266_log_t* log
+ * @param uint8_t* data, where the bytes are stored
+ * @param uint32_t size, max bytes
+ * @return uint32_t, bytes stored, 0 when there are no more records
+ */
+uint32_t
+esp8266_log_read(esp8266_log_t* log, uint8_t* data, uint32_t size);
+
+/**
+ * @brief send the stream on ITM stimulus port ESP8266_LOG_ITM_PORT until it is empty or the
+ * 		  FIFO is full, call it from the main loop
+ * @param esp8266_log_t* log
+ * @return uint32_t, bytes sent
+ */
+uint32_t
+esp8266_log_drain(esp8266_log_t* log);
+
+#endif /* INC_ESP8266_LOG_H_ */
@@ -0,0 +1,58 @@
+/**
+******************************************************************************
+@brief header for the reader of the binary log stream
+@details Puts the lines of a stream of esp8266_log_drain or esp8266_log_read
+		 back together, the way printf would have printed them, see
+		 esp8266_log.h for the stream.
+
+		 The reader formats with snprintf, which the log was made to keep
+		 out of the firmware. It is only built with ESP8266_LOG_READER: the
+		 host build and the Debug configuration, which runs the unit tests,
+		 define it, the Release firmware does not.
+
+@file esp8266_log_reader.h
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_ESP8266_LOG_READER_H_
+#define INC_ESP8266_LOG_READER_H_
+
+#include <esp8266_log.h>
+
+/* Max length of a line from esp8266_log_next, with the '\0' */
+#define ESP8266_LOG_LINE_MAX		128
+
+/* Reads the lines back from a stream, see esp8266_log_next */
+typedef struct {
+	const uint8_t* data;
+	uint32_t len;
+	uint32_t pos;
+	uint32_t time;
+	const uint8_t* formats[ESP8266_LOG_FORMATS];	// in the stream, NULL if not seen yet
+	uint8_t format_len[ESP8266_LOG_FORMATS];
+	uint32_t dropped;
+} esp8266_log_reader_t;
+
+/**
+ * @brief start reading the lines of a stream
+ * @param esp8266_log_reader_t* reader
+ * @param const uint8_t* data, the stream from the start, has to stay there while it is read
+ * @param uint32_t len, bytes of stream
+ * @return bool, false if the stream does not start with the header
+ */
+bool
+esp8266_log_reader_init(esp8266_log_reader_t* reader, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief format the next record of the stream
+ * @param esp8266_log_reader_t* reader
+ * @param char* text, where the line is stored, ESP8266_LOG_LINE_MAX bytes
+ * @param uint32_t* time, where the time of the record is stored, HAL_GetTick when it was logged
+ * @return bool, false at the end of the stream, or at a record that is cut off
+ */
+bool
+esp8266_log_next(esp8266_log_reader_t* reader, char* text, uint32_t* time);
+
+#endif /* INC_ESP8266_LOG_READER_H_ */
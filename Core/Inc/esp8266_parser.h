@@ -0,0 +1,141 @@
+/**
+******************************************************************************
+@brief header for the ESP8266 AT response parser
+@details The parser is fed the bytes from the ESP8266 one at a time and looks
+		 at each byte exactly once. Responses from the module are line based,
+		 so the parser keeps track of which known tokens the current line can
+		 still match, and emits an event when a line is complete. Everything
+		 that does not match a token, such as the command echo, is ignored.
+
+		 A few responses are not line based:
+		 "> "             the CIPSEND prompt, emitted as soon as '>' starts a line
+		 "+IPD,<len>:"    header for incoming data, emitted at the ':' and the
+		 				  following <len> bytes are skipped without being matched
+
+		 With multiple connections (AT+CIPMUX=1) the connection events start
+		 with the link id, such as "0,CONNECT" and "1,CLOSED", and the data
+		 header is "+IPD,<id>,<len>:". The link id is passed in the event.
+
+		 Nothing the module sends can make the parser look at a byte twice or
+		 lose its place for long: lines that do not match are ignored up to
+		 their end, and the data after a +IPD header is at most
+		 ESP8266_PARSER_MAX_PAYLOAD bytes. The fuzz tests in unit_test.c hold
+		 it to that.
+
+		 The parser does not depend on the HAL, so it can be tested and
+		 benchmarked on its own.
+
+@file esp8266_parser.h
+@author agent@local
+@date 16-10-2026
+@version 1.2
+*******************************************************************************/
+
+#ifndef INC_ESP8266_PARSER_H_
+#define INC_ESP8266_PARSER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Max numbers after a token, such as "+IPD,<id>,<len>:" */
+#define ESP8266_PARSER_MAX_VALUES	2
+
+/* Link id of events that are not for a link */
+#define ESP8266_PARSER_NO_LINK		(-1)
+
+/* Link ids are a single digit */
+#define ESP8266_PARSER_MAX_LINK		9
+
+/* Longest +IPD payload, well above the 1460 bytes of a TCP segment. A header with a longer
+ * length, or a link id that is not a digit, is garbled, such as by lost bytes. It is ignored,
+ * so that the answers after it are not skipped as data. */
+#define ESP8266_PARSER_MAX_PAYLOAD	4096
+
+/* Events emitted by the parser */
+typedef enum {
+	ESP8266_EVENT_NONE = 0,
+	ESP8266_EVENT_OK,					// "OK"
+	ESP8266_EVENT_ERROR,				// "ERROR"
+	ESP8266_EVENT_FAIL,					// "FAIL"
+	ESP8266_EVENT_SEND_OK,				// "SEND OK"
+	ESP8266_EVENT_SEND_FAIL,			// "SEND FAIL"
+	ESP8266_EVENT_PROMPT,				// "> " after CIPSEND
+	ESP8266_EVENT_READY,				// "ready", module has booted
+	ESP8266_EVENT_RESET,				// "ets Jan  8 2013,rst cause:..." boot message, module has restarted
+	ESP8266_EVENT_BUSY,					// "busy p..." or "busy s...", module is still working on the last command
+	ESP8266_EVENT_CONNECT,				// "CONNECT"
+	ESP8266_EVENT_CONNECT_FAIL,			// "CONNECT FAIL", only with multiple connections
+	ESP8266_EVENT_CLOSED,				// "CLOSED"
+	ESP8266_EVENT_ALREADY_CONNECTED,	// "ALREADY CONNECTED"
+	ESP8266_EVENT_WIFI_CONNECTED,		// "WIFI CONNECTED"
+	ESP8266_EVENT_WIFI_GOT_IP,			// "WIFI GOT IP"
+	ESP8266_EVENT_WIFI_DISCONNECTED,	// "WIFI DISCONNECT"
+	ESP8266_EVENT_NO_AP,				// "No AP"
+	ESP8266_EVENT_CWJAP,				// "+CWJAP:<n>", value is the error code, 0 if the reply was AP info
+	ESP8266_EVENT_CWMODE,				// "+CWMODE_CUR:<n>", value is the mode
+	ESP8266_EVENT_CIPMUX,				// "+CIPMUX:<n>", value is the mode
+	ESP8266_EVENT_IPD					// "+IPD,<len>:" or "+IPD,<id>,<len>:", value is the length
+} esp8266_event_type_t;
+
+typedef struct {
+	esp8266_event_type_t type;
+	int32_t value;
+	int8_t link;							// link id with multiple connections, ESP8266_PARSER_NO_LINK otherwise
+} esp8266_event_t;
+
+typedef struct {
+	uint8_t state;							// see esp8266_parser.c
+	uint8_t pos;							// position in the current line
+	int8_t link;							// link id at the start of the current line
+	uint32_t candidates;					// bit per token that the current line still matches
+	uint8_t token;							// token that was matched, while reading its values
+	uint8_t value_count;					// number of values read for the token
+	int32_t values[ESP8266_PARSER_MAX_VALUES];
+	uint32_t skip;							// +IPD payload bytes left to skip
+} esp8266_parser_t;
+
+/**
+ * @brief reset the parser to the start of a line
+ * @param esp8266_parser_t* parser
+ * @return void
+ */
+void
+esp8266_parser_init(esp8266_parser_t* parser);
+
+/**
+ * @brief feed one byte to the parser
+ * @param esp8266_parser_t* parser
+ * @param uint8_t c, the byte received from the ESP8266
+ * @param esp8266_event_t* event, filled in if an event was completed by this byte
+ * @return bool, true if an event was emitted
+ */
+bool
+esp8266_parser_feed(esp8266_parser_t* parser, uint8_t c, esp8266_event_t* event);
+
+/**
+ * @brief the caller has taken bytes of the +IPD payload out of the stream itself,
+ * 		  instead of feeding them to the parser
+ * @param esp8266_parser_t* parser
+ * @param uint32_t len, number of payload bytes taken, at most esp8266_parser_payload
+ * @return void
+ */
+void
+esp8266_parser_skip(esp8266_parser_t* parser, uint32_t len);
+
+/**
+ * @brief get the number of +IPD payload bytes that are left, the parser skips these
+ * @param const esp8266_parser_t* parser
+ * @return uint32_t, bytes left, 0 if the parser is not in a payload
+ */
+uint32_t
+esp8266_parser_payload(const esp8266_parser_t* parser);
+
+/**
+ * @brief get the token string for an event, for debugging
+ * @param esp8266_event_type_t type
+ * @return const char*, the token, or "" for ESP8266_EVENT_NONE
+ */
+const char*
+esp8266_parser_event_name(esp8266_event_type_t type);
+
+#endif /* INC_ESP8266_PARSER_H_ */
@@ -0,0 +1,150 @@
+/**
+******************************************************************************
+@brief header for the ESP8266 latency profile
+@details The timing statistics of the driver say how many ms a request took.
+		 The profile measures them in cycles of the DWT cycle counter, in a
+		 histogram, and splits them into the phases a request goes through,
+		 see esp8266_set_profile:
+
+		 	 tx			from the start of the request until the DMA has
+		 	 			sent the last byte of it
+		 	 module		from there until the last bytes received for it
+		 	 			are committed, the time the module thinks and the
+		 	 			time its answer takes on the uart
+		 	 parse		from there until the result, the answer waiting
+		 	 			for esp8266_poll and being parsed
+		 	 total		the three together
+
+		 The answer can not be split from the think time, the DMA does not
+		 tell when its first byte came in, only when the line went idle.
+
+		 A histogram has a bucket for each power of two, the first bucket
+		 holds everything below 2^ESP8266_PROFILE_MIN_BITS cycles, 57 us at
+		 72 MHz. A percentile is the top of the bucket it falls in, it is at
+		 most twice the real value.
+
+		 The cycle counter runs out after 2^32 cycles, 59 s at 72 MHz, which
+		 is longer than any timeout. A host build has no DWT, it has to define
+		 ESP8266_PROFILE_CLOCK as a function that returns a monotonic clock
+		 and ESP8266_PROFILE_CLOCK_HZ as its rate. The host build of
+		 CMakeLists.txt uses host_clock of Host/Src/host_hal.c, the simulated
+		 time in us, which goes forward with the SysTick:
+
+		 	 -DESP8266_PROFILE_CLOCK=host_clock -DESP8266_PROFILE_CLOCK_HZ=1000000
+
+@file esp8266_profile.h
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_ESP8266_PROFILE_H_
+#define INC_ESP8266_PROFILE_H_
+
+#include <main.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The first bucket of a histogram holds the times below 2^ESP8266_PROFILE_MIN_BITS */
+#define ESP8266_PROFILE_MIN_BITS	12
+
+/* Buckets of a histogram, the last one ends at 2^32 */
+#define ESP8266_PROFILE_BUCKETS		(33 - ESP8266_PROFILE_MIN_BITS)
+
+#ifdef ESP8266_PROFILE_CLOCK
+uint32_t ESP8266_PROFILE_CLOCK(void);
+#else
+#define ESP8266_PROFILE_CLOCK_HZ	SystemCoreClock
+#endif
+
+typedef enum {
+	ESP8266_PHASE_TX,
+	ESP8266_PHASE_MODULE,
+	ESP8266_PHASE_PARSE,
+	ESP8266_PHASE_TOTAL,
+	ESP8266_PHASE_COUNT
+} esp8266_phase_t;
+
+typedef struct {
+	uint32_t min;							// clock ticks
+	uint32_t max;
+	uint64_t total;							// for the average
+	uint16_t buckets[ESP8266_PROFILE_BUCKETS];	// stops counting at 65535
+} esp8266_histogram_t;
+
+/* Latencies of a type of request */
+typedef struct {
+	uint32_t count;							// requests with a result, in the histograms
+	uint32_t timeouts;						// requests that timed out, not in the histograms
+	esp8266_histogram_t phases[ESP8266_PHASE_COUNT];
+} esp8266_profile_t;
+
+/**
+ * @brief read the clock of the profile
+ * @return uint32_t, the DWT cycle counter, or ESP8266_PROFILE_CLOCK in a host build
+ */
+static inline uint32_t
+esp8266_profile_clock(void){
+#ifdef ESP8266_PROFILE_CLOCK
+	return ESP8266_PROFILE_CLOCK();
+#else
+	return DWT->CYCCNT;
+#endif
+}
+
+/**
+ * @brief start the DWT cycle counter if it is not running, the debugger leaves it off
+ * @return void
+ */
+void
+esp8266_profile_clock_start(void);
+
+/**
+ * @brief convert clock ticks to us
+ * @param uint32_t ticks
+ * @return uint32_t, us
+ */
+uint32_t
+esp8266_profile_us(uint32_t ticks);
+
+/**
+ * @brief add a time to a histogram
+ * @param esp8266_histogram_t* histogram
+ * @param uint32_t count, times in the histogram before this one
+ * @param uint32_t ticks, the time
+ * @return void
+ */
+void
+esp8266_histogram_add(esp8266_histogram_t* histogram, uint32_t count, uint32_t ticks);
+
+/**
+ * @brief get a percentile from a histogram
+ * @param const esp8266_histogram_t* histogram
+ * @param uint32_t count, times in the histogram
+ * @param uint8_t percent, 1 to 100, such as 99 for the p99
+ * @return uint32_t, ticks that percent of the times are at or below, up to twice too high,
+ * 		   0 for an empty histogram
+ */
+uint32_t
+esp8266_histogram_percentile(const esp8266_histogram_t* histogram, uint32_t count, uint8_t percent);
+
+/**
+ * @brief add a request to a profile
+ * @param esp8266_profile_t* profile
+ * @param const uint32_t* phases, ticks of ESP8266_PHASE_TX to ESP8266_PHASE_PARSE, the total is added up
+ * @return void
+ */
+void
+esp8266_profile_add(esp8266_profile_t* profile, const uint32_t* phases);
+
+/**
+ * @brief print the phases of a profile in us, with min, avg, p99, max and the buckets
+ * 		  that are not empty as top:count
+ * @param const char* name, printed in front
+ * @param const esp8266_profile_t* profile
+ * @return void
+ */
+void
+esp8266_profile_print(const char* name, const esp8266_profile_t* profile);
+
+#endif /* INC_ESP8266_PROFILE_H_ */
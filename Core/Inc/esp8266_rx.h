@@ -0,0 +1,235 @@
+/**
+******************************************************************************
+@brief header for the ESP8266 DMA receive engine
+@details The receive engine replaces the old one-interrupt-per-byte reception.
+		 The UART is set up to receive with DMA into a circular buffer, and the
+		 CPU is only woken up when the line goes idle, or when the DMA has
+		 filled half/all of the buffer. Each wake up just moves the write
+		 position forward, the bytes themselves are read from the buffer by
+		 the driver when it has time for them.
+
+		 The character match of the USART is set to '\n', so the end of every
+		 line the ESP8266 sends wakes the CPU as well. Without it a line that
+		 is followed by more data, such as the +IPD after a SEND OK, is only
+		 seen at the next idle line or half transfer. With it every complete
+		 line is committed to the ring as soon as it is received, and the
+		 parser gets whole lines instead of what happened to be there when
+		 the driver looked.
+
+		 The receiver timeout of the USART says when the ESP8266 has stopped
+		 sending: it fires once the line has been quiet for RX_QUIET_TIME after
+		 the last byte. The idle line event comes after a single character
+		 time, which is too short to tell the end of a response from a pause
+		 between two of its lines. esp8266_rx_quiet is used instead of fixed
+		 delays where the driver has to wait until the module is done, such
+		 as for the boot messages after a reset.
+
+		 The DMA buffer is used as a ring_buffer_t, the DMA is the producer
+		 and the driver is the consumer. Each event commits the bytes the DMA
+		 has written since the last one. If the driver falls more than a lap
+		 behind, the overwritten bytes are skipped and counted as overruns.
+
+		 With flow control the ESP8266 is told to stop sending before that
+		 happens. UART4 has no RTS of its own, so RTS is a GPIO that is raised
+		 by the event that finds RX_FLOW_HIGH bytes unread, and lowered again
+		 when the driver has read the ring down to RX_FLOW_LOW.
+
+@file esp8266_rx.h
+@author agent@local
+@date 16-10-2026
+@version 1.5
+*******************************************************************************/
+
+#ifndef INC_ESP8266_RX_H_
+#define INC_ESP8266_RX_H_
+
+#include <usart.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ring_buffer.h>
+
+/* Size of the circular DMA buffer, has to be a power of two. At 115200 baud this
+ * holds ~180 ms of data, the half transfer interrupt makes sure we never miss a full lap. */
+#define RX_DMA_BUFFER_SIZE		2048
+
+_Static_assert((RX_DMA_BUFFER_SIZE & (RX_DMA_BUFFER_SIZE - 1)) == 0, "RX_DMA_BUFFER_SIZE has to be a power of two");
+
+/* Every ESP8266 response line ends with this */
+#define RX_MATCH_CHARACTER		'\n'
+
+/* ms without a byte before the receiver timeout fires */
+#define RX_QUIET_TIME			20
+
+/* Unread bytes at which RTS is raised and lowered again. The DMA can write half the buffer
+ * between two events, so RX_FLOW_HIGH plus half the buffer has to leave room for the few
+ * bytes the ESP8266 sends after RTS goes up. */
+#define RX_FLOW_HIGH			(RX_DMA_BUFFER_SIZE / 4)
+#define RX_FLOW_LOW				(RX_DMA_BUFFER_SIZE / 8)
+
+typedef struct {
+	UART_HandleTypeDef* huart;				// uart the module is connected to
+	uint8_t buffer[RX_DMA_BUFFER_SIZE];		// DMA target
+	ring_buffer_t ring;						// ring on top of buffer, the DMA produces and the driver consumes
+	uint16_t dma_pos;						// last DMA write position in buffer, only used in the ISR
+	volatile bool stopped;					// reception was aborted by a uart error and needs a restart
+	uint32_t errors;						// number of uart errors that stopped the reception
+	uint32_t lines;							// number of character match interrupts
+	volatile uint32_t timeouts;				// number of receiver timeouts
+	volatile uint16_t timeout_pos;			// DMA write position at the last receiver timeout
+	GPIO_TypeDef* rts_port;					// RTS pin, NULL without flow control
+	uint16_t rts_pin;
+	volatile bool throttled;				// RTS is up, the ESP8266 should not send
+	uint32_t throttles;						// number of times RTS was raised
+} esp8266_rx_t;
+
+/**
+ * @brief reset the receive engine and bind it to a uart. Does not start the reception.
+ * @param esp8266_rx_t* rx, the receive engine
+ * @param UART_HandleTypeDef* huart, uart handle the ESP8266 is connected to
+ * @return void
+ */
+void
+esp8266_rx_init(esp8266_rx_t* rx, UART_HandleTypeDef* huart);
+
+/**
+ * @brief start circular DMA reception with idle line detection
+ * @param esp8266_rx_t* rx, the receive engine
+ * @return HAL_StatusTypeDef, HAL_OK if the reception was started
+ */
+HAL_StatusTypeDef
+esp8266_rx_start(esp8266_rx_t* rx);
+
+/**
+ * @brief move the write position forward. Called from HAL_UARTEx_RxEventCallback, which is
+ * 		  triggered on idle line, half transfer and transfer complete.
+ * @param esp8266_rx_t* rx, the receive engine
+ * @param uint16_t pos, the DMA write position in the buffer, 1 to RX_DMA_BUFFER_SIZE
+ * @return void
+ */
+void
+esp8266_rx_event(esp8266_rx_t* rx, uint16_t pos);
+
+/**
+ * @brief handle the character match and receiver timeout interrupts. The HAL does not handle the
+ * 		  character match, and it takes the receiver timeout as an error that stops the reception.
+ * 		  Called from UART4_IRQHandler before HAL_UART_IRQHandler.
+ * @param esp8266_rx_t* rx, the receive engine
+ * @return void
+ */
+void
+esp8266_rx_irq(esp8266_rx_t* rx);
+
+/**
+ * @brief a line end was received, move the write position forward. Called by esp8266_rx_irq
+ * 		  with the DMA position, and by the unit tests.
+ * @param esp8266_rx_t* rx, the receive engine
+ * @param uint16_t pos, the DMA write position in the buffer, 0 to RX_DMA_BUFFER_SIZE
+ * @return void
+ */
+void
+esp8266_rx_match(esp8266_rx_t* rx, uint16_t pos);
+
+/**
+ * @brief the line has been quiet for RX_QUIET_TIME, move the write position forward. Called by
+ * 		  esp8266_rx_irq with the DMA position, and by the unit tests.
+ * @param esp8266_rx_t* rx, the receive engine
+ * @param uint16_t pos, the DMA write position in the buffer, 0 to RX_DMA_BUFFER_SIZE
+ * @return void
+ */
+void
+esp8266_rx_timeout(esp8266_rx_t* rx, uint16_t pos);
+
+/**
+ * @brief get the position the DMA is writing at, including bytes that have not been committed yet
+ * @param esp8266_rx_t* rx, the receive engine
+ * @return uint16_t, position in the buffer
+ */
+uint16_t
+esp8266_rx_position(esp8266_rx_t* rx);
+
+/**
+ * @brief check if the ESP8266 has stopped sending, that is if the receiver timeout has fired and
+ * 		  nothing has been received after it. Always false before the first byte is received,
+ * 		  since the receiver timeout counts from the last byte.
+ * @param esp8266_rx_t* rx, the receive engine
+ * @return bool, true if the line is quiet
+ */
+bool
+esp8266_rx_quiet(esp8266_rx_t* rx);
+
+/**
+ * @brief turn flow control on or off. RTS is lowered, so the ESP8266 may send.
+ * @param esp8266_rx_t* rx, the receive engine
+ * @param GPIO_TypeDef* port, port of the RTS pin, NULL to turn flow control off
+ * @param uint16_t pin, the RTS pin, set up as output
+ * @return void
+ */
+void
+esp8266_rx_flow(esp8266_rx_t* rx, GPIO_TypeDef* port, uint16_t pin);
+
+/**
+ * @brief mark the reception as stopped. Called from HAL_UART_ErrorCallback, the HAL
+ * 		  aborts the DMA on errors such as overrun. The reception is restarted the
+ * 		  next time the driver reads from the buffer.
+ * @param esp8266_rx_t* rx, the receive engine
+ * @return void
+ */
+void
+esp8266_rx_error(esp8266_rx_t* rx);
+
+/**
+ * @brief get the number of received bytes that have not been read yet
+ * @param esp8266_rx_t* rx, the receive engine
+ * @return uint32_t, number of unread bytes
+ */
+uint32_t
+esp8266_rx_available(esp8266_rx_t* rx);
+
+/**
+ * @brief read received bytes out of the ring
+ * @param esp8266_rx_t* rx, the receive engine
+ * @param uint8_t* dst, where the bytes are copied
+ * @param uint32_t len, max number of bytes to read
+ * @return uint32_t, number of bytes read
+ */
+uint32_t
+esp8266_rx_read(esp8266_rx_t* rx, uint8_t* dst, uint32_t len);
+
+/**
+ * @brief get received bytes where they are in the DMA buffer, without copying them. At the end of
+ * 		  the buffer the rest comes with the next call after esp8266_rx_consume.
+ * @param esp8266_rx_t* rx, the receive engine
+ * @param const uint8_t** data, where the pointer to the bytes is stored. The DMA writes over
+ * 		  them a lap later, so they have to be used right away
+ * @return uint32_t, number of bytes at data, 0 if there is nothing to read
+ */
+uint32_t
+esp8266_rx_peek(esp8266_rx_t* rx, const uint8_t** data);
+
+/**
+ * @brief remove bytes that have been used with esp8266_rx_peek
+ * @param esp8266_rx_t* rx, the receive engine
+ * @param uint32_t len, number of bytes, at most what esp8266_rx_peek returned
+ * @return void
+ */
+void
+esp8266_rx_consume(esp8266_rx_t* rx, uint32_t len);
+
+/**
+ * @brief read one received byte
+ * @param esp8266_rx_t* rx, the receive engine
+ * @param uint8_t* c, where the byte is stored
+ * @return bool, false if there is nothing to read
+ */
+bool
+esp8266_rx_get(esp8266_rx_t* rx, uint8_t* c);
+
+/**
+ * @brief throw away all unread bytes, O(1)
+ * @param esp8266_rx_t* rx, the receive engine
+ * @return void
+ */
+void
+esp8266_rx_flush(esp8266_rx_t* rx);
+
+#endif /* INC_ESP8266_RX_H_ */
@@ -0,0 +1,289 @@
+/**
+******************************************************************************
+@brief header for the simulated ESP8266
+@details A stand-in for the ESP8266 that speaks the AT commands the driver
+		 uses, so the driver can be run, tested and timed without a module,
+		 an access point or a server. It runs on the target, next to the
+		 driver, and needs nothing but the SysTick.
+
+		 The driver is attached to a uart that only exists in RAM. Its
+		 registers are a USART_TypeDef in the simulator, and the HAL works on
+		 them like on a real uart, except that there is no DMA. Once per ms
+		 esp8266_sim_tick does what the uart, the DMA and the module would
+		 have done meanwhile: it takes what the driver transmits, answers it,
+		 and writes the answer into the receive buffer of the driver, calling
+		 the same HAL callbacks as the DMA. Bytes move at the rate of the
+		 uart, 115200 baud, so the times the driver measures are close to
+		 those of a real module.
+
+		 The module knows:
+		 AT, AT+RST         the reset sends the boot messages after ESP8266_SIM_BOOT_TIME
+		 AT+GMR
+		 AT+CWMODE          =<n> and _CUR?, AT+CWJAP= needs station mode
+		 AT+CWJAP           any SSID and password joins
+		 AT+CWQAP, AT+CWAUTOCONN
+		 AT+CIPMUX          =<n> and ?
+		 AT+CIPMODE         =0 and =1
+		 AT+CIPSTART        needs wifi, always connects
+		 AT+CIPSEND         =[<link>,]<len>, and passthrough without a length
+		 AT+CIPCLOSE        with and without a link
+		 AT+UART_CUR        answered with ERROR, the simulated uart has one rate
+		 Everything else is answered with ERROR. Commands are echoed.
+
+		 There is no network. The data the driver sends on a connection is
+		 handed to a remote callback, which plays the server and answers with
+		 esp8266_sim_receive and esp8266_sim_close. The remote is called from
+		 the SysTick interrupt.
+
+		 Instead of answering, the module can play back a trace of a real
+		 module, see esp8266_sim_replay. That way what was seen in the field,
+		 boot garbage, "busy p..." and messages in the middle of answers, can
+		 be played to the driver again and again, as in the field.
+
+		 Faults can be added to see how the driver copes:
+		 esp8266_sim_set_latency   the module takes its time with every answer,
+		 						   a command that comes meanwhile gets "busy p..."
+		 esp8266_sim_set_loss      bytes from the module are lost
+		 esp8266_sim_fail          the next commands of a kind get another answer,
+		 						   such as ERROR, FAIL or nothing at all
+
+		 Usage:
+		 	 static esp8266_t esp;
+		 	 static esp8266_sim_t sim;
+		 	 esp8266_sim_init(&sim, &esp);
+		 	 esp8266_sim_set_remote(&sim, server, NULL);
+		 	 esp8266_init(&esp);
+		 	 esp8266_wifi_init(&esp);
+		 	 ...
+		 	 esp8266_sim_stop(&sim);
+
+		 SysTick_Handler calls esp8266_sim_tick, which does nothing while no
+		 module is simulated.
+
+		 The simulator is only built with ESP8266_SIM defined, which the
+		 Debug configuration does. Without it esp8266_sim.c is empty and the
+		 SysTick does not call it, so it costs nothing in a release build.
+
+@file esp8266_sim.h
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_ESP8266_SIM_H_
+#define INC_ESP8266_SIM_H_
+
+#include <ESP8266.h>
+#include <ring_buffer.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Longest command line, longer ones are answered with ERROR */
+#define ESP8266_SIM_LINE_SIZE		256
+
+/* What the module has to send and the driver has not received yet, has to be a power of two */
+#define ESP8266_SIM_OUT_SIZE		4096
+
+/* ms from the OK of AT+RST to the boot messages */
+#define ESP8266_SIM_BOOT_TIME		100
+
+/* Max data in one +IPD, the payload of a TCP segment */
+#define ESP8266_SIM_IPD_MAX			1460
+
+/* Max number of faults set at once, see esp8266_sim_fail */
+#define ESP8266_SIM_FAULTS			4
+
+typedef struct esp8266_sim esp8266_sim_t;
+
+/**
+ * @brief called from the SysTick interrupt with the data the driver has sent on a connection
+ * @param esp8266_sim_t* sim, the simulated module
+ * @param uint8_t link, the connection, 0 for the single connection
+ * @param const uint8_t* data, the data, only valid during the call
+ * @param uint16_t len, number of bytes
+ * @param void* context, the pointer passed to esp8266_sim_set_remote
+ */
+typedef void (*esp8266_sim_remote_t)(esp8266_sim_t* sim, uint8_t link, const uint8_t* data, uint16_t len,
+									 void* context);
+
+typedef struct {
+	const char* command;				// start of the commands that are answered with reply
+	const char* reply;					// sent after the echo instead of the answer, "" for no answer
+	uint8_t count;						// number of commands left to answer this way
+} esp8266_sim_fault_t;
+
+struct esp8266_sim {
+	UART_HandleTypeDef huart;			// the uart the driver is attached to
+	USART_TypeDef regs;					// its registers
+	esp8266_t* esp;
+	uint32_t time;						// ms since esp8266_sim_init
+
+	/* What the driver sends */
+	char line[ESP8266_SIM_LINE_SIZE];	// command being received
+	uint16_t line_len;
+	bool line_overflow;					// the command did not fit in line
+	uint8_t data[ESP8266_SEND_MAX];		// data after AT+CIPSEND
+	uint16_t data_len;
+	uint16_t data_expected;				// length from AT+CIPSEND, 0 when not receiving data
+	uint8_t data_link;
+	uint8_t plus;						// '+' of the "+++" that ends passthrough
+	uint32_t input_quiet;				// ms since the driver sent the last byte
+
+	/* What the module sends */
+	uint8_t out_buffer[ESP8266_SIM_OUT_SIZE];
+	ring_buffer_t out;
+	uint16_t rx_pos;					// where the next byte goes in the receive buffer of the driver
+	uint32_t hold_until;				// the module is busy until this time and sends nothing
+	uint32_t output_quiet;				// ms since the last byte was received by the driver, for the receiver timeout
+	uint32_t boot_at;					// time of the boot messages after AT+RST, 0 if not resetting
+
+	/* State of the module */
+	uint8_t cwmode;
+	uint8_t cipmux;
+	uint8_t cipmode;
+	bool wifi;
+	bool passthrough;
+	bool links[ESP8266_MAX_LINKS];		// connections that are open
+
+	/* Faults */
+	uint32_t latency;					// ms from a command or data to its answer
+	uint16_t loss;						// one in loss bytes from the module is lost, 0 for none
+	uint32_t seed;
+	esp8266_sim_fault_t faults[ESP8266_SIM_FAULTS];
+
+	/* Replay of a trace, see esp8266_sim_replay */
+	bool replay;						// the answers come from the trace
+	esp8266_trace_reader_t replay_reader;
+	esp8266_trace_record_t replay_record;	// next record to play, len 0 when it has to be read
+	uint32_t replay_sent;				// bytes the driver had sent in the trace up to the next record
+	uint32_t replay_offset;				// time of the simulation at time 0 of the trace
+
+	esp8266_sim_remote_t remote;
+	void* remote_context;
+
+	/* Statistics */
+	uint32_t commands;					// command lines received
+	uint32_t received;					// bytes from the driver
+	uint32_t sent;						// bytes to the driver, including lost ones
+	uint32_t lost;						// bytes lost on purpose, or because the driver was not receiving
+};
+
+/**
+ * @brief reset the simulated module and attach a module of the driver to it. The reception is
+ * 		  not started, see esp8266_init. Only one module is simulated at a time, this one takes
+ * 		  the place of the last.
+ * @param esp8266_sim_t* sim, the simulated module
+ * @param esp8266_t* esp, the module of the driver
+ * @return bool, false if the driver has no room for another module
+ */
+bool
+esp8266_sim_init(esp8266_sim_t* sim, esp8266_t* esp);
+
+/**
+ * @brief stop the simulated module and detach the module of the driver from it
+ * @param esp8266_sim_t* sim, the simulated module
+ * @return void
+ */
+void
+esp8266_sim_stop(esp8266_sim_t* sim);
+
+/**
+ * @brief move the simulated module on by 1 ms. Called from SysTick_Handler.
+ * @return void
+ */
+void
+esp8266_sim_tick(void);
+
+/**
+ * @brief set the server the connections go to
+ * @param esp8266_sim_t* sim, the simulated module
+ * @param esp8266_sim_remote_t remote, called with the data sent, NULL to drop it
+ * @param void* context, passed to the remote
+ * @return void
+ */
+void
+esp8266_sim_set_remote(esp8266_sim_t* sim, esp8266_sim_remote_t remote, void* context);
+
+/**
+ * @brief make the module take its time with every answer
+ * @param esp8266_sim_t* sim, the simulated module
+ * @param uint32_t ms, time from a command or data to the answer
+ * @return void
+ */
+void
+esp8266_sim_set_latency(esp8266_sim_t* sim, uint32_t ms);
+
+/**
+ * @brief lose bytes on their way from the module to the driver
+ * @param esp8266_sim_t* sim, the simulated module
+ * @param uint16_t one_in, one byte in this many is lost, picked at random, 0 for none
+ * @param uint32_t seed, start of the random numbers, the same seed loses the same bytes
+ * @return void
+ */
+void
+esp8266_sim_set_loss(esp8266_sim_t* sim, uint16_t one_in, uint32_t seed);
+
+/**
+ * @brief answer the next commands that start with command with reply, after the echo
+ * @param esp8266_sim_t* sim, the simulated module
+ * @param const char* command, start of the commands, such as "AT+CIPSTART", has to stay valid
+ * @param const char* reply, such as "\r\nERROR\r\n", "" to not answer at all, has to stay valid
+ * @param uint8_t count, number of commands, 0 to remove the fault
+ * @return bool, false if ESP8266_SIM_FAULTS other faults are set
+ */
+bool
+esp8266_sim_fail(esp8266_sim_t* sim, const char* command, const char* reply, uint8_t count);
+
+/**
+ * @brief send data from the server to the driver, as +IPD of at most ESP8266_SIM_IPD_MAX bytes
+ * @param esp8266_sim_t* sim, the simulated module
+ * @param uint8_t link, the connection, 0 for the single connection
+ * @param const uint8_t* data, the data, copied
+ * @param uint16_t len, number of bytes
+ * @return uint16_t, number of bytes queued, less than len if the module has no room for them
+ */
+uint16_t
+esp8266_sim_receive(esp8266_sim_t* sim, uint8_t link, const uint8_t* data, uint16_t len);
+
+/**
+ * @brief close a connection from the server side
+ * @param esp8266_sim_t* sim, the simulated module
+ * @param uint8_t link, the connection, 0 for the single connection
+ * @return void
+ */
+void
+esp8266_sim_close(esp8266_sim_t* sim, uint8_t link);
+
+/**
+ * @brief play back what the module sent in a trace, instead of answering the driver. A record
+ * 		  is held back until the driver has started sending what it had sent before it in the
+ * 		  trace, from there on the time between the records is the time in the trace. What the
+ * 		  driver sends is taken but not looked at, so it has to make the requests the traced
+ * 		  driver made. Latency does not apply, loss does.
+ * @param esp8266_sim_t* sim, the simulated module, after esp8266_sim_init
+ * @param const uint8_t* trace, the records, such as the buffer of an esp8266_trace_t or a dump
+ * 		  without its header, has to stay valid
+ * @param uint32_t len, bytes of records
+ * @return void
+ */
+void
+esp8266_sim_replay(esp8266_sim_t* sim, const uint8_t* trace, uint32_t len);
+
+/**
+ * @brief check if a replay has records left to play
+ * @param esp8266_sim_t* sim, the simulated module
+ * @return bool, false once the last record has been queued, or without a replay
+ */
+bool
+esp8266_sim_replaying(esp8266_sim_t* sim);
+
+/**
+ * @brief send a message of the module's own, such as "WIFI DISCONNECT\r\n"
+ * @param esp8266_sim_t* sim, the simulated module
+ * @param const char* text, sent as it is
+ * @return bool, false if the module has no room for it
+ */
+bool
+esp8266_sim_write(esp8266_sim_t* sim, const char* text);
+
+#endif /* INC_ESP8266_SIM_H_ */
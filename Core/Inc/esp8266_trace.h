@@ -0,0 +1,144 @@
+/**
+******************************************************************************
+@brief header for the ESP8266 uart trace
+@details A trace is everything that went over the uart of a module, with the
+		 time it went, so that what happened in the field can be looked at
+		 and played back later, see esp8266_set_trace and esp8266_sim_replay.
+
+		 The trace is kept in a buffer of the application as records. A
+		 record is bytes that went the same way at the same time:
+
+		 	 header		1 byte, bit 7 set for bytes sent to the module,
+		 	 			clear for bytes received, bits 0-6 the length - 1
+		 	 time		ms since the record before, the first record is at 0.
+		 	 			7 bits per byte, lowest first, bit 7 set on every
+		 	 			byte but the last
+		 	 data		1 to ESP8266_TRACE_RECORD_MAX bytes
+
+		 A received line costs 2 bytes on top of the line, more bytes at
+		 once are split into several records. When the buffer is full the
+		 rest is counted and dropped, the start of the trace is kept.
+
+		 Bytes that are sent are put in the trace when they are queued for the
+		 DMA, bytes that are received when the DMA has written them and the
+		 receive engine commits them, so both are off by the time the DMA
+		 takes, at most a few ms.
+
+		 esp8266_trace_dump sends the trace out on ITM stimulus port
+		 ESP8266_TRACE_ITM_PORT, after an 8 byte header:
+
+		 	 "E8TR", 1 byte ESP8266_TRACE_VERSION, 3 bytes length, lowest first
+
+		 The SWV console of the IDE shows port 0 only, the dump has to be
+		 saved with a trace viewer that records port 1 to a file. A dump can
+		 be put back into the firmware as a const array and played to the
+		 driver with esp8266_sim_replay.
+
+@file esp8266_trace.h
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_ESP8266_TRACE_H_
+#define INC_ESP8266_TRACE_H_
+
+#include <main.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Max bytes in one record, longer pieces are split */
+#define ESP8266_TRACE_RECORD_MAX	128
+
+/* Max size of the header and the time of a record */
+#define ESP8266_TRACE_RECORD_HEAD	6
+
+/* Version of the record format, in the dump header */
+#define ESP8266_TRACE_VERSION		1
+
+/* ITM stimulus port of esp8266_trace_dump, printf uses port 0 */
+#define ESP8266_TRACE_ITM_PORT		1
+
+typedef enum {
+	ESP8266_TRACE_RX,						// received from the module
+	ESP8266_TRACE_TX						// sent to the module
+} esp8266_trace_direction_t;
+
+typedef struct {
+	uint8_t* buffer;
+	uint32_t size;
+	uint32_t len;							// bytes of the buffer used by records
+	uint32_t last;							// HAL_GetTick of the last record
+	uint32_t records;
+	uint32_t bytes[2];						// uart bytes in the records, received and sent
+	uint32_t dropped;						// uart bytes that did not fit
+} esp8266_trace_t;
+
+/* A record read back from a trace */
+typedef struct {
+	esp8266_trace_direction_t direction;
+	uint32_t time;							// ms since the first record
+	const uint8_t* data;					// in the trace
+	uint16_t len;
+} esp8266_trace_record_t;
+
+/* Reads the records of a trace one by one, see esp8266_trace_next */
+typedef struct {
+	const uint8_t* data;
+	uint32_t len;
+	uint32_t pos;
+	uint32_t time;
+} esp8266_trace_reader_t;
+
+/**
+ * @brief set up an empty trace
+ * @param esp8266_trace_t* trace
+ * @param uint8_t* buffer, where the records go
+ * @param uint32_t size, size of the buffer
+ * @return void
+ */
+void
+esp8266_trace_init(esp8266_trace_t* trace, uint8_t* buffer, uint32_t size);
+
+/**
+ * @brief add bytes to the trace, from the main loop or an interrupt
+ * @param esp8266_trace_t* trace
+ * @param esp8266_trace_direction_t direction, which way the bytes went
+ * @param uint32_t time, HAL_GetTick when they went
+ * @param const uint8_t* data
+ * @param uint32_t len
+ * @return bool, false if the bytes did not all fit, the ones that did not are dropped
+ */
+bool
+esp8266_trace_record(esp8266_trace_t* trace, esp8266_trace_direction_t direction, uint32_t time,
+					 const uint8_t* data, uint32_t len);
+
+/**
+ * @brief start reading the records of a trace, or of a dump of one
+ * @param esp8266_trace_reader_t* reader
+ * @param const uint8_t* data, the records, such as the buffer of a trace
+ * @param uint32_t len, bytes of records
+ * @return void
+ */
+void
+esp8266_trace_reader_init(esp8266_trace_reader_t* reader, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief read the next record
+ * @param esp8266_trace_reader_t* reader
+ * @param esp8266_trace_record_t* record, where the record is stored
+ * @return bool, false at the end of the records, or at a record that is cut off
+ */
+bool
+esp8266_trace_next(esp8266_trace_reader_t* reader, esp8266_trace_record_t* record);
+
+/**
+ * @brief send the trace out on ITM stimulus port ESP8266_TRACE_ITM_PORT, with the header.
+ * 		  Blocks until it is all out, at the SWO rate.
+ * @param esp8266_trace_t* trace
+ * @return bool, false if the debugger has not turned on the ITM or the port
+ */
+bool
+esp8266_trace_dump(esp8266_trace_t* trace);
+
+#endif /* INC_ESP8266_TRACE_H_ */
@@ -0,0 +1,177 @@
+/**
+******************************************************************************
+@brief header for the ESP8266 DMA transmit engine
+@details The transmit engine replaces the blocking HAL_UART_Transmit. Data to
+		 send is put in a queue of segments, each a pointer and a length, and
+		 the DMA sends one segment after the other. The transfer complete
+		 interrupt of a segment starts the DMA on the next one, so the CPU only
+		 queues the segments and gets back control right away.
+
+		 Nothing is copied, a segment has to stay untouched until it has been
+		 sent. That way a command prefix, a buffer of the application and a
+		 CRLF can be sent as one, without putting them together in a buffer
+		 first, see esp8266_tx_writev.
+
+		 The segments are written by the main loop and sent from the
+		 interrupt. Like the receive ring, head is only written by the main
+		 loop and tail only by the interrupt, so segments can only be queued
+		 from the main loop, not from a callback. Starting the DMA when it is
+		 idle is done with the interrupts off, so that it can not race with the
+		 interrupt that finds the queue empty.
+
+		 With flow control the ESP8266 holds us back with its RTS, which is
+		 read on a GPIO since UART4 has no CTS of its own. The DMA can not be
+		 paused, so segments are sent in pieces of ESP8266_TX_FLOW_CHUNK and
+		 CTS is checked before each piece. While CTS is up nothing is started,
+		 and esp8266_tx_kick tries again, esp8266_poll calls it each time.
+
+@file esp8266_tx.h
+@author agent@local
+@date 16-10-2026
+@version 1.2
+*******************************************************************************/
+
+#ifndef INC_ESP8266_TX_H_
+#define INC_ESP8266_TX_H_
+
+#include <usart.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* Max number of segments in the queue, has to be a power of two. A HTTP request put together
+ * with esp8266_http_request_init goes out as one writev of up to ESP8266_HTTP_REQUEST_PARTS. */
+#define ESP8266_TX_QUEUE_SIZE		32
+
+_Static_assert((ESP8266_TX_QUEUE_SIZE & (ESP8266_TX_QUEUE_SIZE - 1)) == 0, "ESP8266_TX_QUEUE_SIZE has to be a power of two");
+
+/* Max bytes sent without looking at CTS, with flow control. The receive FIFO of the
+ * ESP8266 is 128 bytes, and its RTS goes up well before it is full. */
+#define ESP8266_TX_FLOW_CHUNK		16
+
+/**
+ * @brief called from the interrupt when a segment has been sent. Do not queue segments from here.
+ * @param void* context, the pointer that was passed with the segment
+ */
+typedef void (*esp8266_tx_callback_t)(void* context);
+
+/* A piece of data for esp8266_tx_writev */
+typedef struct {
+	const char* data;
+	uint16_t len;
+} esp8266_tx_part_t;
+
+typedef struct {
+	const uint8_t* data;
+	uint16_t len;
+	esp8266_tx_callback_t callback;
+	void* context;
+} esp8266_tx_segment_t;
+
+typedef struct {
+	UART_HandleTypeDef* huart;							// uart the module is connected to
+	esp8266_tx_segment_t segments[ESP8266_TX_QUEUE_SIZE];
+	_Atomic uint32_t head;								// segments queued, only written by the main loop
+	_Atomic uint32_t tail;								// segments sent, only written by the interrupt or with the interrupts off
+	volatile bool running;								// the DMA is sending the segment at tail
+	uint16_t offset;									// bytes of the segment at tail that have been sent
+	uint16_t sending;									// bytes the DMA is sending
+	GPIO_TypeDef* cts_port;								// CTS pin, NULL without flow control
+	uint16_t cts_pin;
+	bool held;											// CTS was up the last time we wanted to send
+	uint32_t bytes;										// bytes sent
+	uint32_t errors;									// segments the DMA stopped in the middle of
+	uint32_t stalls;									// number of times CTS held back the transmission
+} esp8266_tx_t;
+
+/**
+ * @brief reset the transmit engine and bind it to a uart. Without a uart nothing is sent, and
+ * 		  esp8266_tx_complete has to be called for each segment instead, which is what the unit tests do.
+ * @param esp8266_tx_t* tx, the transmit engine
+ * @param UART_HandleTypeDef* huart, uart handle the ESP8266 is connected to, can be NULL
+ * @return void
+ */
+void
+esp8266_tx_init(esp8266_tx_t* tx, UART_HandleTypeDef* huart);
+
+/**
+ * @brief turn flow control on or off
+ * @param esp8266_tx_t* tx, the transmit engine
+ * @param GPIO_TypeDef* port, port of the CTS pin, NULL to turn flow control off
+ * @param uint16_t pin, the CTS pin, set up as input
+ * @return void
+ */
+void
+esp8266_tx_flow(esp8266_tx_t* tx, GPIO_TypeDef* port, uint16_t pin);
+
+/**
+ * @brief queue data to send, returns immediately
+ * @param esp8266_tx_t* tx, the transmit engine
+ * @param const uint8_t* data, data to send, has to stay untouched until it has been sent
+ * @param uint16_t len, number of bytes, can be 0
+ * @param esp8266_tx_callback_t callback, called from the interrupt when sent, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if the queue is full
+ */
+bool
+esp8266_tx_write(esp8266_tx_t* tx, const uint8_t* data, uint16_t len,
+				 esp8266_tx_callback_t callback, void* context);
+
+/**
+ * @brief queue several pieces of data to send one after the other, returns immediately.
+ * 		  Either all of them are queued or none.
+ * @param esp8266_tx_t* tx, the transmit engine
+ * @param const esp8266_tx_part_t* parts, the pieces, the data has to stay untouched until it has
+ * 		  been sent. The array itself is not needed after the call.
+ * @param uint8_t count, number of pieces
+ * @param esp8266_tx_callback_t callback, called from the interrupt when the last piece is sent, can be NULL
+ * @param void* context, passed to the callback
+ * @return bool, false if there is not room for all pieces in the queue
+ */
+bool
+esp8266_tx_writev(esp8266_tx_t* tx, const esp8266_tx_part_t* parts, uint8_t count,
+				  esp8266_tx_callback_t callback, void* context);
+
+/**
+ * @brief the DMA is done, start the rest of the segment or the next one. Called from HAL_UART_TxCpltCallback.
+ * @param esp8266_tx_t* tx, the transmit engine
+ * @return void
+ */
+void
+esp8266_tx_complete(esp8266_tx_t* tx);
+
+/**
+ * @brief check if a uart error stopped the DMA in the middle of a segment, and go on with the
+ * 		  next one. Called from HAL_UART_ErrorCallback.
+ * @param esp8266_tx_t* tx, the transmit engine
+ * @return void
+ */
+void
+esp8266_tx_error(esp8266_tx_t* tx);
+
+/**
+ * @brief get the number of segments that can be queued
+ * @param esp8266_tx_t* tx, the transmit engine
+ * @return uint32_t, free segments
+ */
+uint32_t
+esp8266_tx_free(esp8266_tx_t* tx);
+
+/**
+ * @brief start sending the queue if the DMA is idle, such as after CTS held it back
+ * @param esp8266_tx_t* tx, the transmit engine
+ * @return void
+ */
+void
+esp8266_tx_kick(esp8266_tx_t* tx);
+
+/**
+ * @brief check if there is data that has not been sent yet, and start sending it if the DMA
+ * 		  is idle, such as after CTS held it back
+ * @param esp8266_tx_t* tx, the transmit engine
+ * @return bool, true if the queue is not empty
+ */
+bool
+esp8266_tx_busy(esp8266_tx_t* tx);
+
+#endif /* INC_ESP8266_TX_H_ */
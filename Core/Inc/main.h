@@ -59,6 +59,11 @@ void Error_Handler(void);
 
 /* Private defines -----------------------------------------------------------*/
 /* USER CODE BEGIN Private defines */
+/* RTS and CTS to the ESP8266 (its GPIO13 CTS and GPIO15 RTS), see esp8266_set_flow_control */
+#define ESP_RTS_Pin GPIO_PIN_8
+#define ESP_RTS_GPIO_Port GPIOC
+#define ESP_CTS_Pin GPIO_PIN_9
+#define ESP_CTS_GPIO_Port GPIOC
 
 /* USER CODE END Private defines */
 
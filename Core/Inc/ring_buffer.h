@@ -0,0 +1,168 @@
+/**
+******************************************************************************
+@brief header for the single producer, single consumer ring buffer
+@details Lock free byte ring buffer for passing data from one context to
+		 another, such as from the UART interrupt/DMA to the driver.
+		 There can be exactly one producer and one consumer. The producer
+		 only writes head and the consumer only writes tail, so neither needs
+		 to disable interrupts. Both indexes count up forever and are masked
+		 with size - 1 when used, which is why the size has to be a power of
+		 two. The number of bytes in the ring is always head - tail.
+
+		 The data in the ring is published with a release store of head and
+		 picked up with an acquire load of head, so the consumer never sees
+		 the new head before the bytes it covers (and the same for tail in the
+		 other direction).
+
+		 There are two ways to produce data:
+		 ring_buffer_write   copies the data in, whatever does not fit is dropped
+		 ring_buffer_commit  for producers that have already written to the
+		 					 buffer, such as a circular DMA. These can lap the
+		 					 consumer, the consumer then skips the overwritten bytes.
+
+		 Lost bytes are counted in both cases, see ring_buffer_overruns.
+
+		 The consumer can also use the bytes where they are, without copying
+		 them out, with ring_buffer_peek and ring_buffer_consume.
+
+		 ring_buffer_available is for the consumer only, it skips the bytes a
+		 committing producer has written over. The producer, or anyone else
+		 who only wants to know how full the ring is, uses ring_buffer_used,
+		 which writes nothing.
+
+@file ring_buffer.h
+@author agent@local
+@date 16-10-2026
+@version 1.2
+*******************************************************************************/
+
+#ifndef INC_RING_BUFFER_H_
+#define INC_RING_BUFFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+typedef struct {
+	uint8_t* buffer;
+	uint32_t size;					// power of two
+	uint32_t mask;					// size - 1
+	_Atomic uint32_t head;			// total bytes produced, only written by the producer
+	_Atomic uint32_t tail;			// total bytes consumed, only written by the consumer
+	uint32_t dropped;				// bytes that did not fit in ring_buffer_write, only written by the producer
+	uint32_t overwritten;			// bytes that a committing producer wrote over before they were read, only written by the consumer
+	uint32_t high_water;			// most bytes that have been in the ring at once, only written by the producer
+} ring_buffer_t;
+
+/**
+ * @brief set up an empty ring on top of a buffer
+ * @param ring_buffer_t* ring
+ * @param uint8_t* buffer, memory for the ring
+ * @param uint32_t size, size of the buffer, has to be a power of two
+ * @return bool, false if the size is not a power of two
+ */
+bool
+ring_buffer_init(ring_buffer_t* ring, uint8_t* buffer, uint32_t size);
+
+/**
+ * @brief empty the ring and set the indexes back to the start of the buffer. Statistics are kept.
+ * 		  Only safe while the producer is stopped, use ring_buffer_flush otherwise.
+ * @param ring_buffer_t* ring
+ * @return void
+ */
+void
+ring_buffer_reset(ring_buffer_t* ring);
+
+/**
+ * @brief producer: copy bytes into the ring, bytes that do not fit are dropped
+ * @param ring_buffer_t* ring
+ * @param const uint8_t* data
+ * @param uint32_t len
+ * @return uint32_t, number of bytes written
+ */
+uint32_t
+ring_buffer_write(ring_buffer_t* ring, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief producer: publish bytes that were written directly to the buffer, at head & mask and onwards
+ * @param ring_buffer_t* ring
+ * @param uint32_t len, number of new bytes
+ * @return void
+ */
+void
+ring_buffer_commit(ring_buffer_t* ring, uint32_t len);
+
+/**
+ * @brief consumer: get the number of bytes in the ring
+ * @param ring_buffer_t* ring
+ * @return uint32_t, number of bytes that can be read
+ */
+uint32_t
+ring_buffer_available(ring_buffer_t* ring);
+
+/**
+ * @brief either side: get the number of bytes in the ring without changing it, such as
+ * 		  for the producer to check how full it is
+ * @param ring_buffer_t* ring
+ * @return uint32_t, number of bytes in the ring, at most size even when a committing producer
+ * 		   has lapped the consumer
+ */
+uint32_t
+ring_buffer_used(ring_buffer_t* ring);
+
+/**
+ * @brief consumer: copy bytes out of the ring
+ * @param ring_buffer_t* ring
+ * @param uint8_t* dst
+ * @param uint32_t len, max number of bytes to read
+ * @return uint32_t, number of bytes read
+ */
+uint32_t
+ring_buffer_read(ring_buffer_t* ring, uint8_t* dst, uint32_t len);
+
+/**
+ * @brief consumer: read one byte
+ * @param ring_buffer_t* ring
+ * @param uint8_t* c, where the byte is stored
+ * @return bool, false if the ring is empty
+ */
+bool
+ring_buffer_get(ring_buffer_t* ring, uint8_t* c);
+
+/**
+ * @brief consumer: get the bytes at the front of the ring without copying them. Only the bytes up
+ * 		  to the end of the buffer are returned, the rest comes with the next call after
+ * 		  ring_buffer_consume. A committing producer that laps the consumer writes over them.
+ * @param ring_buffer_t* ring
+ * @param const uint8_t** data, where the pointer to the bytes is stored
+ * @return uint32_t, number of bytes at data, 0 if the ring is empty
+ */
+uint32_t
+ring_buffer_peek(ring_buffer_t* ring, const uint8_t** data);
+
+/**
+ * @brief consumer: remove bytes from the front of the ring that have been used in place
+ * @param ring_buffer_t* ring
+ * @param uint32_t len, number of bytes, at most what ring_buffer_peek returned
+ * @return void
+ */
+void
+ring_buffer_consume(ring_buffer_t* ring, uint32_t len);
+
+/**
+ * @brief consumer: throw away everything in the ring, O(1)
+ * @param ring_buffer_t* ring
+ * @return void
+ */
+void
+ring_buffer_flush(ring_buffer_t* ring);
+
+/**
+ * @brief get the total number of bytes lost, either dropped or overwritten
+ * @param ring_buffer_t* ring
+ * @return uint32_t, number of bytes lost
+ */
+uint32_t
+ring_buffer_overruns(ring_buffer_t* ring);
+
+#endif /* INC_RING_BUFFER_H_ */
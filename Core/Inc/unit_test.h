@@ -12,10 +12,73 @@
 void unit_test(void);
 void setUp(void);
 void tearDown(void);
+void test_ring_buffer_size(void);
+void test_ring_buffer_interleaved(void);
+void test_ring_buffer_full(void);
+void test_ring_buffer_flush(void);
+void test_ring_buffer_peek(void);
+void test_ring_buffer_used(void);
+void test_esp8266_rx_wrap_around(void);
+void test_esp8266_rx_overrun(void);
+void test_esp8266_rx_line_match(void);
+void test_esp8266_rx_quiet(void);
+void test_esp8266_rx_flow(void);
+void test_esp8266_rx_payload(void);
+void test_esp8266_tx_order(void);
+void test_esp8266_tx_full(void);
+void test_esp8266_tx_flow(void);
+void test_esp8266_tx_flow_hold(void);
+void test_esp8266_parser_init_transcript(void);
+void test_esp8266_parser_wifi_transcript(void);
+void test_esp8266_parser_http_transcript(void);
+void test_esp8266_parser_multiple_transcript(void);
+void test_esp8266_command_timeout(void);
+void test_esp8266_command_table(void);
+void test_esp8266_long_request(void);
+void test_esp8266_format(void);
+void test_esp8266_baud_range(void);
+void test_esp8266_instances(void);
+void test_esp8266_profile_histogram(void);
+void test_esp8266_http_content_length(void);
+void test_esp8266_http_chunked(void);
+void test_esp8266_http_closed(void);
+void test_esp8266_http_callbacks(void);
+void test_esp8266_http_abort(void);
+void test_esp8266_http_request_builder(void);
+void test_esp8266_sim_init(void);
+void test_esp8266_sim_http(void);
+void test_esp8266_sim_faults(void);
+void test_esp8266_sim_profile(void);
+void test_esp8266_sim_flow_hold(void);
+void test_esp8266_trace_records(void);
+void test_esp8266_trace_capture(void);
+void test_esp8266_trace_replay(void);
+void test_esp8266_parser_fuzz(void);
+void test_esp8266_command_fuzz(void);
+void test_esp8266_log_decode(void);
+void test_esp8266_log_dropped(void);
+void test_esp8266_log_formats(void);
+void test_esp8266_log_sim(void);
+void test_esp8266_parser_benchmark(void);
+void test_esp8266_http_request_benchmark(void);
+void test_esp8266_format_benchmark(void);
+void test_esp8266_sim_benchmark(void);
+void test_esp8266_trace_benchmark(void);
+void test_esp8266_parser_fuzz_benchmark(void);
+void test_esp8266_log_benchmark(void);
 void test_esp8266_init(void);
+void test_esp8266_async(void);
+void test_esp8266_async_timeout(void);
 void test_esp8266_wifi_connect(void);
 void test_esp8266_web_connection(void);
 void test_esp8266_web_request(void);
+void test_esp8266_send_segmented(void);
+void test_esp8266_send_request(void);
+void test_esp8266_link_pool(void);
+void test_esp8266_http_keep_alive_benchmark(void);
+void test_esp8266_stream(void);
+void test_esp8266_baud(void);
+void test_esp8266_flow_control(void);
 void test_esp8266_at_send(char*);
 void test_esp8266_send_data(char*);
 
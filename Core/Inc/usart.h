@@ -32,12 +32,14 @@ extern "C" {
 /* USER CODE END Includes */
 
 extern UART_HandleTypeDef huart4;
+extern UART_HandleTypeDef huart2;
 
 /* USER CODE BEGIN Private defines */
 
 /* USER CODE END Private defines */
 
 void MX_UART4_Init(void);
+void MX_USART2_UART_Init(void);
 
 /* USER CODE BEGIN Prototypes */
 
@@ -18,115 +18,1381 @@
 
 @file ESP8266.c
 @author jonls@kth.se
-@date 06-04-2021
-@version 2
+@author agent@local
+@date 16-10-2026
+@version 3
 *******************************************************************************/
 #include "ESP8266.h"
 
-/* Global variables */
-static uint8_t rx_variable;
-static uint8_t rx_buffer_index = 0;
-static bool error_flag = false;
-static bool fail_flag = false;
-static char rx_buffer[RX_BUFFER_SIZE]; //rx recieve buffer for handling all the ESP8266 data it sends back
+/* The modules that have been attached, for the uart callbacks to find theirs */
+static esp8266_t* instances[ESP8266_MAX_INSTANCES];
+
+/* The module on a uart, NULL if none is attached to it */
+static esp8266_t*
+esp8266_find(UART_HandleTypeDef *huart){
+	for(uint8_t i = 0; i < ESP8266_MAX_INSTANCES; i++){
+		if(instances[i] != NULL && instances[i]->huart->Instance == huart->Instance)
+			return instances[i];
+	}
+	return NULL;
+}
+
+bool
+esp8266_attach(esp8266_t* esp, UART_HandleTypeDef* huart){
+	int8_t slot = -1;
+
+	/* A module that is attached again, or another one on the same uart, takes its place */
+	for(uint8_t i = 0; i < ESP8266_MAX_INSTANCES; i++){
+		if(instances[i] == esp || (instances[i] != NULL && instances[i]->huart->Instance == huart->Instance)){
+			slot = i;
+			break;
+		}
+		if(instances[i] == NULL && slot < 0)
+			slot = i;
+	}
+	if(slot < 0)
+		return false;
+
+	/* Unlinked first, so the callbacks never see it half set up */
+	instances[slot] = NULL;
+	memset(esp, 0, sizeof(*esp));
+	esp->huart = huart;
+	esp->payload_link = ESP8266_PARSER_NO_LINK;
+	esp8266_rx_init(&esp->rx, huart);
+	esp8266_tx_init(&esp->tx, huart);
+	esp8266_parser_init(&esp->parser);
+	instances[slot] = esp;
+	return true;
+}
+
+void
+esp8266_detach(esp8266_t* esp){
+	for(uint8_t i = 0; i < ESP8266_MAX_INSTANCES; i++){
+		if(instances[i] == esp)
+			instances[i] = NULL;
+	}
+}
+
+void
+esp8266_set_flow_pins(esp8266_t* esp, GPIO_TypeDef* rts_port, uint16_t rts_pin,
+					  GPIO_TypeDef* cts_port, uint16_t cts_pin){
+	esp->rts_port = rts_port;
+	esp->rts_pin = rts_pin;
+	esp->cts_port = cts_port;
+	esp->cts_pin = cts_pin;
+}
+
+void
+esp8266_set_trace(esp8266_t* esp, esp8266_trace_t* trace){
+	esp->trace = trace;
+}
+
+/* Put the bytes an event of the receive engine has committed in the trace, head is
+ * where the ring ended before the event. Called from the interrupt. */
+static void
+esp8266_trace_rx(esp8266_t* esp, uint32_t head){
+	ring_buffer_t* ring = &esp->rx.ring;
+	uint32_t len = atomic_load_explicit(&ring->head, memory_order_relaxed) - head;
+
+	if(esp->trace == NULL || len == 0)
+		return;
+
+	/* The new bytes can go across the end of the buffer */
+	uint32_t offset = head & ring->mask;
+	uint32_t first = len < ring->size - offset ? len : ring->size - offset;
+	uint32_t now = HAL_GetTick();
+
+	esp8266_trace_record(esp->trace, ESP8266_TRACE_RX, now, &ring->buffer[offset], first);
+	if(first < len)
+		esp8266_trace_record(esp->trace, ESP8266_TRACE_RX, now, ring->buffer, len - first);
+}
+
+void
+esp8266_set_profile(esp8266_t* esp, esp8266_profile_table_t* profile){
+	if(profile != NULL){
+		memset(profile, 0, sizeof(*profile));
+		esp8266_profile_clock_start();
+	}
+	esp->profile = profile;
+}
+
+void
+esp8266_set_log(esp8266_t* esp, esp8266_log_t* log){
+	esp->log = log;
+}
+
+/* Note when the last bytes for the active request were committed, head is where the
+ * ring ended before the event. Called from the interrupt. */
+static void
+esp8266_profile_rx(esp8266_t* esp, uint32_t head){
+	if(esp->profile != NULL && esp->active && atomic_load_explicit(&esp->rx.ring.head, memory_order_relaxed) != head)
+		esp->profile_received = esp8266_profile_clock();
+}
+
+/* Called from the interrupt when the DMA has sent the last byte of a request */
+static void
+esp8266_profile_sent(void* context){
+	esp8266_t* esp = context;
+	esp->profile_sent = esp8266_profile_clock();
+}
+
+/* Put bytes that are queued for the DMA in the trace */
+static void
+esp8266_trace_tx(esp8266_t* esp, const void* data, uint32_t len){
+	if(esp->trace != NULL)
+		esp8266_trace_record(esp->trace, ESP8266_TRACE_TX, HAL_GetTick(), data, len);
+}
+
+/* Turn flow control on or off on our side */
+static void
+esp8266_flow_pins(esp8266_t* esp, bool enable){
+	esp8266_rx_flow(&esp->rx, enable ? esp->rts_port : NULL, esp->rts_pin);
+	esp8266_tx_flow(&esp->tx, enable ? esp->cts_port : NULL, esp->cts_pin);
+	esp->flow_control = enable;
+}
 
 void
-init_uart_interrupt(void){
-	HAL_UART_Receive_IT(&huart4, &rx_variable, 1);	// change &huart4 to whatever handler you need
+init_uart_interrupt(esp8266_t* esp){
+	esp8266_flow_pins(esp, false);
+	esp8266_rx_init(&esp->rx, esp->huart);
+	esp8266_rx_start(&esp->rx);
+	esp8266_tx_init(&esp->tx, esp->huart);
 }
 
-/* Probably not the most efficient solution
- * each time a byte is received, it is put into the rx_buffer
- * the rx_buffer is used to check for different responses from the esp8266
+/* The DMA fills the receive ring on its own, this is only called when the line
+ * goes idle or the DMA has passed half/end of the ring, so once per burst
+ * instead of once per byte.
  */
 void
-HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
 {
-   if (huart->Instance == UART4) {					 // change UART4 to whatever handler you are using
-      rx_buffer[rx_buffer_index++] = rx_variable;    // Add 1 byte to rx_Buffer
+   esp8266_t* esp = esp8266_find(huart);
+
+   if (esp != NULL) {
+      uint32_t head = atomic_load_explicit(&esp->rx.ring.head, memory_order_relaxed);
+
+      esp8266_rx_event(&esp->rx, Size);
+      esp8266_trace_rx(esp, head);
+      esp8266_profile_rx(esp, head);
    }
-   HAL_UART_Receive_IT(&huart4, &rx_variable, 1); // Clear flags and read next byte
 }
 
-/* djb2 hashing algorithm which is used in mapping sent commands to the right ESP8266 response code.
-   an alternative to using this would be to use some enums or defines instead	 	 	 	 	 	 	 	 */
-const unsigned long
-hash(const char *str) {
-    unsigned long hash = 5381;
-    int c;
+/* Commits the received bytes at the end of every line, so a line that is followed
+ * by more data does not have to wait for the line to go idle.
+ */
+void
+esp8266_uart_irq(UART_HandleTypeDef *huart)
+{
+   esp8266_t* esp = esp8266_find(huart);
+
+   if (esp != NULL) {
+      uint32_t head = atomic_load_explicit(&esp->rx.ring.head, memory_order_relaxed);
 
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + c;
-    return hash;
+      esp8266_rx_irq(&esp->rx);
+      esp8266_trace_rx(esp, head);
+      esp8266_profile_rx(esp, head);
+   }
 }
 
-const char*
-esp8266_send_command(const char* command){
+void
+HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+   esp8266_t* esp = esp8266_find(huart);
 
-	esp8266_clear();
-	HAL_UART_Transmit(&huart4, (uint8_t*) command, strlen(command), 100);
+   if (esp != NULL) {
+      ESP8266_LOG(esp->log, "esp8266 uart error %lx\n", huart->ErrorCode);
+      esp8266_rx_error(&esp->rx);
+      esp8266_tx_error(&esp->tx);
+   }
+}
 
-	// wait for OK or ERROR/FAIL
-	while((strstr(rx_buffer, ESP8266_AT_OK_TERMINATOR) == NULL)){
-		if(strstr(rx_buffer, ESP8266_AT_ERROR) != NULL){
-			error_flag = true;
+void
+HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+   esp8266_t* esp = esp8266_find(huart);
+
+   if (esp != NULL) {
+      esp8266_tx_complete(&esp->tx);
+   }
+}
+
+/* Pass the +IPD data to the receive callback of its connection, straight out of the receive
+ * ring. The parser is told to skip it, so it is never copied or looked at for AT responses.
+ * Returns false if the received bytes are used up before the end of the data.
+ */
+static bool
+esp8266_payload(esp8266_t* esp){
+	esp8266_link_t* link = esp->payload_link != ESP8266_PARSER_NO_LINK ? &esp->links[esp->payload_link] : NULL;
+	esp8266_receive_callback_t receive = link != NULL ? link->receive : esp->single_receive;
+	void* context = link != NULL ? link->receive_context : esp->single_receive_context;
+	const uint8_t* data;
+	uint32_t left;
+
+	while((left = esp8266_parser_payload(&esp->parser)) > 0){
+		uint32_t len = esp8266_rx_peek(&esp->rx, &data);
+		if(len == 0)
+			return false;
+		if(len > left)
+			len = left;
+
+		if(link != NULL)
+			link->received += len;
+		if(receive != NULL)
+			receive(link != NULL ? esp->payload_link : 0, data, len, context);
+
+		esp8266_rx_consume(&esp->rx, len);
+		esp8266_parser_skip(&esp->parser, len);
+	}
+	esp->payload = false;
+	return true;
+}
+
+/* Keep track of the link state from the "<id>,CONNECT" and "<id>,CLOSED" messages */
+static void
+esp8266_link_event(esp8266_t* esp, const esp8266_event_t* event){
+	if(event->link < 0 || event->link >= ESP8266_MAX_LINKS)
+		return;
+
+	esp8266_link_t* link = &esp->links[event->link];
+	switch (event->type) {
+		case ESP8266_EVENT_CONNECT:
+			link->state = ESP8266_LINK_CONNECTED;
 			break;
-		}
-		if(strstr(rx_buffer, ESP8266_AT_FAIL) != NULL){
-			fail_flag = true;
+		case ESP8266_EVENT_CONNECT_FAIL:
+			link->state = ESP8266_LINK_FREE;
 			break;
-		}
-		if(strstr(rx_buffer, "rst") != NULL){
-			fail_flag = true;
+		case ESP8266_EVENT_CLOSED:
+			link->state = ESP8266_LINK_FREE;
+			if(link->receive != NULL)
+				link->receive(event->link, NULL, 0, link->receive_context);
+			break;
+		case ESP8266_EVENT_IPD:
+			esp->payload = true;
+			esp->payload_link = event->link;
 			break;
+		default:
+			break;
+	}
+}
+
+/* Feed received bytes to the parser until it emits an event. Values that get_return
+ * needs are saved from the event as it passes by, and link events are handled.
+ * Returns false if all received bytes are used up without an event.
+ */
+static bool
+esp8266_receive(esp8266_t* esp, esp8266_event_t* event){
+	uint8_t c;
+
+	for(;;){
+		if(esp->payload && !esp8266_payload(esp))
+			return false;
+		if(!esp8266_rx_get(&esp->rx, &c))
+			return false;
+		if(!esp8266_parser_feed(&esp->parser, c, event))
+			continue;
+
+		switch (event->type) {
+			case ESP8266_EVENT_CWMODE:
+				esp->response.cwmode = event->value;
+				break;
+			case ESP8266_EVENT_CIPMUX:
+				esp->response.cipmux = event->value;
+				break;
+			case ESP8266_EVENT_CWJAP:
+				esp->response.cwjap = event->value;
+				break;
+			case ESP8266_EVENT_NO_AP:
+				esp->response.no_ap = true;
+				break;
+			case ESP8266_EVENT_IPD:
+				/* "+IPD,<len>:" on the single connection */
+				if(event->link == ESP8266_PARSER_NO_LINK){
+					esp->payload = true;
+					esp->payload_link = ESP8266_PARSER_NO_LINK;
+					break;
+				}
+				esp8266_link_event(esp, event);
+				break;
+			case ESP8266_EVENT_CLOSED:
+				/* "CLOSED" on the single connection */
+				if(event->link == ESP8266_PARSER_NO_LINK && esp->single_receive != NULL)
+					esp->single_receive(0, NULL, 0, esp->single_receive_context);
+				esp8266_link_event(esp, event);
+				break;
+			case ESP8266_EVENT_CONNECT:
+			case ESP8266_EVENT_CONNECT_FAIL:
+				esp8266_link_event(esp, event);
+				break;
+			default:
+				break;
+		}
+		return true;
+	}
+}
+
+/* The command table, see ESP8266_COMMANDS */
+#define ESP8266_COMMAND_ENTRY(id, command, timeout, expected, result) \
+	[id] = { command, sizeof(command) - 1, timeout, expected, result },
+
+const esp8266_command_t esp8266_commands[ESP8266_CMD_COUNT] = {
+	ESP8266_COMMANDS(ESP8266_COMMAND_ENTRY)
+};
+
+esp8266_command_id_t
+esp8266_command_id(const char* command){
+
+	/* Strings from the table, such as ESP8266_AT */
+	for(uint8_t id = 0; id < ESP8266_CMD_COUNT; id++){
+		if(command == esp8266_commands[id].command)
+			return id;
+	}
+
+	/* Copies, and commands with parameters such as the ones that connect to an access point */
+	for(uint8_t id = 0; id < ESP8266_CMD_COUNT; id++){
+		const esp8266_command_t* entry = &esp8266_commands[id];
+		bool parameters = entry->command[entry->len - 1] == '=';
+
+		if(parameters ? strncmp(command, entry->command, entry->len) == 0
+					  : strcmp(command, entry->command) == 0)
+			return id;
+	}
+	return ESP8266_CMD_OTHER;
+}
+
+uint32_t
+esp8266_get_timeout(esp8266_command_id_t id){
+	if(id < ESP8266_CMD_COUNT)
+		return esp8266_commands[id].timeout;
+	if(id == ESP8266_CMD_DATA)
+		return ESP8266_TIMEOUT_DATA;
+	return ESP8266_TIMEOUT_DEFAULT;
+}
+
+const esp8266_timing_t*
+esp8266_get_timing(esp8266_t* esp, esp8266_command_id_t id){
+	return &esp->timing_table[id];
+}
+
+void
+esp8266_print_timing(esp8266_t* esp){
+	printf("%-14s %6s %8s %6s %6s %6s\n", "request", "count", "timeouts", "min", "avg", "max");
+
+	for(uint8_t id = 0; id <= ESP8266_CMD_DATA; id++){
+		const esp8266_timing_t* timing = &esp->timing_table[id];
+		if(timing->count == 0)
+			continue;
+
+		/* Print the command without the line ending or '=' */
+		const char* name = id == ESP8266_CMD_DATA ? "data" : id == ESP8266_CMD_OTHER ? "other" : esp8266_commands[id].command;
+		int len = (int) strcspn(name, "=\r\n");
+		printf("%-14.*s %6lu %8lu %6lu %6lu %6lu\n", len, name,
+			   (unsigned long) timing->count, (unsigned long) timing->timeouts, (unsigned long) timing->min,
+			   (unsigned long)(timing->total / timing->count), (unsigned long) timing->max);
+	}
+}
+
+const esp8266_profile_t*
+esp8266_get_profile(esp8266_t* esp, esp8266_command_id_t id){
+	return esp->profile != NULL ? &esp->profile->requests[id] : NULL;
+}
+
+void
+esp8266_print_profile(esp8266_t* esp){
+	if(esp->profile == NULL)
+		return;
+
+	printf("%-14s %6s %8s\n  %-12s %8s %8s %8s %8s   %s\n", "request", "count", "timeouts",
+		   "phase (us)", "min", "avg", "p99", "max", "top:count");
+
+	for(uint8_t id = 0; id <= ESP8266_CMD_DATA; id++){
+		const esp8266_profile_t* profile = &esp->profile->requests[id];
+		if(profile->count == 0 && profile->timeouts == 0)
+			continue;
+
+		const char* name = id == ESP8266_CMD_DATA ? "data" : id == ESP8266_CMD_OTHER ? "other" : esp8266_commands[id].command;
+		char command[15];
+		size_t len = strcspn(name, "=\r\n");
+		if(len > sizeof(command) - 1)
+			len = sizeof(command) - 1;
+		memcpy(command, name, len);
+		command[len] = '\0';
+		esp8266_profile_print(command, profile);
+	}
+}
+
+/* Take the later of two clock values that are less than half the clock apart */
+static uint32_t
+esp8266_profile_later(uint32_t a, uint32_t b){
+	return (int32_t)(b - a) > 0 ? b : a;
+}
+
+/* Split the time of the active request into its phases and add it to the profile */
+static void
+esp8266_record_profile(esp8266_t* esp, esp8266_profile_t* profile, bool timeout){
+	if(timeout){
+		profile->timeouts++;
+		return;
+	}
+
+	/* The stamps are read before the clock, so none of them is after it. The answer
+	 * can start before the DMA is done, then there is no module phase. */
+	uint32_t sent = esp8266_profile_later(esp->profile_start, esp->profile_sent);
+	uint32_t received = esp8266_profile_later(sent, esp->profile_received);
+	uint32_t now = esp8266_profile_later(received, esp8266_profile_clock());
+	uint32_t phases[ESP8266_PHASE_TOTAL] = {
+		[ESP8266_PHASE_TX] = sent - esp->profile_start,
+		[ESP8266_PHASE_MODULE] = received - sent,
+		[ESP8266_PHASE_PARSE] = now - received
+	};
+
+	esp8266_profile_add(profile, phases);
+}
+
+/* Save how long a request took, timed out requests are counted with their timeout as time */
+static void
+esp8266_record_timing(esp8266_timing_t* timing, uint32_t ms, bool timeout){
+	if(timing->count == 0 || ms < timing->min)
+		timing->min = ms;
+	if(ms > timing->max)
+		timing->max = ms;
+	timing->total += ms;
+	timing->count++;
+	if(timeout)
+		timing->timeouts++;
+}
+
+static bool
+esp8266_submit(esp8266_t* esp, esp8266_request_type_t type, esp8266_command_id_t id, const char* data, uint32_t len,
+			   uint32_t timeout, esp8266_callback_t callback, void* context){
+
+	/* The length of a request is the length of its DMA segment, it is not cut */
+	if(esp->queue_count == ESP8266_QUEUE_SIZE || len > ESP8266_REQUEST_MAX)
+		return false;
+
+	esp8266_request_t* request = &esp->queue[(esp->queue_first + esp->queue_count) % ESP8266_QUEUE_SIZE];
+	request->type = type;
+	request->id = id;
+	request->data = data;
+	request->len = len;
+	request->parts = NULL;
+	request->timeout = timeout == ESP8266_DEFAULT_TIMEOUT ? esp8266_get_timeout(id) : timeout;
+	request->callback = callback;
+	request->context = context;
+	esp->queue_count++;
+	return true;
+}
+
+bool
+esp8266_send_command_id_async(esp8266_t* esp, esp8266_command_id_t id, const char* command, uint32_t timeout,
+							  esp8266_callback_t callback, void* context){
+	if(command == NULL)
+		command = esp8266_commands[id].command;
+	return esp8266_submit(esp, ESP8266_REQUEST_COMMAND, id, command, strlen(command), timeout, callback, context);
+}
+
+bool
+esp8266_send_parts_async(esp8266_t* esp, esp8266_command_id_t id, const esp8266_tx_part_t* parts, uint8_t count,
+						 uint32_t timeout, esp8266_callback_t callback, void* context){
+	if(!esp8266_submit(esp, ESP8266_REQUEST_COMMAND, id, NULL, count, timeout, callback, context))
+		return false;
+
+	esp->queue[(esp->queue_first + esp->queue_count - 1) % ESP8266_QUEUE_SIZE].parts = parts;
+	return true;
+}
+
+bool
+esp8266_send_command_async(esp8266_t* esp, const char* command, uint32_t timeout,
+						   esp8266_callback_t callback, void* context){
+	return esp8266_submit(esp, ESP8266_REQUEST_COMMAND, esp8266_command_id(command), command, strlen(command),
+						  timeout, callback, context);
+}
+
+bool
+esp8266_send_data_async(esp8266_t* esp, const char* data, uint32_t timeout, esp8266_callback_t callback, void* context){
+	return esp8266_submit(esp, ESP8266_REQUEST_DATA, ESP8266_CMD_DATA, data, strlen(data), timeout, callback, context);
+}
+
+bool
+esp8266_busy(esp8266_t* esp){
+	return esp->queue_count > 0;
+}
+
+/* Remove the first request from the queue and report the result. The request is
+ * removed before the callback is called, so the callback can submit new requests.
+ */
+static void
+esp8266_finish(esp8266_t* esp, const char* result){
+	esp8266_request_t request = esp->queue[esp->queue_first];
+
+	if(esp->active){
+		uint32_t ms = HAL_GetTick() - esp->active_start;
+
+		esp8266_record_timing(&esp->timing_table[request.id], ms, result == ESP8266_TIMEOUT);
+		if(result == ESP8266_TIMEOUT)
+			ESP8266_LOG(esp->log, "esp8266 request %u timed out after %lu ms\n", request.id, ms);
+		if(esp->profile != NULL)
+			esp8266_record_profile(esp, &esp->profile->requests[request.id], result == ESP8266_TIMEOUT);
+	}
+
+	esp->queue_first = (esp->queue_first + 1) % ESP8266_QUEUE_SIZE;
+	esp->queue_count--;
+	esp->active = false;
+
+	if(request.callback != NULL)
+		request.callback(result, request.context);
+}
+
+/* Take the requests with this context out of the queue, except the one being worked on.
+ * The callbacks are not called. */
+static void
+esp8266_cancel(esp8266_t* esp, void* context){
+	uint8_t keep = esp->active ? 1 : 0;
+	uint8_t count = keep;
+
+	for(uint8_t i = keep; i < esp->queue_count; i++){
+		esp8266_request_t* request = &esp->queue[(esp->queue_first + i) % ESP8266_QUEUE_SIZE];
+		if(request->context != context)
+			esp->queue[(esp->queue_first + count++) % ESP8266_QUEUE_SIZE] = *request;
+	}
+	esp->queue_count = count;
+}
+
+/* Clear the flags and the values from the last response */
+static void
+esp8266_reset_response(esp8266_t* esp){
+	esp->error_flag = false;
+	esp->fail_flag = false;
+	esp->response.cwmode = -1;
+	esp->response.cipmux = -1;
+	esp->response.cwjap = -1;
+	esp->response.no_ap = false;
+}
+
+/* Send the first request in the queue */
+static void
+esp8266_start(esp8266_t* esp, esp8266_request_t* request){
+	esp8266_event_t event;
+
+	/* Handle everything received before the request so that it is not taken as the answer.
+	 * Unlike a flush this keeps the data that is coming in on the other links. */
+	while(esp8266_receive(esp, &event));
+
+	if(request->type == ESP8266_REQUEST_COMMAND){
+		esp8266_reset_response(esp);
+	}
+	else if(esp->error_flag || esp->fail_flag){
+		/* if the data is sent after an error, cancel */
+		esp8266_finish(esp, ESP8266_AT_ERROR);
+		return;
+	}
+
+	esp->active_start = HAL_GetTick();
+	if(esp->profile != NULL){
+		esp->profile_start = esp8266_profile_clock();
+		esp->profile_sent = esp->profile_start;
+		esp->profile_received = esp->profile_start;
+	}
+	esp->active = true;
+
+	if(esp->trace != NULL){
+		if(request->parts != NULL){
+			for(uint16_t i = 0; i < request->len; i++)
+				esp8266_trace_tx(esp, request->parts[i].data, request->parts[i].len);
 		}
+		else
+			esp8266_trace_tx(esp, request->data, request->len);
 	}
 
-	//return evaluate(); would more efficient but not as clear in debugging//error handling
-	return get_return(command);
+	/* The DMA sends it, the answer is waited for in esp8266_poll as before */
+	esp8266_tx_callback_t sent = esp->profile != NULL ? esp8266_profile_sent : NULL;
+	bool queued = request->parts != NULL
+				  ? esp8266_tx_writev(&esp->tx, request->parts, request->len, sent, esp)
+				  : esp8266_tx_write(&esp->tx, (const uint8_t*) request->data, request->len, sent, esp);
+	if(!queued)
+		esp8266_finish(esp, ESP8266_AT_ERROR);
+}
+
+static void esp8266_send_done(const char* result, void* context);
+
+/* Length of the segment that starts at offset. The parts are the first segment,
+ * the data after them is cut into segments of ESP8266_SEND_MAX. */
+static uint16_t
+esp8266_send_segment(const esp8266_send_t* send, uint32_t offset){
+	if(offset == 0 && send->parts != NULL)
+		return send->parts_len;
+	return send->len - offset > ESP8266_SEND_MAX ? ESP8266_SEND_MAX : send->len - offset;
+}
+
+/* Queue the next segments, as long as there are less than ESP8266_SEND_WINDOW in flight.
+ * A segment is an AT+CIPSEND and the data, they go in the queue together. */
+static void
+esp8266_send_next(esp8266_send_t* send){
+	esp8266_t* esp = send->esp;
+
+	while(send->queued < send->len && send->in_flight < ESP8266_SEND_WINDOW
+		  && ESP8266_QUEUE_SIZE - esp->queue_count >= 2){
+
+		uint16_t len = esp8266_send_segment(send, send->queued);
+
+		/* At most ESP8266_SEND_WINDOW segments are in flight, so this alternates between the buffers */
+		char* command = send->command[(send->segments + send->in_flight) % ESP8266_SEND_WINDOW];
+		esp8266_format_t format;
+
+		/* AT+CIPSEND=<len> or AT+CIPSEND=<link>,<len> */
+		esp8266_format_init(&format, command, sizeof(send->command[0]));
+		esp8266_format_string(&format, ESP8266_AT_SEND);
+		if(send->link >= 0){
+			esp8266_format_uint(&format, send->link);
+			esp8266_format_string(&format, ",");
+		}
+		esp8266_format_uint(&format, len);
+		esp8266_format_string(&format, "\r\n");
+
+		/* The command has the send as context too, so that esp8266_cancel finds it */
+		esp8266_submit(esp, ESP8266_REQUEST_COMMAND, ESP8266_CMD_SEND, command, esp8266_format_end(&format),
+					   ESP8266_DEFAULT_TIMEOUT, NULL, send);
+		if(send->queued == 0 && send->parts != NULL){
+			esp8266_submit(esp, ESP8266_REQUEST_SEND, ESP8266_CMD_DATA, NULL, send->count,
+						   ESP8266_DEFAULT_TIMEOUT, esp8266_send_done, send);
+			esp->queue[(esp->queue_first + esp->queue_count - 1) % ESP8266_QUEUE_SIZE].parts = send->parts;
+		}
+		else {
+			esp8266_submit(esp, ESP8266_REQUEST_SEND, ESP8266_CMD_DATA,
+						   (const char*) send->data + send->queued - send->parts_len, len,
+						   ESP8266_DEFAULT_TIMEOUT, esp8266_send_done, send);
+		}
+		send->queued += len;
+		send->in_flight++;
+	}
+}
+
+/* Completion callback for the data of a segment, the context is the send */
+static void
+esp8266_send_done(const char* result, void* context){
+	esp8266_send_t* send = context;
+	esp8266_t* esp = send->esp;
+
+	send->in_flight--;
+	if(result == ESP8266_AT_SEND_OK){
+		send->sent += esp8266_send_segment(send, send->sent);
+		send->segments++;
+		if(send->sent < send->len){
+			esp8266_send_next(send);
+			return;
+		}
+	}
+	else {
+		/* The segments after a failed one are not sent */
+		esp8266_cancel(esp, send);
+		send->in_flight = 0;
+	}
+
+	send->busy = false;
+	if(send->callback != NULL)
+		send->callback(result, send->context);
+}
+
+/* Start a send, queues the first segments */
+static bool
+esp8266_send_start(esp8266_t* esp, esp8266_send_t* send, int8_t link, const esp8266_tx_part_t* parts, uint8_t count,
+				   const uint8_t* data, uint32_t len, esp8266_callback_t callback, void* context){
+	uint32_t parts_len = 0;
+
+	for(uint8_t i = 0; i < count; i++)
+		parts_len += parts[i].len;
+
+	if(send->busy || parts_len + len == 0 || parts_len > ESP8266_SEND_MAX || count > ESP8266_TX_QUEUE_SIZE
+	   || ESP8266_QUEUE_SIZE - esp->queue_count < 2)
+		return false;
+
+	send->esp = esp;
+	send->parts = parts_len > 0 ? parts : NULL;
+	send->count = count;
+	send->parts_len = parts_len;
+	send->data = data;
+	send->len = parts_len + len;
+	send->link = link;
+	send->busy = true;
+	send->queued = 0;
+	send->sent = 0;
+	send->in_flight = 0;
+	send->segments = 0;
+	send->callback = callback;
+	send->context = context;
+	esp8266_send_next(send);
+	return true;
+}
+
+/* A send with nothing in flight waits for queue space, the completion of a
+ * segment frees up space but other requests can take it first */
+static void
+esp8266_send_resume(esp8266_t* esp){
+	if(esp->single_send.busy && esp->single_send.in_flight == 0)
+		esp8266_send_next(&esp->single_send);
+
+	for(uint8_t id = 0; id < ESP8266_MAX_LINKS; id++){
+		if(esp->links[id].send.busy && esp->links[id].send.in_flight == 0)
+			esp8266_send_next(&esp->links[id].send);
+	}
+}
+
+bool
+esp8266_send_async(esp8266_t* esp, const uint8_t* data, uint32_t len, esp8266_callback_t callback, void* context){
+	return esp8266_send_start(esp, &esp->single_send, -1, NULL, 0, data, len, callback, context);
+}
+
+bool
+esp8266_sendv_async(esp8266_t* esp, const esp8266_tx_part_t* parts, uint8_t count, const uint8_t* data, uint32_t len,
+					esp8266_callback_t callback, void* context){
+	return esp8266_send_start(esp, &esp->single_send, -1, parts, count, data, len, callback, context);
+}
+
+const esp8266_send_t*
+esp8266_get_send(esp8266_t* esp){
+	return &esp->single_send;
+}
+
+void
+esp8266_poll(esp8266_t* esp){
+	esp8266_event_t event;
+
+	/* Send what CTS held back, the interrupt does not come back for it */
+	esp8266_tx_kick(&esp->tx);
+
+	/* Nothing but the data from the server comes in while streaming */
+	if(esp->streaming){
+		esp8266_rx_flush(&esp->rx);
+		return;
+	}
+
+	esp8266_send_resume(esp);
+
+	if(!esp->active){
+		/* Nothing to do, just keep the receive ring from filling up with unsolicited messages */
+		if(esp->queue_count == 0){
+			while(esp8266_receive(esp, &event));
+			return;
+		}
+		esp8266_start(esp, &esp->queue[esp->queue_first]);
+		if(!esp->active)
+			return;
+	}
+
+	esp8266_request_t* request = &esp->queue[esp->queue_first];
+
+	while(esp8266_receive(esp, &event)){
+
+		if(request->type == ESP8266_REQUEST_DATA){
+			if(event.type == ESP8266_EVENT_CLOSED){
+				esp8266_finish(esp, ESP8266_AT_CLOSED);
+				return;
+			}
+			continue;
+		}
+
+		if(request->type == ESP8266_REQUEST_SEND){
+			if(event.type == ESP8266_EVENT_SEND_OK){
+				esp8266_finish(esp, ESP8266_AT_SEND_OK);
+				return;
+			}
+			if(event.type == ESP8266_EVENT_SEND_FAIL || event.type == ESP8266_EVENT_ERROR){
+				esp->error_flag = true;
+				esp8266_finish(esp, ESP8266_AT_SEND_FAIL);
+				return;
+			}
+			continue;
+		}
+
+		// wait for OK or ERROR/FAIL
+		if(event.type == ESP8266_EVENT_ERROR)
+			esp->error_flag = true;
+		else if(event.type == ESP8266_EVENT_FAIL || event.type == ESP8266_EVENT_RESET)
+			esp->fail_flag = true;
+		else if(event.type != ESP8266_EVENT_OK)
+			continue;
+
+		//return evaluate(esp); would more efficient but not as clear in debugging//error handling
+		esp8266_finish(esp, get_return(esp, request->id));
+		return;
+	}
+
+	/* No answer in time, also counts as an error so that data is not sent after a timed out command */
+	if(request->timeout != ESP8266_NO_TIMEOUT && HAL_GetTick() - esp->active_start >= request->timeout){
+		esp->error_flag = true;
+		esp8266_finish(esp, ESP8266_TIMEOUT);
+	}
+}
+
+/* Completion callback for the blocking functions, saves the result */
+static void
+esp8266_blocking_done(const char* result, void* context){
+	*(const char**) context = result;
+}
+
+/* Submit a request and poll until it is done */
+static const char*
+esp8266_blocking(esp8266_t* esp, esp8266_request_type_t type, esp8266_command_id_t id, const char* data){
+	const char* result = NULL;
+	uint32_t len = strlen(data);
+
+	/* It would never go in the queue */
+	if(len > ESP8266_REQUEST_MAX)
+		return ESP8266_AT_ERROR;
+
+	while(!esp8266_submit(esp, type, id, data, len, ESP8266_DEFAULT_TIMEOUT, esp8266_blocking_done, &result))
+		esp8266_poll(esp);
+
+	while(result == NULL)
+		esp8266_poll(esp);
+
+	return result;
+}
+
+const char*
+esp8266_send_command(esp8266_t* esp, const char* command){
+	return esp8266_blocking(esp, ESP8266_REQUEST_COMMAND, esp8266_command_id(command), command);
+}
+
+const char*
+esp8266_send_command_id(esp8266_t* esp, esp8266_command_id_t id, const char* command){
+	if(command == NULL)
+		command = esp8266_commands[id].command;
+	return esp8266_blocking(esp, ESP8266_REQUEST_COMMAND, id, command);
+}
+
+const char*
+esp8266_send_data(esp8266_t* esp, const char* data){
+	return esp8266_blocking(esp, ESP8266_REQUEST_DATA, ESP8266_CMD_DATA, data);
 }
 
 const char*
-esp8266_send_data(const char* data){
+esp8266_send_parts(esp8266_t* esp, esp8266_command_id_t id, const esp8266_tx_part_t* parts, uint8_t count){
+	const char* result = NULL;
 
-	/* if the function is called after an error, cancel */
-	if(error_flag || fail_flag)
+	while(!esp8266_send_parts_async(esp, id, parts, count, ESP8266_DEFAULT_TIMEOUT, esp8266_blocking_done, &result))
+		esp8266_poll(esp);
+
+	while(result == NULL)
+		esp8266_poll(esp);
+
+	return result;
+}
+
+const char*
+esp8266_send(esp8266_t* esp, const uint8_t* data, uint32_t len){
+	const char* result = NULL;
+
+	while(!esp8266_send_async(esp, data, len, esp8266_blocking_done, &result))
+		esp8266_poll(esp);
+
+	while(result == NULL)
+		esp8266_poll(esp);
+
+	return result;
+}
+
+const char*
+esp8266_sendv(esp8266_t* esp, const esp8266_tx_part_t* parts, uint8_t count, const uint8_t* data, uint32_t len){
+	const char* result = NULL;
+
+	while(!esp8266_sendv_async(esp, parts, count, data, len, esp8266_blocking_done, &result))
+		esp8266_poll(esp);
+
+	while(result == NULL)
+		esp8266_poll(esp);
+
+	return result;
+}
+
+/* Wait for an event that is not the answer to a command, such as the prompt after a command */
+static bool
+esp8266_wait_for_event(esp8266_t* esp, esp8266_event_type_t type, uint32_t timeout){
+	esp8266_event_t event;
+	uint32_t start = HAL_GetTick();
+
+	while(HAL_GetTick() - start < timeout){
+		if(esp8266_receive(esp, &event) && event.type == type)
+			return true;
+	}
+	return false;
+}
+
+/* Wait until the ESP8266 has stopped sending, such as after power on. What comes in
+ * meanwhile is handled like any other unsolicited message. Returns false if it is
+ * still sending after timeout ms.
+ */
+static bool
+esp8266_wait_quiet(esp8266_t* esp, uint32_t timeout){
+	esp8266_event_t event;
+	uint32_t start = HAL_GetTick();
+	uint16_t pos = esp8266_rx_position(&esp->rx);
+
+	while(HAL_GetTick() - start < timeout){
+		while(esp8266_receive(esp, &event));
+
+		/* The receiver timeout has fired after the last byte */
+		if(esp8266_rx_quiet(&esp->rx))
+			return true;
+
+		/* Nothing has come in at all, so there is no last byte for the receiver timeout to count from */
+		if(esp8266_rx_position(&esp->rx) == pos && HAL_GetTick() - start >= RX_QUIET_TIME)
+			return true;
+	}
+	return false;
+}
+
+/* The statistics for a baud rate, a new entry if the rate has not been used.
+ * NULL if the table is full. */
+static esp8266_baud_stats_t*
+esp8266_baud_entry(esp8266_t* esp, uint32_t baud){
+	for(uint8_t i = 0; i < esp->baud_count; i++){
+		if(esp->baud_stats[i].baud == baud)
+			return &esp->baud_stats[i];
+	}
+	if(esp->baud_count == ESP8266_BAUD_MAX_RATES)
+		return NULL;
+
+	esp8266_baud_stats_t* stats = &esp->baud_stats[esp->baud_count++];
+	stats->baud = baud;
+	stats->result = NULL;
+	stats->rate = 0;
+	return stats;
+}
+
+const char*
+esp8266_stream_start(esp8266_t* esp){
+
+	if(esp->streaming || esp8266_busy(esp))
 		return ESP8266_AT_ERROR;
 
-	rx_buffer_index = 0;
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_CIPMODE_PASSTHROUGH, NULL), ESP8266_AT_OK) != 0)
+		return ESP8266_AT_ERROR;
+
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_SEND_PASSTHROUGH, NULL), ESP8266_AT_OK) != 0){
+		esp8266_send_command_id(esp, ESP8266_CMD_CIPMODE_NORMAL, NULL);
+		return ESP8266_AT_ERROR;
+	}
+
+	/* The prompt comes after the OK */
+	if(!esp8266_wait_for_event(esp, ESP8266_EVENT_PROMPT, ESP8266_TIMEOUT_SHORT)){
+		esp8266_send_command_id(esp, ESP8266_CMD_CIPMODE_NORMAL, NULL);
+		return ESP8266_TIMEOUT;
+	}
+
+	esp->streaming = true;
+	esp->stream_stats.bytes = 0;
+	esp->stream_stats.ms = 0;
+	esp->stream_start = HAL_GetTick();
+	return ESP8266_AT_OK;
+}
 
-	memset(rx_buffer, 0, RX_BUFFER_SIZE);
-	HAL_UART_Transmit(&huart4, (uint8_t*) data, strlen(data), 100);
+/* Transmit callback for the stream data, from the interrupt. The context is the module */
+static void
+esp8266_stream_sent(void* context){
+	esp8266_t* esp = context;
 
-	while((strstr(rx_buffer, ESP8266_AT_CLOSED) == NULL));
+	esp->stream_stats.ms = HAL_GetTick() - esp->stream_start;
+}
+
+bool
+esp8266_stream_write(esp8266_t* esp, const uint8_t* data, uint16_t len){
+	if(!esp->streaming || len == 0)
+		return false;
+
+	if(!esp8266_tx_write(&esp->tx, data, len, esp8266_stream_sent, esp))
+		return false;
+	esp8266_trace_tx(esp, data, len);
+	esp->stream_stats.bytes += len;
+	return true;
+}
 
-	return ESP8266_AT_CLOSED;
+bool
+esp8266_stream_busy(esp8266_t* esp){
+	return esp8266_tx_busy(&esp->tx);
 }
 
 const char*
-esp8266_init(void){
+esp8266_stream_stop(esp8266_t* esp){
+	if(!esp->streaming)
+		return ESP8266_AT_ERROR;
+
+	while(esp8266_tx_busy(&esp->tx));
+
+	/* "+++" on its own, with nothing around it */
+	HAL_Delay(ESP8266_STREAM_GUARD_TIME);
+	esp8266_trace_tx(esp, "+++", 3);
+	esp8266_tx_write(&esp->tx, (const uint8_t*) "+++", 3, NULL, NULL);
+	while(esp8266_tx_busy(&esp->tx));
+	HAL_Delay(ESP8266_STREAM_EXIT_TIME);
+
+	/* Throw away what the server sent while streaming */
+	esp->streaming = false;
+	esp8266_clear(esp);
+
+	/* Keep the fastest stream for the rate it ran at */
+	esp8266_baud_stats_t* stats = esp8266_baud_entry(esp, esp8266_get_baud(esp));
+	if(stats != NULL && esp8266_stream_rate(esp) > stats->rate)
+		stats->rate = esp8266_stream_rate(esp);
+
+	return esp8266_send_command_id(esp, ESP8266_CMD_CIPMODE_NORMAL, NULL);
+}
+
+const esp8266_stream_stats_t*
+esp8266_get_stream_stats(esp8266_t* esp){
+	return &esp->stream_stats;
+}
+
+uint32_t
+esp8266_stream_rate(esp8266_t* esp){
+	if(esp->stream_stats.ms == 0)
+		return 0;
+	return (uint32_t)((uint64_t) esp->stream_stats.bytes * 1000 / esp->stream_stats.ms);
+}
+
+/* Check that the uart can make the rate. UART4 and USART2 are clocked from PCLK1, see
+ * SystemClock_Config, and with 16 times oversampling BRR has to be at least 16. */
+static bool
+esp8266_baud_valid(uint32_t baud){
+	uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+
+	if(baud == 0 || pclk / baud < 16)
+		return false;
+
+	uint32_t brr = (pclk + baud / 2) / baud;
+	uint32_t actual = pclk / brr;
+	uint32_t error = actual > baud ? actual - baud : baud - actual;
+	return (uint64_t) error * 100 <= (uint64_t) baud * ESP8266_BAUD_TOLERANCE;
+}
+
+/* Switch the uart to another rate. The transmission has to be done, HAL_UART_Init turns
+ * the uart off while it sets the rate. The reception is started again, which also sets
+ * the receiver timeout for the new rate. */
+static HAL_StatusTypeDef
+esp8266_uart_baud(esp8266_t* esp, uint32_t baud){
+	while(esp8266_tx_busy(&esp->tx));
+
+	HAL_UART_AbortReceive(esp->rx.huart);
+	esp->rx.huart->Init.BaudRate = baud;
+	if(HAL_UART_Init(esp->rx.huart) != HAL_OK)
+		return HAL_ERROR;
+
+	esp8266_clear(esp);
+	return esp8266_rx_start(&esp->rx);
+}
+
+/* Set the uart of the ESP8266, 8 data bits, 1 stop bit and no parity, same as MX_UART4_Init
+ * and MX_USART2_UART_Init. Flow control 3 is both RTS and CTS. */
+static const char*
+esp8266_uart_cur(esp8266_t* esp, uint32_t baud, bool flow){
+	esp8266_format_t format;
+
+	esp8266_format_init(&format, esp->baud_command, sizeof(esp->baud_command));
+	esp8266_format_string(&format, ESP8266_AT_UART_CUR);
+	esp8266_format_uint(&format, baud);
+	esp8266_format_string(&format, flow ? ",8,1,0,3\r\n" : ",8,1,0,0\r\n");
+	return esp8266_send_command_id(esp, ESP8266_CMD_UART_CUR, esp->baud_command);
+}
+
+/* Check the link with AT. The first one can be lost if the ESP8266 has not switched yet */
+static bool
+esp8266_baud_check(esp8266_t* esp){
+
+	/* Let anything sent at the old rate, or while switching, come in and be thrown away */
+	esp8266_wait_quiet(esp, ESP8266_TIMEOUT_SHORT);
+
+	for(uint8_t i = 0; i < ESP8266_BAUD_TRIES; i++){
+		esp8266_clear(esp);
+		if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_AT, NULL), ESP8266_AT_OK) == 0)
+			return true;
+	}
+	return false;
+}
+
+/* Save the result of switching to a rate and pass it on */
+static const char*
+esp8266_baud_result(esp8266_t* esp, uint32_t baud, const char* result){
+	esp8266_baud_stats_t* stats = esp8266_baud_entry(esp, baud);
+
+	if(stats != NULL)
+		stats->result = result;
+	return result;
+}
+
+const char*
+esp8266_set_baud(esp8266_t* esp, uint32_t baud){
+
+	if(esp->streaming || esp8266_busy(esp) || !esp8266_baud_valid(baud))
+		return ESP8266_AT_ERROR;
+
+	uint32_t old = esp8266_get_baud(esp);
+	if(baud == old)
+		return ESP8266_AT_OK;
+
+	const char* result = esp8266_uart_cur(esp, baud, esp->flow_control);
+	if(strcmp(result, ESP8266_AT_OK) != 0)
+		return esp8266_baud_result(esp, baud, result);
+
+	/* The OK was the last thing sent at the old rate */
+	if(esp8266_uart_baud(esp, baud) == HAL_OK && esp8266_baud_check(esp))
+		return esp8266_baud_result(esp, baud, ESP8266_AT_OK);
+
+	/* No answer at the new rate. The ESP8266 may still understand us even if we can not
+	 * read its answers, so it is told to go back before the uart does. */
+	esp8266_uart_cur(esp, old, esp->flow_control);
+
+	if(esp8266_uart_baud(esp, old) != HAL_OK || !esp8266_baud_check(esp))
+		return esp8266_baud_result(esp, baud, ESP8266_TIMEOUT);
+	return esp8266_baud_result(esp, baud, ESP8266_AT_FAIL);
+}
+
+uint32_t
+esp8266_get_baud(esp8266_t* esp){
+	return esp->rx.huart != NULL ? esp->rx.huart->Init.BaudRate : ESP8266_BAUD_DEFAULT;
+}
+
+const char*
+esp8266_set_flow_control(esp8266_t* esp, bool enable){
+
+	if(esp->streaming || esp8266_busy(esp) || (enable && (esp->rts_port == NULL || esp->cts_port == NULL)))
+		return ESP8266_AT_ERROR;
+
+	if(enable == esp->flow_control)
+		return ESP8266_AT_OK;
+
+	/* The OK comes before the ESP8266 starts using its pins */
+	const char* result = esp8266_uart_cur(esp, esp8266_get_baud(esp), enable);
+	if(strcmp(result, ESP8266_AT_OK) != 0)
+		return result;
+
+	esp8266_flow_pins(esp, enable);
+	if(esp8266_baud_check(esp))
+		return ESP8266_AT_OK;
+
+	/* Unwired pins leave the ESP8266 stopped, or us. Without flow control on our side
+	 * the ESP8266 still takes the command, even if its answer does not get through. */
+	esp8266_flow_pins(esp, false);
+	esp8266_uart_cur(esp, esp8266_get_baud(esp), false);
+	return esp8266_baud_check(esp) ? ESP8266_AT_FAIL : ESP8266_TIMEOUT;
+}
+
+bool
+esp8266_get_flow_control(esp8266_t* esp){
+	return esp->flow_control;
+}
+
+void
+esp8266_get_flow_stats(esp8266_t* esp, esp8266_flow_stats_t* stats){
+	stats->overruns = ring_buffer_overruns(&esp->rx.ring);
+	stats->errors = esp->rx.errors;
+	stats->throttles = esp->rx.throttles;
+	stats->stalls = esp->tx.stalls;
+}
+
+const esp8266_baud_stats_t*
+esp8266_get_baud_stats(esp8266_t* esp, uint32_t baud){
+	for(uint8_t i = 0; i < esp->baud_count; i++){
+		if(esp->baud_stats[i].baud == baud)
+			return &esp->baud_stats[i];
+	}
+	return NULL;
+}
+
+void
+esp8266_print_baud(esp8266_t* esp){
+	printf("%-8s %-8s %10s %10s\n", "baud", "result", "line B/s", "stream B/s");
+
+	/* 10 bits per byte with the start and stop bit */
+	for(uint8_t i = 0; i < esp->baud_count; i++){
+		const esp8266_baud_stats_t* stats = &esp->baud_stats[i];
+		printf("%-8lu %-8s %10lu %10lu\n", (unsigned long) stats->baud,
+			   stats->result != NULL ? stats->result : "-",
+			   (unsigned long)(stats->baud / 10), (unsigned long) stats->rate);
+	}
+}
+
+const char*
+esp8266_pool_init(esp8266_t* esp){
+
+	/* Switch to multiple connections */
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_CIPMUX_MULTIPLE, NULL), ESP8266_AT_OK) != 0)
+		return ESP8266_AT_ERROR;
+
+	/* Verify that the esp8266 is configured for multiple connections */
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_CIPMUX_TEST, NULL), ESP8266_AT_CIPMUX_1) != 0)
+		return ESP8266_AT_ERROR;
+
+	memset(esp->links, 0, sizeof(esp->links));
+	return ESP8266_AT_OK;
+}
+
+/* Completion callbacks for the link operations, the context is the link */
+static void
+esp8266_link_opened(const char* result, void* context){
+	esp8266_link_t* link = context;
+
+	link->pending = false;
+	link->state = result == ESP8266_AT_CONNECT ? ESP8266_LINK_CONNECTED : ESP8266_LINK_FREE;
+	if(link->callback != NULL)
+		link->callback(result, link->context);
+}
+
+static void
+esp8266_link_sent(const char* result, void* context){
+	esp8266_link_t* link = context;
+
+	link->pending = false;
+	link->sent += link->send.sent;
+	if(link->callback != NULL)
+		link->callback(result, link->context);
+}
+
+static void
+esp8266_link_closed(const char* result, void* context){
+	esp8266_link_t* link = context;
+
+	link->pending = false;
+	link->state = ESP8266_LINK_FREE;
+	if(link->callback != NULL)
+		link->callback(result, link->context);
+}
+
+int8_t
+esp8266_link_open_async(esp8266_t* esp, const char* type, const char* remote_ip, const char* remote_port,
+						esp8266_receive_callback_t receive, void* receive_context,
+						esp8266_callback_t callback, void* context){
+
+	for(uint8_t id = 0; id < ESP8266_MAX_LINKS; id++){
+		esp8266_link_t* link = &esp->links[id];
+		if(link->state != ESP8266_LINK_FREE || link->pending)
+			continue;
+
+		/* AT+CIPSTART=<link>,"<type>","<remote_ip>",<remote_port> */
+		esp8266_format_t format;
+		esp8266_format_init(&format, link->command, sizeof(link->command));
+		esp8266_format_string(&format, ESP8266_AT_START);
+		esp8266_format_uint(&format, id);
+		esp8266_format_string(&format, ",");
+		esp8266_format_quoted(&format, type);
+		esp8266_format_string(&format, ",");
+		esp8266_format_quoted(&format, remote_ip);
+		esp8266_format_string(&format, ",");
+		esp8266_format_string(&format, remote_port);
+		esp8266_format_string(&format, "\r\n");
+		if(esp8266_format_end(&format) == 0)
+			return -1;
+
+		link->callback = callback;
+		link->context = context;
+		if(!esp8266_send_command_id_async(esp, ESP8266_CMD_START, link->command, ESP8266_DEFAULT_TIMEOUT,
+										  esp8266_link_opened, link))
+			return -1;
+
+		link->state = ESP8266_LINK_CONNECTING;
+		link->pending = true;
+		link->receive = receive;
+		link->receive_context = receive_context;
+		link->sent = 0;
+		link->received = 0;
+		return id;
+	}
+	return -1;
+}
+
+bool
+esp8266_link_send_async(esp8266_t* esp, uint8_t id, const uint8_t* data, uint32_t len,
+						esp8266_callback_t callback, void* context){
+	return esp8266_link_sendv_async(esp, id, NULL, 0, data, len, callback, context);
+}
+
+bool
+esp8266_link_sendv_async(esp8266_t* esp, uint8_t id, const esp8266_tx_part_t* parts, uint8_t count,
+						 const uint8_t* data, uint32_t len, esp8266_callback_t callback, void* context){
+	if(id >= ESP8266_MAX_LINKS)
+		return false;
+
+	esp8266_link_t* link = &esp->links[id];
+	if(link->state != ESP8266_LINK_CONNECTED || link->pending)
+		return false;
+
+	if(!esp8266_send_start(esp, &link->send, id, parts, count, data, len, esp8266_link_sent, link))
+		return false;
+
+	link->callback = callback;
+	link->context = context;
+	link->pending = true;
+	return true;
+}
+
+bool
+esp8266_link_close_async(esp8266_t* esp, uint8_t id, esp8266_callback_t callback, void* context){
+	if(id >= ESP8266_MAX_LINKS)
+		return false;
+
+	esp8266_link_t* link = &esp->links[id];
+	if(link->state != ESP8266_LINK_CONNECTED || link->pending)
+		return false;
+
+	esp8266_format_t format;
+	esp8266_format_init(&format, link->command, sizeof(link->command));
+	esp8266_format_string(&format, ESP8266_AT_STOP_LINK);
+	esp8266_format_uint(&format, id);
+	esp8266_format_string(&format, "\r\n");
+	link->callback = callback;
+	link->context = context;
+	if(!esp8266_send_command_id_async(esp, ESP8266_CMD_STOP_LINK, link->command, ESP8266_DEFAULT_TIMEOUT,
+									  esp8266_link_closed, link))
+		return false;
+
+	link->state = ESP8266_LINK_CLOSING;
+	link->pending = true;
+	return true;
+}
+
+const esp8266_link_t*
+esp8266_get_link(esp8266_t* esp, uint8_t id){
+	return id < ESP8266_MAX_LINKS ? &esp->links[id] : NULL;
+}
+
+void
+esp8266_set_receive(esp8266_t* esp, esp8266_receive_callback_t receive, void* context){
+	esp->single_receive = receive;
+	esp->single_receive_context = context;
+}
+
+const char*
+esp8266_init(esp8266_t* esp){
 
 	/* Init the uart to use here*/
 	//MX_UART4_Init();
 	//HAL_Delay(100);
 
-	/* Enable interrupts for UART4 */
-	init_uart_interrupt();
-	HAL_Delay(100);
+	/* Start DMA reception on the uart of the module */
+	init_uart_interrupt(esp);
+
+	/* Let the esp8266 finish whatever it is sending, such as its boot messages after power on */
+	if(!esp8266_wait_quiet(esp, ESP8266_TIMEOUT_BOOT))
+		return ESP8266_TIMEOUT;
 
 	/* Get OK from esp8266 */
-	if(strcmp(esp8266_send_command(ESP8266_AT), ESP8266_AT_OK) != 0)
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_AT, NULL), ESP8266_AT_OK) != 0)
 		return ESP8266_AT_ERROR;
 
-	/* Esp8266 sends lots of data when first started */
-	HAL_Delay(500);
 	/* Reset the esp8266 */
-	if(strcmp(esp8266_send_command(ESP8266_AT_RST), ESP8266_AT_OK) != 0){
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_RST, NULL), ESP8266_AT_OK) != 0){
 		return ESP8266_AT_ERROR;
 	}
 
+	/* The reset also undoes AT+UART_CUR, the OK was the last thing sent at the old rate */
+	esp8266_flow_pins(esp, false);
+	if(esp8266_get_baud(esp) != ESP8266_BAUD_DEFAULT && esp8266_uart_baud(esp, ESP8266_BAUD_DEFAULT) != HAL_OK)
+		return ESP8266_AT_ERROR;
+
+	/* Esp8266 sends lots of data when it restarts, the last of it is "ready" */
+	if(!esp8266_wait_for_event(esp, ESP8266_EVENT_READY, ESP8266_TIMEOUT_BOOT))
+		return ESP8266_TIMEOUT;
+
 	/* Get OK from esp8266 */
-	if(strcmp(esp8266_send_command(ESP8266_AT), ESP8266_AT_OK) != 0)
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_AT, NULL), ESP8266_AT_OK) != 0)
 		return ESP8266_AT_ERROR;
 
 	/* Disconnect the esp8266 if it auto connects... */
@@ -134,24 +1400,24 @@ esp8266_init(void){
 	 * leave it out. If the module does autoconnect, send ESP8266_AT_CWAUTOCONN.
 	 * The autoconn command also seems to be problematic though...
 	 *
-	 *  if(strcmp(esp8266_send_command(ESP8266_AT_CWQAP), ESP8266_AT_OK) != 0)
+	 *  if(strcmp(esp8266_send_command(esp, ESP8266_AT_CWQAP), ESP8266_AT_OK) != 0)
 	 *	  return ESP8266_AT_ERROR;
 	 */
 
 	/* Set the esp8266 to client mode */
-	if(strcmp(esp8266_send_command(ESP8266_AT_CWMODE_STATION_MODE), ESP8266_AT_OK) != 0)
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_CWMODE_STATION_MODE, NULL), ESP8266_AT_OK) != 0)
 		return ESP8266_AT_ERROR;
 
 	/* Verify that the esp8266 is configured as client */
-	if(strcmp(esp8266_send_command(ESP8266_AT_CWMODE_TEST), ESP8266_AT_CWMODE_1) != 0)
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_CWMODE_TEST, NULL), ESP8266_AT_CWMODE_1) != 0)
 		return ESP8266_AT_ERROR;
 
 	/* Set the esp8266 to use single mode connection */
-	if(strcmp(esp8266_send_command(ESP8266_AT_CIPMUX_SINGLE), ESP8266_AT_OK) != 0)
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_CIPMUX_SINGLE, NULL), ESP8266_AT_OK) != 0)
 		return ESP8266_AT_ERROR;
 
 	/* Verify that the esp8266 is configured as single mode*/
-	if(strcmp(esp8266_send_command(ESP8266_AT_CIPMUX_TEST), ESP8266_AT_CIPMUX_0) != 0)
+	if(strcmp(esp8266_send_command_id(esp, ESP8266_CMD_CIPMUX_TEST, NULL), ESP8266_AT_CIPMUX_0) != 0)
 		return ESP8266_AT_ERROR;
 
 	/* No errors, return OK */
@@ -159,152 +1425,164 @@ esp8266_init(void){
 }
 
 const char*
-esp8266_wifi_init(void){
+esp8266_wifi_init(esp8266_t* esp){
 
-	/* We do a little waiting */
-	HAL_Delay(100);
+	/* Wait until the esp8266 is done talking, it can still be reporting an auto connect */
+	esp8266_wait_quiet(esp, ESP8266_TIMEOUT_SHORT);
 
-	/* Buffers */
-	char wifi_command[256] = {0};
-
-	/* Build the command */
-	esp8266_get_wifi_command(wifi_command);
+	/* AT+CWJAP="SSID","PWD", with the special characters in them escaped */
+	char command[ESP8266_WIFI_COMMAND_SIZE];
+	if(esp8266_get_wifi_command(command, sizeof(command)) == 0)
+		return ESP8266_AT_ERROR;
 
 	/* Connect and return result */
-	return esp8266_send_command(wifi_command);
+	return esp8266_send_command_id(esp, ESP8266_CMD_CWJAP_SET, command);
 }
 
 void
-esp8266_clear(void){
-	rx_buffer_index = 0;
-	error_flag = false;
-	fail_flag = false;
-	memset(rx_buffer, 0, RX_BUFFER_SIZE);
+esp8266_clear(esp8266_t* esp){
+	esp8266_reset_response(esp);
+	esp8266_rx_flush(&esp->rx);
+	esp8266_parser_init(&esp->parser);
+	esp->payload = false;
+	esp->payload_link = ESP8266_PARSER_NO_LINK;
 }
 
-void
-esp8266_get_wifi_command(char* ref){
-	sprintf (ref, "%s\"%s\",\"%s\"\r\n", ESP8266_AT_CWJAP_SET, SSID, PWD);
+uint16_t
+esp8266_get_wifi_command(char* ref, uint16_t size){
+	esp8266_format_t format;
+
+	esp8266_format_init(&format, ref, size);
+	esp8266_format_string(&format, ESP8266_AT_CWJAP_SET);
+	esp8266_format_quoted(&format, SSID);
+	esp8266_format_string(&format, ",");
+	esp8266_format_quoted(&format, PWD);
+	esp8266_format_string(&format, "\r\n");
+	return esp8266_format_end(&format);
 }
 
-void
-esp8266_get_connection_command(char* ref, char* connection_type, char* remote_ip, char* remote_port){
-	sprintf(ref, "%s\"%s\",\"%s\",%s\r\n", ESP8266_AT_START, connection_type, remote_ip, remote_port);
+uint16_t
+esp8266_get_connection_command(char* ref, uint16_t size, const char* connection_type,
+							   const char* remote_ip, const char* remote_port){
+	esp8266_format_t format;
+
+	esp8266_format_init(&format, ref, size);
+	esp8266_format_string(&format, ESP8266_AT_START);
+	esp8266_format_quoted(&format, connection_type);
+	esp8266_format_string(&format, ",");
+	esp8266_format_quoted(&format, remote_ip);
+	esp8266_format_string(&format, ",");
+	esp8266_format_string(&format, remote_port);
+	esp8266_format_string(&format, "\r\n");
+	return esp8266_format_end(&format);
 }
 
-void
-esp8266_get_at_send_command(char* ref, uint8_t len){
-	sprintf(ref, "%s%d\r\n", ESP8266_AT_SEND, len);
+uint16_t
+esp8266_get_at_send_command(char* ref, uint16_t size, uint16_t len){
+	esp8266_format_t format;
+
+	esp8266_format_init(&format, ref, size);
+	esp8266_format_string(&format, ESP8266_AT_SEND);
+	esp8266_format_uint(&format, len);
+	esp8266_format_string(&format, "\r\n");
+	return esp8266_format_end(&format);
 }
 
-uint8_t
-esp8266_http_get_request(char* ref, const char* http_type, char* uri, char* host){
-	sprintf(ref, "%s%s %s\r\n%s%s\r\n%s\r\n\r\n", http_type, uri, HTTP_VERSION, HTTP_HOST, host, HTTP_CONNECTION_CLOSE); // formatting and concatenating http request
-	return (strlen(ref)); // return the length of the request, the length needs to be specified before data can be sent
+uint16_t
+esp8266_http_get_request(char* ref, uint16_t size, const char* http_type, const char* uri, const char* host){
+	esp8266_format_t format;
+
+	/* The length is needed for the AT+CIPSEND before the request can be sent */
+	esp8266_format_init(&format, ref, size);
+	esp8266_format_string(&format, http_type);
+	esp8266_format_string(&format, uri);
+	esp8266_format_string(&format, " ");
+	esp8266_format_string(&format, HTTP_VERSION);
+	esp8266_format_string(&format, "\r\n");
+	esp8266_format_string(&format, HTTP_HOST);
+	esp8266_format_string(&format, host);
+	esp8266_format_string(&format, "\r\n");
+	esp8266_format_string(&format, HTTP_CONNECTION_CLOSE);
+	esp8266_format_string(&format, "\r\n\r\n");
+	return esp8266_format_end(&format);
 }
 
-/* Returns the ESP8266 response code that is in the rx_buffer as a string,
+/* Returns the ESP8266 response code for the last command as a string,
  * this makes debugging and verification through testing easier, at the
  * cost of simplicity.
  */
 const char*
-get_return(const char* command){
+get_return(esp8266_t* esp, esp8266_command_id_t id){
 
-	/* Check for commands that might contain different data than predefined settings,
-	 * such as commands that connect to an access point, holds a http request, etc
-	 */
-	if(strstr(command, ESP8266_AT_CWJAP_SET) != NULL)
-		command = ESP8266_AT_CWJAP_SET;
-	else if(strstr(command, ESP8266_AT_START) != NULL)
-		command = ESP8266_AT_START;
-	else if(strstr(command, ESP8266_AT_SEND) != NULL)
-		command = ESP8266_AT_SEND;
-
-	KEYS return_type = hash(command);
-	switch (return_type) {
-
-		case ESP8266_AT_KEY:
-
-		case ESP8266_AT_GMR_KEY:
-
-		case ESP8266_AT_RST_KEY:
-
-		case ESP8266_AT_CWMODE_STATION_MODE_KEY:
+	if(id >= ESP8266_CMD_COUNT)
+		return ESP8266_NOT_IMPLEMENTED;
 
-		case ESP8266_AT_CIPMUX_KEY:
+	const esp8266_command_t* command = &esp8266_commands[id];
+	switch (command->result) {
 
-		case ESP8266_AT_CWQAP_KEY:
-			return evaluate();
+		case ESP8266_RESULT_BASIC:
+			if(esp->error_flag || esp->fail_flag)
+				return ESP8266_AT_ERROR;
+			return command->expected;
 
-		case ESP8266_AT_CWMODE_TEST_KEY:
-			if(error_flag || fail_flag)
+		case ESP8266_RESULT_CWMODE:
+			if(esp->error_flag || esp->fail_flag)
 				return ESP8266_AT_ERROR;
 			else {
-				if (strstr(rx_buffer, ESP8266_AT_CWMODE_1) != NULL)
+				if (esp->response.cwmode == 1)
 					return ESP8266_AT_CWMODE_1;
-				else if(strstr(rx_buffer, ESP8266_AT_CWMODE_2) != NULL)
+				else if(esp->response.cwmode == 2)
 					return ESP8266_AT_CWMODE_2;
-				else if(strstr(rx_buffer, ESP8266_AT_CWMODE_3) != NULL)
+				else if(esp->response.cwmode == 3)
 					return ESP8266_AT_CWMODE_3;
 				else
 					return ESP8266_AT_UNKNOWN;
 			}
 
-		case ESP8266_AT_CWJAP_TEST_KEY:
-			if(error_flag || fail_flag)
+		case ESP8266_RESULT_CWJAP_TEST:
+			if(esp->error_flag || esp->fail_flag)
 				return ESP8266_AT_ERROR;
 			else {
-				if(strstr(rx_buffer, ESP8266_AT_NO_AP))
+				if(esp->response.no_ap)
 					return ESP8266_AT_WIFI_DISCONNECTED;
 				else
-					return ESP8266_AT_WIFI_CONNECTED;
+					return command->expected;
 			}
 
-		case ESP8266_AT_CWJAP_SET_KEY:
-			if(fail_flag || error_flag){
-				if (strstr(rx_buffer, ESP8266_AT_CWJAP_1) != NULL)
+		case ESP8266_RESULT_CWJAP_SET:
+			if(esp->fail_flag || esp->error_flag){
+				if (esp->response.cwjap == 1)
 					return ESP8266_AT_TIMEOUT;
-				else if((strstr(rx_buffer, ESP8266_AT_CWJAP_2) != NULL))
+				else if(esp->response.cwjap == 2)
 					return ESP8266_AT_WRONG_PWD;
-				else if((strstr(rx_buffer, ESP8266_AT_CWJAP_3) != NULL))
+				else if(esp->response.cwjap == 3)
 					return ESP8266_AT_NO_TARGET;
-				else if((strstr(rx_buffer, ESP8266_AT_CWJAP_4) != NULL))
+				else if(esp->response.cwjap == 4)
 					return ESP8266_AT_CONNECTION_FAIL;
 				else
 					return ESP8266_AT_ERROR;
 			}
 			else
-				return ESP8266_AT_WIFI_CONNECTED;
+				return command->expected;
 
-		case ESP8266_AT_CIPMUX_TEST_KEY:
-			if(error_flag || fail_flag)
+		case ESP8266_RESULT_CIPMUX:
+			if(esp->error_flag || esp->fail_flag)
 				return ESP8266_AT_ERROR;
 			else {
-				if (strstr(rx_buffer, ESP8266_AT_CIPMUX_0) != NULL)
+				if (esp->response.cipmux == 0)
 					return ESP8266_AT_CIPMUX_0;
 				else
 					return ESP8266_AT_CIPMUX_1;
 			}
 
-		case ESP8266_AT_START_KEY:
-			if(error_flag || fail_flag)
-				return ESP8266_AT_ERROR;
-			return ESP8266_AT_CONNECT;
-
-		case ESP8266_AT_SEND_KEY:
-			if(error_flag || fail_flag)
-				return ESP8266_AT_ERROR;
-			return ESP8266_AT_SEND_OK;
-
 		default:
 			return ESP8266_NOT_IMPLEMENTED;
-			break;
 	}
 }
 
 const char*
-evaluate(void){
-	if(error_flag || fail_flag)
+evaluate(esp8266_t* esp){
+	if(esp->error_flag || esp->fail_flag)
 		return ESP8266_AT_ERROR;
 	return ESP8266_AT_OK;
 }
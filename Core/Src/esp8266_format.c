@@ -0,0 +1,78 @@
+/**
+******************************************************************************
+@brief AT command formatter for the ESP8266 wifi-module
+@details Appends strings, quoted strings and decimals to a buffer, see
+		 esp8266_format.h.
+
+@file esp8266_format.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "esp8266_format.h"
+
+/* Append one byte, keeping room for the '\0' */
+static inline bool
+format_put(esp8266_format_t* format, char c){
+	if(format->len + 1 >= format->size){
+		format->overflow = true;
+		return false;
+	}
+	format->buffer[format->len++] = c;
+	return true;
+}
+
+void
+esp8266_format_init(esp8266_format_t* format, char* buffer, uint16_t size){
+	format->buffer = buffer;
+	format->size = size;
+	format->len = 0;
+	format->overflow = size == 0;
+	if(size > 0)
+		buffer[0] = '\0';
+}
+
+void
+esp8266_format_string(esp8266_format_t* format, const char* string){
+	while(*string != '\0' && format_put(format, *string))
+		string++;
+	if(format->size > 0)
+		format->buffer[format->len] = '\0';
+}
+
+void
+esp8266_format_quoted(esp8266_format_t* format, const char* string){
+	bool fits = format_put(format, '"');
+
+	for(; fits && *string != '\0'; string++){
+		if(*string == '"' || *string == ',' || *string == '\\')
+			fits = format_put(format, '\\');
+		if(fits)
+			fits = format_put(format, *string);
+	}
+	if(fits)
+		format_put(format, '"');
+	if(format->size > 0)
+		format->buffer[format->len] = '\0';
+}
+
+void
+esp8266_format_uint(esp8266_format_t* format, uint32_t value){
+	char digits[10];
+	uint8_t count = 0;
+
+	/* The digits come out backwards */
+	do {
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while(value > 0);
+
+	while(count > 0 && format_put(format, digits[--count]));
+	if(format->size > 0)
+		format->buffer[format->len] = '\0';
+}
+
+uint16_t
+esp8266_format_end(const esp8266_format_t* format){
+	return format->overflow ? 0 : format->len;
+}
@@ -0,0 +1,607 @@
+/**
+******************************************************************************
+@brief HTTP client for the ESP8266 wifi-module
+@details Keeps the connection to the server open between requests, see
+		 esp8266_http.h. The response framing reads the status line and the
+		 headers a line at a time, and then counts the body bytes, so the end
+		 of a response is found without keeping the response around. The body
+		 is passed to the callbacks straight from the received data. Requests
+		 are lists of esp8266_tx_part_t that point at the strings they are
+		 made of, so building one costs a few stores per piece.
+
+@file esp8266_http.c
+@author agent@local
+@date 16-10-2026
+@version 1.2
+*******************************************************************************/
+#include "esp8266_http.h"
+#include <ctype.h>
+#include <stdlib.h>
+
+/* Check the name of a header line, header names are case insensitive.
+ * name has to be lower case */
+static bool
+header_is(const char* line, const char* name){
+	while(*name != '\0'){
+		if(tolower((unsigned char) *line++) != *name++)
+			return false;
+	}
+	return true;
+}
+
+/* Check if a header value contains a word, such as "chunked" in "gzip, chunked".
+ * word has to be lower case */
+static bool
+header_has(const char* value, const char* word){
+	for(; *value != '\0'; value++){
+		if(header_is(value, word))
+			return true;
+	}
+	return false;
+}
+
+/* The value of a header line, after the ':' */
+static const char*
+header_value(const char* line){
+	const char* value = strchr(line, ':') + 1;
+
+	while(*value == ' ' || *value == '\t')
+		value++;
+	return value;
+}
+
+/* Read a Content-Length value, digits and nothing but white space after them. No sign, and not
+ * more than fits in content_length, strtoul gives ULONG_MAX when it does not fit in a long */
+static bool
+header_length(const char* value, int32_t* length){
+	char* end;
+
+	if(!isdigit((unsigned char) *value))
+		return false;
+
+	unsigned long n = strtoul(value, &end, 10);
+	while(*end == ' ' || *end == '\t')
+		end++;
+	if(*end != '\0' || n > INT32_MAX)
+		return false;
+
+	*length = (int32_t) n;
+	return true;
+}
+
+/* Reset everything but the callbacks */
+static void
+response_reset(esp8266_http_response_t* response){
+	response->state = ESP8266_HTTP_STATUS_LINE;
+	response->status = 0;
+	response->content_length = ESP8266_HTTP_NO_LENGTH;
+	response->chunked = false;
+	response->close = false;
+	response->remaining = 0;
+	response->body = 0;
+	response->line_len = 0;
+}
+
+/* Pass a header line to the header callback, split into name and value.
+ * Lines without a ':' are not headers and are left out */
+static void
+emit_header(esp8266_http_response_t* response){
+	const esp8266_http_callbacks_t* callbacks = response->callbacks;
+	char* colon = strchr(response->line, ':');
+
+	if(callbacks == NULL || callbacks->header == NULL || colon == NULL)
+		return;
+
+	const char* value = header_value(response->line);
+	*colon = '\0';
+	if(!callbacks->header(response->line, value, callbacks->context))
+		response->state = ESP8266_HTTP_ABORTED;
+}
+
+/* Pass body bytes to the body callback */
+static void
+emit_body(esp8266_http_response_t* response, const uint8_t* data, uint32_t len){
+	const esp8266_http_callbacks_t* callbacks = response->callbacks;
+
+	if(callbacks == NULL || callbacks->body == NULL || len == 0)
+		return;
+
+	if(!callbacks->body(data, len, callbacks->context))
+		response->state = ESP8266_HTTP_ABORTED;
+}
+
+/* The empty line after the headers, work out how the body is framed */
+static void
+end_of_headers(esp8266_http_response_t* response){
+
+	/* 100 Continue, the real response follows */
+	if(response->status < 200){
+		response_reset(response);
+		return;
+	}
+
+	if(response->status == 204 || response->status == 304){
+		response->state = ESP8266_HTTP_DONE;
+	}
+	else if(response->chunked){
+		response->state = ESP8266_HTTP_CHUNK_SIZE;
+	}
+	else if(response->content_length != ESP8266_HTTP_NO_LENGTH){
+		response->remaining = response->content_length;
+		response->state = response->remaining > 0 ? ESP8266_HTTP_BODY : ESP8266_HTTP_DONE;
+	}
+	else {
+		/* No length, the body ends when the server closes the connection */
+		response->close = true;
+		response->state = ESP8266_HTTP_BODY;
+	}
+}
+
+/* A complete line in one of the line based states */
+static void
+end_of_line(esp8266_http_response_t* response){
+	const char* line = response->line;
+
+	switch (response->state) {
+
+		case ESP8266_HTTP_STATUS_LINE:
+			/* HTTP/1.1 200 OK */
+			if(strncmp(line, "HTTP/", 5) != 0 || strchr(line, ' ') == NULL){
+				response->state = ESP8266_HTTP_ERROR;
+				break;
+			}
+			response->status = (uint16_t) strtoul(strchr(line, ' ') + 1, NULL, 10);
+			response->close = strncmp(line, "HTTP/1.0", 8) == 0;
+			response->state = response->status >= 100 ? ESP8266_HTTP_HEADERS : ESP8266_HTTP_ERROR;
+
+			/* 1xx responses are left out, the callbacks only see the real response */
+			if(response->status >= 200 && response->callbacks != NULL && response->callbacks->status != NULL
+			   && !response->callbacks->status(response->status, response->callbacks->context))
+				response->state = ESP8266_HTTP_ABORTED;
+			break;
+
+		case ESP8266_HTTP_HEADERS:
+			if(response->line_len == 0){
+				end_of_headers(response);
+				break;
+			}
+			if(header_is(line, "content-length:")){
+				/* A wrong length would take the next response as body, or the body as the next response */
+				if(!header_length(header_value(line), &response->content_length)){
+					response->state = ESP8266_HTTP_ERROR;
+					break;
+				}
+			}
+			else if(header_is(line, "transfer-encoding:"))
+				response->chunked = header_has(header_value(line), "chunked");
+			else if(header_is(line, "connection:"))
+				response->close = header_has(header_value(line), "close");
+
+			if(response->status >= 200)
+				emit_header(response);
+			break;
+
+		case ESP8266_HTTP_CHUNK_SIZE:
+			/* Hex size, maybe followed by ";extension" which strtoul stops at */
+			if(!isxdigit((unsigned char) line[0])){
+				response->state = ESP8266_HTTP_ERROR;
+				break;
+			}
+			response->remaining = strtoul(line, NULL, 16);
+			response->state = response->remaining > 0 ? ESP8266_HTTP_CHUNK_DATA : ESP8266_HTTP_TRAILER;
+			break;
+
+		case ESP8266_HTTP_CHUNK_END:
+			response->state = response->line_len == 0 ? ESP8266_HTTP_CHUNK_SIZE : ESP8266_HTTP_ERROR;
+			break;
+
+		case ESP8266_HTTP_TRAILER:
+			if(response->line_len == 0)
+				response->state = ESP8266_HTTP_DONE;
+			else
+				emit_header(response);
+			break;
+
+		default:
+			break;
+	}
+}
+
+void
+esp8266_http_response_init(esp8266_http_response_t* response){
+	response->callbacks = NULL;
+	response_reset(response);
+}
+
+void
+esp8266_http_response_callbacks(esp8266_http_response_t* response, const esp8266_http_callbacks_t* callbacks){
+	response->callbacks = callbacks;
+}
+
+uint32_t
+esp8266_http_response_feed(esp8266_http_response_t* response, const uint8_t* data, uint32_t len){
+	uint32_t i = 0;
+
+	while(i < len && response->state < ESP8266_HTTP_DONE){
+
+		/* Body bytes are counted and passed on where they are, without copying them */
+		if(response->state == ESP8266_HTTP_BODY || response->state == ESP8266_HTTP_CHUNK_DATA){
+			uint32_t count = len - i;
+
+			if(response->content_length == ESP8266_HTTP_NO_LENGTH && !response->chunked){
+				response->body += count;
+				emit_body(response, data + i, count);
+				return len;
+			}
+			if(count > response->remaining)
+				count = response->remaining;
+
+			response->remaining -= count;
+			response->body += count;
+			if(response->remaining == 0)
+				response->state = response->state == ESP8266_HTTP_BODY ? ESP8266_HTTP_DONE : ESP8266_HTTP_CHUNK_END;
+			emit_body(response, data + i, count);
+			i += count;
+			continue;
+		}
+
+		uint8_t c = data[i++];
+		if(c == '\n'){
+			response->line[response->line_len] = '\0';
+			end_of_line(response);
+			response->line_len = 0;
+		}
+		else if(c != '\r' && response->line_len < ESP8266_HTTP_LINE_SIZE - 1){
+			response->line[response->line_len++] = c;
+		}
+	}
+	return i;
+}
+
+void
+esp8266_http_response_closed(esp8266_http_response_t* response){
+	if(response->state == ESP8266_HTTP_BODY && response->content_length == ESP8266_HTTP_NO_LENGTH)
+		response->state = ESP8266_HTTP_DONE;
+	else if(response->state < ESP8266_HTTP_DONE)
+		response->state = ESP8266_HTTP_ERROR;
+}
+
+bool
+esp8266_http_response_done(const esp8266_http_response_t* response){
+	return response->state == ESP8266_HTTP_DONE;
+}
+
+void
+esp8266_http_receive(uint8_t link, const uint8_t* data, uint16_t len, void* context){
+	esp8266_http_response_t* response = context;
+
+	(void) link;
+	if(len == 0)
+		esp8266_http_response_closed(response);
+	else
+		esp8266_http_response_feed(response, data, len);
+}
+
+static const char REQUEST_VERSION[]			= " HTTP/1.1\r\nHost: ";
+static const char REQUEST_SEPARATOR[]		= ": ";
+static const char REQUEST_CRLF[]			= "\r\n";
+static const char REQUEST_CONTENT_LENGTH[]	= "Content-Length: ";
+
+/* Add a piece to a request. The last parts are kept for esp8266_http_request_end */
+static bool
+request_add(esp8266_http_request_t* request, const char* data, uint32_t len){
+	if(request->ended || request->count >= ESP8266_HTTP_REQUEST_PARTS - ESP8266_HTTP_REQUEST_END_PARTS
+	   || request->len + len > ESP8266_SEND_MAX){
+		request->overflow = true;
+		return false;
+	}
+	request->parts[request->count].data = data;
+	request->parts[request->count].len = (uint16_t) len;
+	request->count++;
+	request->len += len;
+	return true;
+}
+
+void
+esp8266_http_request_init(esp8266_http_request_t* request, const char* method, const char* uri, const char* host){
+	request->count = 0;
+	request->len = 0;
+	request->body = NULL;
+	request->body_len = 0;
+	request->ended = false;
+	request->overflow = false;
+
+	/* <method> <uri> HTTP/1.1\r\nHost: <host>, each line is ended by the start of the next one */
+	request_add(request, method, strlen(method));
+	request_add(request, uri, strlen(uri));
+	request_add(request, REQUEST_VERSION, sizeof(REQUEST_VERSION) - 1);
+	request_add(request, host, strlen(host));
+}
+
+bool
+esp8266_http_request_header(esp8266_http_request_t* request, const char* name, const char* value){
+
+	/* A header is added whole or not at all */
+	if(request->count + ESP8266_HTTP_HEADER_PARTS > ESP8266_HTTP_REQUEST_PARTS - ESP8266_HTTP_REQUEST_END_PARTS){
+		request->overflow = true;
+		return false;
+	}
+
+	/* \r\n<name>: <value> */
+	return request_add(request, REQUEST_CRLF, sizeof(REQUEST_CRLF) - 1)
+		   && request_add(request, name, strlen(name))
+		   && request_add(request, REQUEST_SEPARATOR, sizeof(REQUEST_SEPARATOR) - 1)
+		   && request_add(request, value, strlen(value));
+}
+
+bool
+esp8266_http_request_headers(esp8266_http_request_t* request, const esp8266_http_header_t* headers, uint8_t count){
+	for(uint8_t i = 0; i < count; i++){
+		if(!esp8266_http_request_header(request, headers[i].name, headers[i].value))
+			return false;
+	}
+	return true;
+}
+
+bool
+esp8266_http_request_end(esp8266_http_request_t* request, const uint8_t* body, uint32_t len){
+	esp8266_format_t format;
+
+	/* Without a body there is nothing to send len bytes from */
+	if(request->ended || request->overflow || (body == NULL && len != 0)){
+		request->overflow = true;
+		return false;
+	}
+
+	/* \r\nContent-Length: <len>\r\n\r\n, or only the empty line without a body */
+	esp8266_format_init(&format, request->content_length, sizeof(request->content_length));
+	esp8266_format_string(&format, REQUEST_CRLF);
+	if(body != NULL){
+		esp8266_format_string(&format, REQUEST_CONTENT_LENGTH);
+		esp8266_format_uint(&format, len);
+		esp8266_format_string(&format, REQUEST_CRLF);
+	}
+	esp8266_format_string(&format, REQUEST_CRLF);
+
+	uint16_t end_len = esp8266_format_end(&format);
+	if(request->len + end_len > ESP8266_SEND_MAX){
+		request->overflow = true;
+		return false;
+	}
+	request->parts[request->count].data = request->content_length;
+	request->parts[request->count].len = end_len;
+	request->count++;
+	request->len += end_len;
+
+	/* The start of the body fills up the first AT+CIPSEND */
+	uint32_t first = ESP8266_SEND_MAX - request->len;
+	if(first > len)
+		first = len;
+	if(first > 0){
+		request->parts[request->count].data = (const char*) body;
+		request->parts[request->count].len = (uint16_t) first;
+		request->count++;
+		request->len += first;
+	}
+	request->body = body != NULL ? body + first : NULL;
+	request->body_len = len - first;
+	request->ended = true;
+	return true;
+}
+
+uint32_t
+esp8266_http_request_length(const esp8266_http_request_t* request){
+	if(!request->ended || request->overflow)
+		return 0;
+	return request->len + request->body_len;
+}
+
+bool
+esp8266_http_request_send_async(esp8266_t* esp, const esp8266_http_request_t* request,
+								esp8266_callback_t callback, void* context){
+	if(esp8266_http_request_length(request) == 0)
+		return false;
+	return esp8266_sendv_async(esp, request->parts, request->count, request->body, request->body_len, callback, context);
+}
+
+bool
+esp8266_http_request_link_send_async(esp8266_t* esp, uint8_t link, const esp8266_http_request_t* request,
+									 esp8266_callback_t callback, void* context){
+	if(esp8266_http_request_length(request) == 0)
+		return false;
+	return esp8266_link_sendv_async(esp, link, request->parts, request->count, request->body, request->body_len,
+									callback, context);
+}
+
+/* The request is done, either way. The callback can start the next request */
+static void
+client_finish(esp8266_http_client_t* client, const char* result){
+	client->busy = false;
+
+	if(strcmp(result, ESP8266_AT_OK) == 0){
+		client->requests++;
+		/* The server closes the connection after this response, so it can not be used again.
+		 * The next request opens a new link instead of waiting for the CLOSED */
+		if(client->response.close)
+			client->link = -1;
+	}
+
+	if(client->callback != NULL)
+		client->callback(result, client->context);
+}
+
+/* Finish the request if the response is complete, or could not be read */
+static void
+client_check(esp8266_http_client_t* client){
+	/* The rest of the response would come in as the start of the next one */
+	if(client->response.state == ESP8266_HTTP_ERROR){
+		esp8266_http_client_close(client);
+		client_finish(client, ESP8266_AT_ERROR);
+	}
+	else if(client->response.state == ESP8266_HTTP_ABORTED){
+		esp8266_http_client_close(client);
+		client_finish(client, ESP8266_ABORTED);
+	}
+	else if(client->sent && esp8266_http_response_done(&client->response)){
+		client_finish(client, ESP8266_AT_OK);
+	}
+}
+
+/* Receive callback for the link of the client */
+static void
+client_received(uint8_t link, const uint8_t* data, uint16_t len, void* context){
+	esp8266_http_client_t* client = context;
+
+	if(link != client->link)
+		return;
+
+	if(len == 0){
+		client->link = -1;
+		if(client->busy){
+			esp8266_http_response_closed(&client->response);
+			client_check(client);
+		}
+		return;
+	}
+
+	/* Anything outside a request is dropped */
+	if(client->busy){
+		esp8266_http_response_feed(&client->response, data, len);
+		client_check(client);
+	}
+}
+
+static void
+client_sent(const char* result, void* context){
+	esp8266_http_client_t* client = context;
+
+	if(!client->busy)
+		return;
+
+	if(strcmp(result, ESP8266_AT_SEND_OK) != 0){
+		client_finish(client, result);
+		return;
+	}
+	client->sent = true;
+	client_check(client);
+}
+
+/* Send the request of the client on its link */
+static bool
+client_send(esp8266_http_client_t* client){
+	if(client->built != NULL)
+		return esp8266_http_request_link_send_async(client->esp, client->link, client->built, client_sent, client);
+	return esp8266_link_send_async(client->esp, client->link, (const uint8_t*) client->request,
+								   strlen(client->request), client_sent, client);
+}
+
+static void
+client_opened(const char* result, void* context){
+	esp8266_http_client_t* client = context;
+
+	if(!client->busy)
+		return;
+
+	if(strcmp(result, ESP8266_AT_CONNECT) != 0){
+		client->link = -1;
+		client_finish(client, result);
+		return;
+	}
+
+	client->connects++;
+	if(!client_send(client))
+		client_finish(client, ESP8266_AT_ERROR);
+}
+
+void
+esp8266_http_client_init(esp8266_http_client_t* client, esp8266_t* esp, const char* type,
+						 const char* remote_ip, const char* remote_port){
+	memset(client, 0, sizeof(*client));
+	client->esp = esp;
+	client->type = type;
+	client->remote_ip = remote_ip;
+	client->remote_port = remote_port;
+	client->link = -1;
+	client->timeout = ESP8266_TIMEOUT_DATA;
+}
+
+/* Start a request, either a string or a built request */
+static bool
+client_start(esp8266_http_client_t* client, const char* request, const esp8266_http_request_t* built,
+			 esp8266_callback_t callback, void* context){
+	if(client->busy)
+		return false;
+
+	client->request = request;
+	client->built = built;
+	client->callback = callback;
+	client->context = context;
+	client->sent = false;
+	client->start = HAL_GetTick();
+	esp8266_http_response_init(&client->response);
+	esp8266_http_response_callbacks(&client->response, client->callbacks);
+
+	/* Reuse the link if the server has not closed it */
+	if(client->link >= 0 && esp8266_get_link(client->esp, client->link)->state == ESP8266_LINK_CONNECTED){
+		if(!client_send(client))
+			return false;
+	}
+	else {
+		int8_t link = esp8266_link_open_async(client->esp, client->type, client->remote_ip, client->remote_port,
+											  client_received, client, client_opened, client);
+		if(link < 0)
+			return false;
+		client->link = link;
+	}
+
+	client->busy = true;
+	return true;
+}
+
+bool
+esp8266_http_client_request_async(esp8266_http_client_t* client, const char* request,
+								  esp8266_callback_t callback, void* context){
+	return client_start(client, request, NULL, callback, context);
+}
+
+bool
+esp8266_http_client_send_async(esp8266_http_client_t* client, const esp8266_http_request_t* request,
+							   esp8266_callback_t callback, void* context){
+	if(esp8266_http_request_length(request) == 0)
+		return false;
+	return client_start(client, NULL, request, callback, context);
+}
+
+bool
+esp8266_http_client_busy(esp8266_http_client_t* client){
+	if(client->busy && HAL_GetTick() - client->start >= client->timeout){
+		esp8266_http_client_close(client);
+		client_finish(client, ESP8266_TIMEOUT);
+	}
+	return client->busy;
+}
+
+void
+esp8266_http_client_close(esp8266_http_client_t* client){
+	if(client->link >= 0)
+		esp8266_link_close_async(client->esp, client->link, NULL, NULL);
+	client->link = -1;
+}
+
+uint16_t
+esp8266_http_keep_alive_request(char* ref, uint16_t size, const char* http_type, const char* uri, const char* host){
+	esp8266_format_t format;
+
+	esp8266_format_init(&format, ref, size);
+	esp8266_format_string(&format, http_type);
+	esp8266_format_string(&format, uri);
+	esp8266_format_string(&format, " ");
+	esp8266_format_string(&format, HTTP_VERSION);
+	esp8266_format_string(&format, "\r\n");
+	esp8266_format_string(&format, HTTP_HOST);
+	esp8266_format_string(&format, host);
+	esp8266_format_string(&format, "\r\n");
+	esp8266_format_string(&format, HTTP_CONNECTION_KEEP_ALIVE);
+	esp8266_format_string(&format, "\r\n\r\n");
+	return esp8266_format_end(&format);
+}
@@ -0,0 +1,202 @@
+/**
+******************************************************************************
+@brief buffered binary log
+@details Keeps records of the format and the arguments in a ring, and sends
+		 them out later without waiting, see esp8266_log.h for the stream.
+		 The stream is read back by esp8266_log_reader.c.
+
+@file esp8266_log.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "esp8266_log.h"
+#include <stddef.h>
+#include <string.h>
+
+/* A record in the ring, only count arguments of it are stored */
+typedef struct {
+	const char* format;
+	uint32_t time;							// HAL_GetTick
+	uint32_t count;							// arguments, and the records dropped before this one above bit 8
+	uint32_t args[ESP8266_LOG_MAX_ARGS];
+} esp8266_log_entry_t;
+
+#define ESP8266_LOG_ENTRY_HEAD		offsetof(esp8266_log_entry_t, args)
+
+_Static_assert(ESP8266_LOG_ENTRY_HEAD % sizeof(uint32_t) == 0, "records are whole words");
+
+static const uint8_t esp8266_log_header[] = ESP8266_LOG_HEADER;
+
+bool
+esp8266_log_init(esp8266_log_t* log, uint8_t* buffer, uint32_t size){
+	memset(log, 0, sizeof(*log));
+	return ring_buffer_init(&log->ring, buffer, size);
+}
+
+/* Copy whole words into the ring from head on, returns the head after them. Records are whole
+ * words and the head starts at 0, so a word is never cut by the end of the buffer */
+static uint32_t
+esp8266_log_put_words(ring_buffer_t* ring, uint32_t head, const void* data, uint32_t len){
+	for(uint32_t i = 0; i < len; i += sizeof(uint32_t))
+		memcpy(&ring->buffer[(head + i) & ring->mask], (const uint8_t*) data + i, sizeof(uint32_t));
+	return head + len;
+}
+
+bool
+esp8266_log_write(esp8266_log_t* log, const char* format, uint8_t count, const uint32_t* args){
+	esp8266_log_entry_t entry;
+
+	if(log == NULL)
+		return false;
+	if(count > ESP8266_LOG_MAX_ARGS)
+		count = ESP8266_LOG_MAX_ARGS;
+
+	entry.format = format;
+	entry.time = HAL_GetTick();
+
+	uint32_t len = ESP8266_LOG_ENTRY_HEAD + count * sizeof(uint32_t);
+	uint32_t primask = __get_PRIMASK();
+	bool written = false;
+
+	/* Interrupts log too, a record must go in whole and must not be cut into. The writer
+	 * only reads the level, ring_buffer_available is for the reader and can move the tail */
+	__disable_irq();
+	if(log->ring.size - ring_buffer_used(&log->ring) >= len){
+		uint32_t head = atomic_load_explicit(&log->ring.head, memory_order_relaxed);
+
+		/* Straight into the ring, without a copy of the record and a memcpy call for each end */
+		entry.count = count | log->dropped << 8;
+		head = esp8266_log_put_words(&log->ring, head, &entry, ESP8266_LOG_ENTRY_HEAD);
+		esp8266_log_put_words(&log->ring, head, args, count * sizeof(uint32_t));
+		ring_buffer_commit(&log->ring, len);
+		log->records++;
+		written = true;
+	}
+	else
+		log->dropped++;
+	__set_PRIMASK(primask);
+	return written;
+}
+
+/* Store a value with 7 bits per byte */
+static uint8_t*
+esp8266_log_put_varint(uint8_t* p, uint32_t value){
+	while(value >= 0x80){
+		*p++ = 0x80 | (value & 0x7f);
+		value >>= 7;
+	}
+	*p++ = value;
+	return p;
+}
+
+/* Report records that were dropped */
+static uint8_t*
+esp8266_log_put_dropped(esp8266_log_t* log, uint32_t dropped, uint8_t* p){
+	*p++ = ESP8266_LOG_TAG_DROPPED;
+	log->reported += dropped;
+	return esp8266_log_put_varint(p, dropped);
+}
+
+/* Get the id of a format, a new one is sent before the record */
+static uint8_t*
+esp8266_log_put_format(esp8266_log_t* log, const char* format, uint8_t* id, uint8_t* p){
+	for(uint8_t i = 0; i < ESP8266_LOG_FORMATS; i++){
+		if(log->formats[i] == format){
+			*id = i;
+			return p;
+		}
+	}
+
+	uint8_t len = strnlen(format, ESP8266_LOG_FORMAT_MAX);
+
+	*id = log->next_id;
+	log->formats[*id] = format;
+	log->next_id = (log->next_id + 1) % ESP8266_LOG_FORMATS;
+
+	*p++ = ESP8266_LOG_TAG_FORMAT;
+	*p++ = *id;
+	*p++ = len;
+	memcpy(p, format, len);
+	return p + len;
+}
+
+/* Put the next item of the stream in out, false if there is nothing to send */
+static bool
+esp8266_log_stage(esp8266_log_t* log){
+	esp8266_log_entry_t entry;
+	uint32_t dropped = log->dropped;
+	uint8_t* p = log->out;
+
+	if(!log->started){
+		memcpy(p, esp8266_log_header, sizeof(esp8266_log_header));
+		p += sizeof(esp8266_log_header);
+		log->started = true;
+	}
+	else if(ring_buffer_read(&log->ring, (uint8_t*) &entry, ESP8266_LOG_ENTRY_HEAD) == ESP8266_LOG_ENTRY_HEAD){
+		uint8_t count = entry.count & 0xff;
+		uint32_t dropped_before = ((entry.count >> 8) - log->reported) & 0xffffff;
+		uint8_t id;
+
+		/* The record went in whole, the arguments are there */
+		ring_buffer_read(&log->ring, (uint8_t*) entry.args, count * sizeof(uint32_t));
+
+		/* Records that were dropped go in the stream where they were dropped */
+		if(dropped_before > 0)
+			p = esp8266_log_put_dropped(log, dropped_before, p);
+
+		p = esp8266_log_put_format(log, entry.format, &id, p);
+		*p++ = ESP8266_LOG_TAG_RECORD | count;
+		*p++ = id;
+		p = esp8266_log_put_varint(p, entry.time - log->last);
+		for(uint8_t i = 0; i < count; i++)
+			p = esp8266_log_put_varint(p, entry.args[i]);
+		log->last = entry.time;
+	}
+	else if(dropped != log->reported)
+		p = esp8266_log_put_dropped(log, dropped - log->reported, p);
+	else
+		return false;
+
+	log->out_len = p - log->out;
+	log->out_pos = 0;
+	return true;
+}
+
+uint32_t
+esp8266_log_read(esp8266_log_t* log, uint8_t* data, uint32_t size){
+	uint32_t len = 0;
+
+	while(len < size){
+		if(log->out_pos == log->out_len && !esp8266_log_stage(log))
+			break;
+
+		uint32_t piece = log->out_len - log->out_pos;
+		if(piece > size - len)
+			piece = size - len;
+		memcpy(&data[len], &log->out[log->out_pos], piece);
+		log->out_pos += piece;
+		len += piece;
+	}
+	return len;
+}
+
+uint32_t
+esp8266_log_drain(esp8266_log_t* log){
+	uint32_t sent = 0;
+
+	/* Nobody is listening, do not let the records pile up */
+	if((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0 || (ITM->TER & (1UL << ESP8266_LOG_ITM_PORT)) == 0){
+		ring_buffer_flush(&log->ring);
+		return 0;
+	}
+
+	/* The port reads 0 while the FIFO is full, the rest goes the next time */
+	while(ITM->PORT[ESP8266_LOG_ITM_PORT].u32 != 0){
+		if(log->out_pos == log->out_len && !esp8266_log_stage(log))
+			break;
+		ITM->PORT[ESP8266_LOG_ITM_PORT].u8 = log->out[log->out_pos++];
+		sent++;
+	}
+	return sent;
+}
@@ -0,0 +1,169 @@
+/**
+******************************************************************************
+@brief reader of the binary log stream
+@details Puts the lines of a stream of esp8266_log.c back together with
+		 snprintf, see esp8266_log_reader.h. Only built with
+		 ESP8266_LOG_READER, so that the firmware does not link it.
+
+@file esp8266_log_reader.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "esp8266_log_reader.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP8266_LOG_READER
+
+static const uint8_t esp8266_log_header[] = ESP8266_LOG_HEADER;
+
+bool
+esp8266_log_reader_init(esp8266_log_reader_t* reader, const uint8_t* data, uint32_t len){
+	memset(reader, 0, sizeof(*reader));
+	if(len < sizeof(esp8266_log_header) || memcmp(data, esp8266_log_header, sizeof(esp8266_log_header)) != 0)
+		return false;
+
+	reader->data = data;
+	reader->len = len;
+	reader->pos = sizeof(esp8266_log_header);
+	return true;
+}
+
+/* Read a value with 7 bits per byte, false if it is cut off */
+static bool
+esp8266_log_get_varint(const esp8266_log_reader_t* reader, uint32_t* pos, uint32_t* value){
+	uint8_t shift = 0;
+	uint8_t c;
+
+	*value = 0;
+	do {
+		if(*pos >= reader->len || shift > 28)
+			return false;
+		c = reader->data[(*pos)++];
+		*value |= (uint32_t) (c & 0x7f) << shift;
+		shift += 7;
+	} while(c & 0x80);
+	return true;
+}
+
+/* Print the arguments with the format. Each conversion is printed on its own, with an l
+ * in front so that the argument can be passed as a long. */
+static void
+esp8266_log_format(char* text, const uint8_t* format, uint8_t len, const uint32_t* args, uint8_t count){
+	uint32_t out = 0;
+	uint8_t arg = 0;
+
+	for(uint8_t i = 0; i < len && out < ESP8266_LOG_LINE_MAX - 1; i++){
+		char spec[16] = "%";
+		uint8_t n = 1;
+		int printed;
+
+		if(format[i] != '%'){
+			text[out++] = format[i];
+			continue;
+		}
+
+		/* Flags, width and precision are kept, the length is replaced */
+		for(i++; i < len && format[i] != '\0' && strchr("-+ #0123456789.", format[i]) != NULL; i++){
+			if(n < sizeof(spec) - 3)
+				spec[n++] = format[i];
+		}
+		while(i < len && (format[i] == 'l' || format[i] == 'h'))
+			i++;
+		if(i >= len)
+			break;
+
+		char conversion = format[i];
+		if(conversion == '%'){
+			text[out++] = '%';
+			continue;
+		}
+		if(arg >= count || conversion == '\0' || strchr("diuxXoc", conversion) == NULL){
+			/* Whatever was logged for it belongs to this conversion, not to the next one */
+			if(arg < count && conversion != '\0')
+				arg++;
+			printed = snprintf(&text[out], ESP8266_LOG_LINE_MAX - out, "?");
+		}
+		else if(conversion == 'c'){
+			spec[n] = 'c';
+			printed = snprintf(&text[out], ESP8266_LOG_LINE_MAX - out, spec, (int) args[arg++]);
+		}
+		else {
+			spec[n] = 'l';
+			spec[n + 1] = conversion;
+			if(conversion == 'd' || conversion == 'i')
+				printed = snprintf(&text[out], ESP8266_LOG_LINE_MAX - out, spec, (long) (int32_t) args[arg++]);
+			else
+				printed = snprintf(&text[out], ESP8266_LOG_LINE_MAX - out, spec, (unsigned long) args[arg++]);
+		}
+
+		if(printed > 0)
+			out += printed;
+		if(out > ESP8266_LOG_LINE_MAX - 1)
+			out = ESP8266_LOG_LINE_MAX - 1;
+	}
+	text[out] = '\0';
+}
+
+bool
+esp8266_log_next(esp8266_log_reader_t* reader, char* text, uint32_t* time){
+	uint32_t pos = reader->pos;
+
+	while(pos < reader->len){
+		uint8_t tag = reader->data[pos++];
+
+		if(tag == ESP8266_LOG_TAG_FORMAT){
+			if(reader->len - pos < 2 || reader->len - pos - 2 < reader->data[pos + 1])
+				return false;
+
+			uint8_t id = reader->data[pos];
+			if(id < ESP8266_LOG_FORMATS){
+				reader->formats[id] = &reader->data[pos + 2];
+				reader->format_len[id] = reader->data[pos + 1];
+			}
+			pos += 2 + reader->data[pos + 1];
+			reader->pos = pos;
+			continue;
+		}
+
+		if(tag == ESP8266_LOG_TAG_DROPPED){
+			uint32_t dropped;
+
+			if(!esp8266_log_get_varint(reader, &pos, &dropped))
+				return false;
+			reader->dropped += dropped;
+			snprintf(text, ESP8266_LOG_LINE_MAX, "%lu records dropped\n", (unsigned long) dropped);
+		}
+		else if((tag & 0xf0) == ESP8266_LOG_TAG_RECORD && (tag & 0x0f) <= ESP8266_LOG_MAX_ARGS){
+			uint8_t count = tag & 0x0f;
+			uint32_t args[ESP8266_LOG_MAX_ARGS];
+			uint32_t delta;
+
+			if(pos >= reader->len)
+				return false;
+			uint8_t id = reader->data[pos++];
+			if(!esp8266_log_get_varint(reader, &pos, &delta))
+				return false;
+			for(uint8_t i = 0; i < count; i++){
+				if(!esp8266_log_get_varint(reader, &pos, &args[i]))
+					return false;
+			}
+
+			reader->time += delta;
+			if(id < ESP8266_LOG_FORMATS && reader->formats[id] != NULL)
+				esp8266_log_format(text, reader->formats[id], reader->format_len[id], args, count);
+			else
+				snprintf(text, ESP8266_LOG_LINE_MAX, "format %u unknown\n", id);
+		}
+		else
+			return false;
+
+		*time = reader->time;
+		reader->pos = pos;
+		return true;
+	}
+	return false;
+}
+
+#endif /* ESP8266_LOG_READER */
@@ -0,0 +1,282 @@
+/**
+******************************************************************************
+@brief AT response parser for the ESP8266 wifi-module
+@details Incremental parser for the responses sent by the ESP8266, see
+		 esp8266_parser.h. Instead of searching the whole receive buffer for
+		 every possible response each time a byte arrives, the parser keeps a
+		 bit per token in the table below, and clears the bits of the tokens
+		 that no longer match as the bytes of a line come in. So the cost per
+		 byte is constant, no matter how long the response is.
+
+@file esp8266_parser.c
+@author agent@local
+@date 16-10-2026
+@version 1.2
+*******************************************************************************/
+#include "esp8266_parser.h"
+#include <stddef.h>
+
+/* Parser states */
+#define PARSER_LINE		0	// matching the current line against the tokens
+#define PARSER_VALUES	1	// reading the numbers after a token
+#define PARSER_IGNORE	2	// nothing more to match, wait for end of line
+#define PARSER_PAYLOAD	3	// skipping +IPD data
+#define PARSER_LINK		4	// read a digit at the start of the line, a ',' makes it the link id
+
+/* How a token is matched */
+#define TOKEN_LINE		0	// the whole line has to be the token
+#define TOKEN_PREFIX	1	// the line starts with the token, the rest of the line is ignored
+#define TOKEN_VALUES	2	// the token is followed by comma separated numbers
+
+#define TOKEN_NONE		0xFF
+
+/* Largest value before we stop adding digits, keeps the value from overflowing */
+#define MAX_VALUE		100000000
+
+typedef struct {
+	const char* text;
+	uint8_t len;
+	uint8_t kind;
+	esp8266_event_type_t type;
+} token_t;
+
+#define TOKEN(text, kind, type) { text, sizeof(text) - 1, kind, type }
+
+static const token_t tokens[] = {
+	TOKEN("OK",					TOKEN_LINE,		ESP8266_EVENT_OK),
+	TOKEN("ERROR",				TOKEN_LINE,		ESP8266_EVENT_ERROR),
+	TOKEN("FAIL",				TOKEN_LINE,		ESP8266_EVENT_FAIL),
+	TOKEN("SEND OK",			TOKEN_LINE,		ESP8266_EVENT_SEND_OK),
+	TOKEN("SEND FAIL",			TOKEN_LINE,		ESP8266_EVENT_SEND_FAIL),
+	TOKEN("ready",				TOKEN_LINE,		ESP8266_EVENT_READY),
+	TOKEN("ets ",				TOKEN_PREFIX,	ESP8266_EVENT_RESET),
+	TOKEN("busy ",				TOKEN_PREFIX,	ESP8266_EVENT_BUSY),
+	TOKEN("CONNECT",			TOKEN_LINE,		ESP8266_EVENT_CONNECT),
+	TOKEN("CONNECT FAIL",		TOKEN_LINE,		ESP8266_EVENT_CONNECT_FAIL),
+	TOKEN("CLOSED",				TOKEN_LINE,		ESP8266_EVENT_CLOSED),
+	TOKEN("ALREADY CONNECTED",	TOKEN_LINE,		ESP8266_EVENT_ALREADY_CONNECTED),
+	TOKEN("WIFI CONNECTED",		TOKEN_LINE,		ESP8266_EVENT_WIFI_CONNECTED),
+	TOKEN("WIFI GOT IP",		TOKEN_LINE,		ESP8266_EVENT_WIFI_GOT_IP),
+	TOKEN("WIFI DISCONNECT",	TOKEN_LINE,		ESP8266_EVENT_WIFI_DISCONNECTED),
+	TOKEN("No AP",				TOKEN_LINE,		ESP8266_EVENT_NO_AP),
+	TOKEN("+CWJAP:",			TOKEN_VALUES,	ESP8266_EVENT_CWJAP),
+	TOKEN("+CWMODE_CUR:",		TOKEN_VALUES,	ESP8266_EVENT_CWMODE),
+	TOKEN("+CIPMUX:",			TOKEN_VALUES,	ESP8266_EVENT_CIPMUX),
+	TOKEN("+IPD,",				TOKEN_VALUES,	ESP8266_EVENT_IPD),
+};
+
+#define TOKEN_COUNT			(sizeof(tokens) / sizeof(tokens[0]))
+#define ALL_CANDIDATES		((uint32_t)((1ULL << TOKEN_COUNT) - 1))
+
+/* Start matching a new line */
+static void
+new_line(esp8266_parser_t* parser){
+	parser->state = PARSER_LINE;
+	parser->pos = 0;
+	parser->link = ESP8266_PARSER_NO_LINK;
+	parser->candidates = ALL_CANDIDATES;
+	parser->token = TOKEN_NONE;
+	parser->value_count = 0;
+	parser->values[0] = 0;
+}
+
+/* Emit the event for the matched token, and start on a new line */
+static bool
+emit(esp8266_parser_t* parser, uint8_t token, esp8266_event_t* event){
+	event->type = tokens[token].type;
+	event->value = parser->values[0];
+	event->link = parser->link;
+	new_line(parser);
+	return true;
+}
+
+/* End of line while matching, emit the token that is exactly the line if there is one */
+static bool
+end_of_line(esp8266_parser_t* parser, esp8266_event_t* event){
+	uint32_t candidates = parser->candidates;
+
+	while(candidates){
+		uint8_t i = __builtin_ctz(candidates);
+		candidates &= candidates - 1;
+		if(tokens[i].kind == TOKEN_LINE && tokens[i].len == parser->pos)
+			return emit(parser, i, event);
+	}
+	new_line(parser);
+	return false;
+}
+
+/* Match the next byte of the line, and drop the tokens that do not match anymore */
+static void
+match(esp8266_parser_t* parser, uint8_t c){
+	uint32_t candidates = parser->candidates;
+	uint32_t matching = 0;
+	uint8_t pos = parser->pos;
+
+	while(candidates){
+		uint8_t i = __builtin_ctz(candidates);
+		candidates &= candidates - 1;
+
+		if(pos >= tokens[i].len || (uint8_t) tokens[i].text[pos] != c)
+			continue;
+
+		/* The whole token has been seen, the rest of the line belongs to it */
+		if(pos + 1 == tokens[i].len && tokens[i].kind != TOKEN_LINE){
+			parser->token = i;
+			parser->state = tokens[i].kind == TOKEN_VALUES ? PARSER_VALUES : PARSER_IGNORE;
+			return;
+		}
+		matching |= 1UL << i;
+	}
+
+	parser->candidates = matching;
+	if(matching == 0)
+		parser->state = PARSER_IGNORE;
+	else if(pos < UINT8_MAX)
+		parser->pos++;
+}
+
+/* Read the numbers after a token */
+static bool
+values(esp8266_parser_t* parser, uint8_t c, esp8266_event_t* event){
+	int32_t* value = &parser->values[parser->value_count];
+
+	if(c >= '0' && c <= '9'){
+		if(*value < MAX_VALUE)
+			*value = *value * 10 + (c - '0');
+	}
+	else if(c == ',' && parser->value_count < ESP8266_PARSER_MAX_VALUES - 1){
+		parser->values[++parser->value_count] = 0;
+	}
+	else if(c == ':' && tokens[parser->token].type == ESP8266_EVENT_IPD){
+		/* +IPD,<len>: is followed by <len> bytes of data, not by a line ending */
+		uint32_t len = (uint32_t) *value;
+		if(len > ESP8266_PARSER_MAX_PAYLOAD || (parser->value_count > 0 && parser->values[0] > ESP8266_PARSER_MAX_LINK)){
+			parser->token = TOKEN_NONE;
+			parser->state = PARSER_IGNORE;
+			return false;
+		}
+		event->type = ESP8266_EVENT_IPD;
+		event->value = *value;
+		event->link = parser->value_count > 0 ? (int8_t) parser->values[0] : ESP8266_PARSER_NO_LINK;
+		new_line(parser);
+		if(len > 0){
+			parser->skip = len;
+			parser->state = PARSER_PAYLOAD;
+		}
+		return true;
+	}
+	else if(tokens[parser->token].type == ESP8266_EVENT_IPD && c != '\r'){
+		/* A +IPD header that does not end in ':' is garbled, there is no data after it */
+		parser->token = TOKEN_NONE;
+		parser->state = PARSER_IGNORE;
+		if(c == '\n')
+			new_line(parser);
+	}
+	else if(c == '\n'){
+		return emit(parser, parser->token, event);
+	}
+	else if(c != '\r'){
+		/* Not a number, such as the AP info after +CWJAP: when querying.
+		 * Still emit the token at the end of the line, with the values read so far */
+		parser->state = PARSER_IGNORE;
+	}
+	return false;
+}
+
+void
+esp8266_parser_init(esp8266_parser_t* parser){
+	parser->skip = 0;
+	new_line(parser);
+}
+
+bool
+esp8266_parser_feed(esp8266_parser_t* parser, uint8_t c, esp8266_event_t* event){
+
+	switch (parser->state) {
+
+		case PARSER_PAYLOAD:
+			if(--parser->skip == 0)
+				new_line(parser);
+			return false;
+
+		case PARSER_VALUES:
+			return values(parser, c, event);
+
+		case PARSER_LINK:
+			if(c == ','){
+				parser->state = PARSER_LINE;
+				return false;
+			}
+			parser->state = PARSER_IGNORE;
+			/* fall through */
+
+		case PARSER_IGNORE:
+			if(c != '\n')
+				return false;
+			if(parser->token != TOKEN_NONE)
+				return emit(parser, parser->token, event);
+			new_line(parser);
+			return false;
+
+		default:
+			break;
+	}
+
+	if(c == '\n')
+		return end_of_line(parser, event);
+
+	if(c == '\r')
+		return false;
+
+	/* The CIPSEND prompt is not followed by a line ending */
+	if(c == '>' && parser->pos == 0){
+		event->type = ESP8266_EVENT_PROMPT;
+		event->value = 0;
+		event->link = ESP8266_PARSER_NO_LINK;
+		return true;
+	}
+
+	/* "<id>,CONNECT" and the like with multiple connections, no token starts with a digit */
+	if(c >= '0' && c <= '9' && parser->pos == 0 && parser->link == ESP8266_PARSER_NO_LINK){
+		parser->link = c - '0';
+		parser->state = PARSER_LINK;
+		return false;
+	}
+
+	/* Garbage, such as the boot messages at 74880 baud after a reset. Start over so
+	 * that the next readable text is matched from the start of a line */
+	if(c < ' ' || c > '~'){
+		new_line(parser);
+		return false;
+	}
+
+	match(parser, c);
+	return false;
+}
+
+void
+esp8266_parser_skip(esp8266_parser_t* parser, uint32_t len){
+	if(parser->state != PARSER_PAYLOAD || len == 0)
+		return;
+
+	parser->skip = len < parser->skip ? parser->skip - len : 0;
+	if(parser->skip == 0)
+		new_line(parser);
+}
+
+uint32_t
+esp8266_parser_payload(const esp8266_parser_t* parser){
+	return parser->state == PARSER_PAYLOAD ? parser->skip : 0;
+}
+
+const char*
+esp8266_parser_event_name(esp8266_event_type_t type){
+	if(type == ESP8266_EVENT_PROMPT)
+		return ">";
+
+	for(uint8_t i = 0; i < TOKEN_COUNT; i++){
+		if(tokens[i].type == type)
+			return tokens[i].text;
+	}
+	return "";
+}
@@ -0,0 +1,109 @@
+/**
+******************************************************************************
+@brief latency profile for the ESP8266 wifi-module
+@details Histograms of the time requests take, see esp8266_profile.h.
+
+@file esp8266_profile.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "esp8266_profile.h"
+#include <stdio.h>
+
+static const char* const esp8266_phase_names[ESP8266_PHASE_COUNT] = {
+	"tx", "module", "parse", "total"
+};
+
+void
+esp8266_profile_clock_start(void){
+#ifndef ESP8266_PROFILE_CLOCK
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+uint32_t
+esp8266_profile_us(uint32_t ticks){
+	return (uint64_t) ticks * 1000000 / ESP8266_PROFILE_CLOCK_HZ;
+}
+
+/* Bucket of a time, bucket i above 0 holds 2^(ESP8266_PROFILE_MIN_BITS + i - 1) up to
+ * 2^(ESP8266_PROFILE_MIN_BITS + i) */
+static uint8_t
+esp8266_histogram_bucket(uint32_t ticks){
+	uint8_t bits = ticks == 0 ? 0 : 32 - __builtin_clz(ticks);
+	return bits <= ESP8266_PROFILE_MIN_BITS ? 0 : bits - ESP8266_PROFILE_MIN_BITS;
+}
+
+void
+esp8266_histogram_add(esp8266_histogram_t* histogram, uint32_t count, uint32_t ticks){
+	if(count == 0 || ticks < histogram->min)
+		histogram->min = ticks;
+	if(ticks > histogram->max)
+		histogram->max = ticks;
+	histogram->total += ticks;
+
+	uint16_t* bucket = &histogram->buckets[esp8266_histogram_bucket(ticks)];
+	if(*bucket < UINT16_MAX)
+		(*bucket)++;
+}
+
+uint32_t
+esp8266_histogram_percentile(const esp8266_histogram_t* histogram, uint32_t count, uint8_t percent){
+	uint32_t rank = ((uint64_t) count * percent + 99) / 100;
+	uint32_t seen = 0;
+
+	if(count == 0)
+		return 0;
+
+	for(uint8_t i = 0; i < ESP8266_PROFILE_BUCKETS; i++){
+		seen += histogram->buckets[i];
+		if(seen < rank)
+			continue;
+
+		/* The top of the bucket, but not above the max or below the min that were seen */
+		uint32_t top = ((uint64_t) 1 << (ESP8266_PROFILE_MIN_BITS + i)) - 1;
+		if(top > histogram->max)
+			top = histogram->max;
+		return top < histogram->min ? histogram->min : top;
+	}
+	/* Only when buckets stopped counting */
+	return histogram->max;
+}
+
+void
+esp8266_profile_add(esp8266_profile_t* profile, const uint32_t* phases){
+	uint32_t total = 0;
+
+	for(uint8_t phase = 0; phase < ESP8266_PHASE_TOTAL; phase++){
+		esp8266_histogram_add(&profile->phases[phase], profile->count, phases[phase]);
+		total += phases[phase];
+	}
+	esp8266_histogram_add(&profile->phases[ESP8266_PHASE_TOTAL], profile->count, total);
+	profile->count++;
+}
+
+void
+esp8266_profile_print(const char* name, const esp8266_profile_t* profile){
+	printf("%-14s %6lu %8lu\n", name, (unsigned long) profile->count, (unsigned long) profile->timeouts);
+	if(profile->count == 0)
+		return;
+
+	for(uint8_t phase = 0; phase < ESP8266_PHASE_COUNT; phase++){
+		const esp8266_histogram_t* histogram = &profile->phases[phase];
+
+		printf("  %-12s %8lu %8lu %8lu %8lu  ", esp8266_phase_names[phase],
+			   (unsigned long) esp8266_profile_us(histogram->min),
+			   (unsigned long) esp8266_profile_us(histogram->total / profile->count),
+			   (unsigned long) esp8266_profile_us(esp8266_histogram_percentile(histogram, profile->count, 99)),
+			   (unsigned long) esp8266_profile_us(histogram->max));
+
+		for(uint8_t i = 0; i < ESP8266_PROFILE_BUCKETS; i++){
+			if(histogram->buckets[i] > 0)
+				printf(" %lu:%u", (unsigned long) esp8266_profile_us(((uint64_t) 1 << (ESP8266_PROFILE_MIN_BITS + i)) - 1),
+					   histogram->buckets[i]);
+		}
+		printf("\n");
+	}
+}
@@ -0,0 +1,227 @@
+/**
+******************************************************************************
+@brief DMA receive engine for the ESP8266 wifi-module
+@details Receives everything the ESP8266 sends with circular DMA, see
+		 esp8266_rx.h for how the ring is used.
+
+@file esp8266_rx.c
+@author agent@local
+@date 16-10-2026
+@version 1.5
+*******************************************************************************/
+#include "esp8266_rx.h"
+
+void
+esp8266_rx_init(esp8266_rx_t* rx, UART_HandleTypeDef* huart){
+	rx->huart = huart;
+	rx->dma_pos = 0;
+	rx->stopped = false;
+	rx->errors = 0;
+	rx->lines = 0;
+	rx->timeouts = 0;
+	rx->timeout_pos = 0;
+	rx->rts_port = NULL;
+	rx->rts_pin = 0;
+	rx->throttled = false;
+	rx->throttles = 0;
+	ring_buffer_init(&rx->ring, rx->buffer, RX_DMA_BUFFER_SIZE);
+}
+
+HAL_StatusTypeDef
+esp8266_rx_start(esp8266_rx_t* rx){
+
+	if(rx->huart == NULL)
+		return HAL_ERROR;
+
+	/* Stop any reception that is already running, such as when the driver is initiated twice */
+	HAL_UART_AbortReceive(rx->huart);
+
+	/* The DMA always starts at the beginning of the buffer, so the ring has to
+	 * start there as well. Anything unread at this point is lost. */
+	ring_buffer_reset(&rx->ring);
+	rx->dma_pos = 0;
+	rx->stopped = false;
+
+	/* Nothing is unread, so the ESP8266 may send again */
+	if(rx->throttled){
+		HAL_GPIO_WritePin(rx->rts_port, rx->rts_pin, GPIO_PIN_RESET);
+		rx->throttled = false;
+	}
+
+	/* ADD can only be written with the uart disabled, which would cut off a transmission.
+	 * It keeps its value, so this is only done at the first start, from esp8266_init. */
+	USART_TypeDef* uart = rx->huart->Instance;
+	if((uart->CR2 & USART_CR2_ADD) != (uint32_t) RX_MATCH_CHARACTER << USART_CR2_ADD_Pos){
+		__HAL_UART_DISABLE(rx->huart);
+		MODIFY_REG(uart->CR2, USART_CR2_ADD, (uint32_t) RX_MATCH_CHARACTER << USART_CR2_ADD_Pos);
+		__HAL_UART_ENABLE(rx->huart);
+	}
+
+	/* The receiver timeout counts in bit times */
+	MODIFY_REG(uart->RTOR, USART_RTOR_RTO, rx->huart->Init.BaudRate / 1000 * RX_QUIET_TIME);
+	SET_BIT(uart->CR2, USART_CR2_RTOEN);
+	rx->timeouts = 0;
+
+	/* Rx event callback on idle line, half transfer and transfer complete */
+	HAL_StatusTypeDef status = HAL_UARTEx_ReceiveToIdle_DMA(rx->huart, rx->buffer, RX_DMA_BUFFER_SIZE);
+
+	/* And esp8266_rx_irq at the end of every line, and when the line goes quiet */
+	__HAL_UART_CLEAR_FLAG(rx->huart, UART_CLEAR_CMF | UART_CLEAR_RTOF);
+	__HAL_UART_ENABLE_IT(rx->huart, UART_IT_CM);
+	__HAL_UART_ENABLE_IT(rx->huart, UART_IT_RTO);
+	return status;
+}
+
+void
+esp8266_rx_event(esp8266_rx_t* rx, uint16_t pos){
+
+	/* pos is RX_DMA_BUFFER_SIZE at transfer complete, that is the start of the next lap */
+	pos &= RX_DMA_BUFFER_SIZE - 1;
+
+	/* The half transfer interrupt makes sure we get here at least twice per lap,
+	 * so the distance from the last position is always the number of new bytes */
+	uint16_t received = (pos - rx->dma_pos) & (RX_DMA_BUFFER_SIZE - 1);
+	rx->dma_pos = pos;
+	ring_buffer_commit(&rx->ring, received);
+
+	/* Tell the ESP8266 to stop while there is still room for what it sends meanwhile */
+	if(rx->rts_port != NULL && !rx->throttled && ring_buffer_used(&rx->ring) >= RX_FLOW_HIGH){
+		HAL_GPIO_WritePin(rx->rts_port, rx->rts_pin, GPIO_PIN_SET);
+		rx->throttled = true;
+		rx->throttles++;
+	}
+}
+
+void
+esp8266_rx_irq(esp8266_rx_t* rx){
+
+	if(rx->huart == NULL)
+		return;
+
+	/* Cleared before the HAL sees it, the HAL would abort the reception */
+	if(__HAL_UART_GET_FLAG(rx->huart, UART_FLAG_RTOF) != RESET){
+		__HAL_UART_CLEAR_FLAG(rx->huart, UART_CLEAR_RTOF);
+		esp8266_rx_timeout(rx, esp8266_rx_position(rx));
+	}
+
+	/* The flag is set as the '\n' arrives, the DMA has moved it by the time we get here.
+	 * The UART and the DMA interrupts have the same priority, so this does not cut into
+	 * an event from the HAL. */
+	if(__HAL_UART_GET_FLAG(rx->huart, UART_FLAG_CMF) != RESET){
+		__HAL_UART_CLEAR_FLAG(rx->huart, UART_CLEAR_CMF);
+		esp8266_rx_match(rx, esp8266_rx_position(rx));
+	}
+}
+
+void
+esp8266_rx_match(esp8266_rx_t* rx, uint16_t pos){
+	rx->lines++;
+	esp8266_rx_event(rx, pos);
+}
+
+void
+esp8266_rx_timeout(esp8266_rx_t* rx, uint16_t pos){
+	rx->timeout_pos = pos & (RX_DMA_BUFFER_SIZE - 1);
+	rx->timeouts++;
+	esp8266_rx_event(rx, pos);
+}
+
+uint16_t
+esp8266_rx_position(esp8266_rx_t* rx){
+
+	/* Without the DMA, such as in the unit tests, the last event is as far as we know */
+	if(rx->huart == NULL || rx->huart->hdmarx == NULL)
+		return rx->dma_pos;
+	return (RX_DMA_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(rx->huart->hdmarx)) & (RX_DMA_BUFFER_SIZE - 1);
+}
+
+bool
+esp8266_rx_quiet(esp8266_rx_t* rx){
+	return rx->timeouts > 0 && esp8266_rx_position(rx) == rx->timeout_pos;
+}
+
+void
+esp8266_rx_error(esp8266_rx_t* rx){
+	rx->errors++;
+	rx->stopped = true;
+}
+
+void
+esp8266_rx_flow(esp8266_rx_t* rx, GPIO_TypeDef* port, uint16_t pin){
+	uint32_t primask = __get_PRIMASK();
+
+	/* The old pin is lowered before it is let go, so the ESP8266 is not left stopped */
+	__disable_irq();
+	if(rx->rts_port != NULL)
+		HAL_GPIO_WritePin(rx->rts_port, rx->rts_pin, GPIO_PIN_RESET);
+	rx->rts_port = port;
+	rx->rts_pin = pin;
+	rx->throttled = false;
+	if(port != NULL)
+		HAL_GPIO_WritePin(port, pin, GPIO_PIN_RESET);
+	__set_PRIMASK(primask);
+}
+
+/* Let the ESP8266 send again once the ring has been read down. The interrupts are off
+ * so that an event can not raise RTS between the check and lowering it. */
+static void
+esp8266_rx_release(esp8266_rx_t* rx){
+	if(!rx->throttled)
+		return;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if(rx->throttled && ring_buffer_available(&rx->ring) <= RX_FLOW_LOW){
+		HAL_GPIO_WritePin(rx->rts_port, rx->rts_pin, GPIO_PIN_RESET);
+		rx->throttled = false;
+	}
+	__set_PRIMASK(primask);
+}
+
+/* DMA was aborted by an error, nothing more will come in until it is restarted */
+static void
+esp8266_rx_check(esp8266_rx_t* rx){
+	if(rx->stopped)
+		esp8266_rx_start(rx);
+}
+
+uint32_t
+esp8266_rx_available(esp8266_rx_t* rx){
+	esp8266_rx_check(rx);
+	return ring_buffer_available(&rx->ring);
+}
+
+uint32_t
+esp8266_rx_read(esp8266_rx_t* rx, uint8_t* dst, uint32_t len){
+	esp8266_rx_check(rx);
+	uint32_t read = ring_buffer_read(&rx->ring, dst, len);
+	esp8266_rx_release(rx);
+	return read;
+}
+
+uint32_t
+esp8266_rx_peek(esp8266_rx_t* rx, const uint8_t** data){
+	esp8266_rx_check(rx);
+	return ring_buffer_peek(&rx->ring, data);
+}
+
+void
+esp8266_rx_consume(esp8266_rx_t* rx, uint32_t len){
+	ring_buffer_consume(&rx->ring, len);
+	esp8266_rx_release(rx);
+}
+
+bool
+esp8266_rx_get(esp8266_rx_t* rx, uint8_t* c){
+	esp8266_rx_check(rx);
+	bool got = ring_buffer_get(&rx->ring, c);
+	esp8266_rx_release(rx);
+	return got;
+}
+
+void
+esp8266_rx_flush(esp8266_rx_t* rx){
+	esp8266_rx_check(rx);
+	ring_buffer_flush(&rx->ring);
+	esp8266_rx_release(rx);
+}
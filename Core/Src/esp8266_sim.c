@@ -0,0 +1,696 @@
+/**
+******************************************************************************
+@brief simulated ESP8266 wifi-module
+@details Answers the AT commands of the driver on a uart in RAM, see
+		 esp8266_sim.h.
+
+@file esp8266_sim.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "esp8266_sim.h"
+
+#ifdef ESP8266_SIM
+
+/* The module esp8266_sim_tick moves on, NULL if none */
+static esp8266_sim_t* running;
+
+static const char SIM_OK[]		= "\r\nOK\r\n";
+static const char SIM_ERROR[]	= "\r\nERROR\r\n";
+
+static const char SIM_GMR[] =
+	"AT version:1.2.0.0(Jul  1 2016 20:04:45)\r\n"
+	"SDK version:1.5.4.1(39cb9a32)\r\n"
+	"compile time:Dec  2 2016 14:21:16\r\n"
+	"OK\r\n";
+
+/* What comes after a reset: the ROM at 74880 baud, which is garbage at our rate, the boot loader, and "ready" */
+static const char SIM_BOOT[] =
+	"\x8f\x12\xff\x03\xd5\x80\r\n"
+	"ets Jan  8 2013,rst cause:2, boot mode:(3,6)\r\n"
+	"\r\n"
+	"load 0x40100000, len 2592, room 16 \r\n"
+	"tail 0\r\n"
+	"chksum 0xf3\r\n"
+	"load 0x3ffe8000, len 764, room 8 \r\n"
+	"tail 4\r\n"
+	"chksum 0x92\r\n"
+	"csum 0x92\r\n"
+	"\r\n"
+	"2nd boot version : 1.6\r\n"
+	"  SPI Speed      : 40MHz\r\n"
+	"  SPI Mode       : DIO\r\n"
+	"\r\n"
+	"\x81\xfe\x12\r\n"
+	"ready\r\n";
+
+/* Queue text to send, from the tick or with the interrupts off */
+static bool
+esp8266_sim_out(esp8266_sim_t* sim, const char* text){
+	uint32_t len = strlen(text);
+
+	return ring_buffer_write(&sim->out, (const uint8_t*) text, len) == len;
+}
+
+/* Queue "<link>," when there are several connections */
+static void
+esp8266_sim_out_link(esp8266_sim_t* sim, uint8_t link){
+	char buffer[8];
+	esp8266_format_t format;
+
+	if(sim->cipmux == 0)
+		return;
+	esp8266_format_init(&format, buffer, sizeof(buffer));
+	esp8266_format_uint(&format, link);
+	esp8266_format_string(&format, ",");
+	esp8266_sim_out(sim, buffer);
+}
+
+/* Queue a number, followed by a few bytes of text */
+static void
+esp8266_sim_out_uint(esp8266_sim_t* sim, uint32_t value, const char* text){
+	char buffer[16];
+	esp8266_format_t format;
+
+	esp8266_format_init(&format, buffer, sizeof(buffer));
+	esp8266_format_uint(&format, value);
+	esp8266_format_string(&format, text);
+	esp8266_sim_out(sim, buffer);
+}
+
+/* Read a decimal at *p and move past it, -1 if there is none */
+static int32_t
+esp8266_sim_number(const char** p){
+	int32_t value = -1;
+
+	while(**p >= '0' && **p <= '9' && value < 100000){
+		value = (value < 0 ? 0 : value * 10) + (**p - '0');
+		(*p)++;
+	}
+	return value;
+}
+
+/* Is the line the command, or does it start with it when the command ends at '=' */
+static bool
+esp8266_sim_is(const char* line, const char* command){
+	uint16_t len = strlen(command);
+
+	if(command[len - 1] == '=')
+		return strncmp(line, command, len) == 0;
+	return strcmp(line, command) == 0;
+}
+
+static void
+esp8266_sim_close_all(esp8266_sim_t* sim){
+	for(uint8_t link = 0; link < ESP8266_MAX_LINKS; link++){
+		if(sim->links[link]){
+			esp8266_sim_out_link(sim, link);
+			esp8266_sim_out(sim, "CLOSED\r\n");
+			sim->links[link] = false;
+		}
+	}
+	sim->passthrough = false;
+}
+
+/* The link of a command with "<link>," in front of the rest when there are several
+ * connections, 0 for the single connection. -1 if it is not valid. */
+static int32_t
+esp8266_sim_link(esp8266_sim_t* sim, const char** p){
+	if(sim->cipmux == 0)
+		return 0;
+
+	int32_t link = esp8266_sim_number(p);
+	if(link < 0 || link >= ESP8266_MAX_LINKS)
+		return -1;
+	if(**p == ',')
+		(*p)++;
+	return link;
+}
+
+static void
+esp8266_sim_cipstart(esp8266_sim_t* sim, const char* p){
+	int32_t link = esp8266_sim_link(sim, &p);
+
+	if(link < 0 || *p != '"'){
+		esp8266_sim_out(sim, SIM_ERROR);
+		return;
+	}
+	if(!sim->wifi){
+		esp8266_sim_out(sim, "no ip\r\n\r\nERROR\r\n");
+		return;
+	}
+	if(sim->links[link]){
+		esp8266_sim_out(sim, "ALREADY CONNECTED\r\n\r\nERROR\r\n");
+		return;
+	}
+	sim->links[link] = true;
+	esp8266_sim_out_link(sim, link);
+	esp8266_sim_out(sim, "CONNECT\r\n\r\nOK\r\n");
+}
+
+static void
+esp8266_sim_cipclose(esp8266_sim_t* sim, const char* p){
+	int32_t link = *p == '\0' ? 0 : esp8266_sim_link(sim, &p);
+
+	if(link < 0 || !sim->links[link]){
+		esp8266_sim_out(sim, SIM_ERROR);
+		return;
+	}
+	sim->links[link] = false;
+	esp8266_sim_out_link(sim, link);
+	esp8266_sim_out(sim, "CLOSED\r\n\r\nOK\r\n");
+}
+
+static void
+esp8266_sim_cipsend(esp8266_sim_t* sim, const char* p){
+	int32_t link = esp8266_sim_link(sim, &p);
+	int32_t len = esp8266_sim_number(&p);
+
+	if(link < 0 || len <= 0 || len > ESP8266_SEND_MAX || *p != '\0' || sim->cipmode != 0){
+		esp8266_sim_out(sim, SIM_ERROR);
+		return;
+	}
+	if(!sim->links[link]){
+		esp8266_sim_out(sim, "link is not valid\r\n\r\nERROR\r\n");
+		return;
+	}
+	sim->data_link = link;
+	sim->data_len = 0;
+	sim->data_expected = len;
+	esp8266_sim_out(sim, "\r\nOK\r\n> ");
+}
+
+/* Answer a command line. What comes after the echo is sent latency ms later. */
+static void
+esp8266_sim_command(esp8266_sim_t* sim){
+	const char* line = sim->line;
+
+	sim->commands++;
+
+	/* Still working on the last one, the command is dropped */
+	if((int32_t)(sim->time - sim->hold_until) < 0){
+		esp8266_sim_out(sim, "busy p...\r\n");
+		return;
+	}
+
+	esp8266_sim_out(sim, line);
+	esp8266_sim_out(sim, "\r\r\n");
+	sim->hold_until = sim->time + sim->latency;
+
+	for(uint8_t i = 0; i < ESP8266_SIM_FAULTS; i++){
+		esp8266_sim_fault_t* fault = &sim->faults[i];
+		if(fault->count > 0 && strncmp(line, fault->command, strlen(fault->command)) == 0){
+			fault->count--;
+			esp8266_sim_out(sim, fault->reply);
+			return;
+		}
+	}
+
+	int32_t value;
+	const char* p;
+
+	if(sim->line_overflow)
+		esp8266_sim_out(sim, SIM_ERROR);
+
+	else if(esp8266_sim_is(line, "AT"))
+		esp8266_sim_out(sim, SIM_OK);
+
+	else if(esp8266_sim_is(line, "AT+RST")){
+		esp8266_sim_out(sim, SIM_OK);
+		sim->boot_at = sim->time + sim->latency + ESP8266_SIM_BOOT_TIME;
+	}
+
+	else if(esp8266_sim_is(line, "AT+GMR"))
+		esp8266_sim_out(sim, SIM_GMR);
+
+	else if(esp8266_sim_is(line, "AT+CWMODE_CUR?") || esp8266_sim_is(line, "AT+CWMODE?")){
+		esp8266_sim_out(sim, line[9] == '_' ? "+CWMODE_CUR:" : "+CWMODE:");
+		esp8266_sim_out_uint(sim, sim->cwmode, "\r\n\r\nOK\r\n");
+	}
+
+	else if(esp8266_sim_is(line, "AT+CWMODE=") || esp8266_sim_is(line, "AT+CWMODE_CUR=")){
+		p = strchr(line, '=') + 1;
+		value = esp8266_sim_number(&p);
+		if(value < 1 || value > 3 || *p != '\0')
+			esp8266_sim_out(sim, SIM_ERROR);
+		else {
+			sim->cwmode = value;
+			esp8266_sim_out(sim, SIM_OK);
+		}
+	}
+
+	else if(esp8266_sim_is(line, "AT+CWJAP?"))
+		esp8266_sim_out(sim, sim->wifi ? "+CWJAP:\"sim\",\"02:00:00:00:00:01\",1,-40\r\n\r\nOK\r\n"
+									   : "No AP\r\n\r\nOK\r\n");
+
+	else if(esp8266_sim_is(line, "AT+CWJAP=")){
+		if(sim->cwmode == 2 || line[9] != '"')
+			esp8266_sim_out(sim, SIM_ERROR);
+		else {
+			if(sim->wifi){
+				esp8266_sim_close_all(sim);
+				esp8266_sim_out(sim, "WIFI DISCONNECT\r\n");
+			}
+			sim->wifi = true;
+			esp8266_sim_out(sim, "WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n");
+		}
+	}
+
+	else if(esp8266_sim_is(line, "AT+CWQAP")){
+		esp8266_sim_out(sim, SIM_OK);
+		if(sim->wifi){
+			esp8266_sim_close_all(sim);
+			esp8266_sim_out(sim, "WIFI DISCONNECT\r\n");
+		}
+		sim->wifi = false;
+	}
+
+	else if(esp8266_sim_is(line, "AT+CWAUTOCONN="))
+		esp8266_sim_out(sim, SIM_OK);
+
+	else if(esp8266_sim_is(line, "AT+CIPMUX?"))
+	{
+		esp8266_sim_out(sim, "+CIPMUX:");
+		esp8266_sim_out_uint(sim, sim->cipmux, "\r\n\r\nOK\r\n");
+	}
+
+	else if(esp8266_sim_is(line, "AT+CIPMUX=")){
+		p = line + 10;
+		value = esp8266_sim_number(&p);
+		bool open = false;
+		for(uint8_t link = 0; link < ESP8266_MAX_LINKS; link++)
+			open |= sim->links[link];
+
+		if(open)
+			esp8266_sim_out(sim, "link is builded\r\n\r\nERROR\r\n");
+		else if(value < 0 || value > 1 || *p != '\0' || (value == 1 && sim->cipmode == 1))
+			esp8266_sim_out(sim, SIM_ERROR);
+		else {
+			sim->cipmux = value;
+			esp8266_sim_out(sim, SIM_OK);
+		}
+	}
+
+	else if(esp8266_sim_is(line, "AT+CIPMODE=")){
+		p = line + 11;
+		value = esp8266_sim_number(&p);
+		if(value < 0 || value > 1 || *p != '\0' || (value == 1 && sim->cipmux == 1))
+			esp8266_sim_out(sim, SIM_ERROR);
+		else {
+			sim->cipmode = value;
+			esp8266_sim_out(sim, SIM_OK);
+		}
+	}
+
+	else if(esp8266_sim_is(line, "AT+CIPSTART="))
+		esp8266_sim_cipstart(sim, line + 12);
+
+	else if(esp8266_sim_is(line, "AT+CIPCLOSE") || esp8266_sim_is(line, "AT+CIPCLOSE="))
+		esp8266_sim_cipclose(sim, line[11] == '=' ? line + 12 : line + 11);
+
+	else if(esp8266_sim_is(line, "AT+CIPSEND")){
+		if(sim->cipmode != 1 || !sim->links[0])
+			esp8266_sim_out(sim, SIM_ERROR);
+		else {
+			sim->passthrough = true;
+			sim->plus = 0;
+			esp8266_sim_out(sim, "\r\nOK\r\n\r\n>");
+		}
+	}
+
+	else if(esp8266_sim_is(line, "AT+CIPSEND="))
+		esp8266_sim_cipsend(sim, line + 11);
+
+	else
+		esp8266_sim_out(sim, SIM_ERROR);
+}
+
+/* The data after AT+CIPSEND is all there */
+static void
+esp8266_sim_data(esp8266_sim_t* sim){
+	sim->data_expected = 0;
+	sim->hold_until = sim->time + sim->latency;
+	esp8266_sim_out(sim, "\r\nRecv ");
+	esp8266_sim_out_uint(sim, sim->data_len, " bytes\r\n");
+	esp8266_sim_out(sim, "\r\nSEND OK\r\n");
+
+	if(sim->remote != NULL)
+		sim->remote(sim, sim->data_link, sim->data, sim->data_len, sim->remote_context);
+}
+
+/* Handle a byte from the driver outside of passthrough */
+static void
+esp8266_sim_byte(esp8266_sim_t* sim, uint8_t c){
+
+	if(sim->data_expected > 0){
+		sim->data[sim->data_len++] = c;
+		if(sim->data_len == sim->data_expected)
+			esp8266_sim_data(sim);
+		return;
+	}
+
+	if(c == '\n'){
+		if(sim->line_len > 0 && sim->line[sim->line_len - 1] == '\r')
+			sim->line_len--;
+		sim->line[sim->line_len] = '\0';
+		if(sim->line_len > 0)
+			esp8266_sim_command(sim);
+		sim->line_len = 0;
+		sim->line_overflow = false;
+		return;
+	}
+
+	/* What does not fit is dropped, the command is answered with ERROR */
+	if(sim->line_len < ESP8266_SIM_LINE_SIZE - 1)
+		sim->line[sim->line_len++] = c;
+	else
+		sim->line_overflow = true;
+}
+
+/* Hand bytes sent in passthrough to the remote. '+' that come after a quiet ms are held
+ * back, three of them followed by another quiet ms are the "+++" that ends passthrough. */
+static void
+esp8266_sim_passthrough(esp8266_sim_t* sim, const uint8_t* data, uint16_t len){
+	uint16_t i = 0;
+
+	while(i < len && data[i] == '+' && sim->plus < 3 && (sim->plus > 0 || sim->input_quiet > 0)){
+		sim->plus++;
+		i++;
+	}
+	if(i == len)
+		return;
+
+	/* Not the escape, the '+' held back are data after all */
+	if(sim->plus > 0 && sim->remote != NULL)
+		sim->remote(sim, 0, (const uint8_t*) "+++", sim->plus, sim->remote_context);
+	sim->plus = 0;
+	if(sim->remote != NULL)
+		sim->remote(sim, 0, &data[i], len - i, sim->remote_context);
+}
+
+/* Take up to max bytes of what the driver transmits */
+static void
+esp8266_sim_input(esp8266_sim_t* sim, uint16_t max){
+	UART_HandleTypeDef* huart = &sim->huart;
+
+	if(huart->gState != HAL_UART_STATE_BUSY_TX){
+		if(sim->passthrough && sim->plus == 3)
+			sim->passthrough = false;
+		else if(sim->plus > 0 && sim->remote != NULL)
+			sim->remote(sim, 0, (const uint8_t*) "+++", sim->plus, sim->remote_context);
+		sim->plus = 0;
+		sim->input_quiet++;
+		return;
+	}
+
+	uint16_t len = huart->TxXferCount < max ? huart->TxXferCount : max;
+	const uint8_t* data = huart->pTxBuffPtr + (huart->TxXferSize - huart->TxXferCount);
+
+	/* A replay does not answer, the answers are in the trace */
+	if(sim->replay)
+		;
+	else if(sim->passthrough)
+		esp8266_sim_passthrough(sim, data, len);
+	else {
+		for(uint16_t i = 0; i < len; i++)
+			esp8266_sim_byte(sim, data[i]);
+	}
+	sim->received += len;
+	sim->input_quiet = 0;
+
+	/* Like the DMA and the transmission complete interrupt */
+	huart->TxXferCount -= len;
+	if(huart->TxXferCount == 0){
+		CLEAR_BIT(sim->regs.CR3, USART_CR3_DMAT);
+		huart->gState = HAL_UART_STATE_READY;
+		HAL_UART_TxCpltCallback(huart);
+	}
+}
+
+/* Queue the records of the trace that are due. rate is bytes per ms on the uart. */
+static void
+esp8266_sim_play(esp8266_sim_t* sim, uint16_t rate){
+	esp8266_trace_record_t* record = &sim->replay_record;
+
+	for(;;){
+		if(record->len == 0 && !esp8266_trace_next(&sim->replay_reader, record))
+			return;
+
+		if(record->direction == ESP8266_TRACE_TX){
+			/* The time of the trace goes on from when the driver starts sending the same */
+			if(sim->received <= sim->replay_sent)
+				return;
+			sim->replay_sent += record->len;
+			sim->replay_offset = sim->time - record->time;
+		}
+		else {
+			/* Queued early by the time the bytes take on the uart, so that they are in at the time of the trace */
+			uint32_t due = sim->replay_offset + record->time - record->len / rate;
+
+			if((int32_t)(sim->time - due) < 0 || ESP8266_SIM_OUT_SIZE - ring_buffer_used(&sim->out) < record->len)
+				return;
+			ring_buffer_write(&sim->out, record->data, record->len);
+		}
+		record->len = 0;
+	}
+}
+
+/* The module has restarted */
+static void
+esp8266_sim_boot(esp8266_sim_t* sim){
+	sim->boot_at = 0;
+	sim->wifi = false;
+	sim->cipmux = 0;
+	sim->cipmode = 0;
+	sim->passthrough = false;
+	sim->data_expected = 0;
+	sim->line_len = 0;
+	memset(sim->links, 0, sizeof(sim->links));
+	esp8266_sim_out(sim, SIM_BOOT);
+}
+
+/* Deliver up to max bytes to the receive buffer of the driver, calling the HAL callbacks
+ * the way the DMA and the uart would */
+static void
+esp8266_sim_output(esp8266_sim_t* sim, uint16_t max){
+	UART_HandleTypeDef* huart = &sim->huart;
+	bool receiving = huart->RxState == HAL_UART_STATE_BUSY_RX;
+	uint16_t len = 0;
+	uint8_t c;
+
+	/* HAL_UART_AbortReceive clears the count, the DMA starts at the beginning of the buffer again */
+	if(receiving && huart->RxXferCount == 0){
+		huart->RxXferCount = huart->RxXferSize;
+		sim->rx_pos = 0;
+		sim->output_quiet = RX_QUIET_TIME;
+	}
+
+	while((int32_t)(sim->time - sim->hold_until) >= 0 && len < max && ring_buffer_get(&sim->out, &c)){
+		len++;
+		sim->sent++;
+
+		if(sim->loss > 0){
+			sim->seed = sim->seed * 1103515245 + 12345;
+			if((sim->seed >> 16) % sim->loss == 0){
+				sim->lost++;
+				continue;
+			}
+		}
+		if(!receiving){
+			sim->lost++;
+			continue;
+		}
+
+		huart->pRxBuffPtr[sim->rx_pos++] = c;
+		if(sim->rx_pos == huart->RxXferSize / 2)
+			HAL_UARTEx_RxEventCallback(huart, sim->rx_pos);
+		if(sim->rx_pos == huart->RxXferSize){
+			HAL_UARTEx_RxEventCallback(huart, sim->rx_pos);
+			sim->rx_pos = 0;
+		}
+	}
+
+	if(len > 0){
+		sim->output_quiet = 0;
+
+		/* The line goes idle at the end of the burst */
+		if(receiving && sim->rx_pos != 0 && sim->rx_pos != huart->RxXferSize / 2)
+			HAL_UARTEx_RxEventCallback(huart, sim->rx_pos);
+		return;
+	}
+
+	/* The receiver timeout, once after the last byte */
+	if(++sim->output_quiet == RX_QUIET_TIME && receiving && READ_BIT(sim->regs.CR2, USART_CR2_RTOEN)){
+		SET_BIT(sim->regs.ISR, USART_ISR_RTOF);
+		esp8266_uart_irq(huart);
+		CLEAR_BIT(sim->regs.ISR, USART_ISR_RTOF);
+	}
+}
+
+bool
+esp8266_sim_init(esp8266_sim_t* sim, esp8266_t* esp){
+	running = NULL;
+	memset(sim, 0, sizeof(*sim));
+
+	/* Only what the HAL needs to send and receive, it is never initialised */
+	sim->huart.Instance = &sim->regs;
+	sim->huart.Init.BaudRate = ESP8266_BAUD_DEFAULT;
+	sim->huart.gState = HAL_UART_STATE_READY;
+	sim->huart.RxState = HAL_UART_STATE_READY;
+	ring_buffer_init(&sim->out, sim->out_buffer, ESP8266_SIM_OUT_SIZE);
+	sim->cwmode = 1;
+	sim->output_quiet = RX_QUIET_TIME;
+
+	if(!esp8266_attach(esp, &sim->huart))
+		return false;
+	sim->esp = esp;
+	running = sim;
+	return true;
+}
+
+void
+esp8266_sim_stop(esp8266_sim_t* sim){
+	if(running == sim)
+		running = NULL;
+	if(sim->esp != NULL)
+		esp8266_detach(sim->esp);
+	sim->esp = NULL;
+}
+
+void
+esp8266_sim_tick(void){
+	esp8266_sim_t* sim = running;
+
+	if(sim == NULL)
+		return;
+
+	/* Bytes per ms at the rate of the uart, 10 bits each */
+	uint16_t rate = sim->huart.Init.BaudRate / 10000;
+	if(rate == 0)
+		rate = 1;
+
+	sim->time++;
+	esp8266_sim_input(sim, rate);
+	if(sim->replay)
+		esp8266_sim_play(sim, rate);
+	if(sim->boot_at != 0 && (int32_t)(sim->time - sim->boot_at) >= 0)
+		esp8266_sim_boot(sim);
+	esp8266_sim_output(sim, rate);
+}
+
+void
+esp8266_sim_set_remote(esp8266_sim_t* sim, esp8266_sim_remote_t remote, void* context){
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	sim->remote = remote;
+	sim->remote_context = context;
+	__set_PRIMASK(primask);
+}
+
+void
+esp8266_sim_set_latency(esp8266_sim_t* sim, uint32_t ms){
+	sim->latency = ms;
+}
+
+void
+esp8266_sim_set_loss(esp8266_sim_t* sim, uint16_t one_in, uint32_t seed){
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	sim->loss = one_in;
+	sim->seed = seed;
+	__set_PRIMASK(primask);
+}
+
+bool
+esp8266_sim_fail(esp8266_sim_t* sim, const char* command, const char* reply, uint8_t count){
+	esp8266_sim_fault_t* slot = NULL;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	for(uint8_t i = 0; i < ESP8266_SIM_FAULTS; i++){
+		esp8266_sim_fault_t* fault = &sim->faults[i];
+		if(fault->count > 0 && strcmp(fault->command, command) == 0){
+			slot = fault;
+			break;
+		}
+		if(fault->count == 0 && slot == NULL)
+			slot = fault;
+	}
+	if(slot != NULL){
+		slot->command = command;
+		slot->reply = reply;
+		slot->count = count;
+	}
+	__set_PRIMASK(primask);
+	return slot != NULL;
+}
+
+uint16_t
+esp8266_sim_receive(esp8266_sim_t* sim, uint8_t link, const uint8_t* data, uint16_t len){
+	uint16_t queued = 0;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	while(queued < len){
+		uint16_t piece = len - queued > ESP8266_SIM_IPD_MAX ? ESP8266_SIM_IPD_MAX : len - queued;
+
+		/* "\r\n+IPD,<link>,<len>:" is at most 20 bytes, the whole piece has to fit */
+		if(ESP8266_SIM_OUT_SIZE - ring_buffer_used(&sim->out) < piece + 20u)
+			break;
+
+		esp8266_sim_out(sim, "\r\n+IPD,");
+		esp8266_sim_out_link(sim, link);
+		esp8266_sim_out_uint(sim, piece, ":");
+		ring_buffer_write(&sim->out, data + queued, piece);
+		queued += piece;
+	}
+	__set_PRIMASK(primask);
+	return queued;
+}
+
+void
+esp8266_sim_close(esp8266_sim_t* sim, uint8_t link){
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if(link < ESP8266_MAX_LINKS && sim->links[link]){
+		sim->links[link] = false;
+		sim->passthrough = false;
+		esp8266_sim_out_link(sim, link);
+		esp8266_sim_out(sim, "CLOSED\r\n");
+	}
+	__set_PRIMASK(primask);
+}
+
+void
+esp8266_sim_replay(esp8266_sim_t* sim, const uint8_t* trace, uint32_t len){
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	esp8266_trace_reader_init(&sim->replay_reader, trace, len);
+	sim->replay_record.len = 0;
+	sim->replay_sent = sim->received;
+	sim->replay_offset = sim->time;
+	sim->replay = true;
+	__set_PRIMASK(primask);
+}
+
+bool
+esp8266_sim_replaying(esp8266_sim_t* sim){
+	return sim->replay && (sim->replay_record.len > 0 || sim->replay_reader.pos < sim->replay_reader.len);
+}
+
+bool
+esp8266_sim_write(esp8266_sim_t* sim, const char* text){
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	bool written = esp8266_sim_out(sim, text);
+	__set_PRIMASK(primask);
+	return written;
+}
+
+#endif /* ESP8266_SIM */
@@ -0,0 +1,132 @@
+/**
+******************************************************************************
+@brief uart trace for the ESP8266 wifi-module
+@details Records what goes over the uart in a compact form, see
+		 esp8266_trace.h for the format.
+
+@file esp8266_trace.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "esp8266_trace.h"
+#include <string.h>
+
+void
+esp8266_trace_init(esp8266_trace_t* trace, uint8_t* buffer, uint32_t size){
+	memset(trace, 0, sizeof(*trace));
+	trace->buffer = buffer;
+	trace->size = size;
+}
+
+/* Put one record in the buffer, len is 1 to ESP8266_TRACE_RECORD_MAX */
+static bool
+esp8266_trace_put(esp8266_trace_t* trace, esp8266_trace_direction_t direction, uint32_t delta,
+				  const uint8_t* data, uint32_t len){
+	if(trace->size - trace->len < ESP8266_TRACE_RECORD_HEAD + len)
+		return false;
+
+	uint8_t* p = &trace->buffer[trace->len];
+
+	*p++ = (direction == ESP8266_TRACE_TX ? 0x80 : 0) | (len - 1);
+	while(delta >= 0x80){
+		*p++ = 0x80 | (delta & 0x7f);
+		delta >>= 7;
+	}
+	*p++ = delta;
+	memcpy(p, data, len);
+
+	trace->len = p + len - trace->buffer;
+	trace->records++;
+	trace->bytes[direction] += len;
+	return true;
+}
+
+bool
+esp8266_trace_record(esp8266_trace_t* trace, esp8266_trace_direction_t direction, uint32_t time,
+					 const uint8_t* data, uint32_t len){
+	uint32_t primask = __get_PRIMASK();
+	bool recorded = true;
+
+	/* The receive side records from the interrupt, it must not cut into a record of the main loop */
+	__disable_irq();
+	while(len > 0){
+		uint32_t piece = len > ESP8266_TRACE_RECORD_MAX ? ESP8266_TRACE_RECORD_MAX : len;
+		uint32_t delta = trace->records > 0 ? time - trace->last : 0;
+
+		if(!esp8266_trace_put(trace, direction, delta, data, piece)){
+			trace->dropped += len;
+			recorded = false;
+			break;
+		}
+		trace->last = time;
+		data += piece;
+		len -= piece;
+	}
+	__set_PRIMASK(primask);
+	return recorded;
+}
+
+void
+esp8266_trace_reader_init(esp8266_trace_reader_t* reader, const uint8_t* data, uint32_t len){
+	reader->data = data;
+	reader->len = len;
+	reader->pos = 0;
+	reader->time = 0;
+}
+
+bool
+esp8266_trace_next(esp8266_trace_reader_t* reader, esp8266_trace_record_t* record){
+	uint32_t pos = reader->pos;
+	uint32_t delta = 0;
+	uint8_t shift = 0;
+	uint8_t c;
+
+	if(pos >= reader->len)
+		return false;
+
+	uint8_t header = reader->data[pos++];
+	do {
+		if(pos >= reader->len || shift > 28)
+			return false;
+		c = reader->data[pos++];
+		delta |= (uint32_t) (c & 0x7f) << shift;
+		shift += 7;
+	} while(c & 0x80);
+
+	uint16_t len = (header & 0x7f) + 1;
+	if(reader->len - pos < len)
+		return false;
+
+	reader->time += delta;
+	record->direction = header & 0x80 ? ESP8266_TRACE_TX : ESP8266_TRACE_RX;
+	record->time = reader->time;
+	record->data = &reader->data[pos];
+	record->len = len;
+	reader->pos = pos + len;
+	return true;
+}
+
+/* Send a byte on the trace port, waits while the port is full */
+static void
+esp8266_trace_itm(uint8_t c){
+	while(ITM->PORT[ESP8266_TRACE_ITM_PORT].u32 == 0);
+	ITM->PORT[ESP8266_TRACE_ITM_PORT].u8 = c;
+}
+
+bool
+esp8266_trace_dump(esp8266_trace_t* trace){
+	if((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0 || (ITM->TER & (1UL << ESP8266_TRACE_ITM_PORT)) == 0)
+		return false;
+
+	const uint8_t header[] = {
+		'E', '8', 'T', 'R', ESP8266_TRACE_VERSION,
+		trace->len & 0xff, (trace->len >> 8) & 0xff, (trace->len >> 16) & 0xff
+	};
+
+	for(uint32_t i = 0; i < sizeof(header); i++)
+		esp8266_trace_itm(header[i]);
+	for(uint32_t i = 0; i < trace->len; i++)
+		esp8266_trace_itm(trace->buffer[i]);
+	return true;
+}
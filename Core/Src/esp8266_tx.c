@@ -0,0 +1,178 @@
+/**
+******************************************************************************
+@brief DMA transmit engine for the ESP8266 wifi-module
+@details Sends a queue of segments with DMA, see esp8266_tx.h for how the
+		 queue is shared with the interrupt.
+
+@file esp8266_tx.c
+@author agent@local
+@date 16-10-2026
+@version 1.2
+*******************************************************************************/
+#include "esp8266_tx.h"
+
+void
+esp8266_tx_init(esp8266_tx_t* tx, UART_HandleTypeDef* huart){
+	tx->huart = huart;
+	atomic_store_explicit(&tx->head, 0, memory_order_relaxed);
+	atomic_store_explicit(&tx->tail, 0, memory_order_relaxed);
+	tx->running = false;
+	tx->offset = 0;
+	tx->sending = 0;
+	tx->cts_port = NULL;
+	tx->cts_pin = 0;
+	tx->held = false;
+	tx->bytes = 0;
+	tx->errors = 0;
+	tx->stalls = 0;
+}
+
+void
+esp8266_tx_flow(esp8266_tx_t* tx, GPIO_TypeDef* port, uint16_t pin){
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	tx->cts_port = port;
+	tx->cts_pin = pin;
+	tx->held = false;
+	__set_PRIMASK(primask);
+}
+
+/* Remove the segment at tail and call its callback. The segment is copied first,
+ * so the callback can queue new segments in its place. */
+static void
+esp8266_tx_done(esp8266_tx_t* tx){
+	uint32_t tail = atomic_load_explicit(&tx->tail, memory_order_relaxed);
+	esp8266_tx_segment_t segment = tx->segments[tail & (ESP8266_TX_QUEUE_SIZE - 1)];
+
+	tx->bytes += segment.len;
+	tx->offset = 0;
+	atomic_store_explicit(&tx->tail, tail + 1, memory_order_release);
+
+	if(segment.callback != NULL)
+		segment.callback(segment.context);
+}
+
+/* Start the DMA on the rest of the segment at tail. Segments that have nothing left to
+ * send, such as empty ones, are done right away. Called from the interrupt, or with the
+ * interrupts off. */
+static void
+esp8266_tx_next(esp8266_tx_t* tx){
+
+	while(atomic_load_explicit(&tx->tail, memory_order_relaxed) != atomic_load_explicit(&tx->head, memory_order_acquire)){
+		esp8266_tx_segment_t* segment = &tx->segments[atomic_load_explicit(&tx->tail, memory_order_relaxed) & (ESP8266_TX_QUEUE_SIZE - 1)];
+
+		if(tx->offset == segment->len){
+			esp8266_tx_done(tx);
+			continue;
+		}
+
+		uint16_t len = segment->len - tx->offset;
+		if(tx->cts_port != NULL){
+
+			/* The ESP8266 has raised its RTS, esp8266_tx_kick tries again */
+			if(HAL_GPIO_ReadPin(tx->cts_port, tx->cts_pin) == GPIO_PIN_SET){
+				if(!tx->held)
+					tx->stalls++;
+				tx->held = true;
+				break;
+			}
+			tx->held = false;
+			if(len > ESP8266_TX_FLOW_CHUNK)
+				len = ESP8266_TX_FLOW_CHUNK;
+		}
+
+		/* The HAL can return busy if the main loop has the uart locked, such as when
+		 * restarting the reception. The segment stays queued and esp8266_tx_kick tries again. */
+		tx->sending = len;
+		tx->running = tx->huart == NULL
+					  || HAL_UART_Transmit_DMA(tx->huart, (uint8_t*) segment->data + tx->offset, len) == HAL_OK;
+		return;
+	}
+	tx->running = false;
+}
+
+void
+esp8266_tx_kick(esp8266_tx_t* tx){
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if(!tx->running)
+		esp8266_tx_next(tx);
+	__set_PRIMASK(primask);
+}
+
+/* Put a segment in the queue, does not start the DMA */
+static void
+esp8266_tx_queue(esp8266_tx_t* tx, const uint8_t* data, uint16_t len,
+				 esp8266_tx_callback_t callback, void* context){
+	uint32_t head = atomic_load_explicit(&tx->head, memory_order_relaxed);
+	esp8266_tx_segment_t* segment = &tx->segments[head & (ESP8266_TX_QUEUE_SIZE - 1)];
+
+	segment->data = data;
+	segment->len = len;
+	segment->callback = callback;
+	segment->context = context;
+	atomic_store_explicit(&tx->head, head + 1, memory_order_release);
+}
+
+bool
+esp8266_tx_write(esp8266_tx_t* tx, const uint8_t* data, uint16_t len,
+				 esp8266_tx_callback_t callback, void* context){
+	if(esp8266_tx_free(tx) == 0)
+		return false;
+
+	esp8266_tx_queue(tx, data, len, callback, context);
+	esp8266_tx_kick(tx);
+	return true;
+}
+
+bool
+esp8266_tx_writev(esp8266_tx_t* tx, const esp8266_tx_part_t* parts, uint8_t count,
+				  esp8266_tx_callback_t callback, void* context){
+	if(count == 0 || esp8266_tx_free(tx) < count)
+		return false;
+
+	/* All parts are queued before the DMA is started, so the interrupt never sees half of them */
+	for(uint8_t i = 0; i < count; i++){
+		bool last = i == count - 1;
+		esp8266_tx_queue(tx, (const uint8_t*) parts[i].data, parts[i].len,
+						 last ? callback : NULL, last ? context : NULL);
+	}
+	esp8266_tx_kick(tx);
+	return true;
+}
+
+void
+esp8266_tx_complete(esp8266_tx_t* tx){
+	if(!tx->running)
+		return;
+
+	tx->offset += tx->sending;
+	esp8266_tx_next(tx);
+}
+
+void
+esp8266_tx_error(esp8266_tx_t* tx){
+
+	/* Receive errors do not stop the transmission. If the uart is ready while a segment
+	 * is being sent, the DMA was stopped and there will be no transfer complete for it.
+	 * Sending the segment again would send part of it twice, so it is counted and dropped. */
+	if(tx->running && tx->huart != NULL && tx->huart->gState == HAL_UART_STATE_READY){
+		tx->errors++;
+		esp8266_tx_done(tx);
+		esp8266_tx_next(tx);
+	}
+}
+
+uint32_t
+esp8266_tx_free(esp8266_tx_t* tx){
+	return ESP8266_TX_QUEUE_SIZE - (atomic_load_explicit(&tx->head, memory_order_relaxed)
+									- atomic_load_explicit(&tx->tail, memory_order_acquire));
+}
+
+bool
+esp8266_tx_busy(esp8266_tx_t* tx){
+	esp8266_tx_kick(tx);
+	return atomic_load_explicit(&tx->tail, memory_order_acquire) != atomic_load_explicit(&tx->head, memory_order_relaxed);
+}
@@ -19,12 +19,14 @@
 /* USER CODE END Header */
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "dma.h"
 #include "usart.h"
 #include "gpio.h"
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "unit_test.h"
+#include "ESP8266.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -46,7 +48,13 @@
 /* Private variables ---------------------------------------------------------*/
 
 /* USER CODE BEGIN PV */
+/* The ESP8266 modules, on UART4 and USART2 */
+static esp8266_t wifi;
+static esp8266_t wifi2;
 
+/* Log of the modules, sent on ITM port 2 when the main loop has time, see esp8266_log.h */
+static uint8_t wifi_log_buffer[1024];
+static esp8266_log_t wifi_log;
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -97,12 +105,24 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_UART4_Init();
+  MX_USART2_UART_Init();
   /* USER CODE BEGIN 2 */
   #ifdef RUN_UNIT_TEST
   	  unit_test();
   #else
   #endif
+
+  /* Each module gets its own uart, buffers and request queue, see esp8266_attach */
+  esp8266_attach(&wifi, &huart4);
+  esp8266_set_flow_pins(&wifi, ESP_RTS_GPIO_Port, ESP_RTS_Pin, ESP_CTS_GPIO_Port, ESP_CTS_Pin);
+  init_uart_interrupt(&wifi);
+  esp8266_attach(&wifi2, &huart2);
+  init_uart_interrupt(&wifi2);
+  esp8266_log_init(&wifi_log, wifi_log_buffer, sizeof(wifi_log_buffer));
+  esp8266_set_log(&wifi, &wifi_log);
+  esp8266_set_log(&wifi2, &wifi_log);
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -112,6 +132,12 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+	  /* Work on queued ESP8266 requests, see esp8266_send_command_async */
+	  esp8266_poll(&wifi);
+	  esp8266_poll(&wifi2);
+
+	  /* Send what has been logged, as much as the SWO takes without waiting */
+	  esp8266_log_drain(&wifi_log);
   }
   /* USER CODE END 3 */
 }
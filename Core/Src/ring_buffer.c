@@ -0,0 +1,169 @@
+/**
+******************************************************************************
+@brief single producer, single consumer ring buffer
+@details See ring_buffer.h.
+
+@file ring_buffer.c
+@author agent@local
+@date 16-10-2026
+@version 1.1
+*******************************************************************************/
+#include "ring_buffer.h"
+#include <string.h>
+
+bool
+ring_buffer_init(ring_buffer_t* ring, uint8_t* buffer, uint32_t size){
+
+	if(size == 0 || (size & (size - 1)) != 0)
+		return false;
+
+	ring->buffer = buffer;
+	ring->size = size;
+	ring->mask = size - 1;
+	ring->dropped = 0;
+	ring->overwritten = 0;
+	ring->high_water = 0;
+	ring_buffer_reset(ring);
+	return true;
+}
+
+void
+ring_buffer_reset(ring_buffer_t* ring){
+	atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+	atomic_store_explicit(&ring->tail, 0, memory_order_release);
+}
+
+/* Producer: save the fill level if it is the highest so far */
+static void
+update_high_water(ring_buffer_t* ring, uint32_t head){
+	uint32_t used = head - atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if(used > ring->size)
+		used = ring->size;
+	if(used > ring->high_water)
+		ring->high_water = used;
+}
+
+uint32_t
+ring_buffer_write(ring_buffer_t* ring, const uint8_t* data, uint32_t len){
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	uint32_t space = ring->size - (head - tail);
+
+	if(len > space){
+		ring->dropped += len - space;
+		len = space;
+	}
+
+	/* Copy in at most two pieces, up to the end of the buffer and then from the start */
+	uint32_t start = head & ring->mask;
+	uint32_t first = ring->size - start;
+	if(first > len)
+		first = len;
+
+	memcpy(&ring->buffer[start], data, first);
+	memcpy(ring->buffer, data + first, len - first);
+
+	atomic_store_explicit(&ring->head, head + len, memory_order_release);
+	update_high_water(ring, head + len);
+	return len;
+}
+
+void
+ring_buffer_commit(ring_buffer_t* ring, uint32_t len){
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed) + len;
+
+	atomic_store_explicit(&ring->head, head, memory_order_release);
+	update_high_water(ring, head);
+}
+
+uint32_t
+ring_buffer_available(ring_buffer_t* ring){
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	uint32_t available = head - tail;
+
+	/* A committing producer has lapped us, the oldest bytes are overwritten so skip past them */
+	if(available > ring->size){
+		ring->overwritten += available - ring->size;
+		atomic_store_explicit(&ring->tail, head - ring->size, memory_order_release);
+		available = ring->size;
+	}
+	return available;
+}
+
+uint32_t
+ring_buffer_used(ring_buffer_t* ring){
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	uint32_t used = head - tail;
+
+	/* Lapped, the consumer skips the overwritten bytes when it gets to them */
+	return used > ring->size ? ring->size : used;
+}
+
+uint32_t
+ring_buffer_read(ring_buffer_t* ring, uint8_t* dst, uint32_t len){
+	uint32_t available = ring_buffer_available(ring);
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	if(len > available)
+		len = available;
+
+	uint32_t start = tail & ring->mask;
+	uint32_t first = ring->size - start;
+	if(first > len)
+		first = len;
+
+	memcpy(dst, &ring->buffer[start], first);
+	memcpy(dst + first, ring->buffer, len - first);
+
+	atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+	return len;
+}
+
+bool
+ring_buffer_get(ring_buffer_t* ring, uint8_t* c){
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	if(head == tail)
+		return false;
+
+	/* Lapped, let ring_buffer_available count it and skip ahead */
+	if(head - tail > ring->size){
+		ring_buffer_available(ring);
+		tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	}
+
+	*c = ring->buffer[tail & ring->mask];
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+uint32_t
+ring_buffer_peek(ring_buffer_t* ring, const uint8_t** data){
+	uint32_t available = ring_buffer_available(ring);
+	uint32_t start = atomic_load_explicit(&ring->tail, memory_order_relaxed) & ring->mask;
+	uint32_t first = ring->size - start;
+
+	*data = &ring->buffer[start];
+	return available < first ? available : first;
+}
+
+void
+ring_buffer_consume(ring_buffer_t* ring, uint32_t len){
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+}
+
+void
+ring_buffer_flush(ring_buffer_t* ring){
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	atomic_store_explicit(&ring->tail, head, memory_order_release);
+}
+
+uint32_t
+ring_buffer_overruns(ring_buffer_t* ring){
+	return ring->dropped + ring->overwritten;
+}
@@ -10,9 +10,54 @@
 
 #include "unit_test.h"
 #include "stdio.h"
+#include "stdlib.h"
 #include "ESP8266.h"
+#include "esp8266_http.h"
+#include "esp8266_sim.h"
+#include "esp8266_log_reader.h"
 
+/* The benchmark build of the host only runs the benchmarks, see CMakeLists.txt */
+#ifndef ESP8266_HOST_BENCHMARK
+#define RUN_RING_BUFFER_TEST
+#define RUN_ESP8266_RX_TEST
+#define RUN_ESP8266_TX_TEST
+#define RUN_ESP8266_PARSER_TEST
+#define RUN_ESP8266_COMMAND_TEST
+#define RUN_ESP8266_HTTP_TEST
+#ifdef ESP8266_SIM
+#define RUN_ESP8266_SIM_TEST
+#endif
+#define RUN_ESP8266_TRACE_TEST
+#define RUN_ESP8266_FUZZ_TEST
+#ifdef ESP8266_LOG_READER
+#define RUN_ESP8266_LOG_TEST
+#endif
+#endif
+
+/* The host build has no module, see Host/Inc/host_hal.h */
+#if !defined(ESP8266_HOST) || defined(ESP8266_HOST_BENCHMARK)
+#define RUN_ESP8266_BENCHMARK
+#endif
+#ifndef ESP8266_HOST
 #define RUN_ESP8266_TEST
+#endif
+
+/* The benchmarks count ticks of esp8266_profile_clock, the DWT cycle counter on the board and
+ * the clock of the workstation in the host benchmark build */
+#ifdef ESP8266_HOST
+#define BENCHMARK_TICKS		"ns"
+#else
+#define BENCHMARK_TICKS		"cycles"
+#endif
+
+/* The module the tests talk to, on UART4 */
+static esp8266_t esp;
+
+#ifdef ESP8266_SIM
+/* The simulated module, and the module of the driver that talks to it */
+static esp8266_sim_t sim;
+static esp8266_t sim_esp;
+#endif
 
 void unit_test(void){
 
@@ -20,6 +65,233 @@ void unit_test(void){
 /* Test begin */
 UNITY_BEGIN();
 
+/* Run tests for the ring buffer */
+#ifdef RUN_RING_BUFFER_TEST
+
+	/* Test that only power of two sizes are accepted */
+	RUN_TEST(test_ring_buffer_size);
+
+	/* Test producer and consumer taking turns with every combination of piece sizes */
+	RUN_TEST(test_ring_buffer_interleaved);
+
+	/* Test that bytes that do not fit are dropped and counted */
+	RUN_TEST(test_ring_buffer_full);
+
+	/* Test that flush empties the ring without touching the data */
+	RUN_TEST(test_ring_buffer_flush);
+
+	/* Test using the bytes in place, across the end of the buffer */
+	RUN_TEST(test_ring_buffer_peek);
+
+	/* Test that the fill level can be read from the producer side without touching the consumer */
+	RUN_TEST(test_ring_buffer_used);
+
+#endif
+
+/* Run tests for the receive engine, these do not need the ESP8266 */
+#ifdef RUN_ESP8266_RX_TEST
+
+	/* Test that no bytes are lost when the DMA wraps around */
+	RUN_TEST(test_esp8266_rx_wrap_around);
+
+	/* Test that the oldest bytes are skipped when the DMA laps the reader */
+	RUN_TEST(test_esp8266_rx_overrun);
+
+	/* Test that every line is passed on at its '\n', without waiting for the line to go idle */
+	RUN_TEST(test_esp8266_rx_line_match);
+
+	/* Test that the line only counts as quiet after a receiver timeout with nothing after it */
+	RUN_TEST(test_esp8266_rx_quiet);
+
+	/* Test that RTS goes up before the ring can overrun, and down when it is read */
+	RUN_TEST(test_esp8266_rx_flow);
+
+	/* Test that +IPD data is handed out from the DMA buffer without going through the parser */
+	RUN_TEST(test_esp8266_rx_payload);
+
+#endif
+
+/* Run tests for the transmit engine, these do not need the ESP8266 */
+#ifdef RUN_ESP8266_TX_TEST
+
+	/* Test that segments are sent in order and the callbacks come when they are done */
+	RUN_TEST(test_esp8266_tx_order);
+
+	/* Test that nothing is queued when the queue is full */
+	RUN_TEST(test_esp8266_tx_full);
+
+	/* Test that flow control sends in pieces */
+	RUN_TEST(test_esp8266_tx_flow);
+
+	/* Test that what CTS held back is sent when it goes down */
+	RUN_TEST(test_esp8266_tx_flow_hold);
+
+#endif
+
+/* Run tests for the response parser, these do not need the ESP8266 */
+#ifdef RUN_ESP8266_PARSER_TEST
+
+	/* Test the events for the responses when initiating the module */
+	RUN_TEST(test_esp8266_parser_init_transcript);
+
+	/* Test the events for the responses when connecting to wifi */
+	RUN_TEST(test_esp8266_parser_wifi_transcript);
+
+	/* Test the events for a http request, +IPD data should not be matched */
+	RUN_TEST(test_esp8266_parser_http_transcript);
+
+	/* Test that the events with multiple connections get the link id */
+	RUN_TEST(test_esp8266_parser_multiple_transcript);
+
+#endif
+
+/* Run tests for the command handling, these do not need the ESP8266 */
+#ifdef RUN_ESP8266_COMMAND_TEST
+
+	/* Test that each type of command gets its own timeout */
+	RUN_TEST(test_esp8266_command_timeout);
+
+	/* Test that every entry in the command table maps back to itself */
+	RUN_TEST(test_esp8266_command_table);
+
+	/* Test that requests longer than 255 bytes keep their length, and that data too long for a request is refused */
+	RUN_TEST(test_esp8266_long_request);
+
+	/* Test the escaping and the buffer checks of the command formatter */
+	RUN_TEST(test_esp8266_format);
+
+	/* Test that rates the uart can not make are turned down without sending anything */
+	RUN_TEST(test_esp8266_baud_range);
+
+	/* Test that two modules on different uarts keep their own data and requests */
+	RUN_TEST(test_esp8266_instances);
+
+	/* Test the buckets and the percentiles of the latency profile */
+	RUN_TEST(test_esp8266_profile_histogram);
+
+#endif
+
+/* Run tests for the HTTP response framing, these do not need the ESP8266 */
+#ifdef RUN_ESP8266_HTTP_TEST
+
+	/* Test that a response ends after Content-Length bytes of body, and that a bad length is an error */
+	RUN_TEST(test_esp8266_http_content_length);
+
+	/* Test that a chunked response ends at the last chunk, no matter how it is split up */
+	RUN_TEST(test_esp8266_http_chunked);
+
+	/* Test that a response without a length ends when the connection is closed */
+	RUN_TEST(test_esp8266_http_closed);
+
+	/* Test that the status, headers and body reach the callbacks, without the 100 Continue and chunk framing */
+	RUN_TEST(test_esp8266_http_callbacks);
+
+	/* Test that a callback can stop a response in the middle of the body */
+	RUN_TEST(test_esp8266_http_abort);
+
+	/* Test that a built request has the same bytes as a sprintf one, and that the pieces are checked */
+	RUN_TEST(test_esp8266_http_request_builder);
+
+#endif
+
+/* Run tests against the simulated ESP8266, these do not need the ESP8266 */
+#ifdef RUN_ESP8266_SIM_TEST
+
+	/* Test initiation and connecting to wifi, through the boot messages after the reset */
+	RUN_TEST(test_esp8266_sim_init);
+
+	/* Test HTTP requests on a kept connection, on one the server closes, and after a broken response */
+	RUN_TEST(test_esp8266_sim_http);
+
+	/* Test that refused commands, missing answers, a slow module and lost bytes are handled */
+	RUN_TEST(test_esp8266_sim_faults);
+
+	/* Test that the time the module thinks shows up in its phase of the profile, and timeouts are kept out */
+	RUN_TEST(test_esp8266_sim_profile);
+
+	/* Test that a request CTS held back is sent by esp8266_poll when CTS goes down */
+	RUN_TEST(test_esp8266_sim_flow_hold);
+
+#endif
+
+/* Run tests for the uart trace, these do not need the ESP8266 */
+#ifdef RUN_ESP8266_TRACE_TEST
+
+	/* Test that records read back as they were written, split up and dropped where they have to be */
+	RUN_TEST(test_esp8266_trace_records);
+
+#ifdef ESP8266_SIM
+	/* Test that everything that goes over the uart of the simulated module is in the trace */
+	RUN_TEST(test_esp8266_trace_capture);
+
+	/* Test that a session with boot garbage, "busy p..." and wifi messages plays back the same */
+	RUN_TEST(test_esp8266_trace_replay);
+#endif
+
+#endif
+
+/* Run random responses through the parser and the driver, these do not need the ESP8266 */
+#ifdef RUN_ESP8266_FUZZ_TEST
+
+	/* Test that the parser only emits valid events on random responses, and finds the next line after them */
+	RUN_TEST(test_esp8266_parser_fuzz);
+
+#ifdef ESP8266_SIM
+	/* Test that random answers from the simulated module get one of the results of the command */
+	RUN_TEST(test_esp8266_command_fuzz);
+#endif
+
+#endif
+
+/* Run tests for the binary log, these do not need the ESP8266 */
+#ifdef RUN_ESP8266_LOG_TEST
+
+	/* Test that records read back as the text printf would make, and a cut off stream up to the cut */
+	RUN_TEST(test_esp8266_log_decode);
+
+	/* Test that records that do not fit are counted, and reported in the stream where they were lost */
+	RUN_TEST(test_esp8266_log_dropped);
+
+	/* Test that more formats than there are ids read back, the ids are sent again */
+	RUN_TEST(test_esp8266_log_formats);
+
+#ifdef ESP8266_SIM
+	/* Test that a request of the simulated module that times out is logged */
+	RUN_TEST(test_esp8266_log_sim);
+#endif
+
+#endif
+
+/* Benchmarks, timed with esp8266_profile_clock */
+#ifdef RUN_ESP8266_BENCHMARK
+
+	/* Throughput of the response parser */
+	RUN_TEST(test_esp8266_parser_benchmark);
+
+	/* Cycles and stack for a POST request with sprintf and with the request builder */
+	RUN_TEST(test_esp8266_http_request_benchmark);
+
+	/* Cycles for the AT commands with sprintf and with the command formatter */
+	RUN_TEST(test_esp8266_format_benchmark);
+
+#ifdef ESP8266_SIM
+	/* Time per request and throughput against the simulated ESP8266, at a few module latencies */
+	RUN_TEST(test_esp8266_sim_benchmark);
+
+	/* Parser cycles on the traffic of a traced session, per byte and for the slowest record */
+	RUN_TEST(test_esp8266_trace_benchmark);
+#endif
+
+#ifndef ESP8266_HOST
+	/* Parser cycles on random responses, the slowest byte has to stay below a bound in cycles */
+	RUN_TEST(test_esp8266_parser_fuzz_benchmark);
+
+	/* Cycles to log a record and to format the same line, the record has to stay below a bound */
+	RUN_TEST(test_esp8266_log_benchmark);
+#endif
+
+#endif
+
 /* Run test for ESP8266 */
 #ifdef RUN_ESP8266_TEST
 
@@ -28,12 +300,20 @@ UNITY_BEGIN();
 	   on different pins 														 */
 	MX_UART4_Init();
 
-	/* Set up interrupt for ESP*/
-	init_uart_interrupt();
+	/* Bind the module to UART4 and set up interrupt for ESP*/
+	esp8266_attach(&esp, &huart4);
+	esp8266_set_flow_pins(&esp, ESP_RTS_GPIO_Port, ESP_RTS_Pin, ESP_CTS_GPIO_Port, ESP_CTS_Pin);
+	init_uart_interrupt(&esp);
 
 	/* Test initiation of ESP8266 */
   	RUN_TEST(test_esp8266_init);
 
+  	/* Test queueing commands without waiting for them */
+  	RUN_TEST(test_esp8266_async);
+
+  	/* Test that a command without an answer times out */
+  	RUN_TEST(test_esp8266_async_timeout);
+
     /* Test connecting to wifi */
     RUN_TEST(test_esp8266_wifi_connect);
 
@@ -44,6 +324,30 @@ UNITY_BEGIN();
     RUN_TEST(test_esp8266_web_request);
     HAL_Delay(2000);
 
+    /* Test sending a request that needs several CIPSEND segments */
+    RUN_TEST(test_esp8266_send_segmented);
+
+    /* Test sending the same request from pieces, without a buffer for it */
+    RUN_TEST(test_esp8266_send_request);
+
+    /* Test two connections open at once */
+    RUN_TEST(test_esp8266_link_pool);
+
+    /* Compare the time per request when connecting for every request and when keeping the connection */
+    RUN_TEST(test_esp8266_http_keep_alive_benchmark);
+
+    /* Test streaming in passthrough mode and print the throughput */
+    RUN_TEST(test_esp8266_stream);
+
+    /* Test switching to higher baud rates and print the throughput at each rate */
+    RUN_TEST(test_esp8266_baud);
+
+    /* Test that a slow reader loses nothing at a high rate with flow control */
+    RUN_TEST(test_esp8266_flow_control);
+
+    /* How long each type of request took */
+    esp8266_print_timing(&esp);
+
 #endif
 
 /* Test end*/
@@ -53,16 +357,63 @@ UNITY_END();
 /* Setup */
 void setUp(void){}
 
-/* Teardown */
-void tearDown(void){}
+/* Teardown, stops the simulated module in case a test failed before it did */
+void tearDown(void){
+#ifdef ESP8266_SIM
+	esp8266_sim_stop(&sim);
+#endif
+}
 
 
 void test_esp8266_init(void){
-	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init(&esp));
+}
+
+/* Completion callback for the async tests, saves the result */
+static void
+async_done(const char* result, void* context){
+	*(const char**) context = result;
+}
+
+void test_esp8266_async(void){
+	const char* first = NULL;
+	const char* second = NULL;
+	uint32_t polls = 0;
+
+	TEST_ASSERT_TRUE(esp8266_send_command_async(&esp, ESP8266_AT, 1000, async_done, &first));
+	TEST_ASSERT_TRUE(esp8266_send_command_async(&esp, ESP8266_AT_CIPMUX_TEST, 1000, async_done, &second));
+	TEST_ASSERT_TRUE(esp8266_busy(&esp));
+
+	/* This is where the application would do other work */
+	while(esp8266_busy(&esp)){
+		esp8266_poll(&esp);
+		polls++;
+	}
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, first);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CIPMUX_0, second);
+	TEST_ASSERT_GREATER_THAN_UINT32(2, polls);
+}
+
+void test_esp8266_async_timeout(void){
+	const char* result = NULL;
+	uint32_t start = HAL_GetTick();
+
+	/* Not terminated by CRLF, so the ESP8266 never answers */
+	TEST_ASSERT_TRUE(esp8266_send_command_async(&esp, "AT", 50, async_done, &result));
+	while(esp8266_busy(&esp))
+		esp8266_poll(&esp);
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_TIMEOUT, result);
+	TEST_ASSERT_UINT32_WITHIN(10, 50, HAL_GetTick() - start);
+	TEST_ASSERT_EQUAL_UINT32(1, esp8266_get_timing(&esp, ESP8266_CMD_OTHER)->timeouts);
+
+	/* Finish the command so the ESP8266 is ready for the next test */
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command(&esp, CRLF));
 }
 
 void test_esp8266_wifi_connect(void){
-	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_wifi_init());
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_wifi_init(&esp));
 }
 
 void test_esp8266_web_connection(void){
@@ -70,8 +421,8 @@ void test_esp8266_web_connection(void){
 	char remote_ip[] = "";
 	char type[] = "TCP";
 	char remote_port[] = "80";
-	esp8266_get_connection_command(connection_command, type, remote_ip, remote_port);
-	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, esp8266_send_command(connection_command));
+	esp8266_get_connection_command(connection_command, sizeof(connection_command), type, remote_ip, remote_port);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, esp8266_send_command(&esp, connection_command));
 }
 
 void test_esp8266_web_request(void){
@@ -82,18 +433,2519 @@ void test_esp8266_web_request(void){
 
 	char host[] = "";
 
-	//	uint8_t len = esp8266_http_get_request(request, HTTP_GET, uri, host);
-	uint8_t len = esp8266_http_get_request(request, HTTP_POST, uri, host);
-	esp8266_get_at_send_command(init_send, len);
+	//	uint16_t len = esp8266_http_get_request(request, sizeof(request), HTTP_GET, uri, host);
+	uint16_t len = esp8266_http_get_request(request, sizeof(request), HTTP_POST, uri, host);
+	esp8266_get_at_send_command(init_send, sizeof(init_send), len);
 
 	test_esp8266_at_send(init_send);
 	test_esp8266_send_data(request);
 }
 
 void test_esp8266_at_send(char* init_send){
-	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, esp8266_send_command(init_send));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, esp8266_send_command(&esp, init_send));
 }
 
 void test_esp8266_send_data(char* request) {
-	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CLOSED, esp8266_send_data(request));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CLOSED, esp8266_send_data(&esp, request));
+}
+
+#define TELEMETRY_SIZE		8192
+
+void test_esp8266_send_segmented(void){
+	static char request[TELEMETRY_SIZE + 256];
+	char connection_command[256] = {0};
+	char remote_ip[] = "";
+	char uri[] = "";
+	char host[] = "";
+
+	/* POST with a JSON body of four times the CIPSEND maximum: [1,1,...,1 ] */
+	uint32_t len = sprintf(request, "%s%s %s\r\n%s%s\r\nContent-Type: application/json\r\nContent-Length: %u\r\n%s\r\n\r\n",
+						   HTTP_POST, uri, HTTP_VERSION, HTTP_HOST, host, TELEMETRY_SIZE, HTTP_CONNECTION_CLOSE);
+	char* body = &request[len];
+	body[0] = '[';
+	for(uint32_t i = 1; i < TELEMETRY_SIZE - 2; i++)
+		body[i] = i % 2 ? '1' : ',';
+	body[TELEMETRY_SIZE - 2] = ' ';
+	body[TELEMETRY_SIZE - 1] = ']';
+	len += TELEMETRY_SIZE;
+
+	esp8266_get_connection_command(connection_command, sizeof(connection_command), "TCP", remote_ip, "80");
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, esp8266_send_command(&esp, connection_command));
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, esp8266_send(&esp, (const uint8_t*) request, len));
+	TEST_ASSERT_EQUAL_UINT32(len, esp8266_get_send(&esp)->sent);
+	TEST_ASSERT_EQUAL_UINT16((len + ESP8266_SEND_MAX - 1) / ESP8266_SEND_MAX, esp8266_get_send(&esp)->segments);
+
+	/* The server may already have closed the connection after its response */
+	esp8266_send_command(&esp, ESP8266_AT_STOP);
+}
+
+void test_esp8266_send_request(void){
+	static char body[TELEMETRY_SIZE];
+	static esp8266_http_request_t request;
+	static const esp8266_http_header_t headers[] = {
+		{"Content-Type", "application/json"},
+		{"Connection", "close"}
+	};
+	char connection_command[256] = {0};
+	char remote_ip[] = "";
+	char uri[] = "";
+	char host[] = "";
+	const char* result = NULL;
+
+	/* The same POST as test_esp8266_send_segmented, without putting it together in a buffer */
+	body[0] = '[';
+	for(uint32_t i = 1; i < TELEMETRY_SIZE - 2; i++)
+		body[i] = i % 2 ? '1' : ',';
+	body[TELEMETRY_SIZE - 2] = ' ';
+	body[TELEMETRY_SIZE - 1] = ']';
+
+	esp8266_http_request_init(&request, HTTP_POST, uri, host);
+	TEST_ASSERT_TRUE(esp8266_http_request_headers(&request, headers, 2));
+	TEST_ASSERT_TRUE(esp8266_http_request_end(&request, (const uint8_t*) body, TELEMETRY_SIZE));
+	uint32_t len = esp8266_http_request_length(&request);
+
+	esp8266_get_connection_command(connection_command, sizeof(connection_command), "TCP", remote_ip, "80");
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, esp8266_send_command(&esp, connection_command));
+
+	TEST_ASSERT_TRUE(esp8266_http_request_send_async(&esp, &request, async_done, &result));
+	while(result == NULL)
+		esp8266_poll(&esp);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, result);
+	TEST_ASSERT_EQUAL_UINT32(len, esp8266_get_send(&esp)->sent);
+	TEST_ASSERT_EQUAL_UINT16((len + ESP8266_SEND_MAX - 1) / ESP8266_SEND_MAX, esp8266_get_send(&esp)->segments);
+
+	esp8266_send_command(&esp, ESP8266_AT_STOP);
+}
+
+/* Receive callback for the pool test, marks the link as closed */
+static void
+link_received(uint8_t link, const uint8_t* data, uint16_t len, void* context){
+	if(len == 0)
+		*(bool*) context = true;
+}
+
+void test_esp8266_link_pool(void){
+	const char* opened[2] = {NULL, NULL};
+	const char* sent[2] = {NULL, NULL};
+	bool closed[2] = {false, false};
+	int8_t link[2];
+	char request[256] = {0};
+	char remote_ip[] = "";
+	char uri[] = "";
+	char host[] = "";
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_pool_init(&esp));
+
+	for(uint8_t i = 0; i < 2; i++){
+		link[i] = esp8266_link_open_async(&esp, "TCP", remote_ip, "80", link_received, &closed[i], async_done, &opened[i]);
+		TEST_ASSERT_NOT_EQUAL(-1, link[i]);
+	}
+	TEST_ASSERT_NOT_EQUAL(link[0], link[1]);
+	while(esp8266_busy(&esp))
+		esp8266_poll(&esp);
+
+	esp8266_http_get_request(request, sizeof(request), HTTP_GET, uri, host);
+	for(uint8_t i = 0; i < 2; i++){
+		TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, opened[i]);
+		TEST_ASSERT_TRUE(esp8266_link_send_async(&esp, link[i], (const uint8_t*) request, strlen(request), async_done, &sent[i]));
+	}
+
+	/* Both requests are sent before either answer is read */
+	uint32_t start = HAL_GetTick();
+	while(!(closed[0] && closed[1]) && HAL_GetTick() - start < 10000)
+		esp8266_poll(&esp);
+
+	for(uint8_t i = 0; i < 2; i++){
+		TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, sent[i]);
+		TEST_ASSERT_TRUE(closed[i]);
+		TEST_ASSERT_EQUAL_UINT32(strlen(request), esp8266_get_link(&esp, link[i])->sent);
+		TEST_ASSERT_GREATER_THAN_UINT32(0, esp8266_get_link(&esp, link[i])->received);
+		TEST_ASSERT_EQUAL_INT(ESP8266_LINK_FREE, esp8266_get_link(&esp, link[i])->state);
+	}
+
+	/* Back to a single connection for the other tests */
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&esp, ESP8266_CMD_CIPMUX_SINGLE, NULL));
+}
+
+#define HTTP_BENCHMARK_REQUESTS		5
+
+/* Send the same request a few times, returns the average ms per request */
+static uint32_t
+http_benchmark(esp8266_http_client_t* client, const char* request){
+	uint32_t start = HAL_GetTick();
+
+	for(uint8_t i = 0; i < HTTP_BENCHMARK_REQUESTS; i++){
+		const char* result = NULL;
+
+		TEST_ASSERT_TRUE(esp8266_http_client_request_async(client, request, async_done, &result));
+		while(esp8266_http_client_busy(client))
+			esp8266_poll(&esp);
+
+		TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, result);
+		TEST_ASSERT_EQUAL_UINT16(200, client->response.status);
+	}
+	return (HAL_GetTick() - start) / HTTP_BENCHMARK_REQUESTS;
+}
+
+void test_esp8266_http_keep_alive_benchmark(void){
+	esp8266_http_client_t close_client;
+	esp8266_http_client_t keep_alive_client;
+	char close_request[256] = {0};
+	char keep_alive_request[256] = {0};
+
+	/* Use a HTTP/1.1 server on the local network, so that the time is mostly spent on our side */
+	char remote_ip[] = "";
+	char uri[] = "";
+	char host[] = "";
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_pool_init(&esp));
+
+	esp8266_http_get_request(close_request, sizeof(close_request), HTTP_GET, uri, host);
+	esp8266_http_keep_alive_request(keep_alive_request, sizeof(keep_alive_request), HTTP_GET, uri, host);
+	esp8266_http_client_init(&close_client, &esp, "TCP", remote_ip, "80");
+	esp8266_http_client_init(&keep_alive_client, &esp, "TCP", remote_ip, "80");
+
+	uint32_t close_ms = http_benchmark(&close_client, close_request);
+	uint32_t keep_alive_ms = http_benchmark(&keep_alive_client, keep_alive_request);
+
+	printf("Connection: close      %lu ms/request, %lu connects\n",
+		   (unsigned long) close_ms, (unsigned long) close_client.connects);
+	printf("Connection: keep-alive %lu ms/request, %lu connects\n",
+		   (unsigned long) keep_alive_ms, (unsigned long) keep_alive_client.connects);
+
+	TEST_ASSERT_EQUAL_UINT32(HTTP_BENCHMARK_REQUESTS, close_client.connects);
+	TEST_ASSERT_EQUAL_UINT32(1, keep_alive_client.connects);
+
+	/* Back to a single connection for the other tests */
+	esp8266_http_client_close(&keep_alive_client);
+	HAL_Delay(1000);
+	while(esp8266_busy(&esp))
+		esp8266_poll(&esp);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&esp, ESP8266_CMD_CIPMUX_SINGLE, NULL));
+}
+
+#define STREAM_TEST_BYTES		32768
+#define STREAM_BUFFER_SIZE		1024
+
+/* Stream STREAM_TEST_BYTES to the server and print the throughput */
+static void
+stream_test(void){
+	static uint8_t buffer[2][STREAM_BUFFER_SIZE];
+	char connection_command[256] = {0};
+	uint8_t current = 0;
+
+	/* Use a server that takes any data, such as netcat on the local network */
+	char remote_ip[] = "";
+	char remote_port[] = "";
+
+	esp8266_get_connection_command(connection_command, sizeof(connection_command), "TCP", remote_ip, remote_port);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, esp8266_send_command(&esp, connection_command));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_stream_start(&esp));
+
+	/* Fill one buffer while the other one is sent */
+	for(uint32_t sent = 0; sent < STREAM_TEST_BYTES; sent += STREAM_BUFFER_SIZE){
+		memset(buffer[current], 'a' + (sent / STREAM_BUFFER_SIZE) % 26, STREAM_BUFFER_SIZE);
+		while(esp8266_stream_busy(&esp));
+		TEST_ASSERT_TRUE(esp8266_stream_write(&esp, buffer[current], STREAM_BUFFER_SIZE));
+		current = !current;
+	}
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_stream_stop(&esp));
+	TEST_ASSERT_EQUAL_UINT32(STREAM_TEST_BYTES, esp8266_get_stream_stats(&esp)->bytes);
+	printf("Passthrough: %lu bytes in %lu ms, %lu bytes/s\n", (unsigned long) esp8266_get_stream_stats(&esp)->bytes,
+		   (unsigned long) esp8266_get_stream_stats(&esp)->ms, (unsigned long) esp8266_stream_rate(&esp));
+	TEST_ASSERT_GREATER_THAN_UINT32(0, esp8266_stream_rate(&esp));
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command(&esp, ESP8266_AT_STOP));
+}
+
+void test_esp8266_stream(void){
+	stream_test();
+}
+
+void test_esp8266_baud(void){
+	const uint32_t rates[] = {230400, 460800, 921600, 2000000};
+
+	for(uint8_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++){
+		const char* result = esp8266_set_baud(&esp, rates[i]);
+
+		/* A rate that does not work has to leave the link at the last one that did */
+		TEST_ASSERT_TRUE(strcmp(result, ESP8266_TIMEOUT) != 0);
+		TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&esp, ESP8266_CMD_AT, NULL));
+		if(strcmp(result, ESP8266_AT_OK) == 0){
+			TEST_ASSERT_EQUAL_UINT32(rates[i], esp8266_get_baud(&esp));
+			stream_test();
+		}
+	}
+	esp8266_print_baud(&esp);
+
+	/* Back to the rate of MX_UART4_Init for the tests after this one */
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_set_baud(&esp, ESP8266_BAUD_DEFAULT));
+}
+
+/* Receive callback that takes longer per byte than the uart needs at 921600 baud */
+static void
+slow_received(uint8_t link, const uint8_t* data, uint16_t len, void* context){
+	if(len == 0)
+		*(bool*) context = true;
+	else
+		HAL_Delay(1);
+}
+
+void test_esp8266_flow_control(void){
+	esp8266_flow_stats_t before;
+	esp8266_flow_stats_t after;
+	const char* opened = NULL;
+	const char* sent = NULL;
+	bool closed = false;
+	char request[256] = {0};
+
+	/* A server with a large response, a few hundred KB */
+	char remote_ip[] = "";
+	char uri[] = "";
+	char host[] = "";
+
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_set_baud(&esp, 921600));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_set_flow_control(&esp, true));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_pool_init(&esp));
+	esp8266_get_flow_stats(&esp, &before);
+
+	int8_t link = esp8266_link_open_async(&esp, "TCP", remote_ip, "80", slow_received, &closed, async_done, &opened);
+	TEST_ASSERT_NOT_EQUAL(-1, link);
+	while(esp8266_busy(&esp))
+		esp8266_poll(&esp);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, opened);
+
+	esp8266_http_get_request(request, sizeof(request), HTTP_GET, uri, host);
+	TEST_ASSERT_TRUE(esp8266_link_send_async(&esp, link, (const uint8_t*) request, strlen(request), async_done, &sent));
+
+	uint32_t start = HAL_GetTick();
+	while(!closed && HAL_GetTick() - start < 60000)
+		esp8266_poll(&esp);
+	esp8266_get_flow_stats(&esp, &after);
+
+	printf("Flow control: %lu bytes, %lu overruns, %lu errors, %lu throttles, %lu stalls\n",
+		   (unsigned long) esp8266_get_link(&esp, link)->received, (unsigned long)(after.overruns - before.overruns),
+		   (unsigned long)(after.errors - before.errors), (unsigned long)(after.throttles - before.throttles),
+		   (unsigned long)(after.stalls - before.stalls));
+
+	/* The reader is too slow for the rate, so RTS had to step in, and nothing was lost */
+	TEST_ASSERT_TRUE(closed);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_SEND_OK, sent);
+	TEST_ASSERT_GREATER_THAN_UINT32(before.throttles, after.throttles);
+	TEST_ASSERT_EQUAL_UINT32(before.overruns, after.overruns);
+	TEST_ASSERT_EQUAL_UINT32(before.errors, after.errors);
+
+	/* Back to the settings of the tests before this one */
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&esp, ESP8266_CMD_CIPMUX_SINGLE, NULL));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_set_flow_control(&esp, false));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_set_baud(&esp, ESP8266_BAUD_DEFAULT));
+}
+
+void test_ring_buffer_size(void){
+	ring_buffer_t ring;
+	uint8_t buffer[64];
+
+	TEST_ASSERT_FALSE(ring_buffer_init(&ring, buffer, 0));
+	TEST_ASSERT_FALSE(ring_buffer_init(&ring, buffer, 48));
+	TEST_ASSERT_TRUE(ring_buffer_init(&ring, buffer, 64));
+	TEST_ASSERT_EQUAL_UINT32(0, ring_buffer_available(&ring));
+}
+
+/* A small ring makes the indexes wrap often. The producer writes pieces of 1 to 16
+ * bytes and the consumer reads pieces of 1 to 16 bytes, in every combination. Every
+ * byte that was written has to come out once and in order, and every byte that did
+ * not fit has to be counted.
+ */
+void test_ring_buffer_interleaved(void){
+	ring_buffer_t ring;
+	uint8_t buffer[16];
+	uint8_t piece[16];
+	uint8_t written = 0;
+	uint8_t expected = 0;
+	uint32_t attempted = 0;
+	uint32_t total = 0;
+
+	ring_buffer_init(&ring, buffer, sizeof(buffer));
+
+	for(uint8_t write_len = 1; write_len <= 16; write_len++){
+		for(uint8_t read_len = 1; read_len <= 16; read_len++){
+			for(uint8_t round = 0; round < 3; round++){
+				for(uint8_t i = 0; i < write_len; i++)
+					piece[i] = written + i;
+				uint32_t len = ring_buffer_write(&ring, piece, write_len);
+				written += len;
+				total += len;
+				attempted += write_len;
+
+				len = ring_buffer_read(&ring, piece, read_len);
+				for(uint32_t i = 0; i < len; i++)
+					TEST_ASSERT_EQUAL_UINT8(expected++, piece[i]);
+			}
+			/* Drain what is left one byte at a time */
+			uint8_t c;
+			while(ring_buffer_get(&ring, &c))
+				TEST_ASSERT_EQUAL_UINT8(expected++, c);
+		}
+	}
+	TEST_ASSERT_EQUAL_UINT8(written, expected);
+	TEST_ASSERT_EQUAL_UINT32(attempted - total, ring_buffer_overruns(&ring));
+	TEST_ASSERT_EQUAL_UINT32(16, ring.high_water);
+}
+
+void test_ring_buffer_full(void){
+	ring_buffer_t ring;
+	uint8_t buffer[8];
+	uint8_t data[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+	uint8_t read[8];
+
+	ring_buffer_init(&ring, buffer, sizeof(buffer));
+
+	TEST_ASSERT_EQUAL_UINT32(8, ring_buffer_write(&ring, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT32(4, ring_buffer_overruns(&ring));
+	TEST_ASSERT_EQUAL_UINT32(8, ring.high_water);
+
+	/* The oldest bytes are kept */
+	TEST_ASSERT_EQUAL_UINT32(8, ring_buffer_read(&ring, read, sizeof(read)));
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(data, read, 8);
+}
+
+void test_ring_buffer_flush(void){
+	ring_buffer_t ring;
+	uint8_t buffer[8];
+	uint8_t data[5] = {'h', 'e', 'l', 'l', 'o'};
+	uint8_t c;
+
+	ring_buffer_init(&ring, buffer, sizeof(buffer));
+	ring_buffer_write(&ring, data, sizeof(data));
+	ring_buffer_flush(&ring);
+
+	TEST_ASSERT_EQUAL_UINT32(0, ring_buffer_available(&ring));
+	TEST_ASSERT_FALSE(ring_buffer_get(&ring, &c));
+
+	/* Writing after a flush continues where the last write ended */
+	ring_buffer_write(&ring, data, 1);
+	TEST_ASSERT_TRUE(ring_buffer_get(&ring, &c));
+	TEST_ASSERT_EQUAL_UINT8('h', c);
+	TEST_ASSERT_EQUAL_UINT8('h', buffer[5]);
+}
+
+void test_ring_buffer_peek(void){
+	ring_buffer_t ring;
+	uint8_t buffer[8];
+	uint8_t data[6] = {'a', 'b', 'c', 'd', 'e', 'f'};
+	const uint8_t* view;
+
+	ring_buffer_init(&ring, buffer, sizeof(buffer));
+	TEST_ASSERT_EQUAL_UINT32(0, ring_buffer_peek(&ring, &view));
+
+	/* Start at 5 so that the data wraps after "abc" */
+	ring_buffer_write(&ring, data, 5);
+	ring_buffer_consume(&ring, 5);
+	ring_buffer_write(&ring, data, sizeof(data));
+
+	/* The first piece ends at the end of the buffer, and points into it */
+	TEST_ASSERT_EQUAL_UINT32(3, ring_buffer_peek(&ring, &view));
+	TEST_ASSERT_EQUAL_PTR(&buffer[5], view);
+	TEST_ASSERT_EQUAL_MEMORY("abc", view, 3);
+
+	/* Using part of it leaves the rest in front */
+	ring_buffer_consume(&ring, 2);
+	TEST_ASSERT_EQUAL_UINT32(1, ring_buffer_peek(&ring, &view));
+	TEST_ASSERT_EQUAL_UINT8('c', view[0]);
+	ring_buffer_consume(&ring, 1);
+
+	TEST_ASSERT_EQUAL_UINT32(3, ring_buffer_peek(&ring, &view));
+	TEST_ASSERT_EQUAL_PTR(buffer, view);
+	TEST_ASSERT_EQUAL_MEMORY("def", view, 3);
+	ring_buffer_consume(&ring, 3);
+	TEST_ASSERT_EQUAL_UINT32(0, ring_buffer_available(&ring));
+}
+
+void test_ring_buffer_used(void){
+	ring_buffer_t ring;
+	uint8_t buffer[8];
+	uint8_t data[3] = {1, 2, 3};
+
+	ring_buffer_init(&ring, buffer, sizeof(buffer));
+	ring_buffer_write(&ring, data, sizeof(data));
+	TEST_ASSERT_EQUAL_UINT32(3, ring_buffer_used(&ring));
+
+	/* A committing producer laps the consumer, the level stops at the size */
+	ring_buffer_commit(&ring, 10);
+	TEST_ASSERT_EQUAL_UINT32(8, ring_buffer_used(&ring));
+	TEST_ASSERT_EQUAL_UINT32(0, atomic_load(&ring.tail));
+	TEST_ASSERT_EQUAL_UINT32(0, ring.overwritten);
+
+	/* Only the consumer skips ahead and counts what was lost */
+	TEST_ASSERT_EQUAL_UINT32(8, ring_buffer_available(&ring));
+	TEST_ASSERT_EQUAL_UINT32(5, ring.overwritten);
+	TEST_ASSERT_EQUAL_UINT32(8, ring_buffer_used(&ring));
+}
+
+/* Simulated DMA, writes a burst of counting bytes into the ring and calls the
+ * event callback like the HAL does: at half transfer, transfer complete and
+ * when the line goes idle after the burst.
+ */
+static uint16_t
+simulate_dma_burst(esp8266_rx_t* rx, uint16_t pos, uint8_t* value, uint16_t len){
+	for(uint16_t i = 0; i < len; i++){
+		rx->buffer[pos++] = (*value)++;
+		if(pos == RX_DMA_BUFFER_SIZE / 2)
+			esp8266_rx_event(rx, pos);
+		if(pos == RX_DMA_BUFFER_SIZE){
+			esp8266_rx_event(rx, pos);
+			pos = 0;
+		}
+	}
+	if(pos != 0 && pos != RX_DMA_BUFFER_SIZE / 2)
+		esp8266_rx_event(rx, pos);
+	return pos;
+}
+
+void test_esp8266_rx_wrap_around(void){
+	static esp8266_rx_t rx;
+	static const uint16_t bursts[] = {1, 37, 512, 1023, RX_DMA_BUFFER_SIZE / 2, 7, RX_DMA_BUFFER_SIZE - 1, 300};
+	uint8_t read[100];
+	uint8_t written = 0;
+	uint8_t expected = 0;
+	uint16_t pos = 0;
+
+	esp8266_rx_init(&rx, NULL);
+
+	for(uint8_t lap = 0; lap < 8; lap++){
+		for(uint8_t i = 0; i < sizeof(bursts) / sizeof(bursts[0]); i++){
+			pos = simulate_dma_burst(&rx, pos, &written, bursts[i]);
+			TEST_ASSERT_EQUAL_UINT32(bursts[i], esp8266_rx_available(&rx));
+
+			/* Read back in small pieces so the copy is split at the end of the ring */
+			uint32_t len;
+			while((len = esp8266_rx_read(&rx, read, sizeof(read))) > 0){
+				for(uint32_t j = 0; j < len; j++)
+					TEST_ASSERT_EQUAL_UINT8(expected++, read[j]);
+			}
+		}
+	}
+	TEST_ASSERT_EQUAL_UINT8(written, expected);
+}
+
+void test_esp8266_rx_overrun(void){
+	static esp8266_rx_t rx;
+	uint8_t read[1];
+	uint8_t written = 0;
+	uint16_t pos = 0;
+
+	esp8266_rx_init(&rx, NULL);
+
+	/* Write one and a half lap without reading anything */
+	pos = simulate_dma_burst(&rx, pos, &written, RX_DMA_BUFFER_SIZE);
+	pos = simulate_dma_burst(&rx, pos, &written, RX_DMA_BUFFER_SIZE / 2);
+	TEST_ASSERT_EQUAL_UINT32(RX_DMA_BUFFER_SIZE, esp8266_rx_available(&rx));
+
+	/* The first byte we get is the oldest one that was not overwritten */
+	esp8266_rx_read(&rx, read, 1);
+	TEST_ASSERT_EQUAL_UINT8((uint8_t)(RX_DMA_BUFFER_SIZE / 2), read[0]);
+	TEST_ASSERT_EQUAL_UINT32(RX_DMA_BUFFER_SIZE / 2, ring_buffer_overruns(&rx.ring));
+	TEST_ASSERT_EQUAL_UINT32(RX_DMA_BUFFER_SIZE, rx.ring.high_water);
+}
+
+/* The ESP8266 sends the SEND OK and the CLOSED after it without a pause, so the line
+ * never goes idle in between. The DMA writes the bytes one at a time, and the character
+ * match interrupt comes at every '\n'. Each line has to reach the parser as soon as its
+ * '\n' is received, and nothing after it.
+ */
+void test_esp8266_rx_line_match(void){
+	static esp8266_rx_t rx;
+	static const char burst[] = "\r\nRecv 5 bytes\r\n\r\nSEND OK\r\n\r\n0,CLOSED\r\n";
+	esp8266_parser_t parser;
+	esp8266_event_t event;
+	uint8_t send_ok_line = 0;
+	uint8_t closed_line = 0;
+	uint8_t line = 0;
+	uint16_t pos = 0;
+	uint8_t c;
+
+	esp8266_rx_init(&rx, NULL);
+	esp8266_parser_init(&parser);
+
+	for(uint16_t i = 0; i < sizeof(burst) - 1; i++){
+		rx.buffer[pos++] = burst[i];
+		if(burst[i] != '\n'){
+			TEST_ASSERT_EQUAL_UINT32(0, esp8266_rx_available(&rx));
+			continue;
+		}
+
+		esp8266_rx_match(&rx, pos);
+		line++;
+		TEST_ASSERT_EQUAL_UINT32(line, rx.lines);
+
+		while(esp8266_rx_get(&rx, &c)){
+			if(!esp8266_parser_feed(&parser, c, &event))
+				continue;
+			if(event.type == ESP8266_EVENT_SEND_OK)
+				send_ok_line = line;
+			if(event.type == ESP8266_EVENT_CLOSED && event.link == 0)
+				closed_line = line;
+		}
+	}
+
+	TEST_ASSERT_EQUAL_UINT8(4, send_ok_line);
+	TEST_ASSERT_EQUAL_UINT8(6, closed_line);
+}
+
+void test_esp8266_rx_quiet(void){
+	static esp8266_rx_t rx;
+	uint8_t written = 0;
+	uint16_t pos = 0;
+
+	esp8266_rx_init(&rx, NULL);
+
+	/* The receiver timeout counts from the last byte, so there is none before the first byte */
+	TEST_ASSERT_FALSE(esp8266_rx_quiet(&rx));
+
+	/* Boot messages, then the line goes quiet */
+	pos = simulate_dma_burst(&rx, pos, &written, 300);
+	TEST_ASSERT_FALSE(esp8266_rx_quiet(&rx));
+	esp8266_rx_timeout(&rx, pos);
+	TEST_ASSERT_TRUE(esp8266_rx_quiet(&rx));
+	TEST_ASSERT_EQUAL_UINT32(300, esp8266_rx_available(&rx));
+
+	/* More data ends the quiet until the next receiver timeout, also across the end of the buffer */
+	pos = simulate_dma_burst(&rx, pos, &written, RX_DMA_BUFFER_SIZE - 300);
+	TEST_ASSERT_EQUAL_UINT16(0, pos);
+	TEST_ASSERT_FALSE(esp8266_rx_quiet(&rx));
+	esp8266_rx_timeout(&rx, RX_DMA_BUFFER_SIZE);
+	TEST_ASSERT_TRUE(esp8266_rx_quiet(&rx));
+	TEST_ASSERT_EQUAL_UINT32(2, rx.timeouts);
+}
+
+void test_esp8266_rx_flow(void){
+	static esp8266_rx_t rx;
+	uint8_t read[64];
+	uint8_t written = 0;
+	uint16_t pos = 0;
+
+	esp8266_rx_init(&rx, NULL);
+	esp8266_rx_flow(&rx, ESP_RTS_GPIO_Port, ESP_RTS_Pin);
+
+	/* One byte short of the high mark, the ESP8266 may still send */
+	pos = simulate_dma_burst(&rx, pos, &written, RX_FLOW_HIGH - 1);
+	TEST_ASSERT_FALSE(rx.throttled);
+	pos = simulate_dma_burst(&rx, pos, &written, 1);
+	TEST_ASSERT_TRUE(rx.throttled);
+
+	/* Half a buffer can come in before the next event, it still fits */
+	pos = simulate_dma_burst(&rx, pos, &written, RX_DMA_BUFFER_SIZE / 2);
+	TEST_ASSERT_EQUAL_UINT32(1, rx.throttles);
+
+	/* RTS stays up until the ring is read down to the low mark */
+	while(esp8266_rx_available(&rx) > RX_FLOW_LOW + 1){
+		uint32_t len = esp8266_rx_available(&rx) - (RX_FLOW_LOW + 1);
+		esp8266_rx_read(&rx, read, len < sizeof(read) ? len : sizeof(read));
+	}
+	TEST_ASSERT_TRUE(rx.throttled);
+	esp8266_rx_read(&rx, read, 1);
+	TEST_ASSERT_FALSE(rx.throttled);
+
+	TEST_ASSERT_EQUAL_UINT32(0, ring_buffer_overruns(&rx.ring));
+	esp8266_rx_flow(&rx, NULL, 0);
+}
+
+/* The driver loop for +IPD data: the parser stops at the ':', and the data is used where it is
+ * in the DMA buffer and skipped in the parser. Here the data crosses the end of the buffer, so
+ * it comes in two pieces, and the CLOSED after it has to reach the parser.
+ */
+void test_esp8266_rx_payload(void){
+	static esp8266_rx_t rx;
+	static const char burst[] = "\r\n+IPD,1,16:0123456789\r\nOK\r\n1,CLOSED\r\n";
+	char received[16];
+	uint32_t received_len = 0;
+	uint8_t pieces = 0;
+	bool closed = false;
+	esp8266_parser_t parser;
+	esp8266_event_t event;
+	const uint8_t* data;
+	uint16_t pos = RX_DMA_BUFFER_SIZE - 20;
+	uint8_t c;
+
+	esp8266_rx_init(&rx, NULL);
+	esp8266_parser_init(&parser);
+
+	/* Start near the end of the buffer */
+	esp8266_rx_event(&rx, pos);
+	esp8266_rx_flush(&rx);
+	for(uint16_t i = 0; i < sizeof(burst) - 1; i++){
+		rx.buffer[pos] = burst[i];
+		pos = (pos + 1) & (RX_DMA_BUFFER_SIZE - 1);
+	}
+	esp8266_rx_event(&rx, pos);
+
+	for(;;){
+		uint32_t left = esp8266_parser_payload(&parser);
+		if(left > 0){
+			uint32_t len = esp8266_rx_peek(&rx, &data);
+			TEST_ASSERT_GREATER_THAN_UINT32(0, len);
+			if(len > left)
+				len = left;
+
+			/* A view into the DMA buffer, not a copy */
+			TEST_ASSERT_TRUE(data >= rx.buffer && data + len <= rx.buffer + RX_DMA_BUFFER_SIZE);
+			memcpy(&received[received_len], data, len);
+			received_len += len;
+			pieces++;
+			esp8266_rx_consume(&rx, len);
+			esp8266_parser_skip(&parser, len);
+			continue;
+		}
+
+		if(!esp8266_rx_get(&rx, &c))
+			break;
+		if(esp8266_parser_feed(&parser, c, &event) && event.type == ESP8266_EVENT_CLOSED && event.link == 1)
+			closed = true;
+	}
+
+	/* The OK inside the data is not a response */
+	TEST_ASSERT_EQUAL_UINT32(16, received_len);
+	TEST_ASSERT_EQUAL_MEMORY("0123456789\r\nOK\r\n", received, 16);
+	TEST_ASSERT_EQUAL_UINT8(2, pieces);
+	TEST_ASSERT_TRUE(closed);
+}
+
+/* Transmit callback for the tests, counts the segments that are done */
+static void
+tx_done(void* context){
+	(*(uint8_t*) context)++;
+}
+
+/* Without a uart nothing is sent, each esp8266_tx_complete plays the transfer complete interrupt */
+void test_esp8266_tx_order(void){
+	static esp8266_tx_t tx;
+	uint8_t done[3] = {0, 0, 0};
+	esp8266_tx_part_t parts[] = {{ESP8266_AT_SEND, strlen(ESP8266_AT_SEND)}, {"", 0}, {"12", 2}, {CRLF, 2}};
+
+	esp8266_tx_init(&tx, NULL);
+	TEST_ASSERT_FALSE(esp8266_tx_busy(&tx));
+
+	TEST_ASSERT_TRUE(esp8266_tx_write(&tx, (const uint8_t*) "first", 5, tx_done, &done[0]));
+	TEST_ASSERT_TRUE(esp8266_tx_writev(&tx, parts, 4, tx_done, &done[1]));
+	TEST_ASSERT_TRUE(esp8266_tx_write(&tx, (const uint8_t*) "", 0, tx_done, &done[2]));
+	TEST_ASSERT_TRUE(esp8266_tx_busy(&tx));
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_TX_QUEUE_SIZE - 6, esp8266_tx_free(&tx));
+
+	/* The callback of the parts comes with the last one, the empty part is skipped */
+	esp8266_tx_complete(&tx);
+	TEST_ASSERT_EQUAL_UINT8(1, done[0]);
+	TEST_ASSERT_EQUAL_UINT32(5, tx.bytes);
+	esp8266_tx_complete(&tx);
+	esp8266_tx_complete(&tx);
+	TEST_ASSERT_EQUAL_UINT8(0, done[1]);
+
+	/* The empty write after the parts is done as soon as the parts are */
+	esp8266_tx_complete(&tx);
+	TEST_ASSERT_EQUAL_UINT8(1, done[1]);
+	TEST_ASSERT_EQUAL_UINT8(1, done[2]);
+	TEST_ASSERT_EQUAL_UINT32(5 + strlen(ESP8266_AT_SEND) + 4, tx.bytes);
+	TEST_ASSERT_FALSE(esp8266_tx_busy(&tx));
+
+	/* A transfer complete with nothing being sent is ignored */
+	esp8266_tx_complete(&tx);
+	TEST_ASSERT_EQUAL_UINT8(1, done[0]);
+}
+
+void test_esp8266_tx_full(void){
+	static esp8266_tx_t tx;
+	uint8_t done = 0;
+	esp8266_tx_part_t parts[] = {{"a", 1}, {"b", 1}};
+
+	esp8266_tx_init(&tx, NULL);
+	for(uint8_t i = 0; i < ESP8266_TX_QUEUE_SIZE - 1; i++)
+		TEST_ASSERT_TRUE(esp8266_tx_write(&tx, (const uint8_t*) "x", 1, tx_done, &done));
+
+	/* Parts are queued all or nothing */
+	TEST_ASSERT_FALSE(esp8266_tx_writev(&tx, parts, 2, NULL, NULL));
+	TEST_ASSERT_EQUAL_UINT32(1, esp8266_tx_free(&tx));
+	TEST_ASSERT_TRUE(esp8266_tx_write(&tx, (const uint8_t*) "x", 1, tx_done, &done));
+	TEST_ASSERT_FALSE(esp8266_tx_write(&tx, (const uint8_t*) "x", 1, tx_done, &done));
+
+	/* The indexes wrap around the queue */
+	for(uint8_t round = 0; round < 3; round++){
+		esp8266_tx_complete(&tx);
+		esp8266_tx_complete(&tx);
+		TEST_ASSERT_TRUE(esp8266_tx_writev(&tx, parts, 2, tx_done, &done));
+	}
+	while(esp8266_tx_busy(&tx))
+		esp8266_tx_complete(&tx);
+
+	TEST_ASSERT_EQUAL_UINT8(ESP8266_TX_QUEUE_SIZE + 3, done);
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_TX_QUEUE_SIZE + 6, tx.bytes);
+}
+
+void test_esp8266_tx_flow(void){
+	static esp8266_tx_t tx;
+	static const uint8_t data[2 * ESP8266_TX_FLOW_CHUNK + 3];
+	uint8_t done = 0;
+
+	esp8266_tx_init(&tx, NULL);
+
+	/* CTS is pulled down, the ESP8266 does not hold us back */
+	esp8266_tx_flow(&tx, ESP_CTS_GPIO_Port, ESP_CTS_Pin);
+	TEST_ASSERT_TRUE(esp8266_tx_write(&tx, data, sizeof(data), tx_done, &done));
+
+	/* CTS is looked at before each piece, the callback comes with the last one */
+	for(uint8_t i = 0; i < 2; i++){
+		TEST_ASSERT_EQUAL_UINT16(ESP8266_TX_FLOW_CHUNK, tx.sending);
+		esp8266_tx_complete(&tx);
+		TEST_ASSERT_EQUAL_UINT8(0, done);
+	}
+	TEST_ASSERT_EQUAL_UINT16(3, tx.sending);
+	esp8266_tx_complete(&tx);
+	TEST_ASSERT_EQUAL_UINT8(1, done);
+
+	TEST_ASSERT_FALSE(esp8266_tx_busy(&tx));
+	TEST_ASSERT_EQUAL_UINT32(sizeof(data), tx.bytes);
+	TEST_ASSERT_EQUAL_UINT32(0, tx.stalls);
+}
+
+void test_esp8266_tx_flow_hold(void){
+	static esp8266_tx_t tx;
+	uint8_t done = 0;
+
+	esp8266_tx_init(&tx, NULL);
+
+	/* RTS is our output and reads back what is written to it, it stands in for CTS */
+	esp8266_tx_flow(&tx, ESP_RTS_GPIO_Port, ESP_RTS_Pin);
+	HAL_GPIO_WritePin(ESP_RTS_GPIO_Port, ESP_RTS_Pin, GPIO_PIN_SET);
+	TEST_ASSERT_TRUE(esp8266_tx_write(&tx, (const uint8_t*) ESP8266_AT, strlen(ESP8266_AT), tx_done, &done));
+
+	/* Held, nothing is started and trying again does not count a new stall */
+	TEST_ASSERT_FALSE(tx.running);
+	esp8266_tx_kick(&tx);
+	TEST_ASSERT_FALSE(tx.running);
+	TEST_ASSERT_EQUAL_UINT32(1, tx.stalls);
+
+	/* Nothing comes from the interrupt, the kick sends it */
+	HAL_GPIO_WritePin(ESP_RTS_GPIO_Port, ESP_RTS_Pin, GPIO_PIN_RESET);
+	esp8266_tx_kick(&tx);
+	TEST_ASSERT_TRUE(tx.running);
+	TEST_ASSERT_EQUAL_UINT16(strlen(ESP8266_AT), tx.sending);
+	esp8266_tx_complete(&tx);
+	TEST_ASSERT_EQUAL_UINT8(1, done);
+	TEST_ASSERT_FALSE(esp8266_tx_busy(&tx));
+	TEST_ASSERT_EQUAL_UINT32(1, tx.stalls);
+}
+
+/* Captured ESP8266 transcripts, including the command echo */
+static const char transcript_init[] =
+	"AT\r\r\n\r\nOK\r\n"
+	"AT+RST\r\r\n\r\nOK\r\n"
+	"\x8c\xfe\x12\x02\xf0" "ets Jan  8 2013,rst cause:2, boot mode:(3,6)\r\n\r\n"
+	"load 0x40100000, len 2408, room 16 \r\n\xff\x9e\x03\r\nready\r\n"
+	"AT\r\r\n\r\nbusy p...\r\n\r\nOK\r\n"
+	"AT+CWMODE=1\r\r\n\r\nOK\r\n"
+	"AT+CWMODE_CUR?\r\r\n+CWMODE_CUR:1\r\n\r\nOK\r\n"
+	"AT+CIPMUX=0\r\r\n\r\nOK\r\n"
+	"AT+CIPMUX?\r\r\n+CIPMUX:0\r\n\r\nOK\r\n";
+
+static const char transcript_wifi[] =
+	"AT+CWJAP=\"One Plus 5\",\"password\"\r\r\n"
+	"WIFI DISCONNECT\r\nWIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n"
+	"AT+CWJAP=\"One Plus 5\",\"wrong\"\r\r\n+CWJAP:2\r\n\r\nFAIL\r\n"
+	"AT+CWJAP?\r\r\n+CWJAP:\"One Plus 5\",\"c0:ee:fb:00:11:22\",6,-58\r\n\r\nOK\r\n"
+	"AT+CWQAP\r\r\n\r\nOK\r\nWIFI DISCONNECT\r\n"
+	"AT+CWJAP?\r\r\nNo AP\r\n\r\nOK\r\n";
+
+static const char transcript_http[] =
+	"AT+CIPSTART=\"TCP\",\"example.com\",80\r\r\nCONNECT\r\n\r\nOK\r\n"
+	"AT+CIPSEND=58\r\r\n\r\nOK\r\n> "
+	"\r\nRecv 58 bytes\r\n\r\nSEND OK\r\n"
+	"\r\n+IPD,42:HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nOK\r\n"
+	"\r\n+IPD,7:\r\nERROR"
+	"CLOSED\r\n";
+
+static const char transcript_multiple[] =
+	"AT+CIPMUX=1\r\r\n\r\nOK\r\n"
+	"AT+CIPSTART=0,\"TCP\",\"example.com\",80\r\r\n0,CONNECT\r\n\r\nOK\r\n"
+	"AT+CIPSTART=1,\"TCP\",\"example.org\",80\r\r\n1,CONNECT\r\n\r\nOK\r\n"
+	"AT+CIPSEND=1,18\r\r\n\r\nOK\r\n> "
+	"\r\nRecv 18 bytes\r\n\r\nSEND OK\r\n"
+	"\r\n+IPD,1,12:0,CLOSED\r\nOK"
+	"1,CLOSED\r\n"
+	"AT+CIPSTART=2,\"TCP\",\"10.0.0.1\",80\r\r\n2,CONNECT FAIL\r\n\r\nERROR\r\n";
+
+/* Feed a transcript to a new parser and save the events */
+static uint8_t
+parse_transcript(const char* transcript, uint32_t len, esp8266_event_t* events, uint8_t max){
+	esp8266_parser_t parser;
+	uint8_t count = 0;
+
+	esp8266_parser_init(&parser);
+	for(uint32_t i = 0; i < len; i++){
+		if(esp8266_parser_feed(&parser, (uint8_t) transcript[i], &events[count]) && count < max - 1)
+			count++;
+	}
+	return count;
+}
+
+static void
+assert_events(const esp8266_event_t* expected, uint8_t expected_count, const esp8266_event_t* events, uint8_t count){
+	TEST_ASSERT_EQUAL_UINT8(expected_count, count);
+	for(uint8_t i = 0; i < count; i++){
+		TEST_ASSERT_EQUAL_STRING(esp8266_parser_event_name(expected[i].type), esp8266_parser_event_name(events[i].type));
+		TEST_ASSERT_EQUAL_INT32(expected[i].value, events[i].value);
+	}
+}
+
+void test_esp8266_parser_init_transcript(void){
+	static const esp8266_event_t expected[] = {
+		{ESP8266_EVENT_OK, 0}, {ESP8266_EVENT_OK, 0}, {ESP8266_EVENT_RESET, 0}, {ESP8266_EVENT_READY, 0},
+		{ESP8266_EVENT_BUSY, 0}, {ESP8266_EVENT_OK, 0}, {ESP8266_EVENT_OK, 0},
+		{ESP8266_EVENT_CWMODE, 1}, {ESP8266_EVENT_OK, 0},
+		{ESP8266_EVENT_OK, 0}, {ESP8266_EVENT_CIPMUX, 0}, {ESP8266_EVENT_OK, 0}
+	};
+	esp8266_event_t events[16];
+	uint8_t count = parse_transcript(transcript_init, sizeof(transcript_init) - 1, events, 16);
+	assert_events(expected, sizeof(expected) / sizeof(expected[0]), events, count);
+}
+
+void test_esp8266_parser_wifi_transcript(void){
+	static const esp8266_event_t expected[] = {
+		{ESP8266_EVENT_WIFI_DISCONNECTED, 0}, {ESP8266_EVENT_WIFI_CONNECTED, 0}, {ESP8266_EVENT_WIFI_GOT_IP, 0},
+		{ESP8266_EVENT_OK, 0}, {ESP8266_EVENT_CWJAP, 2}, {ESP8266_EVENT_FAIL, 0},
+		{ESP8266_EVENT_CWJAP, 0}, {ESP8266_EVENT_OK, 0},
+		{ESP8266_EVENT_OK, 0}, {ESP8266_EVENT_WIFI_DISCONNECTED, 0},
+		{ESP8266_EVENT_NO_AP, 0}, {ESP8266_EVENT_OK, 0}
+	};
+	esp8266_event_t events[16];
+	uint8_t count = parse_transcript(transcript_wifi, sizeof(transcript_wifi) - 1, events, 16);
+	assert_events(expected, sizeof(expected) / sizeof(expected[0]), events, count);
+}
+
+void test_esp8266_parser_http_transcript(void){
+	static const esp8266_event_t expected[] = {
+		{ESP8266_EVENT_CONNECT, 0}, {ESP8266_EVENT_OK, 0}, {ESP8266_EVENT_OK, 0}, {ESP8266_EVENT_PROMPT, 0},
+		{ESP8266_EVENT_SEND_OK, 0}, {ESP8266_EVENT_IPD, 42}, {ESP8266_EVENT_IPD, 7}, {ESP8266_EVENT_CLOSED, 0}
+	};
+	esp8266_event_t events[16];
+	uint8_t count = parse_transcript(transcript_http, sizeof(transcript_http) - 1, events, 16);
+	assert_events(expected, sizeof(expected) / sizeof(expected[0]), events, count);
+}
+
+void test_esp8266_parser_multiple_transcript(void){
+	static const esp8266_event_t expected[] = {
+		{ESP8266_EVENT_OK, 0, ESP8266_PARSER_NO_LINK},
+		{ESP8266_EVENT_CONNECT, 0, 0}, {ESP8266_EVENT_OK, 0, ESP8266_PARSER_NO_LINK},
+		{ESP8266_EVENT_CONNECT, 0, 1}, {ESP8266_EVENT_OK, 0, ESP8266_PARSER_NO_LINK},
+		{ESP8266_EVENT_OK, 0, ESP8266_PARSER_NO_LINK}, {ESP8266_EVENT_PROMPT, 0, ESP8266_PARSER_NO_LINK},
+		{ESP8266_EVENT_SEND_OK, 0, ESP8266_PARSER_NO_LINK}, {ESP8266_EVENT_IPD, 12, 1}, {ESP8266_EVENT_CLOSED, 0, 1},
+		{ESP8266_EVENT_CONNECT_FAIL, 0, 2}, {ESP8266_EVENT_ERROR, 0, ESP8266_PARSER_NO_LINK}
+	};
+	esp8266_event_t events[16];
+	uint8_t count = parse_transcript(transcript_multiple, sizeof(transcript_multiple) - 1, events, 16);
+	assert_events(expected, sizeof(expected) / sizeof(expected[0]), events, count);
+
+	for(uint8_t i = 0; i < count; i++)
+		TEST_ASSERT_EQUAL_INT8(expected[i].link, events[i].link);
+}
+
+/* Two responses back to back, the first one ends after its Content-Length */
+static const char http_content_length[] =
+	"HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\ncontent-length: 5\r\n\r\nhello"
+	"HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+
+static const char http_chunked[] =
+	"HTTP/1.1 100 Continue\r\n\r\n"
+	"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+	"5\r\nhello\r\nA;name=value\r\n0123456789\r\n0\r\nExpires: never\r\n\r\n";
+
+void test_esp8266_http_content_length(void){
+	esp8266_http_response_t response;
+	const uint8_t* data = (const uint8_t*) http_content_length;
+	uint32_t len = sizeof(http_content_length) - 1;
+
+	esp8266_http_response_init(&response);
+	uint32_t used = esp8266_http_response_feed(&response, data, len);
+	TEST_ASSERT_TRUE(esp8266_http_response_done(&response));
+	TEST_ASSERT_EQUAL_UINT16(200, response.status);
+	TEST_ASSERT_EQUAL_UINT32(5, response.body);
+	TEST_ASSERT_FALSE(response.close);
+
+	/* The rest is the next response */
+	esp8266_http_response_init(&response);
+	TEST_ASSERT_EQUAL_UINT32(len - used, esp8266_http_response_feed(&response, data + used, len - used));
+	TEST_ASSERT_TRUE(esp8266_http_response_done(&response));
+	TEST_ASSERT_EQUAL_UINT16(404, response.status);
+	TEST_ASSERT_EQUAL_UINT32(0, response.body);
+
+	/* White space after the number is fine, the largest length too */
+	static const char spaces[] = "HTTP/1.1 200 OK\r\nContent-Length:\t 2147483647 \r\n\r\n";
+	esp8266_http_response_init(&response);
+	esp8266_http_response_feed(&response, (const uint8_t*) spaces, sizeof(spaces) - 1);
+	TEST_ASSERT_EQUAL_INT(ESP8266_HTTP_BODY, response.state);
+	TEST_ASSERT_EQUAL_INT32(INT32_MAX, response.content_length);
+
+	/* A sign, no number, something after it, or more than fits are errors */
+	static const char* const lengths[] = {
+		"-5", "-1", "+5", "", "abc", "5abc", "5 5", "2147483648", "4294967296", "99999999999999999999"
+	};
+	for(uint8_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++){
+		char bad[96];
+		uint32_t bad_len = sprintf(bad, "HTTP/1.1 200 OK\r\nContent-Length: %s\r\n\r\nhello", lengths[i]);
+
+		esp8266_http_response_init(&response);
+		esp8266_http_response_feed(&response, (const uint8_t*) bad, bad_len);
+		TEST_ASSERT_EQUAL_INT_MESSAGE(ESP8266_HTTP_ERROR, response.state, lengths[i]);
+		TEST_ASSERT_EQUAL_UINT32(0, response.body);
+	}
+}
+
+void test_esp8266_http_chunked(void){
+	esp8266_http_response_t response;
+	const uint8_t* data = (const uint8_t*) http_chunked;
+	uint32_t len = sizeof(http_chunked) - 1;
+
+	/* Split in two at every position */
+	for(uint32_t split = 0; split <= len; split++){
+		esp8266_http_response_init(&response);
+		uint32_t used = esp8266_http_response_feed(&response, data, split);
+		TEST_ASSERT_EQUAL_UINT32(split, used);
+		TEST_ASSERT_EQUAL(split == len, esp8266_http_response_done(&response));
+		used += esp8266_http_response_feed(&response, data + split, len - split);
+
+		TEST_ASSERT_EQUAL_UINT32(len, used);
+		TEST_ASSERT_TRUE(esp8266_http_response_done(&response));
+		TEST_ASSERT_EQUAL_UINT16(200, response.status);
+		TEST_ASSERT_EQUAL_UINT32(15, response.body);
+	}
+
+	/* A broken chunk size is an error */
+	esp8266_http_response_init(&response);
+	esp8266_http_response_feed(&response, data, 72);
+	esp8266_http_response_feed(&response, (const uint8_t*) "x\r\n", 3);
+	TEST_ASSERT_EQUAL_INT(ESP8266_HTTP_ERROR, response.state);
+}
+
+void test_esp8266_http_closed(void){
+	static const char no_length[] = "HTTP/1.0 200 OK\r\nServer: test\r\n\r\nabc";
+	static const char cut_short[] = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nabc";
+	esp8266_http_response_t response;
+
+	esp8266_http_response_init(&response);
+	esp8266_http_response_feed(&response, (const uint8_t*) no_length, sizeof(no_length) - 1);
+	TEST_ASSERT_FALSE(esp8266_http_response_done(&response));
+	TEST_ASSERT_TRUE(response.close);
+	esp8266_http_response_closed(&response);
+	TEST_ASSERT_TRUE(esp8266_http_response_done(&response));
+	TEST_ASSERT_EQUAL_UINT32(3, response.body);
+
+	esp8266_http_response_init(&response);
+	esp8266_http_response_feed(&response, (const uint8_t*) cut_short, sizeof(cut_short) - 1);
+	esp8266_http_response_closed(&response);
+	TEST_ASSERT_EQUAL_INT(ESP8266_HTTP_ERROR, response.state);
+}
+
+/* What the callbacks saw, for the callback tests */
+typedef struct {
+	uint16_t status;
+	uint8_t headers;
+	char type[32];
+	char body[32];
+	uint32_t body_len;
+	uint32_t pieces;
+	uint32_t body_limit;					// abort once more than this many body bytes came in
+} http_capture_t;
+
+static bool
+http_capture_status(uint16_t status, void* context){
+	http_capture_t* capture = context;
+
+	capture->status = status;
+	return true;
+}
+
+static bool
+http_capture_header(const char* name, const char* value, void* context){
+	http_capture_t* capture = context;
+
+	capture->headers++;
+	if(strcmp(name, "Content-Type") == 0)
+		strncpy(capture->type, value, sizeof(capture->type) - 1);
+	return true;
+}
+
+static bool
+http_capture_body(const uint8_t* data, uint32_t len, void* context){
+	http_capture_t* capture = context;
+
+	for(uint32_t i = 0; i < len && capture->body_len < sizeof(capture->body) - 1; i++)
+		capture->body[capture->body_len++] = data[i];
+	capture->pieces++;
+	return capture->body_len <= capture->body_limit;
+}
+
+void test_esp8266_http_callbacks(void){
+	static const char chunked[] =
+		"HTTP/1.1 100 Continue\r\nServer: test\r\n\r\n"
+		"HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n"
+		"5\r\nhello\r\n6\r\n world\r\n0\r\nExpires: never\r\n\r\n";
+	http_capture_t capture;
+	esp8266_http_callbacks_t callbacks = {
+		http_capture_status, http_capture_header, http_capture_body, &capture
+	};
+	esp8266_http_response_t response;
+
+	/* Content-Length, one byte at a time */
+	memset(&capture, 0, sizeof(capture));
+	capture.body_limit = UINT32_MAX;
+	esp8266_http_response_init(&response);
+	esp8266_http_response_callbacks(&response, &callbacks);
+	for(uint32_t i = 0; i < sizeof(http_content_length) - 1 && !esp8266_http_response_done(&response); i++)
+		esp8266_http_response_feed(&response, (const uint8_t*) &http_content_length[i], 1);
+
+	TEST_ASSERT_TRUE(esp8266_http_response_done(&response));
+	TEST_ASSERT_EQUAL_UINT16(200, capture.status);
+	TEST_ASSERT_EQUAL_UINT8(2, capture.headers);
+	TEST_ASSERT_EQUAL_STRING("text/plain", capture.type);
+	TEST_ASSERT_EQUAL_STRING("hello", capture.body);
+	TEST_ASSERT_EQUAL_UINT32(5, capture.pieces);
+
+	/* Chunked in one piece, the 100 Continue is left out and the chunk framing is taken out of the body */
+	memset(&capture, 0, sizeof(capture));
+	capture.body_limit = UINT32_MAX;
+	esp8266_http_response_init(&response);
+	esp8266_http_response_callbacks(&response, &callbacks);
+	esp8266_http_response_feed(&response, (const uint8_t*) chunked, sizeof(chunked) - 1);
+
+	TEST_ASSERT_TRUE(esp8266_http_response_done(&response));
+	TEST_ASSERT_EQUAL_UINT16(200, capture.status);
+	TEST_ASSERT_EQUAL_UINT8(3, capture.headers);
+	TEST_ASSERT_EQUAL_STRING("hello world", capture.body);
+	TEST_ASSERT_EQUAL_UINT32(2, capture.pieces);
+}
+
+void test_esp8266_http_abort(void){
+	static const char big[] = "HTTP/1.1 200 OK\r\nContent-Length: 1000\r\n\r\n0123456789";
+	http_capture_t capture;
+	esp8266_http_callbacks_t callbacks = { NULL, NULL, http_capture_body, &capture };
+	esp8266_http_response_t response;
+
+	memset(&capture, 0, sizeof(capture));
+	capture.body_limit = 4;
+	esp8266_http_response_init(&response);
+	esp8266_http_response_callbacks(&response, &callbacks);
+
+	uint32_t used = esp8266_http_response_feed(&response, (const uint8_t*) big, 41);
+	TEST_ASSERT_EQUAL_INT(ESP8266_HTTP_BODY, response.state);
+	TEST_ASSERT_EQUAL_UINT32(41, used);
+
+	/* The body callback stops the response, nothing after it is looked at */
+	used = esp8266_http_response_feed(&response, (const uint8_t*) big + 41, sizeof(big) - 1 - 41);
+	TEST_ASSERT_EQUAL_INT(ESP8266_HTTP_ABORTED, response.state);
+	TEST_ASSERT_EQUAL_UINT32(1, capture.pieces);
+	used = esp8266_http_response_feed(&response, (const uint8_t*) big, 10);
+	TEST_ASSERT_EQUAL_UINT32(0, used);
+	TEST_ASSERT_EQUAL_UINT32(1, capture.pieces);
+
+	/* Closing the connection does not turn it into an error */
+	esp8266_http_receive(0, NULL, 0, &response);
+	TEST_ASSERT_EQUAL_INT(ESP8266_HTTP_ABORTED, response.state);
+	TEST_ASSERT_FALSE(esp8266_http_response_done(&response));
+}
+
+/* Put the pieces of a built request together, to compare it with a sprintf one */
+static uint32_t
+http_request_flatten(const esp8266_http_request_t* request, char* buffer){
+	uint32_t len = 0;
+
+	for(uint8_t i = 0; i < request->count; i++){
+		memcpy(&buffer[len], request->parts[i].data, request->parts[i].len);
+		len += request->parts[i].len;
+	}
+	if(request->body_len > 0)
+		memcpy(&buffer[len], request->body, request->body_len);
+	len += request->body_len;
+	buffer[len] = '\0';
+	return len;
+}
+
+void test_esp8266_http_request_builder(void){
+	static const char body[] = "{\"temperature\":21.5}";
+	static const esp8266_http_header_t headers[] = {
+		{"Content-Type", "application/json"},
+		{"Connection", "keep-alive"}
+	};
+	static char big[ESP8266_SEND_MAX * 2];
+	esp8266_http_request_t request;
+	char expected[256];
+	char built[256];
+
+	/* POST with headers and a body, the same bytes as with sprintf */
+	uint32_t len = sprintf(expected, "%s%s %s\r\n%s%s\r\nContent-Type: application/json\r\n%s\r\nContent-Length: %u\r\n\r\n%s",
+						   HTTP_POST, "/data", HTTP_VERSION, HTTP_HOST, "example.com", HTTP_CONNECTION_KEEP_ALIVE,
+						   (unsigned) strlen(body), body);
+	esp8266_http_request_init(&request, HTTP_POST, "/data", "example.com");
+	TEST_ASSERT_TRUE(esp8266_http_request_headers(&request, headers, 2));
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_http_request_length(&request));
+	TEST_ASSERT_TRUE(esp8266_http_request_end(&request, (const uint8_t*) body, strlen(body)));
+	TEST_ASSERT_EQUAL_UINT32(len, esp8266_http_request_length(&request));
+	TEST_ASSERT_EQUAL_UINT32(len, http_request_flatten(&request, built));
+	TEST_ASSERT_EQUAL_STRING(expected, built);
+
+	/* Without a body there is no Content-Length */
+	esp8266_http_request_init(&request, HTTP_GET, "/", "example.com");
+	TEST_ASSERT_TRUE(esp8266_http_request_end(&request, NULL, 0));
+	http_request_flatten(&request, built);
+	TEST_ASSERT_EQUAL_STRING("GET / HTTP/1.1\r\nHost: example.com\r\n\r\n", built);
+
+	/* A length without a body would be sent from address 0 */
+	esp8266_http_request_init(&request, HTTP_POST, "/", "example.com");
+	TEST_ASSERT_FALSE(esp8266_http_request_end(&request, NULL, 10));
+	TEST_ASSERT_TRUE(request.overflow);
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_http_request_length(&request));
+
+	/* A long body fills up the first AT+CIPSEND, the rest of it is sent after the parts */
+	memset(big, 'x', sizeof(big));
+	esp8266_http_request_init(&request, HTTP_POST, "/", "example.com");
+	TEST_ASSERT_TRUE(esp8266_http_request_end(&request, (const uint8_t*) big, sizeof(big)));
+	TEST_ASSERT_EQUAL_UINT16(ESP8266_SEND_MAX, request.len);
+	TEST_ASSERT_EQUAL_PTR(&big[sizeof(big) - request.body_len], request.body);
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_SEND_MAX + request.body_len, esp8266_http_request_length(&request));
+
+	/* A header that does not fit is not added, and the request can not be sent */
+	uint8_t added = 0;
+	esp8266_http_request_init(&request, HTTP_GET, "/", "example.com");
+	while(esp8266_http_request_header(&request, "X-Test", "1"))
+		added++;
+	TEST_ASSERT_EQUAL_UINT8(4, ESP8266_HTTP_REQUEST_HEADERS);
+	TEST_ASSERT_EQUAL_UINT8(ESP8266_HTTP_REQUEST_HEADERS, added);
+	TEST_ASSERT_FALSE(esp8266_http_request_end(&request, NULL, 0));
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_http_request_length(&request));
+	TEST_ASSERT_FALSE(esp8266_http_request_send_async(&esp, &request, NULL, NULL));
+}
+
+void test_esp8266_command_timeout(void){
+	char wifi_command[256] = {0};
+	char connection_command[256] = {0};
+
+	esp8266_get_wifi_command(wifi_command, sizeof(wifi_command));
+	esp8266_get_connection_command(connection_command, sizeof(connection_command), "TCP", "example.com", "80");
+
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_TIMEOUT_SHORT, esp8266_get_timeout(esp8266_command_id(ESP8266_AT)));
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_TIMEOUT_SHORT, esp8266_get_timeout(esp8266_command_id(ESP8266_AT_CIPMUX_TEST)));
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_TIMEOUT_CWJAP, esp8266_get_timeout(esp8266_command_id(wifi_command)));
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_TIMEOUT_CIPSTART, esp8266_get_timeout(esp8266_command_id(connection_command)));
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_TIMEOUT_DATA, esp8266_get_timeout(ESP8266_CMD_DATA));
+	TEST_ASSERT_EQUAL_UINT32(ESP8266_TIMEOUT_DEFAULT, esp8266_get_timeout(esp8266_command_id("AT+CIFSR\r\n")));
+}
+
+void test_esp8266_command_table(void){
+	char buffer[64];
+
+	for(uint8_t id = 0; id < ESP8266_CMD_COUNT; id++){
+		const esp8266_command_t* command = &esp8266_commands[id];
+		bool parameters = command->command[command->len - 1] == '=';
+
+		TEST_ASSERT_EQUAL_UINT8(strlen(command->command), command->len);
+		TEST_ASSERT_NOT_NULL(command->expected);
+		TEST_ASSERT_GREATER_THAN_UINT32(0, command->timeout);
+		TEST_ASSERT_EQUAL_UINT32(command->timeout, esp8266_get_timeout(id));
+
+		/* Commands without parameters are complete, with the line ending */
+		if(!parameters)
+			TEST_ASSERT_EQUAL_STRING("\r\n", &command->command[command->len - 2]);
+
+		/* The string from the table, a copy of it, and the command with parameters all map back to the entry */
+		TEST_ASSERT_EQUAL_INT(id, esp8266_command_id(command->command));
+		strcpy(buffer, command->command);
+		TEST_ASSERT_EQUAL_INT(id, esp8266_command_id(buffer));
+		if(parameters){
+			strcat(buffer, "1\r\n");
+			TEST_ASSERT_EQUAL_INT(id, esp8266_command_id(buffer));
+		}
+
+		/* Succeeding commands return the expected response */
+		esp8266_clear(&esp);
+		if(command->result == ESP8266_RESULT_BASIC)
+			TEST_ASSERT_EQUAL_STRING(command->expected, get_return(&esp, id));
+	}
+
+	/* The macros for the command strings point into the table */
+	TEST_ASSERT_EQUAL_PTR(esp8266_commands[ESP8266_CMD_AT].command, ESP8266_AT);
+	TEST_ASSERT_EQUAL_PTR(esp8266_commands[ESP8266_CMD_SEND].command, ESP8266_AT_SEND);
+
+	/* A command that only starts like one in the table is not mistaken for it */
+	TEST_ASSERT_EQUAL_INT(ESP8266_CMD_OTHER, esp8266_command_id("AT+RST"));
+	TEST_ASSERT_EQUAL_INT(ESP8266_CMD_OTHER, esp8266_command_id("AT+CIPSTATUS\r\n"));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_NOT_IMPLEMENTED, get_return(&esp, ESP8266_CMD_OTHER));
+}
+
+void test_esp8266_long_request(void){
+	char request[512];
+	char command[32];
+	char uri[300];
+	char host[] = "example.com";
+
+	memset(uri, 'a', sizeof(uri) - 1);
+	uri[0] = '/';
+	uri[sizeof(uri) - 1] = '\0';
+
+	uint16_t len = esp8266_http_get_request(request, sizeof(request), HTTP_POST, uri, host);
+	TEST_ASSERT_GREATER_THAN_UINT16(255, len);
+	TEST_ASSERT_EQUAL_UINT16(strlen(request), len);
+
+	esp8266_get_at_send_command(command, sizeof(command), len);
+	TEST_ASSERT_EQUAL_STRING_LEN(ESP8266_AT_SEND, command, strlen(ESP8266_AT_SEND));
+	TEST_ASSERT_EQUAL_UINT32(len, strtoul(&command[strlen(ESP8266_AT_SEND)], NULL, 10));
+
+	esp8266_get_at_send_command(command, sizeof(command), ESP8266_SEND_MAX);
+	TEST_ASSERT_EQUAL_STRING("AT+CIPSEND=2048\r\n", command);
+
+	/* Data longer than a request can be is refused, instead of being cut to the low 16 bits */
+	static char big[ESP8266_REQUEST_MAX + 2];
+	memset(big, 'x', sizeof(big) - 1);
+	TEST_ASSERT_FALSE(esp8266_send_data_async(&esp, big, ESP8266_DEFAULT_TIMEOUT, NULL, NULL));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_ERROR, esp8266_send_data(&esp, big));
+	TEST_ASSERT_FALSE(esp8266_busy(&esp));
+}
+
+void test_esp8266_format(void){
+	char buffer[64];
+	char small[8];
+	esp8266_format_t format;
+
+	/* Quoted strings get '"', ',' and '\' escaped, and the digits of a number come out in order */
+	esp8266_format_init(&format, buffer, sizeof(buffer));
+	esp8266_format_string(&format, ESP8266_AT_CWJAP_SET);
+	esp8266_format_quoted(&format, "my\"wifi,5\\");
+	esp8266_format_string(&format, ",");
+	esp8266_format_uint(&format, 4294967295u);
+	esp8266_format_uint(&format, 0);
+	TEST_ASSERT_EQUAL_STRING("AT+CWJAP=\"my\\\"wifi\\,5\\\\\",42949672950", buffer);
+	TEST_ASSERT_EQUAL_UINT16(strlen(buffer), esp8266_format_end(&format));
+
+	/* The same bytes as sprintf for a command without special characters */
+	char expected[64];
+	sprintf(expected, "%s\"%s\",\"%s\",%s\r\n", ESP8266_AT_START, "TCP", "example.com", "80");
+	TEST_ASSERT_EQUAL_UINT16(strlen(expected), esp8266_get_connection_command(buffer, sizeof(buffer), "TCP", "example.com", "80"));
+	TEST_ASSERT_EQUAL_STRING(expected, buffer);
+
+	/* What does not fit is cut, the output still ends with '\0' and the length is 0 */
+	esp8266_format_init(&format, small, sizeof(small));
+	esp8266_format_string(&format, "AT+");
+	esp8266_format_quoted(&format, "abcdef");
+	TEST_ASSERT_EQUAL_UINT16(0, esp8266_format_end(&format));
+	TEST_ASSERT_EQUAL_STRING("AT+\"abc", small);
+	TEST_ASSERT_EQUAL_UINT16(0, esp8266_get_at_send_command(small, sizeof(small), ESP8266_SEND_MAX));
+	TEST_ASSERT_EQUAL_UINT16(0, esp8266_get_wifi_command(small, sizeof(small)));
+}
+
+void test_esp8266_baud_range(void){
+
+	/* UART4 runs from the 36 MHz PCLK1, BRR can not go below 16 */
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_ERROR, esp8266_set_baud(&esp, 0));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_ERROR, esp8266_set_baud(&esp, HAL_RCC_GetPCLK1Freq() / 8));
+	TEST_ASSERT_FALSE(esp8266_busy(&esp));
+	TEST_ASSERT_NULL(esp8266_get_baud_stats(&esp, HAL_RCC_GetPCLK1Freq() / 8));
+}
+
+void test_esp8266_instances(void){
+	static esp8266_t first;
+	static esp8266_t second;
+	static UART_HandleTypeDef first_uart = { .Instance = UART4 };
+	static UART_HandleTypeDef second_uart = { .Instance = USART2 };
+	static UART_HandleTypeDef other_uart = { .Instance = USART3 };
+	const char line[] = "WIFI GOT IP\r\n";
+
+	/* Only bound, nothing is started on the uarts */
+	TEST_ASSERT_TRUE(esp8266_attach(&first, &first_uart));
+	TEST_ASSERT_TRUE(esp8266_attach(&second, &second_uart));
+
+	/* What the DMA put in the buffer of one module only shows up there */
+	memcpy(first.rx.buffer, line, strlen(line));
+	HAL_UARTEx_RxEventCallback(&first_uart, strlen(line));
+	TEST_ASSERT_EQUAL_UINT32(strlen(line), esp8266_rx_available(&first.rx));
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_rx_available(&second.rx));
+
+	/* A uart without a module is left alone */
+	HAL_UARTEx_RxEventCallback(&other_uart, RX_DMA_BUFFER_SIZE / 2);
+	TEST_ASSERT_EQUAL_UINT32(strlen(line), esp8266_rx_available(&first.rx));
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_rx_available(&second.rx));
+
+	/* A request on one module does not make the other one busy */
+	TEST_ASSERT_TRUE(esp8266_send_command_async(&second, ESP8266_AT, ESP8266_DEFAULT_TIMEOUT, NULL, NULL));
+	TEST_ASSERT_TRUE(esp8266_busy(&second));
+	TEST_ASSERT_FALSE(esp8266_busy(&first));
+
+	/* Attaching again starts over, on the same uart */
+	TEST_ASSERT_TRUE(esp8266_attach(&second, &second_uart));
+	TEST_ASSERT_FALSE(esp8266_busy(&second));
+	HAL_UARTEx_RxEventCallback(&second_uart, 4);
+	TEST_ASSERT_EQUAL_UINT32(4, esp8266_rx_available(&second.rx));
+	TEST_ASSERT_EQUAL_UINT32(strlen(line), esp8266_rx_available(&first.rx));
+
+	/* Flow control needs pins, which the second module does not have. Nothing is sent */
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_ERROR, esp8266_set_flow_control(&second, true));
+	TEST_ASSERT_FALSE(esp8266_get_flow_control(&second));
+	TEST_ASSERT_FALSE(esp8266_busy(&second));
+
+	/* Detached, the uarts are left alone */
+	esp8266_detach(&first);
+	esp8266_detach(&second);
+	HAL_UARTEx_RxEventCallback(&first_uart, strlen(line) + 4);
+	TEST_ASSERT_EQUAL_UINT32(strlen(line), esp8266_rx_available(&first.rx));
+}
+
+void test_esp8266_profile_histogram(void){
+	esp8266_profile_t profile = { 0 };
+	esp8266_histogram_t empty = { 0 };
+	const uint32_t fast[ESP8266_PHASE_TOTAL] = { 100, 5000, 200 };
+	const uint32_t slow[ESP8266_PHASE_TOTAL] = { 100, 1000000, 200 };
+
+	for(uint8_t i = 0; i < 98; i++)
+		esp8266_profile_add(&profile, fast);
+	esp8266_profile_add(&profile, slow);
+	esp8266_profile_add(&profile, slow);
+	TEST_ASSERT_EQUAL_UINT32(100, profile.count);
+
+	/* Below 2^12 in the first bucket, then a bucket for each power of two */
+	const esp8266_histogram_t* module = &profile.phases[ESP8266_PHASE_MODULE];
+	TEST_ASSERT_EQUAL_UINT16(100, profile.phases[ESP8266_PHASE_TX].buckets[0]);
+	TEST_ASSERT_EQUAL_UINT16(98, module->buckets[1]);
+	TEST_ASSERT_EQUAL_UINT16(2, module->buckets[8]);
+	TEST_ASSERT_EQUAL_UINT32(5000, module->min);
+	TEST_ASSERT_EQUAL_UINT32(1000000, module->max);
+	TEST_ASSERT_TRUE(module->total == 98 * 5000 + 2 * 1000000);
+
+	/* The total is the phases added up */
+	TEST_ASSERT_EQUAL_UINT16(98, profile.phases[ESP8266_PHASE_TOTAL].buckets[1]);
+	TEST_ASSERT_EQUAL_UINT32(1000300, profile.phases[ESP8266_PHASE_TOTAL].max);
+
+	/* A percentile is the top of its bucket, but not above the max */
+	TEST_ASSERT_EQUAL_UINT32(8191, esp8266_histogram_percentile(module, profile.count, 50));
+	TEST_ASSERT_EQUAL_UINT32(8191, esp8266_histogram_percentile(module, profile.count, 98));
+	TEST_ASSERT_EQUAL_UINT32(1000000, esp8266_histogram_percentile(module, profile.count, 99));
+	TEST_ASSERT_EQUAL_UINT32(100, esp8266_histogram_percentile(&profile.phases[ESP8266_PHASE_TX], profile.count, 99));
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_histogram_percentile(&empty, 0, 99));
+
+	/* The ends of the clock */
+	esp8266_histogram_add(&empty, 0, 0);
+	esp8266_histogram_add(&empty, 1, UINT32_MAX);
+	TEST_ASSERT_EQUAL_UINT16(1, empty.buckets[0]);
+	TEST_ASSERT_EQUAL_UINT16(1, empty.buckets[ESP8266_PROFILE_BUCKETS - 1]);
+	TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, esp8266_histogram_percentile(&empty, 2, 100));
+}
+
+#ifdef ESP8266_SIM
+
+/* Body size of the responses of the simulated server */
+#define SIM_BODY_SIZE			1000
+
+typedef struct {
+	uint32_t body;						// bytes of body in each response
+	uint32_t requests;					// requests answered
+	bool broken;						// answer the next request with a broken status line
+} sim_server_t;
+
+/* The server behind the simulated module, called from the SysTick interrupt. Answers every
+ * request with body bytes, and closes the connection after it if the request asks for it. */
+static void
+sim_server(esp8266_sim_t* sim, uint8_t link, const uint8_t* data, uint16_t len, void* context){
+	static const char close[] = "Connection: close";
+	sim_server_t* server = context;
+	uint8_t body[256];
+	char header[96];
+	bool closing = false;
+
+	/* The requests of the tests are sent as a whole */
+	if(len < 4 || memcmp(&data[len - 4], "\r\n\r\n", 4) != 0)
+		return;
+	for(uint16_t i = 0; i + sizeof(close) - 1 <= len && !closing; i++)
+		closing = memcmp(&data[i], close, sizeof(close) - 1) == 0;
+
+	server->requests++;
+	sprintf(header, "%s 200 OK\r\nContent-Length: %lu\r\n%s\r\n", server->broken ? "HTPT/1.1" : "HTTP/1.1",
+			(unsigned long) server->body, closing ? "Connection: close\r\n" : "");
+	server->broken = false;
+	esp8266_sim_receive(sim, link, (const uint8_t*) header, strlen(header));
+
+	for(uint32_t sent = 0; sent < server->body; sent += sizeof(body)){
+		uint32_t piece = server->body - sent < sizeof(body) ? server->body - sent : sizeof(body);
+		memset(body, 'a' + sent / sizeof(body) % 26, piece);
+		esp8266_sim_receive(sim, link, body, piece);
+	}
+	if(closing)
+		esp8266_sim_close(sim, link);
+}
+
+/* Start the simulated module with a server behind it, and bring up the driver and the wifi */
+static void
+sim_start(sim_server_t* server){
+	TEST_ASSERT_TRUE(esp8266_sim_init(&sim, &sim_esp));
+	esp8266_sim_set_remote(&sim, sim_server, server);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init(&sim_esp));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_wifi_init(&sim_esp));
+}
+
+/* Send a request and poll until the response is in */
+static const char*
+sim_request(esp8266_http_client_t* client, const char* request){
+	const char* result = NULL;
+
+	TEST_ASSERT_TRUE(esp8266_http_client_request_async(client, request, async_done, &result));
+	while(esp8266_http_client_busy(client))
+		esp8266_poll(&sim_esp);
+	return result;
+}
+
+void test_esp8266_sim_init(void){
+	sim_server_t server = { .body = SIM_BODY_SIZE };
+
+	sim_start(&server);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_send_command_id(&sim_esp, ESP8266_CMD_CWJAP_TEST, NULL));
+
+	/* AT, AT+RST, AT, the mode, the connection mode, and the wifi */
+	TEST_ASSERT_EQUAL_UINT32(9, sim.commands);
+	TEST_ASSERT_EQUAL_UINT32(0, sim.lost);
+	TEST_ASSERT_EQUAL_UINT32(sim.sent, sim_esp.rx.ring.head);
+	esp8266_sim_stop(&sim);
+}
+
+void test_esp8266_sim_http(void){
+	sim_server_t server = { .body = SIM_BODY_SIZE };
+	esp8266_http_client_t client;
+	char keep_alive_request[128];
+	char close_request[128];
+
+	sim_start(&server);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_pool_init(&sim_esp));
+	esp8266_http_keep_alive_request(keep_alive_request, sizeof(keep_alive_request), HTTP_GET, "/", "sim");
+	esp8266_http_get_request(close_request, sizeof(close_request), HTTP_GET, "/", "sim");
+	esp8266_http_client_init(&client, &sim_esp, "TCP", "192.168.4.2", "80");
+
+	for(uint8_t i = 0; i < 3; i++){
+		TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, sim_request(&client, keep_alive_request));
+		TEST_ASSERT_EQUAL_UINT16(200, client.response.status);
+		TEST_ASSERT_EQUAL_UINT32(SIM_BODY_SIZE, client.response.body);
+	}
+	TEST_ASSERT_EQUAL_UINT32(1, client.connects);
+
+	/* The server closes the connection after this one, so the next request connects again */
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, sim_request(&client, close_request));
+	TEST_ASSERT_TRUE(client.response.close);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, sim_request(&client, keep_alive_request));
+	TEST_ASSERT_EQUAL_UINT32(SIM_BODY_SIZE, client.response.body);
+	TEST_ASSERT_EQUAL_UINT32(2, client.connects);
+
+	/* The rest of a response that could not be read is still coming, so the link is closed and
+	 * the next request connects again */
+	server.broken = true;
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_ERROR, sim_request(&client, keep_alive_request));
+	TEST_ASSERT_EQUAL_INT8(-1, client.link);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, sim_request(&client, keep_alive_request));
+	TEST_ASSERT_EQUAL_UINT16(200, client.response.status);
+	TEST_ASSERT_EQUAL_UINT32(SIM_BODY_SIZE, client.response.body);
+	TEST_ASSERT_EQUAL_UINT32(3, client.connects);
+	TEST_ASSERT_EQUAL_UINT32(7, server.requests);
+	esp8266_sim_stop(&sim);
+}
+
+void test_esp8266_sim_faults(void){
+	sim_server_t server = { .body = SIM_BODY_SIZE };
+	char command[64];
+	uint32_t ok = 0;
+	uint32_t timeouts = 0;
+
+	sim_start(&server);
+	esp8266_get_connection_command(command, sizeof(command), "TCP", "192.168.4.2", "80");
+
+	/* Only the next connection is refused */
+	TEST_ASSERT_TRUE(esp8266_sim_fail(&sim, ESP8266_AT_START, "\r\nERROR\r\nCLOSED\r\n", 1));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_ERROR, esp8266_send_command(&sim_esp, command));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CONNECT, esp8266_send_command(&sim_esp, command));
+
+	/* A command without an answer times out, and the module can be used after it */
+	TEST_ASSERT_TRUE(esp8266_sim_fail(&sim, "AT+CWJAP?", "", 1));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_TIMEOUT, esp8266_send_command_id(&sim_esp, ESP8266_CMD_CWJAP_TEST, NULL));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&sim_esp, ESP8266_CMD_AT, NULL));
+
+	/* The answer takes as long as the module, plus a few ms on the uart */
+	esp8266_sim_set_latency(&sim, 50);
+	uint32_t start = HAL_GetTick();
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&sim_esp, ESP8266_CMD_AT, NULL));
+	TEST_ASSERT_UINT32_WITHIN(5, 53, HAL_GetTick() - start);
+	esp8266_sim_set_latency(&sim, 0);
+
+	/* With bytes lost each command gets its OK or times out, none of them hangs */
+	esp8266_sim_set_loss(&sim, 20, 1);
+	for(uint8_t i = 0; i < 20; i++){
+		const char* result = NULL;
+
+		TEST_ASSERT_TRUE(esp8266_send_command_async(&sim_esp, ESP8266_AT, 50, async_done, &result));
+		while(esp8266_busy(&sim_esp))
+			esp8266_poll(&sim_esp);
+		ok += result != NULL && strcmp(result, ESP8266_AT_OK) == 0;
+		timeouts += result != NULL && strcmp(result, ESP8266_TIMEOUT) == 0;
+	}
+	esp8266_sim_set_loss(&sim, 0, 0);
+
+	TEST_ASSERT_GREATER_THAN_UINT32(0, sim.lost);
+	TEST_ASSERT_GREATER_THAN_UINT32(0, timeouts);
+	TEST_ASSERT_EQUAL_UINT32(20, ok + timeouts);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&sim_esp, ESP8266_CMD_AT, NULL));
+	esp8266_sim_stop(&sim);
+}
+
+void test_esp8266_sim_profile(void){
+	static esp8266_profile_table_t profile;
+	sim_server_t server = { .body = SIM_BODY_SIZE };
+	const uint32_t ms = ESP8266_PROFILE_CLOCK_HZ / 1000;
+
+	sim_start(&server);
+	esp8266_set_profile(&sim_esp, &profile);
+
+	for(uint8_t i = 0; i < 20; i++)
+		TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&sim_esp, ESP8266_CMD_AT, NULL));
+	esp8266_sim_set_latency(&sim, 50);
+	for(uint8_t i = 0; i < 2; i++)
+		TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&sim_esp, ESP8266_CMD_AT, NULL));
+	esp8266_sim_set_latency(&sim, 0);
+
+	const esp8266_profile_t* at = esp8266_get_profile(&sim_esp, ESP8266_CMD_AT);
+	const esp8266_histogram_t* tx = &at->phases[ESP8266_PHASE_TX];
+	const esp8266_histogram_t* module = &at->phases[ESP8266_PHASE_MODULE];
+	const esp8266_histogram_t* parse = &at->phases[ESP8266_PHASE_PARSE];
+	TEST_ASSERT_EQUAL_UINT32(22, at->count);
+	TEST_ASSERT_EQUAL_UINT32(0, at->timeouts);
+
+	/* "AT\r\n" is on the uart in well under a ms, the slow answers are in the module phase,
+	 * at the top of its histogram */
+	TEST_ASSERT_LESS_THAN_UINT32(5 * ms, tx->max);
+	TEST_ASSERT_GREATER_OR_EQUAL_UINT32(50 * ms, module->max);
+	TEST_ASSERT_LESS_THAN_UINT32(50 * ms, esp8266_histogram_percentile(module, at->count, 90));
+	TEST_ASSERT_GREATER_OR_EQUAL_UINT32(50 * ms, esp8266_histogram_percentile(module, at->count, 99));
+	TEST_ASSERT_TRUE(at->phases[ESP8266_PHASE_TOTAL].total == tx->total + module->total + parse->total);
+
+	/* A timeout is counted, but not in the histograms */
+	const esp8266_profile_t* cwjap = esp8266_get_profile(&sim_esp, ESP8266_CMD_CWJAP_TEST);
+	TEST_ASSERT_TRUE(esp8266_sim_fail(&sim, "AT+CWJAP?", "", 1));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_TIMEOUT, esp8266_send_command_id(&sim_esp, ESP8266_CMD_CWJAP_TEST, NULL));
+	TEST_ASSERT_EQUAL_UINT32(1, cwjap->timeouts);
+	TEST_ASSERT_EQUAL_UINT32(0, cwjap->count);
+	esp8266_print_profile(&sim_esp);
+
+	/* Turned off nothing more is added */
+	esp8266_set_profile(&sim_esp, NULL);
+	TEST_ASSERT_NULL(esp8266_get_profile(&sim_esp, ESP8266_CMD_AT));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&sim_esp, ESP8266_CMD_AT, NULL));
+	TEST_ASSERT_EQUAL_UINT32(22, profile.requests[ESP8266_CMD_AT].count);
+	esp8266_sim_stop(&sim);
+}
+
+void test_esp8266_sim_flow_hold(void){
+	sim_server_t server = { .body = SIM_BODY_SIZE };
+	const char* result = NULL;
+	uint32_t commands;
+
+	sim_start(&server);
+	commands = sim.commands;
+
+	/* RTS reads back what is written to it, it stands in for the CTS of the module */
+	esp8266_tx_flow(&sim_esp.tx, ESP_RTS_GPIO_Port, ESP_RTS_Pin);
+	HAL_GPIO_WritePin(ESP_RTS_GPIO_Port, ESP_RTS_Pin, GPIO_PIN_SET);
+	TEST_ASSERT_TRUE(esp8266_send_command_async(&sim_esp, ESP8266_AT, 500, async_done, &result));
+
+	/* Held back, the module gets nothing */
+	uint32_t start = HAL_GetTick();
+	while(HAL_GetTick() - start < 20)
+		esp8266_poll(&sim_esp);
+	TEST_ASSERT_NULL(result);
+	TEST_ASSERT_EQUAL_UINT32(commands, sim.commands);
+	TEST_ASSERT_EQUAL_UINT32(1, sim_esp.tx.stalls);
+
+	/* Let go, esp8266_poll sends it without a transfer complete to start it */
+	HAL_GPIO_WritePin(ESP_RTS_GPIO_Port, ESP_RTS_Pin, GPIO_PIN_RESET);
+	while(esp8266_busy(&sim_esp))
+		esp8266_poll(&sim_esp);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, result);
+	TEST_ASSERT_EQUAL_UINT32(commands + 1, sim.commands);
+
+	esp8266_tx_flow(&sim_esp.tx, NULL, 0);
+	esp8266_sim_stop(&sim);
+}
+
+#endif
+
+/* Read the next record and check it */
+static void
+trace_expect(esp8266_trace_reader_t* reader, esp8266_trace_direction_t direction, uint32_t time,
+			 const void* data, uint16_t len){
+	esp8266_trace_record_t record;
+
+	TEST_ASSERT_TRUE(esp8266_trace_next(reader, &record));
+	TEST_ASSERT_EQUAL(direction, record.direction);
+	TEST_ASSERT_EQUAL_UINT32(time, record.time);
+	TEST_ASSERT_EQUAL_UINT16(len, record.len);
+	TEST_ASSERT_EQUAL_MEMORY(data, record.data, len);
+}
+
+void test_esp8266_trace_records(void){
+	static uint8_t buffer[512];
+	esp8266_trace_reader_t reader;
+	esp8266_trace_record_t record;
+	esp8266_trace_t small;
+	uint8_t data[300];
+
+	for(uint16_t i = 0; i < sizeof(data); i++)
+		data[i] = i;
+
+	esp8266_trace_init(&small, buffer, sizeof(buffer));
+	TEST_ASSERT_TRUE(esp8266_trace_record(&small, ESP8266_TRACE_TX, 1000, (const uint8_t*) "AT\r\n", 4));
+	TEST_ASSERT_TRUE(esp8266_trace_record(&small, ESP8266_TRACE_RX, 1003, (const uint8_t*) "\r\nOK\r\n", 6));
+	TEST_ASSERT_TRUE(esp8266_trace_record(&small, ESP8266_TRACE_RX, 1203, data, sizeof(data)));
+	TEST_ASSERT_TRUE(esp8266_trace_record(&small, ESP8266_TRACE_TX, 1203 + 86400000, data, 1));
+
+	/* 2 bytes on top of a line, the time takes more bytes the longer it is */
+	TEST_ASSERT_EQUAL_UINT32((2 + 4) + (2 + 6) + (3 + 128) + (2 + 128) + (2 + 44) + (5 + 1), small.len);
+	TEST_ASSERT_EQUAL_UINT32(6, small.records);
+	TEST_ASSERT_EQUAL_UINT32(6 + sizeof(data), small.bytes[ESP8266_TRACE_RX]);
+	TEST_ASSERT_EQUAL_UINT32(5, small.bytes[ESP8266_TRACE_TX]);
+
+	/* The time starts at the first record, more bytes than fit in a record are split */
+	esp8266_trace_reader_init(&reader, buffer, small.len);
+	trace_expect(&reader, ESP8266_TRACE_TX, 0, "AT\r\n", 4);
+	trace_expect(&reader, ESP8266_TRACE_RX, 3, "\r\nOK\r\n", 6);
+	trace_expect(&reader, ESP8266_TRACE_RX, 203, data, 128);
+	trace_expect(&reader, ESP8266_TRACE_RX, 203, data + 128, 128);
+	trace_expect(&reader, ESP8266_TRACE_RX, 203, data + 256, 44);
+	trace_expect(&reader, ESP8266_TRACE_TX, 203 + 86400000, data, 1);
+	TEST_ASSERT_FALSE(esp8266_trace_next(&reader, &record));
+
+	/* A record that is cut off is not read */
+	esp8266_trace_reader_init(&reader, buffer, small.len - 1);
+	for(uint8_t i = 0; i < 5; i++)
+		TEST_ASSERT_TRUE(esp8266_trace_next(&reader, &record));
+	TEST_ASSERT_FALSE(esp8266_trace_next(&reader, &record));
+
+	/* When it is full the start is kept, what does not fit is counted */
+	TEST_ASSERT_FALSE(esp8266_trace_record(&small, ESP8266_TRACE_RX, 1203 + 86400000, data, sizeof(data)));
+	TEST_ASSERT_EQUAL_UINT32(sizeof(data) - 128, small.dropped);
+	TEST_ASSERT_EQUAL_UINT32(7, small.records);
+	TEST_ASSERT_TRUE(esp8266_trace_record(&small, ESP8266_TRACE_RX, 1203 + 86400000, data, 1));
+	TEST_ASSERT_FALSE(esp8266_trace_record(&small, ESP8266_TRACE_RX, 1203 + 86400000, data, 60));
+	TEST_ASSERT_EQUAL_UINT32(sizeof(data) - 128 + 60, small.dropped);
+	TEST_ASSERT_EQUAL_UINT32(8, small.records);
+}
+
+#ifdef ESP8266_SIM
+
+/* Buffer of the traces of the simulated module */
+#define TRACE_BUFFER_SIZE		8192
+
+static uint8_t trace_buffer[TRACE_BUFFER_SIZE];
+static esp8266_trace_t trace;
+
+/* Check that two traces have the same bytes going one way, no matter how they are split into records */
+static void
+trace_compare(const esp8266_trace_t* expected, const esp8266_trace_t* actual, esp8266_trace_direction_t direction){
+	esp8266_trace_reader_t readers[2];
+	esp8266_trace_record_t records[2] = {0};
+	uint16_t pos[2] = {0, 0};
+	uint32_t compared = 0;
+
+	esp8266_trace_reader_init(&readers[0], expected->buffer, expected->len);
+	esp8266_trace_reader_init(&readers[1], actual->buffer, actual->len);
+	for(;;){
+		for(uint8_t i = 0; i < 2; i++){
+			while(pos[i] == records[i].len && esp8266_trace_next(&readers[i], &records[i])){
+				if(records[i].direction != direction)
+					records[i].len = 0;
+				pos[i] = 0;
+			}
+		}
+		if(pos[0] == records[0].len || pos[1] == records[1].len)
+			break;
+		TEST_ASSERT_EQUAL_HEX8(records[0].data[pos[0]++], records[1].data[pos[1]++]);
+		compared++;
+	}
+	TEST_ASSERT_EQUAL_UINT32(expected->bytes[direction], compared);
+	TEST_ASSERT_EQUAL_UINT32(actual->bytes[direction], compared);
+}
+
+/* The requests of the trace tests, with what shows up in the field: the boot garbage after
+ * the AT+RST of the init, a "busy p..." before an answer and the wifi dropping in the middle
+ * of one. The faults are only used by the simulated module, a replay has them in the trace. */
+static void
+trace_session(void){
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init(&sim_esp));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_wifi_init(&sim_esp));
+
+	TEST_ASSERT_TRUE(esp8266_sim_fail(&sim, "AT+CWJAP?",
+									  "busy p...\r\n+CWJAP:\"sim\",\"02:00:00:00:00:01\",1,-40\r\n\r\nOK\r\n", 1));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_send_command_id(&sim_esp, ESP8266_CMD_CWJAP_TEST, NULL));
+
+	TEST_ASSERT_TRUE(esp8266_sim_fail(&sim, "AT+CIPMUX?",
+									  "WIFI DISCONNECT\r\n+CIPMUX:0\r\nWIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n", 1));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CIPMUX_0, esp8266_send_command_id(&sim_esp, ESP8266_CMD_CIPMUX_TEST, NULL));
+}
+
+void test_esp8266_trace_capture(void){
+	esp8266_trace_reader_t reader;
+	esp8266_trace_record_t record;
+	uint32_t bytes[2] = {0, 0};
+	uint32_t time = 0;
+
+	TEST_ASSERT_TRUE(esp8266_sim_init(&sim, &sim_esp));
+	esp8266_trace_init(&trace, trace_buffer, sizeof(trace_buffer));
+	esp8266_set_trace(&sim_esp, &trace);
+	trace_session();
+	esp8266_sim_stop(&sim);
+
+	/* Everything the driver and the module have sent */
+	TEST_ASSERT_EQUAL_UINT32(0, trace.dropped);
+	TEST_ASSERT_EQUAL_UINT32(sim.received, trace.bytes[ESP8266_TRACE_TX]);
+	TEST_ASSERT_EQUAL_UINT32(sim.sent, trace.bytes[ESP8266_TRACE_RX]);
+
+	/* It starts with the first AT and the records are in order */
+	esp8266_trace_reader_init(&reader, trace_buffer, trace.len);
+	trace_expect(&reader, ESP8266_TRACE_TX, 0, ESP8266_AT, strlen(ESP8266_AT));
+	while(esp8266_trace_next(&reader, &record)){
+		TEST_ASSERT_GREATER_OR_EQUAL_UINT32(time, record.time);
+		time = record.time;
+		bytes[record.direction] += record.len;
+	}
+	TEST_ASSERT_EQUAL_UINT32(trace.len, reader.pos);
+	TEST_ASSERT_EQUAL_UINT32(trace.bytes[ESP8266_TRACE_RX], bytes[ESP8266_TRACE_RX]);
+	TEST_ASSERT_EQUAL_UINT32(trace.bytes[ESP8266_TRACE_TX] - strlen(ESP8266_AT), bytes[ESP8266_TRACE_TX]);
+}
+
+void test_esp8266_trace_replay(void){
+	static uint8_t replayed_buffer[TRACE_BUFFER_SIZE];
+	esp8266_trace_t replayed;
+	uint32_t ms[2];
+
+	TEST_ASSERT_TRUE(esp8266_sim_init(&sim, &sim_esp));
+	esp8266_trace_init(&trace, trace_buffer, sizeof(trace_buffer));
+	esp8266_set_trace(&sim_esp, &trace);
+	ms[0] = HAL_GetTick();
+	trace_session();
+	ms[0] = HAL_GetTick() - ms[0];
+	esp8266_sim_stop(&sim);
+
+	/* Played to a new driver, which traces what it gets. The module answers nothing itself */
+	TEST_ASSERT_TRUE(esp8266_sim_init(&sim, &sim_esp));
+	esp8266_trace_init(&replayed, replayed_buffer, sizeof(replayed_buffer));
+	esp8266_set_trace(&sim_esp, &replayed);
+	esp8266_sim_replay(&sim, trace_buffer, trace.len);
+	TEST_ASSERT_TRUE(esp8266_sim_replaying(&sim));
+	ms[1] = HAL_GetTick();
+	trace_session();
+	ms[1] = HAL_GetTick() - ms[1];
+	esp8266_sim_stop(&sim);
+
+	TEST_ASSERT_FALSE(esp8266_sim_replaying(&sim));
+	TEST_ASSERT_EQUAL_UINT32(0, sim.commands);
+	TEST_ASSERT_EQUAL_UINT32(0, replayed.dropped);
+
+	/* The same bytes both ways, in about the same time */
+	trace_compare(&trace, &replayed, ESP8266_TRACE_RX);
+	trace_compare(&trace, &replayed, ESP8266_TRACE_TX);
+	TEST_ASSERT_UINT32_WITHIN(ms[0] / 10 + RX_QUIET_TIME, ms[0], ms[1]);
+}
+
+#endif
+
+/* Number and max size of the random responses of the fuzz tests */
+#define FUZZ_ROUNDS				500
+#define FUZZ_RESPONSE_SIZE		256
+
+/* Pieces of the random responses, so that they come close to real ones and get past the
+ * start of the tokens. The rest of the bytes are random. */
+static const char* const fuzz_pieces[] = {
+	"OK", "ERROR", "FAIL", "SEND OK", "SEND FAIL", "ready", "ets Jan  8 2013,rst cause:2", "busy p...",
+	"CONNECT", "CONNECT FAIL", "CLOSED", "WIFI CONNECTED", "WIFI GOT IP", "WIFI DISCONNECT", "No AP",
+	"+CWJAP:", "+CWMODE_CUR:", "+CIPMUX:", "+IPD,", "> ", "\r\n", "\r", "\n", ",", ":", " ",
+	"0", "1", "4", "9", "12", "4096", "4097", "99999999999"
+};
+
+static uint32_t fuzz_seed;
+
+/* Random numbers that are the same on every run, so that a failure can be repeated */
+static uint32_t
+fuzz_random(void){
+	fuzz_seed = fuzz_seed * 1103515245 + 12345;
+	return fuzz_seed >> 16;
+}
+
+/* Fill buffer with a random response of 1 to size bytes, returns its length */
+static uint32_t
+fuzz_response(uint8_t* buffer, uint32_t size){
+	uint32_t len = 0;
+	uint32_t end = 1 + fuzz_random() % size;
+
+	while(len < end){
+		uint32_t r = fuzz_random();
+
+		if(r % 4 == 0){
+			buffer[len++] = fuzz_random();
+			continue;
+		}
+
+		const char* piece = fuzz_pieces[r / 4 % (sizeof(fuzz_pieces) / sizeof(fuzz_pieces[0]))];
+		while(*piece != '\0' && len < end)
+			buffer[len++] = *piece++;
+	}
+	return len;
+}
+
+void test_esp8266_parser_fuzz(void){
+	static const char sync[] = "\r\nOK\r\n";
+	uint8_t response[FUZZ_RESPONSE_SIZE];
+	esp8266_parser_t parser;
+	esp8266_event_t event;
+
+	fuzz_seed = 1;
+	esp8266_parser_init(&parser);
+	for(uint32_t round = 0; round < FUZZ_ROUNDS; round++){
+		uint32_t len = fuzz_response(response, sizeof(response));
+
+		for(uint32_t i = 0; i < len; i++){
+			if(esp8266_parser_feed(&parser, response[i], &event)){
+				TEST_ASSERT_TRUE(event.type > ESP8266_EVENT_NONE && event.type <= ESP8266_EVENT_IPD);
+				TEST_ASSERT_TRUE(event.link >= ESP8266_PARSER_NO_LINK && event.link <= ESP8266_PARSER_MAX_LINK);
+				if(event.type == ESP8266_EVENT_IPD)
+					TEST_ASSERT_TRUE(event.value >= 0 && event.value <= ESP8266_PARSER_MAX_PAYLOAD);
+			}
+			TEST_ASSERT_LESS_OR_EQUAL_UINT32(ESP8266_PARSER_MAX_PAYLOAD, esp8266_parser_payload(&parser));
+		}
+
+		/* Whatever came, after the rest of the payload an OK on a line of its own is found */
+		for(uint32_t left = esp8266_parser_payload(&parser); left > 0; left--)
+			TEST_ASSERT_FALSE(esp8266_parser_feed(&parser, 'x', &event));
+
+		event.type = ESP8266_EVENT_NONE;
+		for(uint8_t i = 0; i < sizeof(sync) - 1; i++)
+			esp8266_parser_feed(&parser, sync[i], &event);
+		TEST_ASSERT_EQUAL(ESP8266_EVENT_OK, event.type);
+	}
+}
+
+#ifdef ESP8266_SIM
+
+void test_esp8266_command_fuzz(void){
+	static const esp8266_command_id_t commands[] = {
+		ESP8266_CMD_AT, ESP8266_CMD_CWMODE_TEST, ESP8266_CMD_CWJAP_TEST, ESP8266_CMD_CIPMUX_TEST
+	};
+	static const char* const results[] = {
+		ESP8266_AT_OK, ESP8266_AT_ERROR, ESP8266_TIMEOUT, ESP8266_AT_CWMODE_1, ESP8266_AT_CWMODE_2,
+		ESP8266_AT_CWMODE_3, ESP8266_AT_UNKNOWN, ESP8266_AT_CIPMUX_0, ESP8266_AT_CIPMUX_1,
+		ESP8266_AT_WIFI_CONNECTED, ESP8266_AT_WIFI_DISCONNECTED
+	};
+	/* The simulated module sends it after the echo, from the SysTick */
+	static char reply[FUZZ_RESPONSE_SIZE + 1];
+	sim_server_t server = { .body = SIM_BODY_SIZE };
+	char command[32];
+
+	sim_start(&server);
+	fuzz_seed = 2;
+	for(uint32_t round = 0; round < FUZZ_ROUNDS / 5; round++){
+		esp8266_command_id_t id = commands[fuzz_random() % (sizeof(commands) / sizeof(commands[0]))];
+		const char* result = NULL;
+		bool known = false;
+
+		/* The fault is matched without the CRLF */
+		strcpy(command, ESP8266_COMMAND_STRING(id));
+		command[strlen(command) - 2] = '\0';
+		while(ring_buffer_used(&sim.out) > 0)
+			HAL_Delay(1);
+		/* Half of them end like an answer, so that they get to the result. The reply is a string */
+		uint32_t len = fuzz_response((uint8_t*) reply, FUZZ_RESPONSE_SIZE - 6);
+		for(uint32_t i = 0; i < len; i++)
+			reply[i] = reply[i] == '\0' ? '\xff' : reply[i];
+		strcpy(&reply[len], round % 2 ? "\r\nOK\r\n" : "");
+		TEST_ASSERT_TRUE(esp8266_sim_fail(&sim, command, reply, 1));
+
+		TEST_ASSERT_TRUE(esp8266_send_command_id_async(&sim_esp, id, NULL, 100, async_done, &result));
+		while(esp8266_busy(&sim_esp))
+			esp8266_poll(&sim_esp);
+
+		for(uint8_t i = 0; i < sizeof(results) / sizeof(results[0]) && !known; i++)
+			known = result != NULL && strcmp(result, results[i]) == 0;
+		TEST_ASSERT_TRUE(known);
+
+		/* After a timeout the application throws away what is left, such as the rest of a +IPD */
+		if(strcmp(result, ESP8266_TIMEOUT) == 0){
+			while(ring_buffer_used(&sim.out) > 0)
+				HAL_Delay(1);
+			esp8266_clear(&sim_esp);
+		}
+	}
+
+	/* Once the module is quiet and what it sent is thrown away, it answers as before */
+	esp8266_sim_fail(&sim, command, "", 0);
+	while(ring_buffer_used(&sim.out) > 0)
+		HAL_Delay(1);
+	esp8266_clear(&sim_esp);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&sim_esp, ESP8266_CMD_AT, NULL));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_CIPMUX_0, esp8266_send_command_id(&sim_esp, ESP8266_CMD_CIPMUX_TEST, NULL));
+	esp8266_sim_stop(&sim);
+}
+
+#endif
+
+/* Buffer of the log of the tests, and room for the stream read out of it */
+#define LOG_BUFFER_SIZE			512
+#define LOG_STREAM_SIZE			2048
+
+static uint8_t log_buffer[LOG_BUFFER_SIZE];
+static esp8266_log_t test_log;
+
+#ifdef ESP8266_LOG_READER
+
+static uint8_t log_stream[LOG_STREAM_SIZE];
+
+/* Read what is in the log into log_stream after len, returns the length of the stream */
+static uint32_t
+log_stream_read(uint32_t len){
+	len += esp8266_log_read(&test_log, &log_stream[len], sizeof(log_stream) - len);
+	TEST_ASSERT_LESS_THAN_UINT32(sizeof(log_stream), len);
+	return len;
+}
+
+/* Check that the stream reads back as these lines and ends there */
+static void
+log_stream_expect(uint32_t len, const char* const* lines, uint32_t count){
+	esp8266_log_reader_t reader;
+	char text[ESP8266_LOG_LINE_MAX];
+	uint32_t time;
+
+	TEST_ASSERT_TRUE(esp8266_log_reader_init(&reader, log_stream, len));
+	for(uint32_t i = 0; i < count; i++){
+		TEST_ASSERT_TRUE(esp8266_log_next(&reader, text, &time));
+		TEST_ASSERT_EQUAL_STRING(lines[i], text);
+	}
+	TEST_ASSERT_FALSE(esp8266_log_next(&reader, text, &time));
+}
+
+void test_esp8266_log_decode(void){
+	static const char link[] = "link %u got %lu bytes\n";
+	static const char* const lines[] = {
+		"no arguments\n",
+		"link 3 got 1460 bytes\n",
+		"-5 00c0ffee a 100%\n",
+		"  42|7   |ff|0XFF\n",
+		"link 3 got 1460 bytes\n",
+		"only 1 and ?\n",
+		"?|?|3\n"
+	};
+	esp8266_log_reader_t reader;
+	char text[ESP8266_LOG_LINE_MAX];
+	uint32_t start = HAL_GetTick();
+	uint32_t last = start;
+	uint32_t time;
+
+	TEST_ASSERT_TRUE(esp8266_log_init(&test_log, log_buffer, sizeof(log_buffer)));
+	TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, "no arguments\n"));
+	TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, link, 3, (uint32_t) 1460));
+	TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, "%d %08lx %c 100%%\n", -5, (uint32_t) 0xc0ffee, 'a'));
+	TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, "%4u|%-4d|%x|%#X\n", 42, 7, 255, 255));
+	TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, link, 3, (uint32_t) 1460));
+	TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, "only %u and %u\n", 1));
+	TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, "%s|%p|%u\n", 1, 2, 3));
+	TEST_ASSERT_EQUAL_UINT32(7, test_log.records);
+	TEST_ASSERT_EQUAL_UINT32(0, test_log.dropped);
+
+	uint32_t len = log_stream_read(0);
+	log_stream_expect(len, lines, sizeof(lines) / sizeof(lines[0]));
+	TEST_ASSERT_EQUAL_UINT32(0, esp8266_log_read(&test_log, log_stream, sizeof(log_stream)));
+
+	/* A format is sent once, after that a record is a few bytes */
+	TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, link, 3, (uint32_t) 1460));
+	TEST_ASSERT_LESS_OR_EQUAL_UINT32(8, esp8266_log_read(&test_log, &log_stream[len], sizeof(log_stream) - len));
+
+	/* The records have the time they were logged at */
+	TEST_ASSERT_TRUE(esp8266_log_reader_init(&reader, log_stream, len));
+	while(esp8266_log_next(&reader, text, &time)){
+		TEST_ASSERT_GREATER_OR_EQUAL_UINT32(last, time);
+		last = time;
+	}
+	TEST_ASSERT_LESS_OR_EQUAL_UINT32(HAL_GetTick(), last);
+
+	/* A stream that is cut off reads up to the cut */
+	log_stream_expect(len - 1, lines, sizeof(lines) / sizeof(lines[0]) - 1);
+	TEST_ASSERT_FALSE(esp8266_log_reader_init(&reader, (const uint8_t*) "E8TR\1", 5));
+}
+
+void test_esp8266_log_dropped(void){
+	static const char* const lines[] = {
+		"record 0\n", "record 1\n", "record 2\n", "record 3\n", "record 4\n",
+		"record 5\n", "record 6\n", "record 7\n", "record 8\n", "record 9\n"
+	};
+	const char* expected[11];
+	char dropped[32];
+	uint8_t small[64];
+	uint32_t written = 0;
+
+	TEST_ASSERT_TRUE(esp8266_log_init(&test_log, small, sizeof(small)));
+	for(uint8_t i = 0; i < 10; i++)
+		written += ESP8266_LOG(&test_log, "record %u\n", i);
+	TEST_ASSERT_GREATER_THAN_UINT32(0, written);
+	TEST_ASSERT_LESS_THAN_UINT32(10, written);
+	TEST_ASSERT_EQUAL_UINT32(written, test_log.records);
+	TEST_ASSERT_EQUAL_UINT32(10 - written, test_log.dropped);
+
+	/* The loss is reported after the records that went in */
+	uint32_t len = log_stream_read(0);
+	sprintf(dropped, "%lu records dropped\n", (unsigned long)(10 - written));
+	for(uint8_t i = 0; i < written; i++)
+		expected[i] = lines[i];
+	expected[written] = dropped;
+	log_stream_expect(len, expected, written + 1);
+
+	/* The ring is empty again, it fills up and loses one more. Both losses are in the stream */
+	while(ESP8266_LOG(&test_log, "record %u\n", 9));
+	TEST_ASSERT_EQUAL_UINT32(11 - written, test_log.dropped);
+	len = log_stream_read(len);
+
+	esp8266_log_reader_t reader;
+	char text[ESP8266_LOG_LINE_MAX];
+	uint32_t time;
+	uint32_t lines_read = 0;
+
+	TEST_ASSERT_TRUE(esp8266_log_reader_init(&reader, log_stream, len));
+	while(esp8266_log_next(&reader, text, &time))
+		lines_read++;
+	TEST_ASSERT_EQUAL_STRING("1 records dropped\n", text);
+	TEST_ASSERT_EQUAL_UINT32(test_log.records + 2, lines_read);
+	TEST_ASSERT_EQUAL_UINT32(test_log.dropped, reader.dropped);
+}
+
+void test_esp8266_log_formats(void){
+	static char formats[ESP8266_LOG_FORMATS + 8][16];
+	static char lines[ESP8266_LOG_FORMATS + 9][16];
+	const char* expected[ESP8266_LOG_FORMATS + 9];
+	const uint8_t count = ESP8266_LOG_FORMATS + 8;
+	uint32_t len = 0;
+
+	TEST_ASSERT_TRUE(esp8266_log_init(&test_log, log_buffer, sizeof(log_buffer)));
+	for(uint8_t i = 0; i < count; i++){
+		sprintf(formats[i], "format %u %%u\n", i);
+		sprintf(lines[i], "format %u %u\n", i, i);
+		expected[i] = lines[i];
+	}
+
+	/* In pieces that fit in the ring */
+	for(uint8_t i = 0; i < count; i++){
+		TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, formats[i], i));
+		if(i % 16 == 15)
+			len = log_stream_read(len);
+	}
+
+	/* The id of the first format has been given to another one, it is sent again */
+	TEST_ASSERT_TRUE(ESP8266_LOG(&test_log, formats[0], 0));
+	expected[count] = lines[0];
+	len = log_stream_read(len);
+	log_stream_expect(len, expected, count + 1);
+}
+
+#ifdef ESP8266_SIM
+
+void test_esp8266_log_sim(void){
+	sim_server_t server = { .body = SIM_BODY_SIZE };
+	char prefix[64];
+
+	sim_start(&server);
+	TEST_ASSERT_TRUE(esp8266_log_init(&test_log, log_buffer, sizeof(log_buffer)));
+	esp8266_set_log(&sim_esp, &test_log);
+
+	/* Only the timeout is logged */
+	TEST_ASSERT_TRUE(esp8266_sim_fail(&sim, "AT+CWJAP?", "", 1));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_TIMEOUT, esp8266_send_command_id(&sim_esp, ESP8266_CMD_CWJAP_TEST, NULL));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_send_command_id(&sim_esp, ESP8266_CMD_AT, NULL));
+	esp8266_set_log(&sim_esp, NULL);
+	TEST_ASSERT_EQUAL_UINT32(1, test_log.records);
+
+	esp8266_log_reader_t reader;
+	char text[ESP8266_LOG_LINE_MAX];
+	uint32_t time;
+	uint32_t len = log_stream_read(0);
+
+	sprintf(prefix, "esp8266 request %u timed out after ", ESP8266_CMD_CWJAP_TEST);
+	TEST_ASSERT_TRUE(esp8266_log_reader_init(&reader, log_stream, len));
+	TEST_ASSERT_TRUE(esp8266_log_next(&reader, text, &time));
+	TEST_ASSERT_EQUAL_STRING_LEN(prefix, text, strlen(prefix));
+	TEST_ASSERT_FALSE(esp8266_log_next(&reader, text, &time));
+	esp8266_sim_stop(&sim);
+}
+
+#endif
+
+#endif /* ESP8266_LOG_READER */
+
+void test_esp8266_parser_benchmark(void){
+	static const struct {
+		const char* name;
+		const char* transcript;
+		uint32_t len;
+	} transcripts[] = {
+		{"init", transcript_init, sizeof(transcript_init) - 1},
+		{"wifi", transcript_wifi, sizeof(transcript_wifi) - 1},
+		{"http", transcript_http, sizeof(transcript_http) - 1}
+	};
+	const uint32_t rounds = 100;
+	esp8266_parser_t parser;
+	esp8266_event_t event;
+	uint32_t events = 0;
+
+	esp8266_profile_clock_start();
+
+	for(uint8_t t = 0; t < sizeof(transcripts) / sizeof(transcripts[0]); t++){
+		uint32_t bytes = transcripts[t].len * rounds;
+
+		esp8266_parser_init(&parser);
+		uint32_t start = esp8266_profile_clock();
+		for(uint32_t r = 0; r < rounds; r++){
+			for(uint32_t i = 0; i < transcripts[t].len; i++)
+				events += esp8266_parser_feed(&parser, (uint8_t) transcripts[t].transcript[i], &event);
+		}
+		uint32_t cycles = esp8266_profile_clock() - start;
+
+		/* cycles per byte with two decimals, and bytes per second at the rate of the clock */
+		uint32_t centi_cycles = (uint32_t)(((uint64_t) cycles * 100) / bytes);
+		uint32_t bytes_per_second = (uint32_t)(((uint64_t) bytes * ESP8266_PROFILE_CLOCK_HZ) / cycles);
+		printf("parser %s: %lu bytes, %lu.%02lu " BENCHMARK_TICKS "/byte, %lu bytes/s\n", transcripts[t].name,
+			   (unsigned long) bytes, (unsigned long)(centi_cycles / 100), (unsigned long)(centi_cycles % 100),
+			   (unsigned long) bytes_per_second);
+	}
+	TEST_ASSERT_NOT_EQUAL(0, events);
+}
+
+/* Stack painted below the caller by stack_measure */
+#define STACK_PAINT_SIZE	1024
+#define STACK_PAINT			0xA5
+
+static const char bench_uri[] = "/api/v1/telemetry";
+static const char bench_host[] = "example.com";
+static const char bench_body[] = "{\"device\":\"stm32f303\",\"temperature\":21.5,\"humidity\":40.25}";
+static const esp8266_http_header_t bench_headers[] = {
+	{"Content-Type", "application/json"},
+	{"Connection", "keep-alive"}
+};
+static uint32_t bench_len;
+static uint8_t* stack_bottom;
+
+/* Fill the free stack below the caller with STACK_PAINT. Nothing is called from here,
+ * it would run on the stack that is being painted */
+static void __attribute__((noinline))
+stack_paint(void){
+	volatile uint8_t* sp = (volatile uint8_t*) (uintptr_t) __get_MSP();
+
+	stack_bottom = (uint8_t*) sp - STACK_PAINT_SIZE;
+	for(volatile uint8_t* p = stack_bottom; p < sp; p++)
+		*p = STACK_PAINT;
+}
+
+/* Bytes of stack a function used, found from the deepest painted byte it wrote.
+ * The interrupts are off, so only the function writes to the painted stack */
+static uint32_t
+stack_measure(void (*function)(void)){
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	const uint8_t* top = (const uint8_t*) (uintptr_t) __get_MSP();
+	stack_paint();
+	function();
+
+	const volatile uint8_t* p = stack_bottom;
+	while(p < top && *p == STACK_PAINT)
+		p++;
+	__set_PRIMASK(primask);
+	return (uint32_t)(top - p);
+}
+
+/* The request with sprintf into a buffer, the way test_esp8266_send_segmented does it */
+static void __attribute__((noinline))
+request_sprintf(void){
+	char request[256];
+
+	bench_len = sprintf(request, "%s%s %s\r\n%s%s\r\nContent-Type: application/json\r\n%s\r\nContent-Length: %u\r\n\r\n%s",
+						HTTP_POST, bench_uri, HTTP_VERSION, HTTP_HOST, bench_host, HTTP_CONNECTION_KEEP_ALIVE,
+						(unsigned)(sizeof(bench_body) - 1), bench_body);
+}
+
+/* The same request with the builder */
+static void __attribute__((noinline))
+request_builder(void){
+	esp8266_http_request_t request;
+
+	esp8266_http_request_init(&request, HTTP_POST, bench_uri, bench_host);
+	esp8266_http_request_headers(&request, bench_headers, 2);
+	esp8266_http_request_end(&request, (const uint8_t*) bench_body, sizeof(bench_body) - 1);
+	bench_len = esp8266_http_request_length(&request);
+}
+
+void test_esp8266_http_request_benchmark(void){
+	static const struct {
+		const char* name;
+		void (*function)(void);
+	} paths[] = {
+		{"sprintf", request_sprintf},
+		{"builder", request_builder}
+	};
+	const uint32_t rounds = 100;
+	uint32_t len[2];
+
+	esp8266_profile_clock_start();
+
+	for(uint8_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++){
+		uint32_t start = esp8266_profile_clock();
+		for(uint32_t r = 0; r < rounds; r++)
+			paths[i].function();
+		uint32_t cycles = (esp8266_profile_clock() - start) / rounds;
+		len[i] = bench_len;
+
+		printf("request %s: %lu bytes, %lu " BENCHMARK_TICKS ", %lu bytes of stack\n", paths[i].name,
+			   (unsigned long) len[i], (unsigned long) cycles, (unsigned long) stack_measure(paths[i].function));
+	}
+	TEST_ASSERT_EQUAL_UINT32(len[0], len[1]);
+}
+
+/* The commands of the send path with sprintf, the way they were put together before the formatter */
+static void __attribute__((noinline))
+format_sprintf(void){
+	char command[64];
+
+	bench_len = sprintf(command, "%s%u\r\n", ESP8266_AT_SEND, 1460);
+	bench_len += sprintf(command, "%s%d,%u\r\n", ESP8266_AT_SEND, 3, 1460);
+	bench_len += sprintf(command, "%s%u,\"%s\",\"%s\",%s\r\n", ESP8266_AT_START, 3, "TCP", bench_host, "80");
+}
+
+/* The same commands with the formatter */
+static void __attribute__((noinline))
+format_formatter(void){
+	char command[64];
+	esp8266_format_t format;
+
+	bench_len = esp8266_get_at_send_command(command, sizeof(command), 1460);
+
+	esp8266_format_init(&format, command, sizeof(command));
+	esp8266_format_string(&format, ESP8266_AT_SEND);
+	esp8266_format_uint(&format, 3);
+	esp8266_format_string(&format, ",");
+	esp8266_format_uint(&format, 1460);
+	esp8266_format_string(&format, "\r\n");
+	bench_len += esp8266_format_end(&format);
+
+	esp8266_format_init(&format, command, sizeof(command));
+	esp8266_format_string(&format, ESP8266_AT_START);
+	esp8266_format_uint(&format, 3);
+	esp8266_format_string(&format, ",");
+	esp8266_format_quoted(&format, "TCP");
+	esp8266_format_string(&format, ",");
+	esp8266_format_quoted(&format, bench_host);
+	esp8266_format_string(&format, ",80\r\n");
+	bench_len += esp8266_format_end(&format);
+}
+
+void test_esp8266_format_benchmark(void){
+	static const struct {
+		const char* name;
+		void (*function)(void);
+	} paths[] = {
+		{"sprintf", format_sprintf},
+		{"formatter", format_formatter}
+	};
+	const uint32_t rounds = 100;
+	uint32_t len[2];
+
+	esp8266_profile_clock_start();
+
+	/* Flash is not measured here, compare the size of _vfprintf_r and esp8266_format in the .map file */
+	for(uint8_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++){
+		uint32_t start = esp8266_profile_clock();
+		for(uint32_t r = 0; r < rounds; r++)
+			paths[i].function();
+		uint32_t cycles = (esp8266_profile_clock() - start) / rounds;
+		len[i] = bench_len;
+
+		printf("commands %s: %lu bytes, %lu " BENCHMARK_TICKS ", %lu bytes of stack\n", paths[i].name,
+			   (unsigned long) len[i], (unsigned long) cycles, (unsigned long) stack_measure(paths[i].function));
+	}
+	TEST_ASSERT_EQUAL_UINT32(len[0], len[1]);
+}
+
+#ifdef ESP8266_SIM
+
+#define SIM_BENCHMARK_REQUESTS	10
+#define SIM_BENCHMARK_BODY		2048
+
+void test_esp8266_sim_benchmark(void){
+	static const uint32_t latencies[] = {0, 20, 100};
+	sim_server_t server = { .body = SIM_BENCHMARK_BODY };
+	esp8266_http_client_t client;
+	char request[128];
+
+	sim_start(&server);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_pool_init(&sim_esp));
+	esp8266_http_keep_alive_request(request, sizeof(request), HTTP_GET, "/", "sim");
+	esp8266_http_client_init(&client, &sim_esp, "TCP", "192.168.4.2", "80");
+
+	/* Connect first, so that only the requests are timed */
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, sim_request(&client, request));
+
+	for(uint8_t l = 0; l < sizeof(latencies) / sizeof(latencies[0]); l++){
+		esp8266_sim_set_latency(&sim, latencies[l]);
+		uint32_t start = HAL_GetTick();
+
+		for(uint8_t i = 0; i < SIM_BENCHMARK_REQUESTS; i++){
+			TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, sim_request(&client, request));
+			TEST_ASSERT_EQUAL_UINT32(SIM_BENCHMARK_BODY, client.response.body);
+		}
+		uint32_t ms = HAL_GetTick() - start;
+
+		/* The AT+CIPSEND and the data each wait for the module */
+		printf("simulated module %3lu ms: %4lu ms/request, %6lu body bytes/s\n", (unsigned long) latencies[l],
+			   (unsigned long)(ms / SIM_BENCHMARK_REQUESTS),
+			   (unsigned long)((uint64_t) SIM_BENCHMARK_BODY * SIM_BENCHMARK_REQUESTS * 1000 / ms));
+		TEST_ASSERT_GREATER_OR_EQUAL_UINT32(2 * latencies[l] * SIM_BENCHMARK_REQUESTS, ms);
+	}
+	TEST_ASSERT_EQUAL_UINT32(1, client.connects);
+	esp8266_sim_stop(&sim);
+}
+
+void test_esp8266_trace_benchmark(void){
+	sim_server_t server = { .body = SIM_BENCHMARK_BODY };
+	esp8266_http_client_t client;
+	esp8266_trace_reader_t reader;
+	esp8266_trace_record_t record;
+	esp8266_parser_t parser;
+	esp8266_event_t event;
+	uint32_t cycles = 0;
+	uint32_t slowest = 0;
+	uint32_t events = 0;
+	char request[128];
+
+	/* A traced session: the init, the wifi and a few requests */
+	TEST_ASSERT_TRUE(esp8266_sim_init(&sim, &sim_esp));
+	esp8266_sim_set_remote(&sim, sim_server, &server);
+	esp8266_trace_init(&trace, trace_buffer, sizeof(trace_buffer));
+	esp8266_set_trace(&sim_esp, &trace);
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_init(&sim_esp));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_WIFI_CONNECTED, esp8266_wifi_init(&sim_esp));
+	TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, esp8266_pool_init(&sim_esp));
+	esp8266_http_keep_alive_request(request, sizeof(request), HTTP_GET, "/", "sim");
+	esp8266_http_client_init(&client, &sim_esp, "TCP", "192.168.4.2", "80");
+	for(uint8_t i = 0; i < 2; i++)
+		TEST_ASSERT_EQUAL_STRING(ESP8266_AT_OK, sim_request(&client, request));
+	esp8266_sim_stop(&sim);
+	TEST_ASSERT_EQUAL_UINT32(0, trace.dropped);
+
+	/* Each received record through the parser, the way the driver gets it */
+	esp8266_profile_clock_start();
+	esp8266_parser_init(&parser);
+	esp8266_trace_reader_init(&reader, trace_buffer, trace.len);
+	while(esp8266_trace_next(&reader, &record)){
+		if(record.direction != ESP8266_TRACE_RX)
+			continue;
+
+		uint32_t start = esp8266_profile_clock();
+		for(uint16_t i = 0; i < record.len; i++)
+			events += esp8266_parser_feed(&parser, record.data[i], &event);
+		uint32_t record_cycles = esp8266_profile_clock() - start;
+
+		cycles += record_cycles;
+		if(record_cycles > slowest)
+			slowest = record_cycles;
+	}
+
+	/* cycles per byte with two decimals, and the longest the parser held up the main loop */
+	uint32_t bytes = trace.bytes[ESP8266_TRACE_RX];
+	uint32_t centi_cycles = (uint32_t)(((uint64_t) cycles * 100) / bytes);
+	printf("parser on trace: %lu records, %lu bytes, %lu events, %lu.%02lu " BENCHMARK_TICKS "/byte, slowest record %lu "
+		   BENCHMARK_TICKS "\n",
+		   (unsigned long) trace.records, (unsigned long) bytes, (unsigned long) events,
+		   (unsigned long)(centi_cycles / 100), (unsigned long)(centi_cycles % 100), (unsigned long) slowest);
+	TEST_ASSERT_NOT_EQUAL(0, events);
+}
+
+#endif
+
+/* Most cycles the parser may spend on a byte, a pass over the token table is a few hundred */
+#define FUZZ_MAX_BYTE_CYCLES	1000
+
+void test_esp8266_parser_fuzz_benchmark(void){
+	uint8_t response[FUZZ_RESPONSE_SIZE];
+	esp8266_parser_t parser;
+	esp8266_event_t event;
+	uint32_t cycles = 0;
+	uint32_t slowest = 0;
+	uint32_t bytes = 0;
+
+	esp8266_profile_clock_start();
+	esp8266_parser_init(&parser);
+	fuzz_seed = 3;
+	for(uint32_t round = 0; round < FUZZ_ROUNDS; round++){
+		uint32_t len = fuzz_response(response, sizeof(response));
+
+		for(uint32_t i = 0; i < len; i++){
+			uint32_t primask = __get_PRIMASK();
+
+			/* Timed with the interrupts off, so that only the parser is counted */
+			__disable_irq();
+			uint32_t start = esp8266_profile_clock();
+			esp8266_parser_feed(&parser, response[i], &event);
+			uint32_t byte_cycles = esp8266_profile_clock() - start;
+			__set_PRIMASK(primask);
+
+			cycles += byte_cycles;
+			if(byte_cycles > slowest)
+				slowest = byte_cycles;
+		}
+		bytes += len;
+	}
+
+	uint32_t centi_cycles = (uint32_t)(((uint64_t) cycles * 100) / bytes);
+	printf("parser on random responses: %lu bytes, %lu.%02lu cycles/byte, slowest byte %lu cycles\n",
+		   (unsigned long) bytes, (unsigned long)(centi_cycles / 100), (unsigned long)(centi_cycles % 100),
+		   (unsigned long) slowest);
+	TEST_ASSERT_LESS_THAN_UINT32(FUZZ_MAX_BYTE_CYCLES, slowest);
+}
+
+/* Most cycles a record with two arguments may take, the goal of a few dozen. They go to the call,
+ * HAL_GetTick, saving and restoring PRIMASK, the level of the ring, and the 5 words of the
+ * record. Without optimization, as in the Debug build, every one of them is loads and stores on
+ * the stack, about three times as many cycles. */
+#ifdef __OPTIMIZE__
+#define LOG_MAX_CYCLES			64
+#else
+#define LOG_MAX_CYCLES			200
+#endif
+
+void test_esp8266_log_benchmark(void){
+	const uint32_t rounds = 16;
+	char text[ESP8266_LOG_LINE_MAX];
+	uint32_t log_cycles = 0;
+	uint32_t format_cycles = 0;
+
+	esp8266_profile_clock_start();
+	TEST_ASSERT_TRUE(esp8266_log_init(&test_log, log_buffer, sizeof(log_buffer)));
+	for(uint32_t i = 0; i < rounds; i++){
+		uint32_t primask = __get_PRIMASK();
+
+		/* Timed with the interrupts off, so that only the log and the formatting are counted */
+		__disable_irq();
+		uint32_t start = esp8266_profile_clock();
+		ESP8266_LOG(&test_log, "link %u got %lu bytes\n", 3, (uint32_t) 1460);
+		uint32_t middle = esp8266_profile_clock();
+		snprintf(text, sizeof(text), "link %u got %lu bytes\n", 3, (unsigned long) 1460);
+		uint32_t end = esp8266_profile_clock();
+		__set_PRIMASK(primask);
+
+		log_cycles += middle - start;
+		format_cycles += end - middle;
+	}
+	TEST_ASSERT_EQUAL_UINT32(rounds, test_log.records);
+
+	printf("log record: %lu cycles, snprintf of the same line: %lu cycles, and the ITM after that\n",
+		   (unsigned long)(log_cycles / rounds), (unsigned long)(format_cycles / rounds));
+	TEST_ASSERT_LESS_THAN_UINT32(LOG_MAX_CYCLES, log_cycles / rounds);
 }
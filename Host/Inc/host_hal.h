@@ -0,0 +1,134 @@
+/**
+******************************************************************************
+@brief header for the host build of the ESP8266 driver
+@details The driver, the simulated ESP8266 and the unit tests are built for
+		 the workstation against the real STM32 headers, with a thin mock of
+		 the HAL in place of the board, see CMakeLists.txt. This header is
+		 put in front of every file with -include.
+
+		 The Cortex-M intrinsics of cmsis_gcc.h are ARM assembly, they are
+		 replaced here and cmsis_gcc.h is left out. __disable_irq and
+		 __set_PRIMASK keep a PRIMASK of their own, and the interrupts that
+		 are due are run when it goes back to 0, like on the board.
+
+		 Time is simulated, the host runs as fast as it can:
+
+		 	 HAL_GetTick		the main loop has waited for the next ms
+		 	 					and the SysTick runs
+		 	 __set_PRIMASK(0)	HOST_IRQ_US go by, busy loops such as
+		 	 __enable_irq		while(esp8266_tx_busy(...)); get the SysTick
+		 	 					from here
+
+		 The SysTick does what SysTick_Handler does on the board, it moves
+		 the simulated ESP8266 on with esp8266_sim_tick. There is no DMA,
+		 the HAL leaves the uart busy with the buffer set the way the HAL
+		 does without one, and the simulator moves the bytes. A uart without
+		 a simulated module never finishes sending.
+
+		 The registers of the peripherals are mapped into the process as
+		 RAM, so the register macros of the HAL work on UART4 and USART2. The
+		 core peripherals, DWT and ITM, are not, nothing may use them.
+		 ESP8266_PROFILE_CLOCK is host_clock, the simulated time in us, and
+		 host_ns, the time of the workstation, in the benchmark build.
+
+@file host_hal.h
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+
+#ifndef HOST_HAL_H_
+#define HOST_HAL_H_
+
+#include <stdint.h>
+
+/* cmsis_gcc.h is not included, what the headers and the driver need of it is below */
+#define __CMSIS_GCC_H
+
+#define __ASM							__asm
+#define __INLINE						inline
+#define __STATIC_INLINE					static inline
+#define __STATIC_FORCEINLINE			__attribute__((always_inline)) static inline
+#define __NO_RETURN						__attribute__((__noreturn__))
+#define __USED							__attribute__((used))
+#define __WEAK							__attribute__((weak))
+#define __PACKED						__attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT					struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION					union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)					__attribute__((aligned(x)))
+#define __RESTRICT						__restrict
+#define __COMPILER_BARRIER()			__asm volatile("" ::: "memory")
+
+#define __NOP()							((void) 0)
+#define __WFI()							((void) 0)
+#define __WFE()							((void) 0)
+#define __SEV()							((void) 0)
+#define __ISB()							__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __DSB()							__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __DMB()							__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __REV(value)					__builtin_bswap32(value)
+#define __CLZ(value)					((uint8_t) __builtin_clz(value))
+
+/* Simulated us that go by each time the interrupts are turned back on */
+#define HOST_IRQ_US						10
+
+/**
+ * @brief turn the interrupts off
+ * @return void
+ */
+void
+__disable_irq(void);
+
+/**
+ * @brief turn the interrupts on, the interrupts that are due run
+ * @return void
+ */
+void
+__enable_irq(void);
+
+/**
+ * @brief get PRIMASK
+ * @return uint32_t, 1 while the interrupts are off
+ */
+uint32_t
+__get_PRIMASK(void);
+
+/**
+ * @brief set PRIMASK, the interrupts that are due run when it goes to 0
+ * @param uint32_t primask
+ * @return void
+ */
+void
+__set_PRIMASK(uint32_t primask);
+
+/**
+ * @brief get the stack pointer, for the stack measurements of the benchmarks. Not cut to 32 bits
+ * 		  like on the board, the stack is painted from it.
+ * @return uintptr_t, an address near the top of the stack
+ */
+uintptr_t
+__get_MSP(void);
+
+/**
+ * @brief get the simulated time, ESP8266_PROFILE_CLOCK of the host build
+ * @return uint32_t, us since the start
+ */
+uint32_t
+host_clock(void);
+
+/**
+ * @brief get the monotonic clock of the workstation, ESP8266_PROFILE_CLOCK of the benchmark build
+ * @return uint32_t, ns, runs out after 4.3 s
+ */
+uint32_t
+host_ns(void);
+
+/**
+ * @brief let time go by, the SysTick runs for each ms that goes by
+ * @param uint32_t us
+ * @return void
+ */
+void
+host_advance(uint32_t us);
+
+#endif /* HOST_HAL_H_ */
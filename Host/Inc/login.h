@@ -0,0 +1,19 @@
+/**
+******************************************************************************
+@brief login of the host build
+@details The wifi the simulated ESP8266 joins, it takes any. The board gets
+		 its own Core/Inc/login.h, see README.md.
+
+@file login.h
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+
+#ifndef INC_LOGIN_H_
+#define INC_LOGIN_H_
+
+static const char SSID[] = "sim";
+static const char PWD[]  = "simulated";
+
+#endif /* INC_LOGIN_H_ */
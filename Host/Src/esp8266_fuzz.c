@@ -0,0 +1,214 @@
+/**
+******************************************************************************
+@brief fuzz target of the response parser and the command results
+@details LLVMFuzzerTestOneInput for libFuzzer, or for fuzz_main.c, which runs
+		 it on files, for AFL, or on random inputs. Built with the sanitizers
+		 of the host build, see CMakeLists.txt.
+
+		 The input is an answer of the module. It goes through the parser on
+		 its own, where every event has to be valid and no byte may take
+		 longer than FUZZ_MAX_BYTE_NS, and through the driver: the simulated
+		 module answers a command from the table with it, the first byte
+		 picks the command. The result has to be one that get_return can
+		 give for the command, and the driver has to answer the next AT.
+
+		 The time per byte is CPU time of the thread, with the sanitizers on,
+		 so the bound only catches a parser that goes back over what it has
+		 seen. The bound in cycles is test_esp8266_parser_fuzz_benchmark on
+		 the board.
+
+@file esp8266_fuzz.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "ESP8266.h"
+#include "esp8266_sim.h"
+#include "esp8266_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Most ns of CPU time the parser may take on a byte */
+#define FUZZ_MAX_BYTE_NS		100000
+
+/* Longest answer sent through the simulated module, it has to fit in its output */
+#define FUZZ_REPLY_MAX			1024
+
+/* ms the driver waits for the answer, the answer is sent right away */
+#define FUZZ_TIMEOUT			100
+
+#define FUZZ_CHECK(condition)																\
+	do {																					\
+		if(!(condition)){																	\
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition);					\
+			abort();																		\
+		}																					\
+	} while(0)
+
+/* The commands that are answered, with their parameters, and none that change the uart */
+static const struct {
+	esp8266_command_id_t id;
+	const char* command;				// NULL for the command of the table
+} fuzz_commands[] = {
+	{ ESP8266_CMD_AT, NULL },
+	{ ESP8266_CMD_GMR, NULL },
+	{ ESP8266_CMD_CWMODE_TEST, NULL },
+	{ ESP8266_CMD_CWMODE_STATION_MODE, NULL },
+	{ ESP8266_CMD_CWJAP_TEST, NULL },
+	{ ESP8266_CMD_CWJAP_SET, "AT+CWJAP=\"fuzz\",\"fuzz\"\r\n" },
+	{ ESP8266_CMD_CWQAP, NULL },
+	{ ESP8266_CMD_CIPMUX_TEST, NULL },
+	{ ESP8266_CMD_CIPMUX_SINGLE, NULL },
+	{ ESP8266_CMD_START, "AT+CIPSTART=\"TCP\",\"192.168.4.2\",80\r\n" },
+	{ ESP8266_CMD_STOP, NULL }
+};
+
+static esp8266_t esp;
+static esp8266_sim_t sim;
+
+static uint64_t
+fuzz_clock(void){
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Completion callback, saves the result */
+static void
+fuzz_done(const char* result, void* context){
+	*(const char**) context = result;
+}
+
+/* The results get_return can give for a command, and a timeout */
+static bool
+fuzz_known(esp8266_command_id_t id, const char* result){
+	const esp8266_command_t* command = &esp8266_commands[id];
+	const char* results[7] = { ESP8266_TIMEOUT, ESP8266_AT_ERROR, command->expected };
+	uint8_t count = 3;
+
+	switch(command->result){
+		case ESP8266_RESULT_BASIC:
+			break;
+		case ESP8266_RESULT_CWMODE:
+			results[count++] = ESP8266_AT_CWMODE_2;
+			results[count++] = ESP8266_AT_CWMODE_3;
+			results[count++] = ESP8266_AT_UNKNOWN;
+			break;
+		case ESP8266_RESULT_CWJAP_TEST:
+			results[count++] = ESP8266_AT_WIFI_DISCONNECTED;
+			break;
+		case ESP8266_RESULT_CWJAP_SET:
+			results[count++] = ESP8266_AT_TIMEOUT;
+			results[count++] = ESP8266_AT_WRONG_PWD;
+			results[count++] = ESP8266_AT_NO_TARGET;
+			results[count++] = ESP8266_AT_CONNECTION_FAIL;
+			break;
+		case ESP8266_RESULT_CIPMUX:
+			results[count++] = ESP8266_AT_CIPMUX_1;
+			break;
+	}
+	for(uint8_t i = 0; i < count; i++){
+		if(strcmp(result, results[i]) == 0)
+			return true;
+	}
+	return false;
+}
+
+/* Every byte through the parser, the events have to make sense */
+static void
+fuzz_parser(const uint8_t* data, size_t size){
+	static const char sync[] = "\r\nOK\r\n";
+	esp8266_parser_t parser;
+	esp8266_event_t event;
+
+	esp8266_parser_init(&parser);
+	for(size_t i = 0; i < size; i++){
+		uint64_t start = fuzz_clock();
+		bool emitted = esp8266_parser_feed(&parser, data[i], &event);
+		FUZZ_CHECK(fuzz_clock() - start < FUZZ_MAX_BYTE_NS);
+
+		if(emitted){
+			FUZZ_CHECK(event.type > ESP8266_EVENT_NONE && event.type <= ESP8266_EVENT_IPD);
+			FUZZ_CHECK(event.link >= ESP8266_PARSER_NO_LINK && event.link <= ESP8266_PARSER_MAX_LINK);
+			if(event.type == ESP8266_EVENT_IPD)
+				FUZZ_CHECK(event.value >= 0 && event.value <= ESP8266_PARSER_MAX_PAYLOAD);
+		}
+		FUZZ_CHECK(esp8266_parser_payload(&parser) <= ESP8266_PARSER_MAX_PAYLOAD);
+	}
+
+	/* After the rest of the payload an OK on a line of its own is found */
+	for(uint32_t left = esp8266_parser_payload(&parser); left > 0; left--)
+		FUZZ_CHECK(!esp8266_parser_feed(&parser, 'x', &event));
+
+	event.type = ESP8266_EVENT_NONE;
+	for(uint8_t i = 0; i < sizeof(sync) - 1; i++)
+		esp8266_parser_feed(&parser, sync[i], &event);
+	FUZZ_CHECK(event.type == ESP8266_EVENT_OK);
+}
+
+/* Throw away what the module is still sending, as the application does after a timeout */
+static void
+fuzz_quiet(void){
+	while(ring_buffer_used(&sim.out) > 0)
+		HAL_Delay(1);
+	esp8266_clear(&esp);
+}
+
+/* The input as the answer to a command, through the uart, the receive engine and get_return */
+static void
+fuzz_driver(const uint8_t* data, size_t size){
+	static char reply[FUZZ_REPLY_MAX + 1];
+	char prefix[ESP8266_SIM_LINE_SIZE];
+	const char* result = NULL;
+
+	if(size == 0)
+		return;
+
+	uint8_t pick = data[0] % (sizeof(fuzz_commands) / sizeof(fuzz_commands[0]));
+	esp8266_command_id_t id = fuzz_commands[pick].id;
+	const char* command = fuzz_commands[pick].command;
+
+	/* The fault is matched on the command without its parameters and CRLF. The reply is a string. */
+	size_t len = size - 1 < FUZZ_REPLY_MAX ? size - 1 : FUZZ_REPLY_MAX;
+	for(size_t i = 0; i < len; i++)
+		reply[i] = data[1 + i] == '\0' ? '\xff' : data[1 + i];
+	reply[len] = '\0';
+	size_t prefix_len = strcspn(ESP8266_COMMAND_STRING(id), "=\r\n");
+	memcpy(prefix, ESP8266_COMMAND_STRING(id), prefix_len);
+	prefix[prefix_len] = '\0';
+
+	fuzz_quiet();
+	FUZZ_CHECK(esp8266_sim_fail(&sim, prefix, reply, 1));
+	FUZZ_CHECK(esp8266_send_command_id_async(&esp, id, command, FUZZ_TIMEOUT, fuzz_done, &result));
+	while(esp8266_busy(&esp))
+		esp8266_poll(&esp);
+	esp8266_sim_fail(&sim, prefix, "", 0);
+
+	if(result == NULL || !fuzz_known(id, result)){
+		fprintf(stderr, "%.*s: %s\n", (int) strcspn(ESP8266_COMMAND_STRING(id), "\r\n"),
+				ESP8266_COMMAND_STRING(id), result != NULL ? result : "no result");
+		abort();
+	}
+
+	/* Once the module is quiet and what it sent is thrown away, it answers as before */
+	fuzz_quiet();
+	FUZZ_CHECK(strcmp(esp8266_send_command_id(&esp, ESP8266_CMD_AT, NULL), ESP8266_AT_OK) == 0);
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+	static bool started;
+
+	if(!started){
+		FUZZ_CHECK(esp8266_sim_init(&sim, &esp));
+		FUZZ_CHECK(strcmp(esp8266_init(&esp), ESP8266_AT_OK) == 0);
+		started = true;
+	}
+
+	fuzz_parser(data, size);
+	fuzz_driver(data, size);
+	return 0;
+}
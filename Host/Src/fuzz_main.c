@@ -0,0 +1,100 @@
+/**
+******************************************************************************
+@brief runs the fuzz target without libFuzzer
+@details For gcc, which has no libFuzzer, and for AFL:
+
+		 	 esp8266_fuzz [file...]
+
+		 Runs LLVMFuzzerTestOneInput once on each file, AFL gives the file
+		 with @@. Without files it runs on FUZZ_RUNS random inputs, made of
+		 tokens of the module and random bytes like the fuzz tests of
+		 unit_test.c, the same ones on every run so that a crash can be
+		 repeated. A check that fails aborts, as with libFuzzer.
+
+@file fuzz_main.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Number and max size of the random inputs */
+#define FUZZ_RUNS				2000
+#define FUZZ_INPUT_SIZE			512
+
+/* Max size of an input file, libFuzzer's default -max_len is lower */
+#define FUZZ_FILE_MAX			65536
+
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+/* Pieces of the random inputs, so that they get past the start of the tokens */
+static const char* const fuzz_pieces[] = {
+	"OK", "ERROR", "FAIL", "SEND OK", "SEND FAIL", "ready", "ets Jan  8 2013,rst cause:2", "busy p...",
+	"CONNECT", "CONNECT FAIL", "CLOSED", "WIFI CONNECTED", "WIFI GOT IP", "WIFI DISCONNECT", "No AP",
+	"+CWJAP:", "+CWMODE_CUR:", "+CIPMUX:", "+IPD,", "> ", "\r\n", "\r", "\n", ",", ":", " ",
+	"0", "1", "4", "9", "12", "4096", "4097", "99999999999"
+};
+
+static uint32_t fuzz_seed = 1;
+
+static uint32_t
+fuzz_random(void){
+	fuzz_seed = fuzz_seed * 1103515245 + 12345;
+	return fuzz_seed >> 16;
+}
+
+/* Fill buffer with a random input of 1 to size bytes, returns its length. Half of them end
+ * like an answer, so that they get to the result. */
+static size_t
+fuzz_input(uint8_t* buffer, size_t size){
+	static const char ok[] = "\r\nOK\r\n";
+	size_t len = 0;
+	size_t end = 1 + fuzz_random() % (size - sizeof(ok));
+
+	while(len < end){
+		uint32_t r = fuzz_random();
+
+		if(r % 4 == 0){
+			buffer[len++] = fuzz_random();
+			continue;
+		}
+
+		const char* piece = fuzz_pieces[r / 4 % (sizeof(fuzz_pieces) / sizeof(fuzz_pieces[0]))];
+		while(*piece != '\0' && len < end)
+			buffer[len++] = *piece++;
+	}
+	if(fuzz_random() % 2 == 0){
+		memcpy(&buffer[len], ok, sizeof(ok) - 1);
+		len += sizeof(ok) - 1;
+	}
+	return len;
+}
+
+int
+main(int argc, char** argv){
+	static uint8_t buffer[FUZZ_FILE_MAX];
+
+	if(argc == 1){
+		for(uint32_t run = 0; run < FUZZ_RUNS; run++)
+			LLVMFuzzerTestOneInput(buffer, fuzz_input(buffer, FUZZ_INPUT_SIZE));
+		printf("%u random inputs\n", FUZZ_RUNS);
+		return 0;
+	}
+
+	for(int i = 1; i < argc; i++){
+		FILE* file = fopen(argv[i], "rb");
+		if(file == NULL){
+			perror(argv[i]);
+			return 1;
+		}
+		size_t size = fread(buffer, 1, sizeof(buffer), file);
+		fclose(file);
+		LLVMFuzzerTestOneInput(buffer, size);
+	}
+	printf("%d inputs\n", argc - 1);
+	return 0;
+}
@@ -0,0 +1,226 @@
+/**
+******************************************************************************
+@brief HAL of the host build
+@details Stands in for the parts of the STM32 HAL the driver uses, with
+		 simulated time and interrupts, see host_hal.h.
+
+@file host_hal.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "main.h"
+#include "usart.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#ifdef ESP8266_SIM
+#include "esp8266_sim.h"
+#endif
+
+/* PCLK1 of SystemClock_Config, which clocks UART4 and USART2 */
+#define HOST_PCLK1				36000000
+
+/* GPIO ports that can be written and read back */
+#define HOST_GPIO_PORTS			4
+
+UART_HandleTypeDef huart4;
+UART_HandleTypeDef huart2;
+uint32_t SystemCoreClock = 72000000;
+
+/* Simulated time in us, and the SysTicks that are due but have not run */
+static uint32_t host_time;
+static uint32_t host_ticks_due;
+
+/* The ms count of HAL_GetTick, only moved by the SysTick like on the board */
+static uint32_t host_ms;
+
+static uint32_t host_primask;
+static bool host_in_irq;
+
+/* Levels of the pins that have been written */
+static struct {
+	GPIO_TypeDef* port;
+	uint16_t pins;
+} host_gpio[HOST_GPIO_PORTS];
+
+/* The peripherals are at fixed addresses, UART4 at 0x40004C00. The APB and AHB1 part
+ * of the memory map is made RAM, before main, so the register macros of the HAL work. */
+__attribute__((constructor)) static void
+host_map_peripherals(void){
+	void* base = (void*) PERIPH_BASE;
+
+	if(mmap(base, AHB1PERIPH_BASE + 0x10000 - PERIPH_BASE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) != base){
+		perror("host_map_peripherals");
+		exit(1);
+	}
+}
+
+/* Like SysTick_Handler */
+static void
+host_systick(void){
+	host_ms++;
+#ifdef ESP8266_SIM
+	esp8266_sim_tick();
+#endif
+}
+
+/* Run the SysTicks that are due, unless the interrupts are off or one is running */
+static void
+host_interrupts(void){
+	if(host_in_irq || host_primask != 0)
+		return;
+
+	host_in_irq = true;
+	while(host_ticks_due > 0){
+		host_ticks_due--;
+		host_systick();
+	}
+	host_in_irq = false;
+}
+
+void
+host_advance(uint32_t us){
+	host_ticks_due += (host_time % 1000 + us) / 1000;
+	host_time += us;
+	host_interrupts();
+}
+
+uint32_t
+host_clock(void){
+	return host_time;
+}
+
+uint32_t
+host_ns(void){
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t) ((uint64_t) now.tv_sec * 1000000000 + now.tv_nsec);
+}
+
+void
+__disable_irq(void){
+	host_primask = 1;
+}
+
+void
+__enable_irq(void){
+	host_primask = 0;
+	host_advance(HOST_IRQ_US);
+}
+
+uint32_t
+__get_PRIMASK(void){
+	return host_primask;
+}
+
+void
+__set_PRIMASK(uint32_t primask){
+	if(primask == 0)
+		__enable_irq();
+	else
+		__disable_irq();
+}
+
+uintptr_t
+__get_MSP(void){
+	return (uintptr_t) __builtin_frame_address(0);
+}
+
+uint32_t
+HAL_GetTick(void){
+
+	/* The main loop waits for the next ms, an interrupt gets the time it came at */
+	if(!host_in_irq && host_primask == 0)
+		host_advance(1000 - host_time % 1000);
+	return host_ms;
+}
+
+void
+HAL_Delay(uint32_t delay){
+	uint32_t start = HAL_GetTick();
+
+	while(HAL_GetTick() - start < delay);
+}
+
+uint32_t
+HAL_RCC_GetPCLK1Freq(void){
+	return HOST_PCLK1;
+}
+
+void
+HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state){
+	for(uint8_t i = 0; i < HOST_GPIO_PORTS; i++){
+		if(host_gpio[i].port != port && host_gpio[i].port != NULL)
+			continue;
+
+		host_gpio[i].port = port;
+		if(state == GPIO_PIN_SET)
+			host_gpio[i].pins |= pin;
+		else
+			host_gpio[i].pins &= ~pin;
+		return;
+	}
+}
+
+GPIO_PinState
+HAL_GPIO_ReadPin(GPIO_TypeDef* port, uint16_t pin){
+	for(uint8_t i = 0; i < HOST_GPIO_PORTS; i++){
+		if(host_gpio[i].port == port)
+			return (host_gpio[i].pins & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+	}
+	return GPIO_PIN_RESET;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Init(UART_HandleTypeDef* huart){
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	huart->ErrorCode = HAL_UART_ERROR_NONE;
+	return HAL_OK;
+}
+
+/* As the HAL does without a DMA channel: the uart is busy with the buffer until whoever
+ * plays the DMA has sent it */
+HAL_StatusTypeDef
+HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size){
+	if(huart->gState != HAL_UART_STATE_READY)
+		return HAL_BUSY;
+	if(data == NULL || size == 0)
+		return HAL_ERROR;
+
+	huart->pTxBuffPtr = data;
+	huart->TxXferSize = size;
+	huart->TxXferCount = size;
+	huart->gState = HAL_UART_STATE_BUSY_TX;
+	SET_BIT(huart->Instance->CR3, USART_CR3_DMAT);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size){
+	if(huart->RxState != HAL_UART_STATE_READY)
+		return HAL_BUSY;
+	if(data == NULL || size == 0)
+		return HAL_ERROR;
+
+	huart->ReceptionType = HAL_UART_RECEPTION_TOIDLE;
+	huart->pRxBuffPtr = data;
+	huart->RxXferSize = size;
+	huart->RxXferCount = size;
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+	SET_BIT(huart->Instance->CR3, USART_CR3_DMAR);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UART_AbortReceive(UART_HandleTypeDef* huart){
+	CLEAR_BIT(huart->Instance->CR3, USART_CR3_DMAR);
+	huart->RxXferCount = 0;
+	huart->RxState = HAL_UART_STATE_READY;
+	huart->ReceptionType = HAL_UART_RECEPTION_STANDARD;
+	return HAL_OK;
+}
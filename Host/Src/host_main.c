@@ -0,0 +1,18 @@
+/**
+******************************************************************************
+@brief unit tests on the host
+@details Runs the Unity suite of unit_test.c, the exit status is the number
+		 of failed tests, for ctest.
+
+@file host_main.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "unit_test.h"
+
+int
+main(void){
+	unit_test();
+	return Unity.TestFailures == 0 ? 0 : 1;
+}
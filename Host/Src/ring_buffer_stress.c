@@ -0,0 +1,150 @@
+/**
+******************************************************************************
+@brief two thread stress test of the ring buffer
+@details A producer thread and a consumer thread on the same small ring, as
+		 the DMA interrupt and the main loop are on the board. Every byte
+		 has to come out once and in order. Built with ThreadSanitizer, which
+		 reports the bytes of the buffer as a race if head and tail do not
+		 order them, even on a CPU that would not show it.
+
+@file ring_buffer_stress.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "unity.h"
+#include "ring_buffer.h"
+#include <pthread.h>
+#include <sched.h>
+
+/* Bytes through the ring in each test, many times its size */
+#define STRESS_BYTES			1000000
+
+/* Small, so that the indexes wrap and the threads meet at the ends all the time */
+#define STRESS_RING_SIZE		64
+
+static ring_buffer_t ring;
+static uint8_t buffer[STRESS_RING_SIZE];
+
+/* Copies pieces of 1 to 13 counting bytes in, what did not fit is written again */
+static void*
+stress_write(void* context){
+	uint32_t* attempted = context;
+	uint8_t piece[13];
+	uint32_t value = 0;
+
+	while(value < STRESS_BYTES){
+		uint32_t len = 1 + value % sizeof(piece);
+
+		if(len > STRESS_BYTES - value)
+			len = STRESS_BYTES - value;
+		for(uint32_t i = 0; i < len; i++)
+			piece[i] = value + i;
+
+		uint32_t written = ring_buffer_write(&ring, piece, len);
+		*attempted += len;
+		value += written;
+		if(written < len)
+			sched_yield();
+	}
+	return NULL;
+}
+
+/* Writes counting bytes into the buffer and commits them like the DMA, never more than
+ * there is room for, so that nothing is overwritten */
+static void*
+stress_commit(void* context){
+	uint32_t value = 0;
+
+	(void) context;
+	while(value < STRESS_BYTES){
+		uint32_t room = ring.size - ring_buffer_used(&ring);
+		uint32_t len = 1 + value % 7;
+
+		if(len > STRESS_BYTES - value)
+			len = STRESS_BYTES - value;
+		if(len > room){
+			sched_yield();
+			continue;
+		}
+
+		uint32_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+		for(uint32_t i = 0; i < len; i++)
+			ring.buffer[(head + i) & ring.mask] = value + i;
+		ring_buffer_commit(&ring, len);
+		value += len;
+	}
+	return NULL;
+}
+
+/* Start the producer and check that every byte comes out once and in order */
+static void
+stress_read(void* (*producer)(void*), void* context, bool in_place){
+	pthread_t thread;
+	uint32_t expected = 0;
+
+	TEST_ASSERT_TRUE(ring_buffer_init(&ring, buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL_INT(0, pthread_create(&thread, NULL, producer, context));
+
+	while(expected < STRESS_BYTES){
+		const uint8_t* data;
+		uint8_t piece[7];
+		uint32_t len;
+
+		if(in_place){
+			len = ring_buffer_peek(&ring, &data);
+			if(len > 5)
+				len = 5;
+		}
+		else {
+			len = ring_buffer_read(&ring, piece, 1 + expected % sizeof(piece));
+			data = piece;
+		}
+		if(len == 0){
+			sched_yield();
+			continue;
+		}
+
+		for(uint32_t i = 0; i < len; i++)
+			TEST_ASSERT_EQUAL_HEX8((uint8_t) (expected + i), data[i]);
+		if(in_place)
+			ring_buffer_consume(&ring, len);
+		expected += len;
+	}
+
+	TEST_ASSERT_EQUAL_INT(0, pthread_join(thread, NULL));
+	TEST_ASSERT_EQUAL_UINT32(0, ring_buffer_used(&ring));
+	TEST_ASSERT_LESS_OR_EQUAL_UINT32(STRESS_RING_SIZE, ring.high_water);
+}
+
+void setUp(void){}
+
+void tearDown(void){}
+
+void test_ring_buffer_stress_write(void){
+	uint32_t attempted = 0;
+
+	stress_read(stress_write, &attempted, false);
+
+	/* The bytes that were written again are the ones that were dropped */
+	TEST_ASSERT_EQUAL_UINT32(attempted - STRESS_BYTES, ring.dropped);
+	TEST_ASSERT_EQUAL_UINT32(0, ring.overwritten);
+}
+
+void test_ring_buffer_stress_commit(void){
+	stress_read(stress_commit, NULL, true);
+	TEST_ASSERT_EQUAL_UINT32(0, ring_buffer_overruns(&ring));
+}
+
+int
+main(void){
+	UNITY_BEGIN();
+
+	/* Test copying in and out while the other thread does the same */
+	RUN_TEST(test_ring_buffer_stress_write);
+
+	/* Test committing like the DMA and using the bytes in place */
+	RUN_TEST(test_ring_buffer_stress_commit);
+
+	return UNITY_END();
+}
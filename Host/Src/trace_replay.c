@@ -0,0 +1,387 @@
+/**
+******************************************************************************
+@brief replay of a uart trace on the host
+@details Plays a trace to the driver with the time it had in the field, see
+		 esp8266_trace.h and esp8266_sim_replay, so that the parser and the
+		 request handling can be measured and checked on real traffic.
+
+		 	 esp8266_replay [trace]
+
+		 The trace is a dump of esp8266_trace_dump, with its header, or the
+		 records of a trace without one. Without a trace a session with the
+		 simulated module is traced first: the init, the wifi and a request.
+
+		 The simulated module plays what the module sent, the driver makes the
+		 requests the traced driver made, each one at the time it was made in
+		 the trace. The requests are taken from what was sent: a line is a
+		 command, AT+CIPSEND= and its data are a send on the single
+		 connection. Traces with sends on links or passthrough are not
+		 replayed.
+
+		 Prints each request with its result, the latency profile of the
+		 driver and the time the parser takes on the received bytes. Exits
+		 with 1 if the driver did not send and receive the bytes of the
+		 trace, 2 if the trace could not be replayed.
+
+@file trace_replay.c
+@author agent@local
+@date 16-10-2026
+@version 1.0
+*******************************************************************************/
+#include "ESP8266.h"
+#include "esp8266_sim.h"
+#include "esp8266_trace.h"
+#include "esp8266_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Max size of a trace, the 3 length bytes of a dump */
+#define REPLAY_TRACE_MAX		(1 << 24)
+
+/* Buffer of the trace of the replay, and of the session traced without a trace */
+#define REPLAY_BUFFER_SIZE		65536
+
+/* ms after the last record that the replay may take, the longest timeout a request can wait out */
+#define REPLAY_GRACE			ESP8266_TIMEOUT_CWJAP
+
+typedef struct {
+	uint32_t time;						// ms in the trace when the first byte was sent
+	const char* data;					// the command, or the data of a send, in the sent bytes
+	uint16_t len;
+	bool send;							// data of AT+CIPSEND= on the single connection
+	esp8266_command_id_t id;
+	esp8266_tx_part_t part;
+	const char* result;					// NULL until done
+	uint32_t started;					// ms since the start of the replay
+	uint32_t finished;
+} replay_request_t;
+
+static esp8266_t esp;
+static esp8266_sim_t sim;
+static esp8266_profile_table_t profile;
+
+/* Completion callback of the requests */
+static void
+replay_done(const char* result, void* context){
+	replay_request_t* request = context;
+
+	request->result = result;
+	request->finished = HAL_GetTick();
+}
+
+/* The server of the session traced without a trace, answers the request and closes */
+static void
+replay_server(esp8266_sim_t* sim, uint8_t link, const uint8_t* data, uint16_t len, void* context){
+	static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nConnection: close\r\n\r\nhello";
+
+	(void) data;
+	(void) len;
+	(void) context;
+	esp8266_sim_receive(sim, link, (const uint8_t*) response, strlen(response));
+	esp8266_sim_close(sim, link);
+}
+
+/* Trace a session with the simulated module answering, returns the length of the records */
+static uint32_t
+replay_session(uint8_t* buffer, uint32_t size){
+	esp8266_trace_t trace;
+	char connect[64];
+	char request[128];
+
+	if(!esp8266_sim_init(&sim, &esp))
+		return 0;
+	esp8266_sim_set_remote(&sim, replay_server, NULL);
+	esp8266_trace_init(&trace, buffer, size);
+	esp8266_set_trace(&esp, &trace);
+
+	esp8266_get_connection_command(connect, sizeof(connect), "TCP", "192.168.4.2", "80");
+	uint16_t len = esp8266_http_get_request(request, sizeof(request), "GET", "/", "sim");
+	bool ok = strcmp(esp8266_init(&esp), ESP8266_AT_OK) == 0
+			  && strcmp(esp8266_wifi_init(&esp), ESP8266_AT_WIFI_CONNECTED) == 0
+			  && strcmp(esp8266_send_command(&esp, connect), ESP8266_AT_CONNECT) == 0
+			  && strcmp(esp8266_send(&esp, (const uint8_t*) request, len), ESP8266_AT_SEND_OK) == 0;
+
+	/* The response and the close come after the SEND OK */
+	for(uint32_t start = HAL_GetTick(); HAL_GetTick() - start < 100;)
+		esp8266_poll(&esp);
+	esp8266_sim_stop(&sim);
+	return ok && trace.dropped == 0 ? trace.len : 0;
+}
+
+/* Read a trace file, without the header of a dump. Returns NULL if it can not be read. */
+static uint8_t*
+replay_load(const char* path, uint32_t* len){
+	FILE* file = fopen(path, "rb");
+	if(file == NULL){
+		perror(path);
+		return NULL;
+	}
+
+	uint8_t* data = malloc(REPLAY_TRACE_MAX + 8);
+	size_t read = data != NULL ? fread(data, 1, REPLAY_TRACE_MAX + 8, file) : 0;
+	fclose(file);
+
+	*len = read;
+	if(read >= 8 && memcmp(data, "E8TR", 4) == 0){
+		uint32_t records = data[5] | data[6] << 8 | data[7] << 16;
+
+		if(data[4] != ESP8266_TRACE_VERSION || records > read - 8){
+			fprintf(stderr, "%s: version %u or length %lu of the dump is wrong\n", path, data[4],
+					(unsigned long) records);
+			free(data);
+			return NULL;
+		}
+		memmove(data, data + 8, records);
+		*len = records;
+	}
+	return data;
+}
+
+/* Put the bytes that were sent one after the other in sent, and cut them into requests.
+ * Returns the number of requests, -1 if they are not what the driver can send again. */
+static int32_t
+replay_requests(const uint8_t* trace, uint32_t len, char* sent, uint32_t* times, replay_request_t* requests){
+	esp8266_trace_reader_t reader;
+	esp8266_trace_record_t record;
+	uint32_t bytes = 0;
+	int32_t count = 0;
+
+	esp8266_trace_reader_init(&reader, trace, len);
+	while(esp8266_trace_next(&reader, &record)){
+		if(record.direction != ESP8266_TRACE_TX)
+			continue;
+		memcpy(&sent[bytes], record.data, record.len);
+		for(uint16_t i = 0; i < record.len; i++)
+			times[bytes++] = record.time;
+	}
+
+	for(uint32_t pos = 0; pos < bytes; count++){
+		replay_request_t* request = &requests[count];
+		const char* end = memchr(&sent[pos], '\n', bytes - pos);
+		char command[ESP8266_SIM_LINE_SIZE];
+
+		if(end == NULL || end + 1 - &sent[pos] >= (int32_t) sizeof(command)){
+			fprintf(stderr, "%lu ms: %lu bytes that are not a command\n", (unsigned long) times[pos],
+					(unsigned long) (bytes - pos));
+			return -1;
+		}
+
+		memset(request, 0, sizeof(*request));
+		request->time = times[pos];
+		request->data = &sent[pos];
+		request->len = end + 1 - &sent[pos];
+		memcpy(command, request->data, request->len);
+		command[request->len] = '\0';
+		request->id = esp8266_command_id(command);
+		pos += request->len;
+		if(request->id != ESP8266_CMD_SEND)
+			continue;
+
+		/* The driver sends the AT+CIPSEND= of a send itself, the data goes with it */
+		char* digits_end;
+		unsigned long data_len = strtoul(&command[strlen(ESP8266_AT_SEND)], &digits_end, 10);
+		if(strcmp(digits_end, "\r\n") != 0 || data_len == 0 || data_len > bytes - pos){
+			fprintf(stderr, "%lu ms: %.*s is not a send on the single connection\n",
+					(unsigned long) request->time, (int) strcspn(command, "\r\n"), command);
+			return -1;
+		}
+		request->send = true;
+		request->data = &sent[pos];
+		request->len = data_len;
+		pos += data_len;
+	}
+	return count;
+}
+
+/* Queue a request, false if the driver has no room for it yet */
+static bool
+replay_submit(replay_request_t* request){
+	request->started = HAL_GetTick();
+	if(request->send)
+		return esp8266_sendv_async(&esp, NULL, 0, (const uint8_t*) request->data, request->len, replay_done, request);
+
+	request->part.data = request->data;
+	request->part.len = request->len;
+	return esp8266_send_parts_async(&esp, request->id, &request->part, 1, ESP8266_DEFAULT_TIMEOUT, replay_done, request);
+}
+
+/* Count the bytes that went one way in both traces and are the same, up to the first difference */
+static uint32_t
+replay_compare(const uint8_t* expected, uint32_t expected_len, const esp8266_trace_t* actual,
+			   esp8266_trace_direction_t direction, uint32_t* total){
+	esp8266_trace_reader_t readers[2];
+	esp8266_trace_record_t records[2] = {0};
+	uint16_t pos[2] = {0, 0};
+	uint32_t same = 0;
+
+	*total = 0;
+	esp8266_trace_reader_init(&readers[0], expected, expected_len);
+	esp8266_trace_reader_init(&readers[1], actual->buffer, actual->len);
+	while(esp8266_trace_next(&readers[0], &records[0])){
+		if(records[0].direction == direction)
+			*total += records[0].len;
+	}
+
+	esp8266_trace_reader_init(&readers[0], expected, expected_len);
+	records[0].len = 0;
+	for(;;){
+		for(uint8_t i = 0; i < 2; i++){
+			while(pos[i] == records[i].len && esp8266_trace_next(&readers[i], &records[i])){
+				if(records[i].direction != direction)
+					records[i].len = 0;
+				pos[i] = 0;
+			}
+		}
+		if(pos[0] == records[0].len || pos[1] == records[1].len
+		   || records[0].data[pos[0]++] != records[1].data[pos[1]++])
+			return same;
+		same++;
+	}
+}
+
+/* Time the parser on the received records, as the driver gets them */
+static void
+replay_parser(const uint8_t* trace, uint32_t len){
+	esp8266_trace_reader_t reader;
+	esp8266_trace_record_t record;
+	esp8266_parser_t parser;
+	esp8266_event_t event;
+	uint64_t total = 0;
+	uint64_t slowest = 0;
+	uint32_t bytes = 0;
+	uint32_t events = 0;
+
+	esp8266_parser_init(&parser);
+	esp8266_trace_reader_init(&reader, trace, len);
+	while(esp8266_trace_next(&reader, &record)){
+		struct timespec start, end;
+
+		if(record.direction != ESP8266_TRACE_RX)
+			continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(uint16_t i = 0; i < record.len; i++)
+			events += esp8266_parser_feed(&parser, record.data[i], &event);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		uint64_t ns = (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec - start.tv_nsec;
+		total += ns;
+		bytes += record.len;
+		if(ns > slowest)
+			slowest = ns;
+	}
+
+	printf("parser: %lu bytes, %lu events, %.1f ns/byte, slowest record %lu ns\n", (unsigned long) bytes,
+		   (unsigned long) events, bytes > 0 ? (double) total / bytes : 0.0, (unsigned long) slowest);
+}
+
+int
+main(int argc, char** argv){
+	static uint8_t buffer[REPLAY_BUFFER_SIZE];
+	esp8266_trace_reader_t reader;
+	esp8266_trace_record_t record;
+	esp8266_trace_t replayed;
+	uint8_t* trace = buffer;
+	uint32_t len;
+
+	if(argc > 2){
+		fprintf(stderr, "usage: %s [trace]\n", argv[0]);
+		return 2;
+	}
+	if(argc == 2)
+		trace = replay_load(argv[1], &len);
+	else
+		len = replay_session(buffer, sizeof(buffer));
+	if(trace == NULL || len == 0){
+		fprintf(stderr, "no trace to replay\n");
+		return 2;
+	}
+
+	/* The requests, from the sent bytes, and the time of the last record */
+	uint32_t last = 0;
+	uint32_t sent_len = 0;
+	esp8266_trace_reader_init(&reader, trace, len);
+	while(esp8266_trace_next(&reader, &record)){
+		last = record.time;
+		if(record.direction == ESP8266_TRACE_TX)
+			sent_len += record.len;
+	}
+
+	char* sent = malloc(sent_len + 1);
+	uint32_t* times = malloc((sent_len + 1) * sizeof(*times));
+	replay_request_t* requests = malloc((sent_len + 1) * sizeof(*requests));
+	int32_t count = sent != NULL && times != NULL && requests != NULL
+					? replay_requests(trace, len, sent, times, requests) : -1;
+	if(count < 0)
+		return 2;
+
+	/* Played to a new driver, which traces what it gets */
+	uint8_t* replayed_buffer = malloc(len + len / 2 + REPLAY_BUFFER_SIZE);
+	if(replayed_buffer == NULL || !esp8266_sim_init(&sim, &esp))
+		return 2;
+	esp8266_trace_init(&replayed, replayed_buffer, len + len / 2 + REPLAY_BUFFER_SIZE);
+	esp8266_set_trace(&esp, &replayed);
+	esp8266_set_profile(&esp, &profile);
+	esp8266_rx_init(&esp.rx, esp.huart);
+	esp8266_rx_start(&esp.rx);
+	esp8266_tx_init(&esp.tx, esp.huart);
+	esp8266_sim_replay(&sim, trace, len);
+
+	/* Each request at its time in the trace, the driver starts it when the one before is done */
+	uint32_t start = HAL_GetTick();
+	int32_t next = 0;
+	int32_t done = 0;
+	while((done < count || esp8266_sim_replaying(&sim)) && HAL_GetTick() - start <= last + REPLAY_GRACE){
+		while(next < count && HAL_GetTick() - start >= requests[next].time && replay_submit(&requests[next]))
+			next++;
+		esp8266_poll(&esp);
+		while(done < next && requests[done].result != NULL)
+			done++;
+	}
+
+	/* Until the driver has taken in the last of it */
+	for(uint32_t quiet = HAL_GetTick(); HAL_GetTick() - quiet < 100;)
+		esp8266_poll(&esp);
+	esp8266_sim_stop(&sim);
+
+	printf("%8s %9s  %-24s %s\n", "trace", "took", "request", "result");
+	for(int32_t i = 0; i < count; i++){
+		replay_request_t* request = &requests[i];
+
+		printf("%8lu ms %6lu ms  %-24.*s %s\n", (unsigned long) request->time,
+			   (unsigned long) (request->finished - request->started),
+			   request->send ? 4 : (int) strcspn(request->data, "\r\n"), request->send ? "data" : request->data,
+			   request->result != NULL ? request->result : "not done");
+	}
+	esp8266_print_profile(&esp);
+	replay_parser(trace, len);
+
+	/* The driver has to have sent and got what the traced one did */
+	uint32_t totals[2];
+	uint32_t same[2] = {
+		replay_compare(trace, len, &replayed, ESP8266_TRACE_RX, &totals[ESP8266_TRACE_RX]),
+		replay_compare(trace, len, &replayed, ESP8266_TRACE_TX, &totals[ESP8266_TRACE_TX])
+	};
+	bool passed = done == count && sim.lost == 0 && replayed.dropped == 0;
+
+	for(uint8_t direction = ESP8266_TRACE_RX; direction <= ESP8266_TRACE_TX; direction++){
+		const char* name = direction == ESP8266_TRACE_RX ? "received" : "sent";
+
+		printf("%s: %lu of %lu bytes as in the trace, %lu replayed\n", name, (unsigned long) same[direction],
+			   (unsigned long) totals[direction], (unsigned long) replayed.bytes[direction]);
+		passed &= same[direction] == totals[direction] && replayed.bytes[direction] == totals[direction];
+	}
+	printf("%ld of %ld requests done in %lu ms, %lu ms in the trace, %lu bytes lost: %s\n", (long) done, (long) count,
+		   (unsigned long) (HAL_GetTick() - start), (unsigned long) last, (unsigned long) sim.lost,
+		   passed ? "PASS" : "FAIL");
+
+	if(trace != buffer)
+		free(trace);
+	free(replayed_buffer);
+	free(requests);
+	free(times);
+	free(sent);
+	return passed ? 0 : 1;
+}